@@ -10,7 +10,11 @@
 
 #include "bvh/bvh_bundle.h"
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <unordered_set>
 
 #include "rdf/rdf/inc/amdrdf.h"
@@ -21,6 +25,8 @@
 #include "public/rra_error.h"
 #include <public/rra_ray_history.h>
 
+#include "parallel_util.h"
+
 namespace rta
 {
     constexpr std::uint32_t kDeprecatedBvhChunkVersion = 1;  ///< 1.0 Fallback version for chunk files with old index reference mappings.
@@ -37,6 +43,18 @@ namespace rta
         , missing_blas_count_(missing_blas_count)
         , inactive_instance_count_(inactive_instance_count)
     {
+        // Resolve the concrete types once, so the per-query lookups don't need to cast.
+        encoded_top_level_bvhs_.reserve(top_level_bvhs_.size());
+        for (const auto& top_level_bvh : top_level_bvhs_)
+        {
+            encoded_top_level_bvhs_.push_back(dynamic_cast<EncodedRtIp11TopLevelBvh*>(top_level_bvh.get()));
+        }
+        encoded_bottom_level_bvhs_.reserve(bottom_level_bvhs_.size());
+        for (const auto& bottom_level_bvh : bottom_level_bvhs_)
+        {
+            encoded_bottom_level_bvhs_.push_back(dynamic_cast<EncodedRtIp11BottomLevelBvh*>(bottom_level_bvh.get()));
+        }
+
         empty_blas_count_  = 0;
         size_t start_index = (empty_placeholder) ? 1 : 0;
 
@@ -51,6 +69,98 @@ namespace rta
 
     BvhBundle::~BvhBundle()
     {
+        StopDeferredBlasDecode();
+    }
+
+    bool BvhBundle::PostLoad()
+    {
+        for (auto& top_level_bvh : top_level_bvhs_)
+        {
+            if (top_level_bvh->PostLoad() == false)
+            {
+                return false;
+            }
+        }
+        for (auto& bottom_level_bvh : bottom_level_bvhs_)
+        {
+            if (bottom_level_bvh->PostLoad() == false)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool BvhBundle::HasDeferredBlasNodeData() const
+    {
+        for (const auto* encoded_blas : encoded_bottom_level_bvhs_)
+        {
+            if (encoded_blas != nullptr && !encoded_blas->IsNodeDataLoaded())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void BvhBundle::StartDeferredBlasDecode(std::function<void()> on_complete)
+    {
+        RRA_ASSERT(!deferred_blas_decode_thread_.joinable());
+        if (deferred_blas_decode_thread_.joinable())
+        {
+            return;
+        }
+
+        auto done = std::make_shared<std::promise<bool>>();
+        deferred_blas_decode_done_ = done->get_future().share();
+
+        cancel_deferred_blas_decode_ = false;
+        deferred_blas_decode_thread_ = std::thread([this, on_complete, done]() {
+            for (const auto* encoded_blas : encoded_bottom_level_bvhs_)
+            {
+                if (cancel_deferred_blas_decode_)
+                {
+                    done->set_value(false);
+                    return;
+                }
+
+                // Anything already decoded on first access is skipped.
+                if (encoded_blas != nullptr)
+                {
+                    encoded_blas->LoadDeferredNodeData();
+                }
+            }
+
+            if (cancel_deferred_blas_decode_)
+            {
+                done->set_value(false);
+                return;
+            }
+
+            if (on_complete)
+            {
+                on_complete();
+            }
+            done->set_value(true);
+        });
+    }
+
+    bool BvhBundle::WaitForDeferredBlasDecode() const
+    {
+        if (deferred_blas_decode_done_.valid())
+        {
+            return deferred_blas_decode_done_.get();
+        }
+        return true;
+    }
+
+    void BvhBundle::StopDeferredBlasDecode()
+    {
+        cancel_deferred_blas_decode_ = true;
+        if (deferred_blas_decode_thread_.joinable())
+        {
+            deferred_blas_decode_thread_.join();
+        }
     }
 
     bool BvhBundle::HasEncoding(const RayTracingIpLevel encoding) const
@@ -98,6 +208,26 @@ namespace rta
         return bottom_level_bvhs_;
     }
 
+    const std::vector<EncodedRtIp11TopLevelBvh*>& BvhBundle::GetEncodedTopLevelBvhs() const
+    {
+        return encoded_top_level_bvhs_;
+    }
+
+    const std::vector<EncodedRtIp11BottomLevelBvh*>& BvhBundle::GetEncodedBottomLevelBvhs() const
+    {
+        return encoded_bottom_level_bvhs_;
+    }
+
+    EncodedRtIp11TopLevelBvh* BvhBundle::GetEncodedTopLevelBvh(uint64_t tlas_index) const
+    {
+        return tlas_index < encoded_top_level_bvhs_.size() ? encoded_top_level_bvhs_[tlas_index] : nullptr;
+    }
+
+    EncodedRtIp11BottomLevelBvh* BvhBundle::GetEncodedBottomLevelBvh(uint64_t blas_index) const
+    {
+        return blas_index < encoded_bottom_level_bvhs_.size() ? encoded_bottom_level_bvhs_[blas_index] : nullptr;
+    }
+
     size_t BvhBundle::GetBlasCount() const
     {
         auto size = bottom_level_bvhs_.size();
@@ -133,86 +263,189 @@ namespace rta
         return empty_placeholder_;
     }
 
-    /// @brief Load a "RawAccelStruct" chunk.
+    /// @brief The state of a single "RawAccelStruct" chunk while the bundle is being decoded.
+    struct RawAccelStructChunkSlot
+    {
+        std::int32_t                    chunk_index = 0;        ///< The index of the chunk in the chunk file.
+        std::int64_t                    data_size   = 0;        ///< The size of the chunk data.
+        RawAccelStructRdfChunkHeader    header      = {};       ///< The chunk header.
+        const RawAccelStructHeaderData* header_data = nullptr;  ///< A copy of the header data of a BLAS chunk, if one is known.
+        std::unique_ptr<IBvh>           bvh;                    ///< The decoded BVH, or nullptr if the chunk failed to load.
+    };
+
+    /// @brief Read the data of a "RawAccelStruct" chunk into a buffer.
     ///
     /// @param [in]  chunk_file        The chunk file to load from.
     /// @param [in]  chunk_index       The chunk index in the chunk file.
-    /// @param [in]  chunk_header      Reference to the chunk header data.
     /// @param [in]  chunk_identifier  The BVH chunk name.
-    /// @param [in]  import_option     Flag indicating which sections of the chunk to load/discard.
-    /// @param [out] bvh               The loaded BVH data.
-    ///
-    /// @return The BVH object loaded in if successful or nullptr if error.
-    static std::unique_ptr<IBvh> LoadRtIp11RawAccelStrucAtChunkFileIndex(rdf::ChunkFile&                      chunk_file,
-                                                                         const std::int32_t                   chunk_index,
-                                                                         const RawAccelStructRdfChunkHeader&  chunk_header,
-                                                                         const char* const                    chunk_identifier,
-                                                                         const BvhBundleReadOption            import_option,
-                                                                         std::unique_ptr<IEncodedRtIp11Bvh>&& bvh)
+    /// @param [in]  data_size         The size of the chunk data, from the trace chunk index.
+    /// @param [out] buffer            The buffer to receive the chunk data.
+    static void ReadRtIp11RawAccelStrucChunkData(rdf::ChunkFile&            chunk_file,
+                                                 const std::int32_t         chunk_index,
+                                                 const char* const          chunk_identifier,
+                                                 const std::int64_t         data_size,
+                                                 std::vector<std::uint8_t>& buffer)
     {
-        const std::uint32_t version       = chunk_file.GetChunkVersion(chunk_identifier, chunk_index);
-        std::uint32_t       major_version = version >> 16;
-        if (major_version <= GPURT_ACCEL_STRUCT_MAJOR_VERSION)
+        buffer.resize(data_size);
+        if (data_size > 0)
         {
-            if (bvh->LoadRawAccelStrucFromFile(chunk_file, chunk_index, chunk_header, chunk_identifier, import_option) == true)
-            {
-                return std::move(bvh);
-            }
+            chunk_file.ReadChunkDataToBuffer(chunk_identifier, static_cast<uint32_t>(chunk_index), buffer.data());
         }
-        return nullptr;
     }
 
-    /// Create an empty BVH structure
-    static std::unique_ptr<IBvh> CreateRtIp11RawAccelStrucAtIndex(std::unique_ptr<IEncodedRtIp11Bvh>&& bvh, uint64_t index)
+    /// @brief Decode the "RawAccelStruct" chunks described by the slots provided, using a pool of worker threads.
+    ///
+    /// The chunk file is not thread safe, so each worker opens the trace file again, and reads and decompresses the
+    /// chunk data through a chunk file of its own. The reading, decompression and decoding of the chunks are all done
+    /// concurrently. Without a file path the chunk file passed in is shared, and only the decoding is concurrent. Each
+    /// worker only writes to the slot it claimed, so the order of the BVHs is the same as the order of the chunks in the file.
+    ///
+    /// If kDeferBlasNodeData is set, only the BLAS headers are decoded. The TLASes are always decoded in full. A BLAS
+    /// whose slot holds a copy of its header data is restored from that copy, without reading the chunk at all.
+    ///
+    /// @param [in]     chunk_file        The chunk file to load from.
+    /// @param [in]     file_path         The path of the trace file, or nullptr to share the chunk file between the workers.
+    /// @param [in]     chunk_identifier  The BVH chunk name.
+    /// @param [in]     import_option     Flag indicating which sections of the chunk to load/discard.
+    /// @param [in,out] slots             The chunks to decode. The decoded BVHs are written back to the slots.
+    ///
+    /// @return kRraOk if every chunk was decoded, or the error of the first chunk that failed. The workers stop at the first failure.
+    static RraErrorCode DecodeRtIp11RawAccelStrucChunks(rdf::ChunkFile&                       chunk_file,
+                                                        const char*                           file_path,
+                                                        const char* const                     chunk_identifier,
+                                                        const BvhBundleReadOption             import_option,
+                                                        std::vector<RawAccelStructChunkSlot>& slots)
     {
-        bvh->SetID(index);
-        assert(!bvh->HasBvhReferences());
-        return std::move(bvh);
-    }
+        const bool defer_blas_node_data =
+            static_cast<std::uint8_t>(import_option) & static_cast<std::uint8_t>(BvhBundleReadOption::kDeferBlasNodeData);
 
-    static bool IdentifiersContainedInChunkFile(const std::vector<const char*> identifiers, const rdf::ChunkFile& chunk_file)
-    {
-        for (const char* identifier : identifiers)
-        {
-            try
+        std::mutex                chunk_file_mutex;
+        std::atomic<std::size_t>  next_slot{0};
+        std::atomic<RraErrorCode> error_code{kRraOk};
+
+        auto set_error = [&error_code](RraErrorCode error) {
+            RraErrorCode expected = kRraOk;
+            error_code.compare_exchange_strong(expected, error);
+        };
+
+        auto worker = [&](std::size_t) {
+            std::unique_ptr<rdf::Stream>    stream;
+            std::unique_ptr<rdf::ChunkFile> worker_chunk_file;
+            std::vector<std::uint8_t>       buffer;
+
+            for (std::size_t slot_index = next_slot++; slot_index < slots.size() && error_code == kRraOk; slot_index = next_slot++)
             {
-                bool result = chunk_file.ContainsChunk(identifier);
-                if (result == false)
+                RawAccelStructChunkSlot& slot = slots[slot_index];
+
+                try
                 {
-                    return result;
+                    if (defer_blas_node_data && slot.header.flags.blas == 1 && slot.header_data != nullptr)
+                    {
+                        auto blas = std::make_unique<EncodedRtIp11BottomLevelBvh>();
+                        if (blas->LoadRawAccelStrucHeaderFromHeaderData(*slot.header_data, slot.header, import_option))
+                        {
+                            slot.bvh = std::move(blas);
+                        }
+                        else
+                        {
+                            set_error(kRraErrorMalformedData);
+                        }
+                        continue;
+                    }
+
+                    if (file_path != nullptr)
+                    {
+                        if (worker_chunk_file == nullptr)
+                        {
+                            stream            = std::make_unique<rdf::Stream>(rdf::Stream::OpenFile(file_path));
+                            worker_chunk_file = std::make_unique<rdf::ChunkFile>(*stream);
+                        }
+                        ReadRtIp11RawAccelStrucChunkData(*worker_chunk_file, slot.chunk_index, chunk_identifier, slot.data_size, buffer);
+                    }
+                    else
+                    {
+                        std::lock_guard<std::mutex> lock(chunk_file_mutex);
+                        ReadRtIp11RawAccelStrucChunkData(chunk_file, slot.chunk_index, chunk_identifier, slot.data_size, buffer);
+                    }
+
+                    std::unique_ptr<IEncodedRtIp11Bvh> bvh;
+                    if (slot.header.flags.blas == 1)
+                    {
+                        bvh = std::make_unique<EncodedRtIp11BottomLevelBvh>();
+                    }
+                    else
+                    {
+                        bvh = std::make_unique<EncodedRtIp11TopLevelBvh>();
+                    }
+
+                    bool loaded = false;
+                    if (defer_blas_node_data && slot.header.flags.blas == 1)
+                    {
+                        loaded = bvh->LoadRawAccelStrucHeaderFromBuffer(buffer, slot.header, import_option);
+                    }
+                    else
+                    {
+                        loaded = bvh->LoadRawAccelStrucFromBuffer(buffer, slot.header, import_option);
+                    }
+
+                    if (loaded == true)
+                    {
+                        slot.bvh = std::move(bvh);
+                    }
+                    else
+                    {
+                        set_error(kRraErrorMalformedData);
+                    }
+                }
+                catch (const std::bad_alloc&)
+                {
+                    set_error(kRraErrorOutOfMemory);
+                }
+                catch (...)
+                {
+                    // The chunk file throws if a chunk can't be read or decompressed.
+                    set_error(kRraErrorMalformedData);
                 }
             }
-            catch (...)
-            {
-                return false;
-            }
-        }
 
-        return true;
+            // The chunk file references the stream, so close it first.
+            worker_chunk_file.reset();
+            stream.reset();
+        };
+
+        rra::RunInParallel(rra::GetParallelTaskCount(slots.size(), 1), worker);
+
+        return error_code;
+    }
+
+    /// Create an empty BVH structure
+    static std::unique_ptr<IBvh> CreateRtIp11RawAccelStrucAtIndex(std::unique_ptr<IEncodedRtIp11Bvh>&& bvh, uint64_t index)
+    {
+        bvh->SetID(index);
+        assert(!bvh->HasBvhReferences());
+        return std::move(bvh);
     }
 
     /// @brief Load in all the "RawAccelStruc" chunks from the file provided.
     ///
-    /// @param [in] chunk_file     The chunk file to load from.
-    /// @param [in] import_option  Flag indicating which sections of the chunk to load/discard.
-    /// @param [out] io_error_code Variable to receive an error code if the load failed.
+    /// @param [in] chunk_file         The chunk file to load from.
+    /// @param [in] file_path          The path of the trace file, used to read deferred BLAS node data.
+    /// @param [in] trace_chunk_index  The chunk index of the trace being loaded.
+    /// @param [in] blas_header_data   Copies of the header data of the BLAS chunks, in chunk order, or nullptr.
+    /// @param [in] import_option      Flag indicating which sections of the chunk to load/discard.
+    /// @param [out] io_error_code     Variable to receive an error code if the load failed.
     ///
     /// @return The BVH object loaded in if successful or nullptr if error.
-    static std::unique_ptr<BvhBundle> LoadRtIp11RawAccelStructBundleFromFile(rdf::ChunkFile&           chunk_file,
-                                                                             const BvhBundleReadOption import_option,
-                                                                             RraErrorCode*             io_error_code)
+    static std::unique_ptr<BvhBundle> LoadRtIp11RawAccelStructBundleFromFile(rdf::ChunkFile&                              chunk_file,
+                                                                             const char*                                  file_path,
+                                                                             const rra::TraceChunkIndex&                  trace_chunk_index,
+                                                                             const std::vector<RawAccelStructHeaderData>* blas_header_data,
+                                                                             const BvhBundleReadOption                    import_option,
+                                                                             RraErrorCode*                                io_error_code)
     {
         // Check if all expected identifiers are contained in the chunk file
-        const char* bvh_identifier = nullptr;
-        if (IdentifiersContainedInChunkFile({IBvh::kAccelChunkIdentifier1}, chunk_file))
-        {
-            bvh_identifier = IBvh::kAccelChunkIdentifier1;
-        }
-        else if (IdentifiersContainedInChunkFile({IBvh::kAccelChunkIdentifier2}, chunk_file))
-        {
-            bvh_identifier = IBvh::kAccelChunkIdentifier2;
-        }
-        else
+        const char* bvh_identifier = trace_chunk_index.GetAccelStructIdentifier();
+        if (bvh_identifier == nullptr)
         {
             *io_error_code = kRraErrorNoASChunks;
             return nullptr;
@@ -221,7 +454,7 @@ namespace rta
         std::vector<std::unique_ptr<IBvh>> top_level_bvhs;
         std::vector<std::unique_ptr<IBvh>> bottom_level_bvhs;
 
-        const auto bvh_chunk_count = chunk_file.GetChunkCount(bvh_identifier);
+        const auto& bvh_chunks = trace_chunk_index.GetChunks(bvh_identifier);
 
         std::unordered_map<GpuVirtualAddress, std::uint64_t> tlas_map;
         std::unordered_map<GpuVirtualAddress, std::uint64_t> blas_map;
@@ -235,53 +468,100 @@ namespace rta
             blas_map.insert(std::make_pair(address, index));
         }
 
-        for (auto ci = 0; ci < bvh_chunk_count; ++ci)
+        // The chunk headers come from the trace chunk index. They are small and decide which list each chunk ends up in.
+        std::vector<RawAccelStructChunkSlot> slots;
+        slots.reserve(bvh_chunks.size());
+        for (std::size_t ci = 0; ci < bvh_chunks.size(); ++ci)
         {
-            uint64_t header_size = chunk_file.GetChunkHeaderSize(bvh_identifier, ci);
-
-            RRA_ASSERT(header_size > 0);
+            const rra::TraceChunkInfo& chunk_info = bvh_chunks[ci];
 
-            if (header_size > 0)
+            // Chunks without a complete header are skipped.
+            if (chunk_info.header.size() >= sizeof(RawAccelStructRdfChunkHeader))
             {
-                RawAccelStructRdfChunkHeader header;
-                chunk_file.ReadChunkHeaderToBuffer(bvh_identifier, ci, &header);
-
-                // Call the load function here, passing in a reference to the header as a parameter.
-                if (header.flags.blas == 1)
+                std::uint32_t major_version = chunk_info.version >> 16;
+                if (major_version > GPURT_ACCEL_STRUCT_MAJOR_VERSION)
                 {
-                    bottom_level_bvhs.emplace_back(LoadRtIp11RawAccelStrucAtChunkFileIndex(
-                        chunk_file, ci, header, bvh_identifier, import_option, std::make_unique<EncodedRtIp11BottomLevelBvh>()));
-                    if (bottom_level_bvhs.back() == nullptr)
-                    {
-                        *io_error_code = kRraErrorMalformedData;
-                        return nullptr;
-                    }
-
-                    // Add a mapping of GPU address to index.
-                    auto        index   = bottom_level_bvhs.size() - 1;
-                    const auto& as      = bottom_level_bvhs[index];
-                    auto        address = as->GetVirtualAddress();
-                    blas_map.insert(std::make_pair(address, index));
+                    *io_error_code = kRraErrorMalformedData;
+                    return nullptr;
                 }
-                else
+
+                RawAccelStructChunkSlot slot;
+                slot.chunk_index = static_cast<std::int32_t>(ci);
+                slot.data_size   = chunk_info.data_size;
+                memcpy(&slot.header, chunk_info.header.data(), sizeof(slot.header));
+                slots.push_back(std::move(slot));
+            }
+        }
+
+        // The header data copies are only used if there is one for every BLAS chunk, so they can't be matched to the wrong chunk.
+        size_t blas_chunk_count = 0;
+        for (const auto& slot : slots)
+        {
+            blas_chunk_count += (slot.header.flags.blas == 1) ? 1 : 0;
+        }
+        if (blas_header_data != nullptr && blas_header_data->size() == blas_chunk_count)
+        {
+            size_t blas_index = 0;
+            for (auto& slot : slots)
+            {
+                if (slot.header.flags.blas == 1)
                 {
-                    top_level_bvhs.emplace_back(LoadRtIp11RawAccelStrucAtChunkFileIndex(
-                        chunk_file, ci, header, bvh_identifier, import_option, std::make_unique<EncodedRtIp11TopLevelBvh>()));
-                    if (top_level_bvhs.back() == nullptr)
-                    {
-                        *io_error_code = kRraErrorMalformedData;
-                        return nullptr;
-                    }
+                    slot.header_data = &(*blas_header_data)[blas_index++];
+                }
+            }
+        }
+
+        const RraErrorCode decode_error = DecodeRtIp11RawAccelStrucChunks(chunk_file, file_path, bvh_identifier, import_option, slots);
+        if (decode_error != kRraOk)
+        {
+            *io_error_code = decode_error;
+            return nullptr;
+        }
+
+        const bool defer_blas_node_data =
+            (file_path != nullptr) && (static_cast<std::uint8_t>(import_option) & static_cast<std::uint8_t>(BvhBundleReadOption::kDeferBlasNodeData));
+
+        // The chunk file passed in is closed once the trace is loaded, so deferred BLASes share a reader of their own.
+        std::shared_ptr<DeferredChunkReader> deferred_reader;
+        if (defer_blas_node_data)
+        {
+            deferred_reader = std::make_shared<DeferredChunkReader>(file_path);
+        }
+
+        // Gather the decoded BVHs in chunk order so the TLAS and BLAS indices are deterministic.
+        for (auto& slot : slots)
+        {
+            if (slot.bvh == nullptr)
+            {
+                *io_error_code = kRraErrorMalformedData;
+                return nullptr;
+            }
 
-                    // Add a mapping of GPU address to index.
-                    auto        index   = top_level_bvhs.size() - 1;
-                    const auto& as      = top_level_bvhs[index];
-                    auto        address = as->GetVirtualAddress();
-                    tlas_map.insert(std::make_pair(address, index));
+            if (slot.header.flags.blas == 1)
+            {
+                if (defer_blas_node_data)
+                {
+                    auto* encoded_bvh = static_cast<IEncodedRtIp11Bvh*>(slot.bvh.get());
+                    encoded_bvh->SetDeferredNodeData(deferred_reader, bvh_identifier, slot.chunk_index, slot.header, import_option);
                 }
+                bottom_level_bvhs.emplace_back(std::move(slot.bvh));
+            }
+            else
+            {
+                top_level_bvhs.emplace_back(std::move(slot.bvh));
             }
         }
 
+        // Add a mapping of GPU address to index.
+        for (std::size_t index = 1; index < bottom_level_bvhs.size(); ++index)
+        {
+            blas_map.insert(std::make_pair(bottom_level_bvhs[index]->GetVirtualAddress(), index));
+        }
+        for (std::size_t index = 0; index < top_level_bvhs.size(); ++index)
+        {
+            tlas_map.insert(std::make_pair(top_level_bvhs[index]->GetVirtualAddress(), index));
+        }
+
         // Replace absolute addresses in the TLAS with indices. Additionally, the instance nodes
         // in the TLAS refer to BLAS instances, and these addresses also need converting to indices.
         std::unordered_set<GpuVirtualAddress> missing_tlas_set;
@@ -289,13 +569,16 @@ namespace rta
 
         uint64_t inactive_instance_count = 0;
 
+        const bool post_load =
+            (static_cast<std::uint8_t>(import_option) & static_cast<std::uint8_t>(BvhBundleReadOption::kDeferPostLoad)) == 0;
+
         for (std::size_t t = 0; t < top_level_bvhs.size(); ++t)
         {
             auto& top_level_bvh = top_level_bvhs[t];
             top_level_bvh->SetRelativeReferences(tlas_map, true, missing_tlas_set);
             top_level_bvh->SetRelativeReferences(blas_map, false, missing_blas_set);
             inactive_instance_count += top_level_bvh->GetInactiveInstanceCount();
-            if (top_level_bvh->PostLoad() == false)
+            if (post_load && top_level_bvh->PostLoad() == false)
             {
                 *io_error_code = kRraErrorMalformedData;
                 return nullptr;
@@ -307,7 +590,7 @@ namespace rta
         {
             auto& bottom_level_bvh = bottom_level_bvhs[t];
             bottom_level_bvh->SetRelativeReferences(blas_map, true, missing_tlas_set);
-            if (bottom_level_bvh->PostLoad() == false)
+            if (post_load && bottom_level_bvh->PostLoad() == false)
             {
                 *io_error_code = kRraErrorMalformedData;
                 return nullptr;
@@ -318,51 +601,55 @@ namespace rta
         return std::make_unique<BvhBundle>(std::move(top_level_bvhs), std::move(bottom_level_bvhs), true, missing_blas_set.size(), inactive_instance_count);
     }
 
-    RayTracingIpLevel GetRtIpLevel(rdf::ChunkFile& chunk_file, RraErrorCode* io_error_code)
+    RayTracingIpLevel GetRtIpLevel(rdf::ChunkFile& chunk_file, const rra::TraceChunkIndex& trace_chunk_index, RraErrorCode* io_error_code)
     {
         // Check if all expected identifiers are contained in the chunk file
-        const char* bvh_identifier = nullptr;
-        if (IdentifiersContainedInChunkFile({IBvh::kAccelChunkIdentifier1}, chunk_file))
-        {
-            bvh_identifier = IBvh::kAccelChunkIdentifier1;
-        }
-        else if (IdentifiersContainedInChunkFile({IBvh::kAccelChunkIdentifier2}, chunk_file))
-        {
-            bvh_identifier = IBvh::kAccelChunkIdentifier2;
-        }
-        else
+        const char* bvh_identifier = trace_chunk_index.GetAccelStructIdentifier();
+        if (bvh_identifier == nullptr)
         {
             *io_error_code = kRraErrorNoASChunks;
             return RayTracingIpLevel::_None;
         }
 
-        const auto bvh_chunk_count = chunk_file.GetChunkCount(bvh_identifier);
+        // The RT IP level is only stored in the AccelStructHeader, so some chunk data has to be read. Every
+        // TLAS carries the same value, so pick the smallest TLAS to keep the amount of data decompressed down.
+        const auto& bvh_chunks = trace_chunk_index.GetChunks(bvh_identifier);
 
-        for (auto ci = 0; ci < bvh_chunk_count; ++ci)
+        std::int64_t                 tlas_chunk  = -1;
+        RawAccelStructRdfChunkHeader tlas_header = {};
+        for (std::size_t ci = 0; ci < bvh_chunks.size(); ++ci)
         {
-            uint64_t header_size = chunk_file.GetChunkHeaderSize(bvh_identifier, ci);
-
-            RRA_ASSERT(header_size > 0);
+            const rra::TraceChunkInfo& chunk_info = bvh_chunks[ci];
 
-            if (header_size > 0)
+            // Chunks without a complete header are skipped.
+            if (chunk_info.header.size() >= sizeof(RawAccelStructRdfChunkHeader))
             {
                 RawAccelStructRdfChunkHeader header;
-                chunk_file.ReadChunkHeaderToBuffer(bvh_identifier, ci, &header);
+                memcpy(&header, chunk_info.header.data(), sizeof(header));
 
-                if (header.flags.blas != 1)
+                if (header.flags.blas != 1 && (tlas_chunk < 0 || chunk_info.data_size < bvh_chunks[tlas_chunk].data_size))
                 {
-                    const auto data_size = chunk_file.GetChunkDataSize(bvh_identifier, static_cast<uint32_t>(ci));
+                    tlas_chunk  = static_cast<std::int64_t>(ci);
+                    tlas_header = header;
+                }
+            }
+        }
 
-                    std::vector<std::uint8_t> buffer(data_size);
-                    if (data_size > 0)
-                    {
-                        chunk_file.ReadChunkDataToBuffer(bvh_identifier, static_cast<uint32_t>(ci), buffer.data());
-                    }
+        if (tlas_chunk >= 0)
+        {
+            const auto   data_size    = bvh_chunks[tlas_chunk].data_size;
+            const size_t rt_ip_offset = tlas_header.header_offset + offsetof(AccelStructHeader, rtIpLevel);
 
-                    *io_error_code      = kRraOk;
-                    size_t rt_ip_offset = offsetof(AccelStructHeader, rtIpLevel);
-                    return *reinterpret_cast<RayTracingIpLevel*>((char*)buffer.data() + header.header_offset + rt_ip_offset);
-                }
+            std::vector<std::uint8_t> buffer(data_size);
+            if (data_size > 0)
+            {
+                chunk_file.ReadChunkDataToBuffer(bvh_identifier, static_cast<uint32_t>(tlas_chunk), buffer.data());
+            }
+
+            if (buffer.size() >= rt_ip_offset + sizeof(RayTracingIpLevel))
+            {
+                *io_error_code = kRraOk;
+                return *reinterpret_cast<RayTracingIpLevel*>(buffer.data() + rt_ip_offset);
             }
         }
 
@@ -370,43 +657,30 @@ namespace rta
         return RayTracingIpLevel::_None;
     }
 
-    RraErrorCode GetMaxMajorVersions(rdf::ChunkFile& chunk_file, int* max_as_major_version, int* max_dispatch_major_version)
+    RraErrorCode GetMaxMajorVersions(const rra::TraceChunkIndex& trace_chunk_index, int* max_as_major_version, int* max_dispatch_major_version)
     {
         // Check if all expected identifiers are contained in the chunk file
-        const char* bvh_identifier = nullptr;
-        if (IdentifiersContainedInChunkFile({IBvh::kAccelChunkIdentifier1}, chunk_file))
-        {
-            bvh_identifier = IBvh::kAccelChunkIdentifier1;
-        }
-        else if (IdentifiersContainedInChunkFile({IBvh::kAccelChunkIdentifier2}, chunk_file))
-        {
-            bvh_identifier = IBvh::kAccelChunkIdentifier2;
-        }
-        else
+        const char* bvh_identifier = trace_chunk_index.GetAccelStructIdentifier();
+        if (bvh_identifier == nullptr)
         {
             return kRraErrorNoASChunks;
         }
 
         auto dispatch_identifier = RRA_RAY_HISTORY_RAW_TOKENS_IDENTIFIER;
 
-        const auto bvh_chunk_count      = chunk_file.GetChunkCount(bvh_identifier);
-        const auto dispatch_chunk_count = chunk_file.GetChunkCount(dispatch_identifier);
-
         std::uint32_t max_as_mv   = 0;  // Acceleration structures.
         std::uint32_t max_disp_mv = 0;  // Dispatches
 
-        for (auto ci = 0; ci < bvh_chunk_count; ++ci)
+        for (const auto& chunk_info : trace_chunk_index.GetChunks(bvh_identifier))
         {
-            const std::uint32_t version       = chunk_file.GetChunkVersion(bvh_identifier, ci);
-            std::uint32_t       major_version = version >> 16;
-            max_as_mv                         = std::max(max_as_mv, major_version);
+            std::uint32_t major_version = chunk_info.version >> 16;
+            max_as_mv                   = std::max(max_as_mv, major_version);
         }
 
-        for (auto ci = 0; ci < dispatch_chunk_count; ++ci)
+        for (const auto& chunk_info : trace_chunk_index.GetChunks(dispatch_identifier))
         {
-            const std::uint32_t version = chunk_file.GetChunkVersion(dispatch_identifier, ci);
-            std::uint32_t       major_version = version >> 16;
-            max_disp_mv                       = std::max(max_disp_mv, major_version);
+            std::uint32_t major_version = chunk_info.version >> 16;
+            max_disp_mv                 = std::max(max_disp_mv, major_version);
         }
 
         *max_as_major_version = max_as_mv;
@@ -415,14 +689,17 @@ namespace rta
         return kRraOk;
     }
 
-    std::unique_ptr<BvhBundle> LoadBvhBundleFromFile(rdf::ChunkFile&           chunk_file,
-                                                     const RayTracingIpLevel   encoding,
-                                                     const BvhBundleReadOption import_option,
-                                                     RraErrorCode*             io_error_code)
+    std::unique_ptr<BvhBundle> LoadBvhBundleFromFile(rdf::ChunkFile&                              chunk_file,
+                                                     const char*                                  file_path,
+                                                     const rra::TraceChunkIndex&                  trace_chunk_index,
+                                                     const std::vector<RawAccelStructHeaderData>* blas_header_data,
+                                                     const RayTracingIpLevel                      encoding,
+                                                     const BvhBundleReadOption                    import_option,
+                                                     RraErrorCode*                                io_error_code)
     {
         RRA_UNUSED(encoding);
         {
-            return LoadRtIp11RawAccelStructBundleFromFile(chunk_file, import_option, io_error_code);
+            return LoadRtIp11RawAccelStructBundleFromFile(chunk_file, file_path, trace_chunk_index, blas_header_data, import_option, io_error_code);
         }
     }
 
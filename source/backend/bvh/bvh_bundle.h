@@ -11,16 +11,25 @@
 #ifndef RRA_BACKEND_BVH_BVH_BUNDLE_H_
 #define RRA_BACKEND_BVH_BVH_BUNDLE_H_
 
-#include <vector>
+#include <atomic>
+#include <functional>
+#include <future>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include "public/rra_error.h"
 
 #include "bvh/bvh_index_reference_map.h"
 #include "ibvh.h"
+#include "trace_chunk_index.h"
 
 namespace rta
 {
+    class EncodedRtIp11BottomLevelBvh;
+    class EncodedRtIp11TopLevelBvh;
+    struct RawAccelStructHeaderData;
+
     // Types of bvh dump formats
     enum class DxcBvhFormat : std::uint32_t
     {
@@ -71,6 +80,34 @@ namespace rta
         /// @return The bottom level BVH structures.
         const std::vector<std::unique_ptr<IBvh>>& GetBottomLevelBvhs() const;
 
+        /// @brief Get the top level BVH structures as RT IP 1.1 TLASes.
+        ///
+        /// Resolved once when the bundle is created, so no casts are needed per query.
+        ///
+        /// @return The TLASes, in the same order as GetTopLevelBvhs(). An entry is nullptr if its BVH isn't an RT IP 1.1 TLAS.
+        const std::vector<EncodedRtIp11TopLevelBvh*>& GetEncodedTopLevelBvhs() const;
+
+        /// @brief Get the bottom level BVH structures as RT IP 1.1 BLASes.
+        ///
+        /// Resolved once when the bundle is created, so no casts are needed per query.
+        ///
+        /// @return The BLASes, in the same order as GetBottomLevelBvhs(). An entry is nullptr if its BVH isn't an RT IP 1.1 BLAS.
+        const std::vector<EncodedRtIp11BottomLevelBvh*>& GetEncodedBottomLevelBvhs() const;
+
+        /// @brief Get a TLAS by index.
+        ///
+        /// @param [in] tlas_index The index of the TLAS.
+        ///
+        /// @return The TLAS, or nullptr if the index is out of range.
+        EncodedRtIp11TopLevelBvh* GetEncodedTopLevelBvh(uint64_t tlas_index) const;
+
+        /// @brief Get a BLAS by index.
+        ///
+        /// @param [in] blas_index The index of the BLAS.
+        ///
+        /// @return The BLAS, or nullptr if the index is out of range.
+        EncodedRtIp11BottomLevelBvh* GetEncodedBottomLevelBvh(uint64_t blas_index) const;
+
         /// @brief Get the number of BLASes in the trace.
         ///
         /// This includes empty BLASes but not missing ones.
@@ -108,45 +145,95 @@ namespace rta
         /// @return true if a placeholder has been added, false otherwise.
         bool ContainsEmptyPlaceholder() const;
 
+        /// @brief Run the post-load step on every BVH in the bundle.
+        ///
+        /// Only needed if the bundle was loaded with BvhBundleReadOption::kDeferPostLoad.
+        ///
+        /// @return true if successful, false if any BVH failed its post-load step.
+        bool PostLoad();
+
+        /// @brief Are there any BLASes whose node data has not been decoded yet.
+        ///
+        /// This is only the case if the bundle was loaded with BvhBundleReadOption::kDeferBlasNodeData.
+        ///
+        /// @return true if some BLAS node data is still to be decoded, false otherwise.
+        bool HasDeferredBlasNodeData() const;
+
+        /// @brief Decode the deferred BLAS node data on a background thread.
+        ///
+        /// BLASes that are accessed before the background thread gets to them are decoded on the
+        /// accessing thread instead. The thread is cancelled and joined when the bundle is destroyed.
+        ///
+        /// @param [in] on_complete Function called on the background thread once every BLAS has been decoded.
+        void StartDeferredBlasDecode(std::function<void()> on_complete);
+
+        /// @brief Wait for the background thread started by StartDeferredBlasDecode() to finish.
+        ///
+        /// Returns straight away if the thread was never started.
+        ///
+        /// @return true if the thread decoded every BLAS, false if it was stopped first.
+        bool WaitForDeferredBlasDecode() const;
+
+        /// @brief Stop the background thread started by StartDeferredBlasDecode(), and join it.
+        ///
+        /// The BLAS being decoded when this is called is finished first. The BLASes the thread didn't get to are
+        /// still decoded on first access. Does nothing if the thread was never started.
+        void StopDeferredBlasDecode();
+
     protected:
         std::vector<std::unique_ptr<IBvh>> top_level_bvhs_;     ///< The list of top level BVH's.
         std::vector<std::unique_ptr<IBvh>> bottom_level_bvhs_;  ///< The list of bottom level BVH's.
 
+        std::vector<EncodedRtIp11TopLevelBvh*>    encoded_top_level_bvhs_;     ///< The top level BVH's, as RT IP 1.1 TLASes.
+        std::vector<EncodedRtIp11BottomLevelBvh*> encoded_bottom_level_bvhs_;  ///< The bottom level BVH's, as RT IP 1.1 BLASes.
+
         bool     empty_placeholder_       = false;  ///< Has an empty BLAS been placed at index 0 in the bottom_level_bvhs_ array.
         uint64_t missing_blas_count_      = 0;      ///< The number of missing BLASes in the trace.
         uint64_t empty_blas_count_        = 0;      ///< The number of empty BLASes in the trace.
         uint64_t inactive_instance_count_ = 0;      ///< The number of inactive instances in the trace.
+
+        std::thread              deferred_blas_decode_thread_;         ///< The thread decoding deferred BLAS node data.
+        std::atomic<bool>        cancel_deferred_blas_decode_{false};  ///< Set to stop the deferred BLAS decode thread.
+        std::shared_future<bool> deferred_blas_decode_done_;           ///< Set once the deferred BLAS decode thread has finished, to whether it decoded every BLAS.
     };
 
     /// @brief Load function.
     ///
-    /// @param [in]     chunk_file     A Reference to a ChunkFile object which describes the file chunk being loaded.
-    /// @param [in]     encoding       The encoding scheme of the file.
-    /// @param [in]     import_option  A flag indicating which sections of the chunk to load/discard.
-    /// @param [in,out] io_error_code  An error code indicating whether the file loaded successfully.
+    /// @param [in]     chunk_file         A Reference to a ChunkFile object which describes the file chunk being loaded.
+    /// @param [in]     file_path          The path of the trace file. Only used with BvhBundleReadOption::kDeferBlasNodeData.
+    /// @param [in]     trace_chunk_index  The chunk index built when the trace was opened.
+    /// @param [in]     blas_header_data   Copies of the header data of the BLAS chunks, in chunk order, or nullptr. Only used with
+    ///                                    BvhBundleReadOption::kDeferBlasNodeData, to load the BLAS headers without reading the chunks.
+    /// @param [in]     encoding           The encoding scheme of the file.
+    /// @param [in]     import_option      A flag indicating which sections of the chunk to load/discard.
+    /// @param [in,out] io_error_code      An error code indicating whether the file loaded successfully.
     ///
     /// @return A pointer to the bundle information of the loaded file, or nullptr if the load failed.
-    std::unique_ptr<BvhBundle> LoadBvhBundleFromFile(rdf::ChunkFile&           chunk_file,
-                                                     const RayTracingIpLevel   encoding,
-                                                     const BvhBundleReadOption import_option,
-                                                     RraErrorCode*             io_error_code);
+    std::unique_ptr<BvhBundle> LoadBvhBundleFromFile(rdf::ChunkFile&                              chunk_file,
+                                                     const char*                                  file_path,
+                                                     const rra::TraceChunkIndex&                  trace_chunk_index,
+                                                     const std::vector<RawAccelStructHeaderData>* blas_header_data,
+                                                     const RayTracingIpLevel                      encoding,
+                                                     const BvhBundleReadOption                    import_option,
+                                                     RraErrorCode*                                io_error_code);
 
     /// @brief Get ray tracing IP level of chunk file.
     ///
-    /// @param [in]     chunk_file     A Reference to a ChunkFile object which describes the file chunk being loaded.
-    /// @param [in,out] io_error_code  An error code indicating whether the file loaded successfully.
+    /// @param [in]     chunk_file         A Reference to a ChunkFile object which describes the file chunk being loaded.
+    /// @param [in]     trace_chunk_index  The chunk index built when the trace was opened.
+    /// @param [in,out] io_error_code      An error code indicating whether the file loaded successfully.
     ///
     /// @return The ray tracing IP level.
-    RayTracingIpLevel GetRtIpLevel(rdf::ChunkFile& chunk_file, RraErrorCode* io_error_code);
+    RayTracingIpLevel GetRtIpLevel(rdf::ChunkFile& chunk_file, const rra::TraceChunkIndex& trace_chunk_index, RraErrorCode* io_error_code);
 
-    /// @brief Get maximum major versions from the chunk file.
+    /// @brief Get maximum major versions from the chunk index.
     ///
-    /// @param [in]     chunk_file     A Reference to a ChunkFile object which describes the file chunk being loaded.
-    /// @param [in,out] max_as_major_version The maximum major version of acceleration structures in the file.
+    /// @param [in]     trace_chunk_index          The chunk index built when the trace was opened.
+    /// @param [in,out] max_as_major_version       The maximum major version of acceleration structures in the file.
     /// @param [in,out] max_dispatch_major_version The maximum major version of dispatches in the file.
     ///
     /// @return An error code indicating whether the file loaded successfully.
-    RraErrorCode GetMaxMajorVersions(rdf::ChunkFile& chunk_file, int* max_as_major_version, int* max_dispatch_major_version);
+    RraErrorCode GetMaxMajorVersions(const rra::TraceChunkIndex& trace_chunk_index, int* max_as_major_version, int* max_dispatch_major_version);
 
 }  // namespace rta
 
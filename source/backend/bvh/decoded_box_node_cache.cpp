@@ -0,0 +1,126 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Decoded box node cache implementation.
+//=============================================================================
+
+#include "bvh/decoded_box_node_cache.h"
+
+#include <array>
+
+#include "bvh/node_types/float16_box_node.h"
+#include "bvh/node_types/float32_box_node.h"
+#include "public/rra_assert.h"
+
+namespace rta
+{
+    DecodedBoxNodeCache::DecodedBoxNodeCache(const std::vector<std::uint8_t>& interior_nodes, std::uint64_t interior_nodes_offset)
+        : interior_nodes_offset_(interior_nodes_offset)
+    {
+        // Box nodes start on a 64-byte boundary, so each 64-byte slot of the interior node data can hold at most one.
+        const size_t slot_count = interior_nodes.size() / dxr::amd::kFp16BoxNodeSize;
+        decoded_.resize(slot_count, 0);
+        children_.resize(slot_count * 4);
+        min_x_.resize(slot_count * 4);
+        min_y_.resize(slot_count * 4);
+        min_z_.resize(slot_count * 4);
+        max_x_.resize(slot_count * 4);
+        max_y_.resize(slot_count * 4);
+        max_z_.resize(slot_count * 4);
+
+        // The buffer only says which type a box node is in the pointers to it, so walk the tree from the root.
+        std::vector<dxr::amd::NodePointer> traverse_nodes = {
+            dxr::amd::NodePointer(dxr::amd::NodeType::kAmdNodeBoxFp32, dxr::amd::kAccelerationStructureHeaderSize)};
+
+        while (!traverse_nodes.empty())
+        {
+            const dxr::amd::NodePointer node_ptr = traverse_nodes.back();
+            traverse_nodes.pop_back();
+
+            const size_t node_size = node_ptr.IsFp32BoxNode() ? dxr::amd::kFp32BoxNodeSize : dxr::amd::kFp16BoxNodeSize;
+            if (node_ptr.GetByteOffset() < interior_nodes_offset_ || node_ptr.GetByteOffset() - interior_nodes_offset_ + node_size > interior_nodes.size())
+            {
+                continue;
+            }
+
+            const size_t node_offset = node_ptr.GetByteOffset() - interior_nodes_offset_;
+            if (decoded_[node_offset / dxr::amd::kFp16BoxNodeSize] != 0)
+            {
+                continue;
+            }
+
+            Decode(interior_nodes, node_ptr, node_offset);
+
+            const dxr::amd::NodePointer* children = GetChildren(node_ptr);
+            for (std::uint32_t child_index = 0; child_index < 4; child_index++)
+            {
+                if (children[child_index].IsBoxNode())
+                {
+                    traverse_nodes.push_back(children[child_index]);
+                }
+            }
+        }
+    }
+
+    bool DecodedBoxNodeCache::Contains(const dxr::amd::NodePointer node_ptr) const
+    {
+        if (!node_ptr.IsBoxNode() || node_ptr.GetByteOffset() < interior_nodes_offset_)
+        {
+            return false;
+        }
+
+        const size_t slot = (node_ptr.GetByteOffset() - interior_nodes_offset_) / dxr::amd::kFp16BoxNodeSize;
+        return slot < decoded_.size() && decoded_[slot] != 0;
+    }
+
+    const dxr::amd::NodePointer* DecodedBoxNodeCache::GetChildren(const dxr::amd::NodePointer node_ptr) const
+    {
+        return &children_[GetEntryIndex(node_ptr)];
+    }
+
+    dxr::amd::AxisAlignedBoundingBox DecodedBoxNodeCache::GetChildBoundingBox(const dxr::amd::NodePointer node_ptr, std::uint32_t child_index) const
+    {
+        RRA_ASSERT(child_index < 4);
+        const size_t entry = GetEntryIndex(node_ptr) + child_index;
+        return dxr::amd::AxisAlignedBoundingBox({min_x_[entry], min_y_[entry], min_z_[entry]}, {max_x_[entry], max_y_[entry], max_z_[entry]});
+    }
+
+    size_t DecodedBoxNodeCache::GetEntryIndex(const dxr::amd::NodePointer node_ptr) const
+    {
+        RRA_ASSERT(Contains(node_ptr));
+        return (node_ptr.GetByteOffset() - interior_nodes_offset_) / dxr::amd::kFp16BoxNodeSize * 4;
+    }
+
+    void DecodedBoxNodeCache::Decode(const std::vector<std::uint8_t>& interior_nodes, const dxr::amd::NodePointer node_ptr, size_t node_offset)
+    {
+        std::array<dxr::amd::NodePointer, 4>            child_array;
+        std::array<dxr::amd::AxisAlignedBoundingBox, 4> bbox_array;
+        if (node_ptr.IsFp16BoxNode())
+        {
+            const auto* box_node = reinterpret_cast<const dxr::amd::Float16BoxNode*>(&interior_nodes[node_offset]);
+            child_array          = box_node->GetChildren();
+            bbox_array           = box_node->GetBoundingBoxes();
+        }
+        else
+        {
+            const auto* box_node = reinterpret_cast<const dxr::amd::Float32BoxNode*>(&interior_nodes[node_offset]);
+            child_array          = box_node->GetChildren();
+            bbox_array           = box_node->GetBoundingBoxes();
+        }
+
+        const size_t slot  = node_offset / dxr::amd::kFp16BoxNodeSize;
+        const size_t first = slot * 4;
+        for (size_t child_index = 0; child_index < 4; child_index++)
+        {
+            children_[first + child_index] = child_array[child_index];
+            min_x_[first + child_index]    = bbox_array[child_index].min.x;
+            min_y_[first + child_index]    = bbox_array[child_index].min.y;
+            min_z_[first + child_index]    = bbox_array[child_index].min.z;
+            max_x_[first + child_index]    = bbox_array[child_index].max.x;
+            max_y_[first + child_index]    = bbox_array[child_index].max.y;
+            max_z_[first + child_index]    = bbox_array[child_index].max.z;
+        }
+        decoded_[slot] = 1;
+    }
+}  // namespace rta
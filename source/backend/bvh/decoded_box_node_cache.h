@@ -0,0 +1,92 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Decoded box node cache definition.
+///
+/// The decoded box node cache holds the child pointers and fp32 child
+/// bounding boxes of every box node in a BVH, decoded once after loading.
+/// Queries read from it instead of reinterpreting the interior node data
+/// and converting the fp16 bounds on every call.
+//=============================================================================
+
+#ifndef RRA_BACKEND_BVH_DECODED_BOX_NODE_CACHE_H_
+#define RRA_BACKEND_BVH_DECODED_BOX_NODE_CACHE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "bvh/dxr_definitions.h"
+#include "bvh/node_pointer.h"
+
+namespace rta
+{
+    /// @brief The decoded children of the box nodes in a BVH, stored as structure of arrays.
+    ///
+    /// Each box node owns 4 consecutive entries in every array, one per child, so the bounds of all the
+    /// children of a node can be read with a single vector load per component.
+    class DecodedBoxNodeCache
+    {
+    public:
+        /// @brief Constructor.
+        ///
+        /// Decodes every box node reachable from the root node.
+        ///
+        /// @param [in] interior_nodes        The interior node data of the BVH.
+        /// @param [in] interior_nodes_offset The byte offset of the interior node data in the BVH.
+        DecodedBoxNodeCache(const std::vector<std::uint8_t>& interior_nodes, std::uint64_t interior_nodes_offset);
+
+        /// @brief Has a box node been decoded.
+        ///
+        /// @param [in] node_ptr The box node.
+        ///
+        /// @return true if the node is in the cache, false if not.
+        bool Contains(const dxr::amd::NodePointer node_ptr) const;
+
+        /// @brief Get the children of a box node.
+        ///
+        /// Assumes Contains() returns true for the node.
+        ///
+        /// @param [in] node_ptr The box node.
+        ///
+        /// @return A pointer to the 4 child node pointers.
+        const dxr::amd::NodePointer* GetChildren(const dxr::amd::NodePointer node_ptr) const;
+
+        /// @brief Get the bounding box of a child of a box node.
+        ///
+        /// Assumes Contains() returns true for the node.
+        ///
+        /// @param [in] node_ptr    The box node.
+        /// @param [in] child_index The index of the child, from 0 to 3.
+        ///
+        /// @return The bounding box.
+        dxr::amd::AxisAlignedBoundingBox GetChildBoundingBox(const dxr::amd::NodePointer node_ptr, std::uint32_t child_index) const;
+
+    private:
+        /// @brief Get the index of the first entry of a box node.
+        ///
+        /// @param [in] node_ptr The box node.
+        ///
+        /// @return The entry index.
+        size_t GetEntryIndex(const dxr::amd::NodePointer node_ptr) const;
+
+        /// @brief Decode a box node into its entries.
+        ///
+        /// @param [in] interior_nodes The interior node data of the BVH.
+        /// @param [in] node_ptr       The box node.
+        /// @param [in] node_offset    The byte offset of the box node in the interior node data.
+        void Decode(const std::vector<std::uint8_t>& interior_nodes, const dxr::amd::NodePointer node_ptr, size_t node_offset);
+
+        std::uint64_t                      interior_nodes_offset_ = 0;   ///< The byte offset of the interior node data in the BVH.
+        std::vector<std::uint8_t>          decoded_               = {};  ///< Set for each 64-byte interior node slot holding a decoded node.
+        std::vector<dxr::amd::NodePointer> children_              = {};  ///< The child node pointers.
+        std::vector<float>                 min_x_                 = {};  ///< The minimum x of the child bounding boxes.
+        std::vector<float>                 min_y_                 = {};  ///< The minimum y of the child bounding boxes.
+        std::vector<float>                 min_z_                 = {};  ///< The minimum z of the child bounding boxes.
+        std::vector<float>                 max_x_                 = {};  ///< The maximum x of the child bounding boxes.
+        std::vector<float>                 max_y_                 = {};  ///< The maximum y of the child bounding boxes.
+        std::vector<float>                 max_z_                 = {};  ///< The maximum z of the child bounding boxes.
+    };
+}  // namespace rta
+
+#endif  // RRA_BACKEND_BVH_DECODED_BOX_NODE_CACHE_H_
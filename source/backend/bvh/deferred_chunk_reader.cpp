@@ -0,0 +1,52 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Deferred chunk reader implementation.
+//=============================================================================
+
+#include "bvh/deferred_chunk_reader.h"
+
+namespace rta
+{
+    DeferredChunkReader::DeferredChunkReader(const std::string& file_path)
+        : file_path_(file_path)
+    {
+    }
+
+    DeferredChunkReader::~DeferredChunkReader()
+    {
+        // The chunk file references the stream, so close it first.
+        chunk_file_.reset();
+        stream_.reset();
+    }
+
+    bool DeferredChunkReader::ReadChunkData(const char* chunk_identifier, std::int32_t chunk_index, std::vector<std::uint8_t>& buffer)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        try
+        {
+            if (chunk_file_ == nullptr)
+            {
+                stream_     = std::make_unique<rdf::Stream>(rdf::Stream::OpenFile(file_path_.c_str()));
+                chunk_file_ = std::make_unique<rdf::ChunkFile>(*stream_);
+            }
+
+            const auto data_size = chunk_file_->GetChunkDataSize(chunk_identifier, chunk_index);
+            buffer.resize(data_size);
+            if (data_size > 0)
+            {
+                chunk_file_->ReadChunkDataToBuffer(chunk_identifier, chunk_index, buffer.data());
+            }
+        }
+        catch (...)
+        {
+            chunk_file_.reset();
+            stream_.reset();
+            return false;
+        }
+
+        return true;
+    }
+}  // namespace rta
@@ -0,0 +1,55 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Deferred chunk reader definition.
+///
+/// A deferred chunk reader keeps a chunk file open after a trace has been
+/// loaded, so acceleration structures whose data was not decoded at load
+/// time can read their chunk data later.
+//=============================================================================
+
+#ifndef RRA_BACKEND_BVH_DEFERRED_CHUNK_READER_H_
+#define RRA_BACKEND_BVH_DEFERRED_CHUNK_READER_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rdf/rdf/inc/amdrdf.h"
+
+namespace rta
+{
+    class DeferredChunkReader
+    {
+    public:
+        /// @brief Constructor.
+        ///
+        /// @param [in] file_path The path of the trace file. The file is opened on first use.
+        explicit DeferredChunkReader(const std::string& file_path);
+
+        /// @brief Destructor.
+        ~DeferredChunkReader();
+
+        /// @brief Read the data of a chunk into a buffer.
+        ///
+        /// Reads are serialized, so this may be called from any thread.
+        ///
+        /// @param [in]  chunk_identifier The chunk identifier.
+        /// @param [in]  chunk_index      The index of the chunk in the file.
+        /// @param [out] buffer           The buffer to receive the chunk data.
+        ///
+        /// @return true if the chunk data was read, false if not.
+        bool ReadChunkData(const char* chunk_identifier, std::int32_t chunk_index, std::vector<std::uint8_t>& buffer);
+
+    private:
+        std::mutex                      mutex_;       ///< Serializes access to the chunk file.
+        std::string                     file_path_;   ///< The path of the trace file.
+        std::unique_ptr<rdf::Stream>    stream_;      ///< The file stream, opened on first use.
+        std::unique_ptr<rdf::ChunkFile> chunk_file_;  ///< The chunk file, opened on first use.
+    };
+}  // namespace rta
+
+#endif  // RRA_BACKEND_BVH_DEFERRED_CHUNK_READER_H_
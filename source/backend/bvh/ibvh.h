@@ -43,6 +43,18 @@ namespace rta
         // Assume that there is no meta data stored.
         kNoMetaData = 0x1,
 
+        // Only decode the BLAS headers at load time. The BLAS node data is decoded
+        // later, either by a background prefetch or on first access.
+        kDeferBlasNodeData = 0x2,
+
+        // Don't run the post-load step on the BVHs. The caller either restores the
+        // derived data (e.g. from the derived data cache) or calls PostLoad() itself.
+        kDeferPostLoad = 0x4,
+
+        // Decode the box nodes into a cache of child pointers and fp32 bounding boxes
+        // once the node data is loaded, so queries don't decode them on every call.
+        kDecodedNodeCache = 0x8,
+
         // Skip the padding data by default.
         kDefault = kIgnoreUnknown
     };
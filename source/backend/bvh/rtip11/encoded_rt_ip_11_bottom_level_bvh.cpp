@@ -23,16 +23,19 @@ namespace rta
 
     const std::vector<uint8_t>& EncodedRtIp11BottomLevelBvh::GetLeafNodesData() const
     {
+        LoadDeferredNodeData();
         return leaf_nodes_;
     }
 
     const std::vector<dxr::amd::GeometryInfo>& EncodedRtIp11BottomLevelBvh::GetGeometryInfos() const
     {
+        LoadDeferredNodeData();
         return geom_infos_;
     }
 
     const std::vector<dxr::amd::NodePointer>& EncodedRtIp11BottomLevelBvh::GetPrimitiveNodePtrs() const
     {
+        LoadDeferredNodeData();
         return primitive_node_ptrs_;
     }
 
@@ -54,6 +57,7 @@ namespace rta
 
     void EncodedRtIp11BottomLevelBvh::UpdatePrimitiveNodePtrs()
     {
+        LoadDeferredNodeData();
         auto                  byte_offset = header_->GetBufferOffsets().leaf_nodes;
         dxr::amd::NodePointer node_ptr;
 
@@ -100,9 +104,8 @@ namespace rta
                                                                 const char* const                   chunk_identifier,
                                                                 const BvhBundleReadOption           import_option)
     {
-        const auto identifier     = chunk_identifier;
-        const auto data_size      = chunk_file.GetChunkDataSize(identifier, static_cast<uint32_t>(chunk_index));
-        const bool skip_meta_data = static_cast<std::uint8_t>(import_option) & static_cast<std::uint8_t>(BvhBundleReadOption::kNoMetaData);
+        const auto identifier = chunk_identifier;
+        const auto data_size  = chunk_file.GetChunkDataSize(identifier, static_cast<uint32_t>(chunk_index));
 
         std::vector<std::uint8_t> buffer(data_size);
         if (data_size > 0)
@@ -110,17 +113,41 @@ namespace rta
             chunk_file.ReadChunkDataToBuffer(identifier, static_cast<uint32_t>(chunk_index), buffer.data());
         }
 
-        if (!skip_meta_data)
-        {
-            memcpy(&meta_data_, buffer.data() + chunk_header.meta_header_offset, sizeof(dxr::amd::MetaDataV1));
-        }
+        return LoadRawAccelStrucFromBuffer(buffer, chunk_header, import_option);
+    }
 
+    bool EncodedRtIp11BottomLevelBvh::LoadRawAccelStrucHeaderFromBuffer(const std::vector<std::uint8_t>&    buffer,
+                                                                        const RawAccelStructRdfChunkHeader& chunk_header,
+                                                                        const BvhBundleReadOption           import_option)
+    {
         if (buffer.size() < ((size_t)dxr::amd::kAccelerationStructureHeaderSize + chunk_header.header_offset))
         {
             return false;
         }
 
-        header_->LoadFromBuffer(dxr::amd::kAccelerationStructureHeaderSize, buffer.data() + chunk_header.header_offset);
+        RawAccelStructHeaderData header_data = {};
+        if (buffer.size() >= sizeof(dxr::amd::MetaDataV1) + chunk_header.meta_header_offset)
+        {
+            memcpy(&header_data.meta_data, buffer.data() + chunk_header.meta_header_offset, sizeof(dxr::amd::MetaDataV1));
+        }
+        memcpy(header_data.header.data(), buffer.data() + chunk_header.header_offset, dxr::amd::kAccelerationStructureHeaderSize);
+
+        return LoadRawAccelStrucHeaderFromHeaderData(header_data, chunk_header, import_option);
+    }
+
+    bool EncodedRtIp11BottomLevelBvh::LoadRawAccelStrucHeaderFromHeaderData(const RawAccelStructHeaderData&     header_data,
+                                                                            const RawAccelStructRdfChunkHeader& chunk_header,
+                                                                            const BvhBundleReadOption           import_option)
+    {
+        const bool skip_meta_data = static_cast<std::uint8_t>(import_option) & static_cast<std::uint8_t>(BvhBundleReadOption::kNoMetaData);
+
+        raw_header_data_ = header_data;
+        if (!skip_meta_data)
+        {
+            meta_data_ = header_data.meta_data;
+        }
+
+        header_->LoadFromBuffer(dxr::amd::kAccelerationStructureHeaderSize, raw_header_data_.header.data());
         if (!header_->IsValid())
         {
             return false;
@@ -129,6 +156,18 @@ namespace rta
         uint64_t address = (static_cast<std::uint64_t>(chunk_header.accel_struct_base_va_hi) << 32) | chunk_header.accel_struct_base_va_lo;
         SetVirtualAddress(address);
 
+        return true;
+    }
+
+    const RawAccelStructHeaderData& EncodedRtIp11BottomLevelBvh::GetRawHeaderData() const
+    {
+        return raw_header_data_;
+    }
+
+    bool EncodedRtIp11BottomLevelBvh::LoadRawAccelStrucNodeDataFromBuffer(const std::vector<std::uint8_t>&    buffer,
+                                                                          const RawAccelStructRdfChunkHeader& chunk_header,
+                                                                          const BvhBundleReadOption           import_option)
+    {
         auto buffer_offset = chunk_header.header_offset + chunk_header.header_size;
         auto buffer_stream = rdf::Stream::FromReadOnlyMemory(buffer.size() - buffer_offset, buffer.data() + buffer_offset);
 
@@ -180,6 +219,18 @@ namespace rta
 
     bool EncodedRtIp11BottomLevelBvh::PostLoad()
     {
+        if (IsNodeDataPending())
+        {
+            // Runs again once the deferred node data has been decoded.
+            return true;
+        }
+
+        // The derived data restored from the cache replaces the data set up here.
+        if (HasRestoredDerivedData())
+        {
+            return true;
+        }
+
         size_t num_leaf_nodes = leaf_nodes_.size() / sizeof(dxr::amd::TriangleNode);
         ScanTreeDepth();
         triangle_surface_area_heuristic_.resize(num_leaf_nodes, 0);
@@ -188,6 +239,7 @@ namespace rta
 
     float EncodedRtIp11BottomLevelBvh::GetLeafNodeSurfaceAreaHeuristic(const dxr::amd::NodePointer node_ptr) const
     {
+        LoadDeferredNodeData();
         const uint32_t byte_offset = node_ptr.GetByteOffset();
         const uint32_t leaf_nodes  = GetHeader().GetBufferOffsets().leaf_nodes;
         if (byte_offset < leaf_nodes)
@@ -203,6 +255,7 @@ namespace rta
 
     void EncodedRtIp11BottomLevelBvh::SetLeafNodeSurfaceAreaHeuristic(uint64_t leaf_index, float surface_area_heuristic)
     {
+        LoadDeferredNodeData();
         assert(leaf_index < (leaf_nodes_.size() / sizeof(dxr::amd::TriangleNode)));
         assert(leaf_index < triangle_surface_area_heuristic_.size());
         triangle_surface_area_heuristic_[leaf_index] = surface_area_heuristic;
@@ -210,12 +263,53 @@ namespace rta
 
     float EncodedRtIp11BottomLevelBvh::GetSurfaceAreaHeuristic() const
     {
+        LoadDeferredNodeData();
         return surface_area_heuristic_;
     }
 
     void EncodedRtIp11BottomLevelBvh::SetSurfaceAreaHeuristic(float surface_area_heuristic)
     {
+        LoadDeferredNodeData();
         surface_area_heuristic_ = surface_area_heuristic;
     }
 
+    void EncodedRtIp11BottomLevelBvh::ClearNodeData()
+    {
+        IEncodedRtIp11Bvh::ClearNodeData();
+        leaf_nodes_.clear();
+        leaf_nodes_.shrink_to_fit();
+        geom_infos_.clear();
+        sideband_data_.clear();
+        triangle_surface_area_heuristic_.clear();
+        triangle_surface_area_heuristic_.shrink_to_fit();
+        surface_area_heuristic_ = 0.0f;
+    }
+
+    void EncodedRtIp11BottomLevelBvh::WriteDerivedData(rra::DerivedDataWriter& writer) const
+    {
+        IEncodedRtIp11Bvh::WriteDerivedData(writer);
+        writer.Write(surface_area_heuristic_);
+        writer.WriteArray(triangle_surface_area_heuristic_);
+    }
+
+    bool EncodedRtIp11BottomLevelBvh::ReadDerivedData(rra::DerivedDataReader& reader)
+    {
+        if (!IEncodedRtIp11Bvh::ReadDerivedData(reader))
+        {
+            return false;
+        }
+
+        const size_t       num_leaf_nodes = leaf_nodes_.size() / sizeof(dxr::amd::TriangleNode);
+        std::vector<float> triangle_surface_area_heuristic;
+
+        reader.Read(surface_area_heuristic_);
+        if (!reader.ReadArray(triangle_surface_area_heuristic) || triangle_surface_area_heuristic.size() != num_leaf_nodes)
+        {
+            return false;
+        }
+
+        triangle_surface_area_heuristic_ = std::move(triangle_surface_area_heuristic);
+        return true;
+    }
+
 }  // namespace rta
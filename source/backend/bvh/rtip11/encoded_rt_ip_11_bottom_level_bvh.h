@@ -70,6 +70,35 @@ namespace rta
                                        const char* const                   chunk_identifier,
                                        const BvhBundleReadOption           import_option) override;
 
+        /// @brief Decode the meta data, header and virtual address from a buffer holding the raw chunk data.
+        ///
+        /// @param [in] buffer            The raw chunk data, as read from the chunk file.
+        /// @param [in] header            The raw acceleration structure header.
+        /// @param [in] import_option     Flag indicating which sections of the chunk to load/discard.
+        ///
+        /// @return true if the header loaded successfully, false if not.
+        bool LoadRawAccelStrucHeaderFromBuffer(const std::vector<std::uint8_t>&    buffer,
+                                               const RawAccelStructRdfChunkHeader& header,
+                                               const BvhBundleReadOption           import_option) override;
+
+        /// @brief Decode the meta data, header and virtual address from a copy of the header data of the chunk.
+        ///
+        /// Used to restore the header without reading the chunk data.
+        ///
+        /// @param [in] header_data       The header data, as returned by GetRawHeaderData() when the chunk was last loaded.
+        /// @param [in] header            The raw acceleration structure header.
+        /// @param [in] import_option     Flag indicating which sections of the chunk to load/discard.
+        ///
+        /// @return true if the header loaded successfully, false if not.
+        bool LoadRawAccelStrucHeaderFromHeaderData(const RawAccelStructHeaderData&     header_data,
+                                                   const RawAccelStructRdfChunkHeader& header,
+                                                   const BvhBundleReadOption           import_option);
+
+        /// @brief Get the header data the BLAS was loaded from.
+        ///
+        /// @return The header data.
+        const RawAccelStructHeaderData& GetRawHeaderData() const;
+
         /// @brief Do the post-load step.
         ///
         /// This will be called once all the acceleration structures are loaded and fixed up. Tasks here include
@@ -101,7 +130,33 @@ namespace rta
         /// @param [in] surface_area_heuristic The surface area heuristic value to be set.
         void SetSurfaceAreaHeuristic(float surface_area_heuristic);
 
+        /// @brief Write the data derived from this BVH after loading to the derived data cache.
+        ///
+        /// @param [in] writer The writer to serialize to.
+        void WriteDerivedData(rra::DerivedDataWriter& writer) const override;
+
+        /// @brief Restore the data written by WriteDerivedData().
+        ///
+        /// @param [in] reader The reader to deserialize from.
+        ///
+        /// @return true if the data was restored, false if it doesn't match this BVH.
+        bool ReadDerivedData(rra::DerivedDataReader& reader) override;
+
     private:
+        /// @brief Decode the node data from a buffer holding the raw chunk data.
+        ///
+        /// @param [in] buffer            The raw chunk data, as read from the chunk file.
+        /// @param [in] header            The raw acceleration structure header.
+        /// @param [in] import_option     Flag indicating which sections of the chunk to load/discard.
+        ///
+        /// @return true if the node data loaded successfully, false if not.
+        bool LoadRawAccelStrucNodeDataFromBuffer(const std::vector<std::uint8_t>&    buffer,
+                                                 const RawAccelStructRdfChunkHeader& header,
+                                                 const BvhBundleReadOption           import_option) override;
+
+        /// @brief Release the node data, after the deferred node data failed to decode.
+        void ClearNodeData() override;
+
         /// @brief Obtain the byte size of the encoded buffer.
         ///
         /// @param [in] import_option Flag indicating which sections of the chunk to load/discard.
@@ -119,6 +174,7 @@ namespace rta
         std::vector<std::uint8_t>           sideband_data_                   = {};    ///< Sideband data for compression.
         std::vector<float>                  triangle_surface_area_heuristic_ = {};    ///< Surface area heuristic values for the triangles.
         float                               surface_area_heuristic_          = 0.0f;  ///< The precalculated Surface area heuristic for this BLAS.
+        RawAccelStructHeaderData            raw_header_data_                 = {};    ///< The header data the BLAS was loaded from.
     };
 
 }  // namespace rta
@@ -88,9 +88,8 @@ namespace rta
                                                              const char*                         chunk_identifier,
                                                              const BvhBundleReadOption           import_option)
     {
-        const auto identifier     = chunk_identifier;
-        const auto data_size      = chunk_file.GetChunkDataSize(identifier, static_cast<uint32_t>(chunk_index));
-        const bool skip_meta_data = static_cast<std::uint8_t>(import_option) & static_cast<std::uint8_t>(BvhBundleReadOption::kNoMetaData);
+        const auto identifier = chunk_identifier;
+        const auto data_size  = chunk_file.GetChunkDataSize(identifier, static_cast<uint32_t>(chunk_index));
 
         std::vector<std::uint8_t> buffer(data_size);
         if (data_size > 0)
@@ -98,6 +97,15 @@ namespace rta
             chunk_file.ReadChunkDataToBuffer(identifier, static_cast<uint32_t>(chunk_index), buffer.data());
         }
 
+        return LoadRawAccelStrucFromBuffer(buffer, chunk_header, import_option);
+    }
+
+    bool EncodedRtIp11TopLevelBvh::LoadRawAccelStrucHeaderFromBuffer(const std::vector<std::uint8_t>&    buffer,
+                                                                     const RawAccelStructRdfChunkHeader& chunk_header,
+                                                                     const BvhBundleReadOption           import_option)
+    {
+        const bool skip_meta_data = static_cast<std::uint8_t>(import_option) & static_cast<std::uint8_t>(BvhBundleReadOption::kNoMetaData);
+
         if (!skip_meta_data)
         {
             memcpy(&meta_data_, buffer.data() + chunk_header.meta_header_offset, chunk_header.meta_header_size);
@@ -113,6 +121,13 @@ namespace rta
         uint64_t address = (static_cast<std::uint64_t>(chunk_header.accel_struct_base_va_hi) << 32) | chunk_header.accel_struct_base_va_lo;
         SetVirtualAddress(address);
 
+        return true;
+    }
+
+    bool EncodedRtIp11TopLevelBvh::LoadRawAccelStrucNodeDataFromBuffer(const std::vector<std::uint8_t>&    buffer,
+                                                                       const RawAccelStructRdfChunkHeader& chunk_header,
+                                                                       const BvhBundleReadOption           import_option)
+    {
         auto buffer_offset = chunk_header.header_offset + chunk_header.header_size;
         auto buffer_stream = rdf::Stream::FromReadOnlyMemory(buffer.size() - buffer_offset, buffer.data() + buffer_offset);
 
@@ -144,6 +159,12 @@ namespace rta
 
     bool EncodedRtIp11TopLevelBvh::PostLoad()
     {
+        // The derived data restored from the cache replaces the data set up here.
+        if (HasRestoredDerivedData())
+        {
+            return true;
+        }
+
         bool result = BuildInstanceList();
         ScanTreeDepth();
         instance_surface_area_heuristic_.resize(header_->GetPrimitiveCount(), 0);
@@ -192,6 +213,8 @@ namespace rta
 
     bool EncodedRtIp11TopLevelBvh::BuildInstanceList()
     {
+        instance_list_.clear();
+
         if (IsEmpty())
         {
             // An empty TLAS should be OK; it just won't be shown in the UI.
@@ -399,6 +422,11 @@ namespace rta
 
     float EncodedRtIp11TopLevelBvh::GetLeafNodeSurfaceAreaHeuristic(const dxr::amd::NodePointer node_ptr) const
     {
+        if (!HasSurfaceAreaHeuristic())
+        {
+            return 0.0f;
+        }
+
         const int32_t index = GetInstanceIndex(&node_ptr);
         assert(index != -1);
         assert(index < static_cast<int32_t>(instance_surface_area_heuristic_.size()));
@@ -413,4 +441,52 @@ namespace rta
         instance_surface_area_heuristic_[index] = surface_area_heuristic;
     }
 
+    void EncodedRtIp11TopLevelBvh::WriteDerivedData(rra::DerivedDataWriter& writer) const
+    {
+        IEncodedRtIp11Bvh::WriteDerivedData(writer);
+
+        writer.Write(static_cast<std::uint64_t>(instance_list_.size()));
+        for (const auto& it : instance_list_)
+        {
+            writer.Write(it.first);
+            writer.WriteArray(it.second);
+        }
+        writer.WriteArray(instance_surface_area_heuristic_);
+    }
+
+    bool EncodedRtIp11TopLevelBvh::ReadDerivedData(rra::DerivedDataReader& reader)
+    {
+        if (!IEncodedRtIp11Bvh::ReadDerivedData(reader))
+        {
+            return false;
+        }
+
+        std::uint64_t instance_list_size = 0;
+        if (!reader.Read(instance_list_size))
+        {
+            return false;
+        }
+
+        std::unordered_map<uint64_t, std::vector<dxr::amd::NodePointer>> instance_list;
+        for (std::uint64_t i = 0; i < instance_list_size; ++i)
+        {
+            uint64_t blas_index = 0;
+            reader.Read(blas_index);
+            if (!reader.ReadArray(instance_list[blas_index]))
+            {
+                return false;
+            }
+        }
+
+        std::vector<float> instance_surface_area_heuristic;
+        if (!reader.ReadArray(instance_surface_area_heuristic) || instance_surface_area_heuristic.size() != header_->GetPrimitiveCount())
+        {
+            return false;
+        }
+
+        instance_list_                   = std::move(instance_list);
+        instance_surface_area_heuristic_ = std::move(instance_surface_area_heuristic);
+        return true;
+    }
+
 }  // namespace rta
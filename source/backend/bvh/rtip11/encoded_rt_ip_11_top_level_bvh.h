@@ -66,6 +66,17 @@ namespace rta
                                        const char* const                   chunk_identifier,
                                        const BvhBundleReadOption           import_option) override;
 
+        /// @brief Decode the meta data, header and virtual address from a buffer holding the raw chunk data.
+        ///
+        /// @param [in] buffer            The raw chunk data, as read from the chunk file.
+        /// @param [in] header            The raw acceleration structure header.
+        /// @param [in] import_option     Flag indicating which sections of the chunk to load/discard.
+        ///
+        /// @return true if the header loaded successfully, false if not.
+        bool LoadRawAccelStrucHeaderFromBuffer(const std::vector<std::uint8_t>&    buffer,
+                                               const RawAccelStructRdfChunkHeader& header,
+                                               const BvhBundleReadOption           import_option) override;
+
         /// @brief Replace all absolute references with relative references.
         ///
         /// This includes replacing absolute VA's with index values for quick lookup.
@@ -141,7 +152,30 @@ namespace rta
         /// @param [in] surface_area_heuristic The surface area heuristic value to be set.
         void SetLeafNodeSurfaceAreaHeuristic(const dxr::amd::NodePointer node_ptr, float surface_area_heuristic);
 
+        /// @brief Write the data derived from this BVH after loading to the derived data cache.
+        ///
+        /// @param [in] writer The writer to serialize to.
+        void WriteDerivedData(rra::DerivedDataWriter& writer) const override;
+
+        /// @brief Restore the data written by WriteDerivedData().
+        ///
+        /// @param [in] reader The reader to deserialize from.
+        ///
+        /// @return true if the data was restored, false if it doesn't match this BVH.
+        bool ReadDerivedData(rra::DerivedDataReader& reader) override;
+
     private:
+        /// @brief Decode the node data from a buffer holding the raw chunk data.
+        ///
+        /// @param [in] buffer            The raw chunk data, as read from the chunk file.
+        /// @param [in] header            The raw acceleration structure header.
+        /// @param [in] import_option     Flag indicating which sections of the chunk to load/discard.
+        ///
+        /// @return true if the node data loaded successfully, false if not.
+        bool LoadRawAccelStrucNodeDataFromBuffer(const std::vector<std::uint8_t>&    buffer,
+                                                 const RawAccelStructRdfChunkHeader& header,
+                                                 const BvhBundleReadOption           import_option) override;
+
         /// @brief Get the size of an instance node.
         ///
         /// This will be dependent on whether it's a fused instance or not.
@@ -67,21 +67,31 @@ namespace rta
 
     const dxr::amd::ParentBlock& IEncodedRtIp11Bvh::GetParentData() const
     {
+        LoadDeferredNodeData();
         return parent_data_;
     }
 
     const std::vector<std::uint8_t>& IEncodedRtIp11Bvh::GetInteriorNodesData() const
     {
+        LoadDeferredNodeData();
         return interior_nodes_;
     }
 
     std::vector<std::uint8_t>& IEncodedRtIp11Bvh::GetInteriorNodesData()
     {
+        LoadDeferredNodeData();
         return interior_nodes_;
     }
 
+    const DecodedBoxNodeCache* IEncodedRtIp11Bvh::GetDecodedNodeCache() const
+    {
+        LoadDeferredNodeData();
+        return decoded_node_cache_.get();
+    }
+
     bool IEncodedRtIp11Bvh::IsCompacted() const
     {
+        LoadDeferredNodeData();
         return is_compacted_;
     }
 
@@ -99,6 +109,7 @@ namespace rta
 
     const dxr::amd::Float32BoxNode* IEncodedRtIp11Bvh::GetFloat32Box(const dxr::amd::NodePointer node_pointer, const int offset) const
     {
+        LoadDeferredNodeData();
         assert(node_pointer.IsFp32BoxNode());
         return reinterpret_cast<const dxr::amd::Float32BoxNode*>(
             &interior_nodes_[node_pointer.GetByteOffset() - (size_t)header_->GetBufferOffsets().interior_nodes + offset * dxr::amd::kFp32BoxNodeSize]);
@@ -106,6 +117,7 @@ namespace rta
 
     const dxr::amd::Float16BoxNode* IEncodedRtIp11Bvh::GetFloat16Box(const dxr::amd::NodePointer node_pointer, const int offset) const
     {
+        LoadDeferredNodeData();
         assert(node_pointer.IsFp16BoxNode());
         return reinterpret_cast<const dxr::amd::Float16BoxNode*>(
             &interior_nodes_[node_pointer.GetByteOffset() - (size_t)header_->GetBufferOffsets().interior_nodes + offset * dxr::amd::kFp16BoxNodeSize]);
@@ -164,17 +176,19 @@ namespace rta
 
     const dxr::amd::NodePointer* IEncodedRtIp11Bvh::GetPrimitiveNodePointer(int32_t index) const
     {
+        LoadDeferredNodeData();
         return &primitive_node_ptrs_[index];
     }
 
     bool IEncodedRtIp11Bvh::IsCompactedImpl() const
     {
+        LoadDeferredNodeData();
         return is_compacted_;
     }
 
     bool IEncodedRtIp11Bvh::IsEmptyImpl() const
     {
-        return header_->GetInteriorNodeCount() == 0;
+        return header_->GetInteriorNodeCount() == 0 || HasNodeDataError();
     }
 
     uint64_t IEncodedRtIp11Bvh::GetInactiveInstanceCountImpl() const
@@ -231,8 +245,164 @@ namespace rta
         return {actual_interior_node_buffer_size, actual_leaf_node_buffer_size};
     }
 
+    bool IEncodedRtIp11Bvh::LoadRawAccelStrucFromBuffer(const std::vector<std::uint8_t>&    buffer,
+                                                        const RawAccelStructRdfChunkHeader& chunk_header,
+                                                        const BvhBundleReadOption           import_option)
+    {
+        if (!LoadRawAccelStrucHeaderFromBuffer(buffer, chunk_header, import_option))
+        {
+            return false;
+        }
+        if (!LoadRawAccelStrucNodeDataFromBuffer(buffer, chunk_header, import_option))
+        {
+            return false;
+        }
+        BuildDecodedNodeCache(import_option);
+        return true;
+    }
+
+    void IEncodedRtIp11Bvh::BuildDecodedNodeCache(const BvhBundleReadOption import_option)
+    {
+        if ((static_cast<std::uint8_t>(import_option) & static_cast<std::uint8_t>(BvhBundleReadOption::kDecodedNodeCache)) == 0)
+        {
+            return;
+        }
+        decoded_node_cache_ = std::make_unique<DecodedBoxNodeCache>(interior_nodes_, header_->GetBufferOffsets().interior_nodes);
+    }
+
+    void IEncodedRtIp11Bvh::SetDeferredNodeData(std::shared_ptr<DeferredChunkReader> reader,
+                                                const char* const                    chunk_identifier,
+                                                const std::int32_t                   chunk_index,
+                                                const RawAccelStructRdfChunkHeader&  header,
+                                                const BvhBundleReadOption            import_option)
+    {
+        deferred_node_data_                   = std::make_unique<DeferredNodeData>();
+        deferred_node_data_->reader           = std::move(reader);
+        deferred_node_data_->chunk_identifier = chunk_identifier;
+        deferred_node_data_->chunk_index      = chunk_index;
+        deferred_node_data_->header           = header;
+        deferred_node_data_->import_option    = import_option;
+        node_data_loaded_.store(false, std::memory_order_release);
+    }
+
+    void IEncodedRtIp11Bvh::SetNodeDataLoadedCallback(std::function<void(IEncodedRtIp11Bvh&)> callback)
+    {
+        if (deferred_node_data_ != nullptr)
+        {
+            std::lock_guard<std::recursive_mutex> lock(deferred_node_data_->mutex);
+            deferred_node_data_->on_loaded = std::move(callback);
+        }
+    }
+
+    bool IEncodedRtIp11Bvh::IsNodeDataLoaded() const
+    {
+        return node_data_loaded_.load(std::memory_order_acquire);
+    }
+
+    bool IEncodedRtIp11Bvh::HasNodeDataError() const
+    {
+        return node_data_failed_.load(std::memory_order_acquire);
+    }
+
+    bool IEncodedRtIp11Bvh::IsNodeDataPending() const
+    {
+        return !IsNodeDataLoaded() && !deferred_node_data_->loading.load(std::memory_order_acquire);
+    }
+
+    void IEncodedRtIp11Bvh::LoadDeferredNodeDataImpl() const
+    {
+        RRA_ASSERT(deferred_node_data_ != nullptr);
+        DeferredNodeData& deferred = *deferred_node_data_;
+
+        std::lock_guard<std::recursive_mutex> lock(deferred.mutex);
+
+        // Either another thread finished the decode while this one waited for the lock, or this is a
+        // call from the on_loaded callback on the decoding thread, where the data is already in place.
+        if (node_data_loaded_.load(std::memory_order_acquire) || deferred.loading.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        deferred.loading.store(true, std::memory_order_release);
+
+        // The node data is only written here, under the lock and before it is published, so casting away
+        // the const is safe.
+        IEncodedRtIp11Bvh* bvh = const_cast<IEncodedRtIp11Bvh*>(this);
+
+        std::vector<std::uint8_t> buffer;
+        bool                      result = deferred.reader->ReadChunkData(deferred.chunk_identifier, deferred.chunk_index, buffer);
+        if (result)
+        {
+            result = bvh->LoadRawAccelStrucNodeDataFromBuffer(buffer, deferred.header, deferred.import_option);
+        }
+        if (result)
+        {
+            bvh->BuildDecodedNodeCache(deferred.import_option);
+        }
+        buffer.clear();
+        buffer.shrink_to_fit();
+
+        // Data derived from the nodes on a previous load replaces PostLoad() and the callback, if it matches the nodes.
+        bool restored = false;
+        if (result && !deferred.derived_data.empty())
+        {
+            rra::DerivedDataReader reader(deferred.derived_data.data(), deferred.derived_data.size());
+            restored = bvh->ReadDerivedData(reader) && !reader.HasFailed();
+        }
+        deferred.derived_data.clear();
+        deferred.derived_data.shrink_to_fit();
+
+        if (result && !restored)
+        {
+            result = bvh->PostLoad();
+        }
+
+        if (result)
+        {
+            if (restored)
+            {
+                derived_data_restored_.store(true, std::memory_order_release);
+            }
+            else if (deferred.on_loaded)
+            {
+                deferred.on_loaded(*bvh);
+            }
+        }
+        else
+        {
+            // The trace may have been moved, truncated or changed since it was opened. Rather than publish node data
+            // that doesn't match the header, leave the BVH with no nodes and record the failure. It isn't retried.
+            bvh->ClearNodeData();
+            node_data_failed_.store(true, std::memory_order_release);
+        }
+
+        deferred.loading.store(false, std::memory_order_release);
+        node_data_loaded_.store(true, std::memory_order_release);
+    }
+
+    void IEncodedRtIp11Bvh::ClearNodeData()
+    {
+        parent_data_ = {};
+        interior_nodes_.clear();
+        interior_nodes_.shrink_to_fit();
+        primitive_node_ptrs_.clear();
+        primitive_node_ptrs_.shrink_to_fit();
+        box_surface_area_heuristic_.clear();
+        box_surface_area_heuristic_.shrink_to_fit();
+        box_sub_tree_surface_area_heuristic_.clear();
+        box_sub_tree_surface_area_heuristic_.shrink_to_fit();
+        decoded_node_cache_.reset();
+        max_tree_depth_ = 0;
+        avg_tree_depth_ = 0;
+    }
+
     std::uint32_t IEncodedRtIp11Bvh::GetNodeCount(const BvhNodeFlags flag) const
     {
+        if (HasNodeDataError())
+        {
+            return 0;
+        }
+
         if (flag == BvhNodeFlags::kIsInteriorNode)
         {
             return header_->GetInteriorNodeCount();
@@ -304,6 +474,7 @@ namespace rta
         const size_t num_box_nodes = header_->GetInteriorNodeCount();
 
         box_surface_area_heuristic_.resize(num_box_nodes, 0);
+        box_sub_tree_surface_area_heuristic_.resize(num_box_nodes);
     }
 
     void IEncodedRtIp11Bvh::SetRelativeReferences(const std::unordered_map<GpuVirtualAddress, std::uint64_t>& reference_map,
@@ -380,6 +551,9 @@ namespace rta
 
     void IEncodedRtIp11Bvh::ScanTreeDepth()
     {
+        max_tree_depth_ = 0;
+        avg_tree_depth_ = 0;
+
         size_t num_box_nodes = header_->GetInteriorNodeCount();
         if (num_box_nodes == 0)
         {
@@ -452,6 +626,11 @@ namespace rta
 
     float IEncodedRtIp11Bvh::GetInteriorNodeSurfaceAreaHeuristic(const dxr::amd::NodePointer node_ptr) const
     {
+        LoadDeferredNodeData();
+        if (!HasSurfaceAreaHeuristic())
+        {
+            return 0.0f;
+        }
         const uint32_t index = (node_ptr.GetByteOffset() - GetHeader().GetBufferOffsets().interior_nodes) / sizeof(dxr::amd::Float32BoxNode);
         RRA_ASSERT(index < box_surface_area_heuristic_.size());
         return box_surface_area_heuristic_[index];
@@ -459,6 +638,7 @@ namespace rta
 
     void IEncodedRtIp11Bvh::SetInteriorNodeSurfaceAreaHeuristic(const dxr::amd::NodePointer node_ptr, float surface_area_heuristic)
     {
+        LoadDeferredNodeData();
         const uint32_t byte_offset   = node_ptr.GetByteOffset();
         const uint32_t header_offset = GetHeader().GetBufferOffsets().interior_nodes;
         const uint32_t index         = (byte_offset - header_offset) / sizeof(dxr::amd::Float32BoxNode);
@@ -466,13 +646,129 @@ namespace rta
         box_surface_area_heuristic_[index] = surface_area_heuristic;
     }
 
+    bool IEncodedRtIp11Bvh::HasSurfaceAreaHeuristic() const
+    {
+        return surface_area_heuristic_complete_.load(std::memory_order_acquire);
+    }
+
+    void IEncodedRtIp11Bvh::SetSurfaceAreaHeuristicComplete(bool complete)
+    {
+        surface_area_heuristic_complete_.store(complete, std::memory_order_release);
+    }
+
+    const SubTreeSurfaceAreaHeuristic& IEncodedRtIp11Bvh::GetInteriorNodeSubTreeSurfaceAreaHeuristic(const dxr::amd::NodePointer node_ptr) const
+    {
+        LoadDeferredNodeData();
+        const uint32_t index = (node_ptr.GetByteOffset() - GetHeader().GetBufferOffsets().interior_nodes) / sizeof(dxr::amd::Float32BoxNode);
+        RRA_ASSERT(index < box_sub_tree_surface_area_heuristic_.size());
+        return box_sub_tree_surface_area_heuristic_[index];
+    }
+
+    void IEncodedRtIp11Bvh::SetInteriorNodeSubTreeSurfaceAreaHeuristic(const dxr::amd::NodePointer node_ptr, const SubTreeSurfaceAreaHeuristic& sub_tree)
+    {
+        LoadDeferredNodeData();
+        const uint32_t index = (node_ptr.GetByteOffset() - GetHeader().GetBufferOffsets().interior_nodes) / sizeof(dxr::amd::Float32BoxNode);
+        RRA_ASSERT(index < box_sub_tree_surface_area_heuristic_.size());
+        box_sub_tree_surface_area_heuristic_[index] = sub_tree;
+    }
+
+    bool IEncodedRtIp11Bvh::HasSubTreeSurfaceAreaHeuristic() const
+    {
+        LoadDeferredNodeData();
+        return sub_tree_surface_area_heuristic_complete_.load(std::memory_order_acquire);
+    }
+
+    void IEncodedRtIp11Bvh::SetSubTreeSurfaceAreaHeuristicComplete()
+    {
+        sub_tree_surface_area_heuristic_complete_.store(true, std::memory_order_release);
+    }
+
+    void IEncodedRtIp11Bvh::WriteDerivedData(rra::DerivedDataWriter& writer) const
+    {
+        RRA_ASSERT(HasDerivedData());
+        writer.Write(max_tree_depth_);
+        writer.Write(avg_tree_depth_);
+        writer.WriteArray(box_surface_area_heuristic_);
+        writer.Write(static_cast<std::uint8_t>(sub_tree_surface_area_heuristic_complete_.load(std::memory_order_acquire)));
+        writer.WriteArray(box_sub_tree_surface_area_heuristic_);
+    }
+
+    bool IEncodedRtIp11Bvh::ReadDerivedData(rra::DerivedDataReader& reader)
+    {
+        // The box SAH array is sized when the node data is loaded, so it tells if the cache matches this BVH.
+        const size_t       num_box_nodes = box_surface_area_heuristic_.size();
+        std::vector<float> box_surface_area_heuristic;
+
+        reader.Read(max_tree_depth_);
+        reader.Read(avg_tree_depth_);
+        if (!reader.ReadArray(box_surface_area_heuristic) || box_surface_area_heuristic.size() != num_box_nodes)
+        {
+            return false;
+        }
+
+        std::uint8_t                             sub_tree_complete = 0;
+        std::vector<SubTreeSurfaceAreaHeuristic> box_sub_tree_surface_area_heuristic;
+        reader.Read(sub_tree_complete);
+        if (!reader.ReadArray(box_sub_tree_surface_area_heuristic) || box_sub_tree_surface_area_heuristic.size() != num_box_nodes)
+        {
+            return false;
+        }
+
+        box_surface_area_heuristic_          = std::move(box_surface_area_heuristic);
+        box_sub_tree_surface_area_heuristic_ = std::move(box_sub_tree_surface_area_heuristic);
+        if (sub_tree_complete != 0)
+        {
+            SetSubTreeSurfaceAreaHeuristicComplete();
+        }
+        return true;
+    }
+
+    bool IEncodedRtIp11Bvh::HasDerivedData() const
+    {
+        return IsNodeDataLoaded() && !HasNodeDataError() && HasSurfaceAreaHeuristic();
+    }
+
+    bool IEncodedRtIp11Bvh::RestoreDerivedData(std::vector<std::uint8_t> data)
+    {
+        if (deferred_node_data_ != nullptr)
+        {
+            // Keep the data for the decode, which takes the same lock, so it can't be missed by a decode in progress.
+            std::lock_guard<std::recursive_mutex> lock(deferred_node_data_->mutex);
+            if (!node_data_loaded_.load(std::memory_order_acquire))
+            {
+                deferred_node_data_->derived_data = std::move(data);
+                return true;
+            }
+        }
+
+        if (HasNodeDataError())
+        {
+            return false;
+        }
+
+        rra::DerivedDataReader reader(data.data(), data.size());
+        if (!ReadDerivedData(reader) || reader.HasFailed())
+        {
+            return false;
+        }
+        derived_data_restored_.store(true, std::memory_order_release);
+        return true;
+    }
+
+    bool IEncodedRtIp11Bvh::HasRestoredDerivedData() const
+    {
+        return derived_data_restored_.load(std::memory_order_acquire);
+    }
+
     uint32_t IEncodedRtIp11Bvh::GetMaxTreeDepth() const
     {
+        LoadDeferredNodeData();
         return max_tree_depth_;
     }
 
     uint32_t IEncodedRtIp11Bvh::GetAvgTreeDepth() const
     {
+        LoadDeferredNodeData();
         return avg_tree_depth_;
     }
 
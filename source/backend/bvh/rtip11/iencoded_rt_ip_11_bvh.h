@@ -8,7 +8,15 @@
 #ifndef RRA_BACKEND_BVH_IENCODED_RT_IP_11_BVH_H_
 #define RRA_BACKEND_BVH_IENCODED_RT_IP_11_BVH_H_
 
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+
 #include "bvh/ibvh.h"
+#include "bvh/decoded_box_node_cache.h"
+#include "bvh/deferred_chunk_reader.h"
 
 #include "bvh/rtip11/irt_ip_11_acceleration_structure_header.h"
 #include "bvh/node_types/float16_box_node.h"
@@ -19,6 +27,8 @@
 #include "bvh/metadata_v1.h"
 #include "bvh/parent_block.h"
 
+#include "derived_data_cache.h"
+
 #include "rdf/rdf/inc/amdrdf.h"
 
 namespace rta
@@ -52,6 +62,15 @@ namespace rta
         RdfAccelStructHeaderFlags flags;  // Miscellaneous flags
     };
 
+    /// @brief The parts of a "RawAccelStruct" chunk that are needed to load the acceleration structure header.
+    ///
+    /// They are a small prefix of the chunk data, so keeping a copy lets the header be restored without reading the chunk.
+    struct RawAccelStructHeaderData
+    {
+        dxr::amd::MetaDataV1                                                 meta_data = {};  ///< The driver metadata header.
+        std::array<std::uint8_t, dxr::amd::kAccelerationStructureHeaderSize> header    = {};  ///< The raw AccelStructHeader.
+    };
+
     // 180 Bytes
     // Base of all RtIp 1.1 chunk headers based on the first header version.
     struct RtIp11ChunkHeaderBase
@@ -91,6 +110,21 @@ namespace rta
         kDefault    = kAll
     };
 
+    /// @brief A summary of the surface area heuristic values of a set of nodes.
+    struct SurfaceAreaHeuristicAggregate
+    {
+        float         min_sah    = std::numeric_limits<float>::infinity();  ///< The minimum value, ignoring NaNs.
+        float         total_sah  = 0.0f;                                    ///< The sum of the values, summed per sub tree.
+        std::uint32_t node_count = 0;                                       ///< The number of values.
+    };
+
+    /// @brief The surface area heuristic summaries for the sub tree below an interior node, including the node itself.
+    struct SubTreeSurfaceAreaHeuristic
+    {
+        SurfaceAreaHeuristicAggregate all_nodes      = {};  ///< Every node in the sub tree.
+        SurfaceAreaHeuristicAggregate triangle_nodes = {};  ///< Only the triangle nodes in the sub tree.
+    };
+
     /// @brief Base class for a ray-tracing IP 1.1-based BVH. This corresponds to Navi2x ray tracing.
     class IEncodedRtIp11Bvh : public IBvh
     {
@@ -149,6 +183,14 @@ namespace rta
         /// @return The interior nodes.
         std::vector<std::uint8_t>& GetInteriorNodesData();
 
+        /// @brief Get the decoded box node cache for this acceleration structure.
+        ///
+        /// Only built if the BVH was loaded with BvhBundleReadOption::kDecodedNodeCache. It is a copy of the
+        /// interior node data as loaded, so is out of date if that data is changed afterwards.
+        ///
+        /// @return The decoded box node cache, or nullptr if there is none.
+        const DecodedBoxNodeCache* GetDecodedNodeCache() const;
+
         /// @brief Is this acceleration structure compacted.
         ///
         /// @return true if compacted, false if not.
@@ -186,6 +228,77 @@ namespace rta
                                                const char* const                   chunk_identifier,
                                                const BvhBundleReadOption           import_option) = 0;
 
+        /// @brief Decode the BVH data from a buffer holding the raw chunk data.
+        ///
+        /// Does not touch the chunk file, so may be called concurrently for different BVHs.
+        ///
+        /// @param [in] buffer            The raw chunk data, as read from the chunk file.
+        /// @param [in] header            The raw acceleration structure header.
+        /// @param [in] import_option     Flag indicating which sections of the chunk to load/discard.
+        ///
+        /// @return true if the BVH data loaded successfully, false if not.
+        bool LoadRawAccelStrucFromBuffer(const std::vector<std::uint8_t>&    buffer,
+                                         const RawAccelStructRdfChunkHeader& header,
+                                         const BvhBundleReadOption           import_option);
+
+        /// @brief Decode the meta data, header and virtual address from a buffer holding the raw chunk data.
+        ///
+        /// @param [in] buffer            The raw chunk data, as read from the chunk file.
+        /// @param [in] header            The raw acceleration structure header.
+        /// @param [in] import_option     Flag indicating which sections of the chunk to load/discard.
+        ///
+        /// @return true if the header loaded successfully, false if not.
+        virtual bool LoadRawAccelStrucHeaderFromBuffer(const std::vector<std::uint8_t>&    buffer,
+                                                       const RawAccelStructRdfChunkHeader& header,
+                                                       const BvhBundleReadOption           import_option) = 0;
+
+        /// @brief Defer decoding of the node data until it is first needed.
+        ///
+        /// The header must already have been loaded with LoadRawAccelStrucHeaderFromBuffer().
+        ///
+        /// @param [in] reader            The reader used to fetch the chunk data.
+        /// @param [in] chunk_identifier  The BVH chunk name.
+        /// @param [in] chunk_index       The index of the chunk in the file.
+        /// @param [in] header            The raw acceleration structure header.
+        /// @param [in] import_option     Flag indicating which sections of the chunk to load/discard.
+        void SetDeferredNodeData(std::shared_ptr<DeferredChunkReader> reader,
+                                 const char* const                    chunk_identifier,
+                                 const std::int32_t                   chunk_index,
+                                 const RawAccelStructRdfChunkHeader&  header,
+                                 const BvhBundleReadOption            import_option);
+
+        /// @brief Set a function to be called once deferred node data has been decoded.
+        ///
+        /// The function is called on the thread doing the decode, before the node data is made visible to other
+        /// threads, so it can be used to derive data (eg the surface area heuristics) from the nodes.
+        ///
+        /// @param [in] callback The function to call.
+        void SetNodeDataLoadedCallback(std::function<void(IEncodedRtIp11Bvh&)> callback);
+
+        /// @brief Is the node data for this BVH resident.
+        ///
+        /// @return true if the node data has been decoded, false if decoding was deferred and hasn't happened yet.
+        bool IsNodeDataLoaded() const;
+
+        /// @brief Did the deferred node data fail to decode.
+        ///
+        /// A BVH whose node data failed to decode is left with no nodes, and reports itself as empty.
+        ///
+        /// @return true if the decode failed, false if it succeeded, or hasn't happened yet.
+        bool HasNodeDataError() const;
+
+        /// @brief Make sure the node data is resident, decoding it now if decoding was deferred.
+        ///
+        /// @return true if the node data is resident, false if it failed to decode.
+        bool LoadDeferredNodeData() const
+        {
+            if (!node_data_loaded_.load(std::memory_order_acquire))
+            {
+                LoadDeferredNodeDataImpl();
+            }
+            return !node_data_failed_.load(std::memory_order_acquire);
+        }
+
         /// @brief Replace all absolute references with relative references.
         ///
         /// This includes replacing absolute VA's with index values for quick lookup.
@@ -227,9 +340,23 @@ namespace rta
         ///
         /// @param [in] node_ptr The interior node whose SAH is to be found.
         ///
-        /// @return The surface area heuristic.
+        /// @return The surface area heuristic, or 0 if HasSurfaceAreaHeuristic() returns false.
         float GetInteriorNodeSurfaceAreaHeuristic(const dxr::amd::NodePointer node_ptr) const;
 
+        /// @brief Have the surface area heuristic values of the nodes been calculated.
+        ///
+        /// Only false while the values are being calculated in the background, when the SAH accessors return 0.
+        ///
+        /// @return true if the values are set, false if not.
+        bool HasSurfaceAreaHeuristic() const;
+
+        /// @brief Set whether the surface area heuristic values of the nodes have been calculated.
+        ///
+        /// Clear before calculating the values on a background thread, and set once they are all written, to publish them.
+        ///
+        /// @param [in] complete true if the values are all set, false if they are about to be calculated.
+        void SetSurfaceAreaHeuristicComplete(bool complete);
+
         /// @brief Get the maximum tree depth of this BVH.
         ///
         /// @return The maximum tree depth.
@@ -246,6 +373,68 @@ namespace rta
         /// @param [in] surface_area_heuristic The surface area heuristic value to be set.
         void SetInteriorNodeSurfaceAreaHeuristic(const dxr::amd::NodePointer node_ptr, float surface_area_heuristic);
 
+        /// @brief Get the surface area heuristic summary for the sub tree below a given interior node.
+        ///
+        /// Only valid once HasSubTreeSurfaceAreaHeuristic() returns true.
+        ///
+        /// @param [in] node_ptr The interior node whose sub tree summary is to be found.
+        ///
+        /// @return The sub tree summary.
+        const SubTreeSurfaceAreaHeuristic& GetInteriorNodeSubTreeSurfaceAreaHeuristic(const dxr::amd::NodePointer node_ptr) const;
+
+        /// @brief Set the surface area heuristic summary for the sub tree below a given interior node.
+        ///
+        /// @param [in] node_ptr The interior node whose sub tree summary is to be set.
+        /// @param [in] sub_tree The sub tree summary to be set.
+        void SetInteriorNodeSubTreeSurfaceAreaHeuristic(const dxr::amd::NodePointer node_ptr, const SubTreeSurfaceAreaHeuristic& sub_tree);
+
+        /// @brief Have the sub tree surface area heuristic summaries been calculated.
+        ///
+        /// @return true if the summaries are set for every interior node, false if not.
+        bool HasSubTreeSurfaceAreaHeuristic() const;
+
+        /// @brief Mark the sub tree surface area heuristic summaries as set for every interior node.
+        void SetSubTreeSurfaceAreaHeuristicComplete();
+
+        /// @brief Write the data derived from this BVH after loading to the derived data cache.
+        ///
+        /// This is the data calculated by PostLoad() and the surface area heuristic calculations.
+        ///
+        /// @param [in] writer The writer to serialize to.
+        virtual void WriteDerivedData(rra::DerivedDataWriter& writer) const;
+
+        /// @brief Restore the data written by WriteDerivedData().
+        ///
+        /// Used in place of PostLoad() and the surface area heuristic calculations. The node data must be resident.
+        ///
+        /// @param [in] reader The reader to deserialize from.
+        ///
+        /// @return true if the data was restored, false if it doesn't match this BVH.
+        virtual bool ReadDerivedData(rra::DerivedDataReader& reader);
+
+        /// @brief Is the data written by WriteDerivedData() complete.
+        ///
+        /// It isn't while the node data is still to be decoded, or while the surface area heuristics are calculated.
+        ///
+        /// @return true if the derived data can be written to the cache, false if not.
+        bool HasDerivedData() const;
+
+        /// @brief Restore the derived data of this BVH from the cache, without decoding its node data.
+        ///
+        /// If the node data is resident, the data is read straight away. If its decode was deferred, the data is kept
+        /// and read once the node data is decoded, in place of PostLoad() and the callback set with
+        /// SetNodeDataLoadedCallback(). If it doesn't match the decoded node data then, those run as usual.
+        ///
+        /// @param [in] data The data written by WriteDerivedData().
+        ///
+        /// @return true if the data was restored or kept, false if it doesn't match this BVH.
+        bool RestoreDerivedData(std::vector<std::uint8_t> data);
+
+        /// @brief Has the derived data of this BVH been restored from the cache.
+        ///
+        /// @return true if the data was read by RestoreDerivedData(), or once the deferred node data was decoded.
+        bool HasRestoredDerivedData() const;
+
         /// @brief Get the box32 node associated with the node pointer.
         ///
         /// Assumes that the node pointer passed in is a box32 node.
@@ -296,6 +485,31 @@ namespace rta
         const dxr::amd::NodePointer* GetPrimitiveNodePointer(int32_t index) const;
 
     protected:
+        /// @brief Decode the node data from a buffer holding the raw chunk data.
+        ///
+        /// The meta data and header must already have been loaded.
+        ///
+        /// @param [in] buffer            The raw chunk data, as read from the chunk file.
+        /// @param [in] header            The raw acceleration structure header.
+        /// @param [in] import_option     Flag indicating which sections of the chunk to load/discard.
+        ///
+        /// @return true if the node data loaded successfully, false if not.
+        virtual bool LoadRawAccelStrucNodeDataFromBuffer(const std::vector<std::uint8_t>&    buffer,
+                                                         const RawAccelStructRdfChunkHeader& header,
+                                                         const BvhBundleReadOption           import_option) = 0;
+
+        /// @brief Is node data decoding deferred and still outstanding.
+        ///
+        /// Returns false while the deferred decode is running, so PostLoad() can tell whether to do its work now.
+        ///
+        /// @return true if the node data is still to be decoded.
+        bool IsNodeDataPending() const;
+
+        /// @brief Release the node data, after the deferred node data failed to decode.
+        ///
+        /// Derived classes holding node data of their own release it too.
+        virtual void ClearNodeData();
+
         /// @brief Scan the tree to get the maximum and average tree depths.
         void ScanTreeDepth();
 
@@ -329,7 +543,40 @@ namespace rta
         uint32_t                                            avg_tree_depth_             = 0;   ///< The average depth of a triangle node in the BVH tree.
         uint64_t                                            gpu_virtual_address_        = 0;   ///< The GPU virtual address.
 
+        std::unique_ptr<DecodedBoxNodeCache> decoded_node_cache_ = nullptr;  ///< The decoded box nodes, if enabled.
+
+        std::vector<SubTreeSurfaceAreaHeuristic> box_sub_tree_surface_area_heuristic_ = {};         ///< Sub tree SAH summaries for the interior box nodes.
+        std::atomic<bool>                        sub_tree_surface_area_heuristic_complete_{false};  ///< Set once every sub tree SAH summary is set.
+        std::atomic<bool>                        surface_area_heuristic_complete_{true};            ///< Cleared while the node SAH values are calculated.
+
     private:
+        /// @brief The information needed to decode the node data after the BVH has been loaded.
+        struct DeferredNodeData
+        {
+            std::shared_ptr<DeferredChunkReader>    reader;                                            ///< The reader to fetch the chunk data with.
+            const char*                             chunk_identifier = nullptr;                        ///< The BVH chunk name.
+            std::int32_t                            chunk_index      = 0;                              ///< The index of the chunk in the file.
+            RawAccelStructRdfChunkHeader            header           = {};                             ///< The raw acceleration structure header.
+            BvhBundleReadOption                     import_option    = BvhBundleReadOption::kDefault;  ///< The import flags.
+            std::function<void(IEncodedRtIp11Bvh&)> on_loaded;     ///< Called once the data is decoded, unless the derived data is restored.
+            std::vector<std::uint8_t>               derived_data;  ///< Derived data from the cache, read once the data is decoded.
+            std::recursive_mutex                    mutex;    ///< Held while decoding. Recursive so on_loaded can use the accessors.
+            std::atomic<bool>                       loading{false};  ///< Set while the decode is in progress. Read without the lock.
+        };
+
+        /// @brief Decode the deferred node data.
+        void LoadDeferredNodeDataImpl() const;
+
+        /// @brief Build the decoded box node cache, if the read options ask for it.
+        ///
+        /// @param [in] import_option Flags to indicate how the BVH was read.
+        void BuildDecodedNodeCache(const BvhBundleReadOption import_option);
+
+        std::unique_ptr<DeferredNodeData> deferred_node_data_ = nullptr;  ///< Set if the node data decode was deferred.
+        mutable std::atomic<bool>         node_data_loaded_{true};         ///< Is the node data resident, or has its decode failed.
+        mutable std::atomic<bool>         node_data_failed_{false};        ///< Did the deferred node data fail to decode.
+        mutable std::atomic<bool>         derived_data_restored_{false};   ///< Was the derived data restored from the cache.
+
         /// @brief Is this acceleration structure compacted.
         ///
         /// @return true if compacted, false if not.
@@ -0,0 +1,619 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Implementation for the derived data cache.
+//=============================================================================
+
+#include "derived_data_cache.h"
+
+#include <filesystem>
+#include <fstream>
+
+#include "bvh/bvh_bundle.h"
+#include "bvh/ibvh.h"
+#include "bvh/rtip11/encoded_rt_ip_11_bottom_level_bvh.h"
+#include "bvh/rtip11/iencoded_rt_ip_11_bvh.h"
+#include "public/rra_assert.h"
+#include "public/rra_async_ray_history_loader.h"
+#include "trace_chunk_index.h"
+
+namespace rra
+{
+    /// The magic number at the start of a sidecar cache file.
+    static const char kDerivedDataCacheMagic[8] = {'R', 'R', 'A', 'C', 'A', 'C', 'H', 'E'};
+
+    /// The seed used for the chunk table hash and the cache checksum.
+    static constexpr std::uint64_t kHashSeed = 0xcbf29ce484222325ULL;
+
+    /// @brief The header at the start of a sidecar cache file.
+    struct DerivedDataCacheFileHeader
+    {
+        char                magic[8]           = {};  ///< Always kDerivedDataCacheMagic.
+        std::uint32_t       version            = 0;   ///< The sidecar format version.
+        std::uint32_t       reserved           = 0;   ///< Unused, keeps the key 8-byte aligned.
+        DerivedDataCacheKey key                = {};  ///< The trace the cache was built from.
+        std::uint64_t       header_data_size   = 0;   ///< The size of the BLAS header data that follows the header.
+        std::uint64_t       bvh_data_size      = 0;   ///< The size of the BVH data that follows the BLAS header data.
+        std::uint64_t       dispatch_data_size = 0;   ///< The size of the dispatch data that follows the BVH data.
+        std::uint64_t       checksum           = 0;   ///< The hash of the BLAS header, BVH and dispatch data.
+    };
+
+    /// @brief Hash a block of memory.
+    ///
+    /// Works on 8 bytes at a time, so hashing a buffer in blocks whose sizes are multiples of 8
+    /// gives the same result as hashing it in one go.
+    ///
+    /// @param [in] data The data to hash.
+    /// @param [in] size The size of the data, in bytes.
+    /// @param [in] hash The hash of the preceding data, or kHashSeed.
+    ///
+    /// @return The updated hash.
+    static std::uint64_t HashBytes(const void* data, size_t size, std::uint64_t hash)
+    {
+        constexpr std::uint64_t kPrime = 0x100000001b3ULL;
+
+        const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+
+        size_t i = 0;
+        for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t))
+        {
+            std::uint64_t word;
+            memcpy(&word, bytes + i, sizeof(word));
+            hash = (hash ^ word) * kPrime;
+            hash ^= hash >> 29;
+        }
+        for (; i < size; ++i)
+        {
+            hash = (hash ^ bytes[i]) * kPrime;
+        }
+        return hash;
+    }
+
+    /// @brief Get the path of the sidecar cache for a trace.
+    ///
+    /// @param [in] trace_path The path of the trace file.
+    ///
+    /// @return The sidecar path.
+    static std::string GetSidecarPath(const std::string& trace_path)
+    {
+        return trace_path + DerivedDataCache::kFileExtension;
+    }
+
+    /// @brief Get the size and last write time of a trace file.
+    ///
+    /// @param [in]  trace_path The path of the trace file.
+    /// @param [out] key        The key to receive the file size and last write time.
+    ///
+    /// @return true if successful, false if the file could not be queried.
+    static bool GetFileAttributes(const std::string& trace_path, DerivedDataCacheKey& key)
+    {
+        std::error_code error;
+
+        const auto file_size = std::filesystem::file_size(trace_path, error);
+        if (error)
+        {
+            return false;
+        }
+
+        const auto file_time = std::filesystem::last_write_time(trace_path, error);
+        if (error)
+        {
+            return false;
+        }
+
+        key.file_size  = static_cast<std::uint64_t>(file_size);
+        key.file_mtime = static_cast<std::int64_t>(file_time.time_since_epoch().count());
+        return true;
+    }
+
+    /// @brief Hash the chunk table of a trace.
+    ///
+    /// Covers the version, header and data size of every chunk the cache derives data from. Together
+    /// with the file size and last write time this identifies the trace without reading its chunk data.
+    ///
+    /// @param [in] chunk_index The chunk index of the trace.
+    ///
+    /// @return The chunk table hash.
+    static std::uint64_t HashChunkTable(const TraceChunkIndex& chunk_index)
+    {
+        static const char* const kKeyChunkIdentifiers[] = {
+            rta::IBvh::kAccelChunkIdentifier1,
+            rta::IBvh::kAccelChunkIdentifier2,
+            RRA_RAY_HISTORY_TOKENS_METADATA_IDENTIFIER,
+            RRA_RAY_HISTORY_RAW_TOKENS_IDENTIFIER,
+        };
+
+        std::uint64_t hash = kHashSeed;
+        for (const char* identifier : kKeyChunkIdentifiers)
+        {
+            const auto&         chunks      = chunk_index.GetChunks(identifier);
+            const std::uint64_t chunk_count = chunks.size();
+            hash                            = HashBytes(&chunk_count, sizeof(chunk_count), hash);
+            for (const TraceChunkInfo& chunk : chunks)
+            {
+                hash = HashBytes(&chunk.version, sizeof(chunk.version), hash);
+                hash = HashBytes(&chunk.header_size, sizeof(chunk.header_size), hash);
+                hash = HashBytes(&chunk.data_size, sizeof(chunk.data_size), hash);
+                hash = HashBytes(chunk.header.data(), chunk.header.size(), hash);
+            }
+        }
+        return hash;
+    }
+
+    /// @brief Serialize the per-coordinate data of one ray history dispatch.
+    ///
+    /// @param [in]  dispatch_data The dispatch data.
+    /// @param [out] writer        The writer to serialize to.
+    static void WriteDispatchCoordinates(const RayDispatchData& dispatch_data, DerivedDataWriter& writer)
+    {
+        writer.Write(dispatch_data.dispatch_width);
+        writer.Write(dispatch_data.dispatch_height);
+        writer.WriteArray(dispatch_data.coordinate_offsets);
+        writer.WriteArray(dispatch_data.begin_identifiers);
+        writer.WriteArray(dispatch_data.coordinate_stats);
+        writer.WriteArray(dispatch_data.ray_results);
+        writer.WriteArray(dispatch_data.ray_parents);
+        writer.WriteArray(dispatch_data.ray_child_offsets);
+        writer.WriteArray(dispatch_data.ray_children);
+    }
+
+    /// @brief Deserialize the derived data of one ray history dispatch.
+    ///
+    /// @param [in]  reader The reader to deserialize from.
+    /// @param [out] data   The dispatch data.
+    ///
+    /// @return true if successful, false if the data is malformed.
+    static bool ReadDispatchData(DerivedDataReader& reader, CachedDispatchData& data)
+    {
+        reader.Read(data.dim_x);
+        reader.Read(data.dim_y);
+        reader.Read(data.dim_z);
+        reader.Read(data.total_ray_count);
+        reader.Read(data.stats);
+
+        RayDispatchData& dispatch_data = data.dispatch_data;
+        reader.Read(dispatch_data.dispatch_width);
+        reader.Read(dispatch_data.dispatch_height);
+        reader.ReadArray(dispatch_data.coordinate_offsets);
+        reader.ReadArray(dispatch_data.begin_identifiers);
+        reader.ReadArray(dispatch_data.coordinate_stats);
+        reader.ReadArray(dispatch_data.ray_results);
+        reader.ReadArray(dispatch_data.ray_parents);
+        reader.ReadArray(dispatch_data.ray_child_offsets);
+        reader.ReadArray(dispatch_data.ray_children);
+
+        // The loader indexes the coordinate data by dispatch coordinate, so it must cover the whole dispatch.
+        const std::uint64_t coordinate_count = static_cast<std::uint64_t>(data.dim_x) * data.dim_y * data.dim_z;
+        if (reader.HasFailed() || coordinate_count != dispatch_data.coordinate_stats.size())
+        {
+            return false;
+        }
+
+        const auto& offsets = dispatch_data.coordinate_offsets;
+        if ( offsets.size() != dispatch_data.coordinate_stats.size() + 1 || offsets.front() != 0 ||
+            offsets.back() != dispatch_data.begin_identifiers.size() || dispatch_data.ray_results.size() != dispatch_data.begin_identifiers.size())
+        {
+            return false;
+        }
+
+        const auto& child_offsets = dispatch_data.ray_child_offsets;
+        if (dispatch_data.ray_parents.size() != dispatch_data.begin_identifiers.size() || child_offsets.size() != dispatch_data.begin_identifiers.size() + 1 ||
+            child_offsets.front() != 0 || child_offsets.back() != dispatch_data.ray_children.size())
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i + 1 < child_offsets.size(); ++i)
+        {
+            if (child_offsets[i] > child_offsets[i + 1])
+            {
+                return false;
+            }
+        }
+
+        for (size_t i = 0; i + 1 < offsets.size(); ++i)
+        {
+            if (offsets[i] > offsets[i + 1])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    const std::vector<std::uint8_t>& DerivedDataWriter::GetBuffer() const
+    {
+        return buffer_;
+    }
+
+    void DerivedDataWriter::Append(const void* data, size_t size)
+    {
+        const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+        buffer_.insert(buffer_.end(), bytes, bytes + size);
+    }
+
+    void DerivedDataWriter::Align()
+    {
+        buffer_.resize((buffer_.size() + 7) & ~static_cast<size_t>(7), 0);
+    }
+
+    DerivedDataReader::DerivedDataReader(const std::uint8_t* data, size_t size)
+        : data_(data)
+        , size_(size)
+    {
+    }
+
+    bool DerivedDataReader::HasFailed() const
+    {
+        return failed_;
+    }
+
+    bool DerivedDataReader::Consume(void* data, size_t size)
+    {
+        if (failed_ || size > size_ - offset_)
+        {
+            failed_ = true;
+            return false;
+        }
+        if (size > 0)
+        {
+            memcpy(data, data_ + offset_, size);
+        }
+        offset_ += size;
+        return true;
+    }
+
+    bool DerivedDataReader::Align()
+    {
+        const size_t aligned = (offset_ + 7) & ~static_cast<size_t>(7);
+        if (failed_ || aligned > size_)
+        {
+            failed_ = true;
+            return false;
+        }
+        offset_ = aligned;
+        return true;
+    }
+
+    DerivedDataCache::DerivedDataCache()
+    {
+    }
+
+    DerivedDataCache::~DerivedDataCache()
+    {
+    }
+
+    bool DerivedDataCache::GetKey(const char* trace_path, const TraceChunkIndex& chunk_index, DerivedDataCacheKey& key)
+    {
+        if (trace_path == nullptr || !GetFileAttributes(trace_path, key))
+        {
+            return false;
+        }
+        key.chunk_table_hash = HashChunkTable(chunk_index);
+        return true;
+    }
+
+    bool DerivedDataCache::Load(const char* trace_path, const DerivedDataCacheKey& key)
+    {
+        loaded_ = false;
+        blas_header_data_.clear();
+        bvh_data_.clear();
+        dispatch_data_.clear();
+
+        if (trace_path == nullptr)
+        {
+            return false;
+        }
+
+        std::ifstream file(GetSidecarPath(trace_path), std::ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+
+        DerivedDataCacheFileHeader header = {};
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        {
+            return false;
+        }
+        if (memcmp(header.magic, kDerivedDataCacheMagic, sizeof(header.magic)) != 0 || header.version != kVersion ||
+            header.key.file_size != key.file_size || header.key.file_mtime != key.file_mtime || header.key.chunk_table_hash != key.chunk_table_hash)
+        {
+            return false;
+        }
+
+        std::vector<std::uint8_t> header_data;
+        std::vector<std::uint8_t> dispatch_data;
+        try
+        {
+            header_data.resize(header.header_data_size);
+            bvh_data_.resize(header.bvh_data_size);
+            dispatch_data.resize(header.dispatch_data_size);
+        }
+        catch (...)
+        {
+            bvh_data_.clear();
+            return false;
+        }
+
+        file.read(reinterpret_cast<char*>(header_data.data()), header_data.size());
+        file.read(reinterpret_cast<char*>(bvh_data_.data()), bvh_data_.size());
+        file.read(reinterpret_cast<char*>(dispatch_data.data()), dispatch_data.size());
+        if (!file)
+        {
+            bvh_data_.clear();
+            return false;
+        }
+
+        std::uint64_t checksum = HashBytes(header_data.data(), header_data.size(), kHashSeed);
+        checksum               = HashBytes(bvh_data_.data(), bvh_data_.size(), checksum);
+        checksum               = HashBytes(dispatch_data.data(), dispatch_data.size(), checksum);
+        if (checksum != header.checksum)
+        {
+            bvh_data_.clear();
+            return false;
+        }
+
+        DerivedDataReader header_reader(header_data.data(), header_data.size());
+        if (!header_reader.ReadArray(blas_header_data_))
+        {
+            bvh_data_.clear();
+            return false;
+        }
+
+        DerivedDataReader reader(dispatch_data.data(), dispatch_data.size());
+
+        std::uint64_t dispatch_count = 0;
+        reader.Read(dispatch_count);
+        for (std::uint64_t i = 0; i < dispatch_count && !reader.HasFailed(); ++i)
+        {
+            std::uint64_t present = 0;
+            reader.Read(present);
+
+            std::shared_ptr<CachedDispatchData> data = nullptr;
+            if (present != 0)
+            {
+                data = std::make_shared<CachedDispatchData>();
+                if (!ReadDispatchData(reader, *data))
+                {
+                    data = nullptr;
+                    break;
+                }
+            }
+            dispatch_data_.push_back(std::move(data));
+        }
+
+        if (reader.HasFailed() || dispatch_data_.size() != dispatch_count)
+        {
+            blas_header_data_.clear();
+            bvh_data_.clear();
+            dispatch_data_.clear();
+            return false;
+        }
+
+        loaded_ = true;
+        return true;
+    }
+
+    bool DerivedDataCache::IsLoaded() const
+    {
+        return loaded_;
+    }
+
+    bool DerivedDataCache::RestoreBvhBundle(rta::BvhBundle& bundle) const
+    {
+        if (!loaded_)
+        {
+            return false;
+        }
+
+        const auto& top_level_bvhs    = bundle.GetTopLevelBvhs();
+        const auto& bottom_level_bvhs = bundle.GetBottomLevelBvhs();
+
+        DerivedDataReader reader(bvh_data_.data(), bvh_data_.size());
+
+        std::uint64_t tlas_count = 0;
+        std::uint64_t blas_count = 0;
+        reader.Read(tlas_count);
+        reader.Read(blas_count);
+        if (reader.HasFailed() || tlas_count != top_level_bvhs.size() || blas_count != bottom_level_bvhs.size())
+        {
+            return false;
+        }
+
+        // Each BVH's data is its own array, so a BVH that wasn't written, or doesn't match, doesn't stop the others.
+        bool restored = true;
+        for (const auto* bvhs : {&top_level_bvhs, &bottom_level_bvhs})
+        {
+            for (const auto& bvh : *bvhs)
+            {
+                auto*                     encoded_bvh = dynamic_cast<rta::IEncodedRtIp11Bvh*>(bvh.get());
+                std::vector<std::uint8_t> bvh_data;
+                if (encoded_bvh == nullptr || !reader.ReadArray(bvh_data))
+                {
+                    return false;
+                }
+                if (bvh_data.empty() || !encoded_bvh->RestoreDerivedData(std::move(bvh_data)))
+                {
+                    restored = false;
+                }
+            }
+        }
+
+        return restored && !reader.HasFailed();
+    }
+
+    const std::vector<rta::RawAccelStructHeaderData>* DerivedDataCache::GetBlasHeaderData() const
+    {
+        return loaded_ ? &blas_header_data_ : nullptr;
+    }
+
+    std::shared_ptr<CachedDispatchData> DerivedDataCache::TakeDispatchData(std::int64_t dispatch_index)
+    {
+        if (!loaded_ || dispatch_index < 0 || static_cast<size_t>(dispatch_index) >= dispatch_data_.size())
+        {
+            return nullptr;
+        }
+        return std::move(dispatch_data_[dispatch_index]);
+    }
+
+    RraErrorCode DerivedDataCache::Write(const std::string&                                            trace_path,
+                                         const DerivedDataCacheKey&                                    key,
+                                         const rta::BvhBundle&                                         bundle,
+                                         const std::vector<std::shared_ptr<RraAsyncRayHistoryLoader>>& loaders)
+    {
+        DerivedDataCacheFileHeader header = {};
+        memcpy(header.magic, kDerivedDataCacheMagic, sizeof(header.magic));
+        header.version = kVersion;
+        header.key     = key;
+
+        // Don't tag data derived from the old trace with the attributes of a trace that was replaced during the load.
+        DerivedDataCacheKey current_key = {};
+        if (!GetFileAttributes(trace_path, current_key) || current_key.file_size != key.file_size || current_key.file_mtime != key.file_mtime)
+        {
+            return kRraErrorFileNotOpen;
+        }
+
+        // The first BLAS is the empty placeholder, which doesn't come from a chunk.
+        const auto&                                encoded_blases = bundle.GetEncodedBottomLevelBvhs();
+        std::vector<rta::RawAccelStructHeaderData> blas_header_data;
+        for (size_t blas_index = bundle.ContainsEmptyPlaceholder() ? 1 : 0; blas_index < encoded_blases.size(); ++blas_index)
+        {
+            if (encoded_blases[blas_index] == nullptr)
+            {
+                return kRraErrorInvalidPointer;
+            }
+            blas_header_data.push_back(encoded_blases[blas_index]->GetRawHeaderData());
+        }
+
+        DerivedDataWriter header_writer;
+        header_writer.WriteArray(blas_header_data);
+
+        DerivedDataWriter dispatch_writer;
+        dispatch_writer.Write(static_cast<std::uint64_t>(loaders.size()));
+        for (const auto& loader : loaders)
+        {
+            // Waits for the loader to finish.
+            const RayDispatchData& dispatch_data = loader->GetDispatchData();
+
+            // A cancelled load means the trace is being unloaded, and its dispatches would be missing from the cache.
+            if (loader->IsCancelled())
+            {
+                return kRraErrorCancelled;
+            }
+
+            const std::uint64_t present = loader->HasErrors() ? 0 : 1;
+            dispatch_writer.Write(present);
+            if (present != 0)
+            {
+                const rta::DispatchSize dispatch_size = loader->GetDerivedDispatchSize();
+                dispatch_writer.Write(dispatch_size.width);
+                dispatch_writer.Write(dispatch_size.height);
+                dispatch_writer.Write(dispatch_size.depth);
+                dispatch_writer.Write(static_cast<std::uint64_t>(loader->GetTotalRayCount()));
+                dispatch_writer.Write(loader->GetStats());
+                WriteDispatchCoordinates(dispatch_data, dispatch_writer);
+            }
+        }
+
+        // Let the background BLAS decode, if one was started, finish, so the TLAS surface area heuristics are done too. A
+        // BVH whose node data hasn't been decoded, because the decode was stopped, or whose surface area heuristics are
+        // still being calculated, is written as an empty array and is derived again on the next load. Nothing here
+        // decodes a BLAS.
+        bundle.WaitForDeferredBlasDecode();
+
+        const auto& top_level_bvhs    = bundle.GetTopLevelBvhs();
+        const auto& bottom_level_bvhs = bundle.GetBottomLevelBvhs();
+
+        DerivedDataWriter bvh_writer;
+        bvh_writer.Write(static_cast<std::uint64_t>(top_level_bvhs.size()));
+        bvh_writer.Write(static_cast<std::uint64_t>(bottom_level_bvhs.size()));
+        for (const auto* bvhs : {&top_level_bvhs, &bottom_level_bvhs})
+        {
+            for (const auto& bvh : *bvhs)
+            {
+                const auto* encoded_bvh = dynamic_cast<const rta::IEncodedRtIp11Bvh*>(bvh.get());
+                if (encoded_bvh == nullptr)
+                {
+                    return kRraErrorInvalidPointer;
+                }
+
+                DerivedDataWriter encoded_bvh_writer;
+                if (encoded_bvh->HasDerivedData())
+                {
+                    encoded_bvh->WriteDerivedData(encoded_bvh_writer);
+                }
+                bvh_writer.WriteArray(encoded_bvh_writer.GetBuffer());
+            }
+        }
+
+        const auto& header_data   = header_writer.GetBuffer();
+        const auto& bvh_data      = bvh_writer.GetBuffer();
+        const auto& dispatch_data = dispatch_writer.GetBuffer();
+
+        header.header_data_size   = header_data.size();
+        header.bvh_data_size      = bvh_data.size();
+        header.dispatch_data_size = dispatch_data.size();
+        header.checksum           = HashBytes(header_data.data(), header_data.size(), kHashSeed);
+        header.checksum           = HashBytes(bvh_data.data(), bvh_data.size(), header.checksum);
+        header.checksum           = HashBytes(dispatch_data.data(), dispatch_data.size(), header.checksum);
+
+        // Write to a temporary file first, so a partially written cache is never picked up.
+        const std::string sidecar_path   = GetSidecarPath(trace_path);
+        const std::string temporary_path = sidecar_path + ".tmp";
+        {
+            std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(header_data.data()), header_data.size());
+            file.write(reinterpret_cast<const char*>(bvh_data.data()), bvh_data.size());
+            file.write(reinterpret_cast<const char*>(dispatch_data.data()), dispatch_data.size());
+            if (!file)
+            {
+                file.close();
+                std::error_code error;
+                std::filesystem::remove(temporary_path, error);
+                return kRraErrorFileNotOpen;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporary_path, sidecar_path, error);
+        if (error)
+        {
+            std::filesystem::remove(temporary_path, error);
+            return kRraErrorPlatformFunctionFailed;
+        }
+
+#ifdef _DEBUG
+        // Check the round trip. The cache must load back, and serializing what was loaded must give the same bytes.
+        DerivedDataCache debug_cache;
+        RRA_ASSERT(debug_cache.Load(trace_path.c_str(), key));
+        RRA_ASSERT(debug_cache.bvh_data_ == bvh_data);
+
+        DerivedDataWriter debug_header_writer;
+        debug_header_writer.WriteArray(debug_cache.blas_header_data_);
+        RRA_ASSERT(debug_header_writer.GetBuffer() == header_data);
+
+        DerivedDataWriter debug_dispatch_writer;
+        debug_dispatch_writer.Write(static_cast<std::uint64_t>(debug_cache.dispatch_data_.size()));
+        for (const auto& data : debug_cache.dispatch_data_)
+        {
+            debug_dispatch_writer.Write(static_cast<std::uint64_t>(data != nullptr ? 1 : 0));
+            if (data != nullptr)
+            {
+                debug_dispatch_writer.Write(data->dim_x);
+                debug_dispatch_writer.Write(data->dim_y);
+                debug_dispatch_writer.Write(data->dim_z);
+                debug_dispatch_writer.Write(data->total_ray_count);
+                debug_dispatch_writer.Write(data->stats);
+                WriteDispatchCoordinates(data->dispatch_data, debug_dispatch_writer);
+            }
+        }
+        RRA_ASSERT(debug_dispatch_writer.GetBuffer() == dispatch_data);
+#endif  // _DEBUG
+
+        return kRraOk;
+    }
+}  // namespace rra
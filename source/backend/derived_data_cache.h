@@ -0,0 +1,263 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Definition for the derived data cache.
+///
+/// The derived data cache is a sidecar file stored next to a trace. It holds
+/// the data the backend derives from the trace after loading it (tree depths,
+/// surface area heuristics, TLAS instance lists and the indexed ray history
+/// dispatch data), so reopening an unchanged trace can skip that work. It also
+/// holds a copy of the header data of each BLAS, so the BLAS headers can be
+/// loaded without reading the BLAS chunks when BLAS decoding is deferred.
+//=============================================================================
+
+#ifndef RRA_BACKEND_DERIVED_DATA_CACHE_H_
+#define RRA_BACKEND_DERIVED_DATA_CACHE_H_
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "public/rra_error.h"
+#include "public/rra_ray_history.h"
+
+class RraAsyncRayHistoryLoader;
+
+namespace rta
+{
+    class BvhBundle;
+    struct RawAccelStructHeaderData;
+}  // namespace rta
+
+namespace rra
+{
+    class TraceChunkIndex;
+
+    /// @brief Serializes derived data into a flat byte buffer.
+    ///
+    /// Arrays are prefixed with their element count and start on an 8-byte boundary, so the
+    /// buffer can be used in place once read back or mapped.
+    class DerivedDataWriter
+    {
+    public:
+        /// @brief Write a single value.
+        ///
+        /// @param [in] value The value to write.
+        template <typename T>
+        void Write(const T& value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be written");
+            Append(&value, sizeof(T));
+        }
+
+        /// @brief Write an array of values.
+        ///
+        /// @param [in] values The values to write.
+        template <typename T>
+        void WriteArray(const std::vector<T>& values)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be written");
+            Write(static_cast<std::uint64_t>(values.size()));
+            Align();
+            Append(values.data(), values.size() * sizeof(T));
+            Align();
+        }
+
+        /// @brief Get the serialized data.
+        ///
+        /// @return The buffer holding the serialized data.
+        const std::vector<std::uint8_t>& GetBuffer() const;
+
+    private:
+        /// @brief Append raw bytes to the buffer.
+        ///
+        /// @param [in] data The data to append.
+        /// @param [in] size The size of the data, in bytes.
+        void Append(const void* data, size_t size);
+
+        /// @brief Pad the buffer to the next 8-byte boundary.
+        void Align();
+
+        std::vector<std::uint8_t> buffer_;  ///< The serialized data.
+    };
+
+    /// @brief Reads derived data written by a DerivedDataWriter.
+    ///
+    /// Every read is bounds checked. Once a read fails all further reads fail too.
+    class DerivedDataReader
+    {
+    public:
+        /// @brief Constructor.
+        ///
+        /// @param [in] data The serialized data.
+        /// @param [in] size The size of the serialized data, in bytes.
+        DerivedDataReader(const std::uint8_t* data, size_t size);
+
+        /// @brief Read a single value.
+        ///
+        /// @param [out] value The value read.
+        ///
+        /// @return true if the value was read, false if the data is exhausted.
+        template <typename T>
+        bool Read(T& value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be read");
+            return Consume(&value, sizeof(T));
+        }
+
+        /// @brief Read an array of values.
+        ///
+        /// @param [out] values The values read.
+        ///
+        /// @return true if the array was read, false if the data is exhausted.
+        template <typename T>
+        bool ReadArray(std::vector<T>& values)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be read");
+            std::uint64_t count = 0;
+            if (!Read(count) || !Align() || count > (size_ - offset_) / sizeof(T))
+            {
+                failed_ = true;
+                return false;
+            }
+            values.resize(count);
+            return Consume(values.data(), count * sizeof(T)) && Align();
+        }
+
+        /// @brief Has any read failed.
+        ///
+        /// @return true if a read failed, false otherwise.
+        bool HasFailed() const;
+
+    private:
+        /// @brief Copy raw bytes out of the buffer.
+        ///
+        /// @param [out] data The destination.
+        /// @param [in]  size The number of bytes to copy.
+        ///
+        /// @return true if the bytes were available, false otherwise.
+        bool Consume(void* data, size_t size);
+
+        /// @brief Skip to the next 8-byte boundary.
+        ///
+        /// @return true if successful, false if the data is exhausted.
+        bool Align();
+
+        const std::uint8_t* data_   = nullptr;  ///< The serialized data.
+        size_t              size_   = 0;        ///< The size of the serialized data.
+        size_t              offset_ = 0;        ///< The current read offset.
+        bool                failed_ = false;    ///< Set once a read has failed.
+    };
+
+    /// @brief The ray history data derived from a single dispatch.
+    struct CachedDispatchData
+    {
+        std::uint32_t      dim_x           = 0;   ///< The dispatch dimension x.
+        std::uint32_t      dim_y           = 0;   ///< The dispatch dimension y.
+        std::uint32_t      dim_z           = 0;   ///< The dispatch dimension z.
+        std::uint64_t      total_ray_count = 0;   ///< The number of rays in the dispatch.
+        RraRayHistoryStats stats           = {};  ///< The dispatch stats.
+        RayDispatchData    dispatch_data   = {};  ///< The indexed dispatch data.
+    };
+
+    /// @brief Identifies the trace a sidecar cache was built from.
+    struct DerivedDataCacheKey
+    {
+        std::uint64_t file_size        = 0;  ///< The size of the trace file, in bytes.
+        std::int64_t  file_mtime       = 0;  ///< The last write time of the trace file.
+        std::uint64_t chunk_table_hash = 0;  ///< A hash of the versions, headers and sizes of the chunks the data is derived from.
+    };
+
+    class DerivedDataCache
+    {
+    public:
+        static constexpr std::uint32_t kVersion       = 9;         ///< The sidecar format version. Bump when the layout changes.
+        static constexpr const char*   kFileExtension = ".cache";  ///< Appended to the trace file name to form the sidecar name.
+
+        /// @brief Constructor.
+        DerivedDataCache();
+
+        /// @brief Destructor.
+        ~DerivedDataCache();
+
+        /// @brief Get the key identifying a trace.
+        ///
+        /// Only the file attributes and the chunk table are used, so the trace data isn't read.
+        ///
+        /// @param [in]  trace_path  The path of the trace file.
+        /// @param [in]  chunk_index The chunk index of the trace.
+        /// @param [out] key         The key.
+        ///
+        /// @return true if successful, false if the file could not be queried.
+        static bool GetKey(const char* trace_path, const TraceChunkIndex& chunk_index, DerivedDataCacheKey& key);
+
+        /// @brief Load the sidecar cache for a trace.
+        ///
+        /// The cache is only accepted if its version, the key, and the checksum of the cached data all match.
+        ///
+        /// @param [in] trace_path The path of the trace file.
+        /// @param [in] key        The key of the trace, from GetKey().
+        ///
+        /// @return true if a valid cache was loaded, false if not.
+        bool Load(const char* trace_path, const DerivedDataCacheKey& key);
+
+        /// @brief Has a valid cache been loaded.
+        ///
+        /// @return true if a cache is loaded, false otherwise.
+        bool IsLoaded() const;
+
+        /// @brief Restore the derived BVH data into a bundle.
+        ///
+        /// The bundle must have been loaded with BvhBundleReadOption::kDeferPostLoad. The data of a BLAS whose node data
+        /// decode was deferred is kept by the BLAS until it is decoded, so restoring doesn't decode any BLAS. If this
+        /// fails, the bundle may be partially restored and the caller must run the post-load step itself. The post-load
+        /// step and the surface area heuristic calculations skip the BVHs that were restored.
+        ///
+        /// @param [in] bundle The bundle to restore.
+        ///
+        /// @return true if every BVH in the bundle was restored, false otherwise.
+        bool RestoreBvhBundle(rta::BvhBundle& bundle) const;
+
+        /// @brief Get the cached copies of the header data of the BLAS chunks.
+        ///
+        /// @return The header data, in chunk order, or nullptr if no cache is loaded.
+        const std::vector<rta::RawAccelStructHeaderData>* GetBlasHeaderData() const;
+
+        /// @brief Take the cached data for a dispatch.
+        ///
+        /// @param [in] dispatch_index The dispatch index.
+        ///
+        /// @return The cached dispatch data, or nullptr if there is none. Each dispatch can only be taken once.
+        std::shared_ptr<CachedDispatchData> TakeDispatchData(std::int64_t dispatch_index);
+
+        /// @brief Write the sidecar cache for a trace.
+        ///
+        /// Waits for the ray history loaders, and the background BLAS decode if one was started, to finish. Dispatches that
+        /// failed to load are left out of the cache, and nothing is written if any load was cancelled. BLASes aren't
+        /// decoded to write them. Only the BVHs whose derived data is complete are written, and the others, such as the
+        /// BLASes the background decode was stopped before reaching, are derived again on the next load.
+        ///
+        /// @param [in] trace_path The path of the trace file.
+        /// @param [in] key        The key of the trace, from GetKey() when the trace was loaded.
+        /// @param [in] bundle     The loaded BVH bundle, including its surface area heuristics.
+        /// @param [in] loaders    The ray history loaders, one per dispatch.
+        ///
+        /// @return kRraOk if successful, error code if not.
+        static RraErrorCode Write(const std::string&                                            trace_path,
+                                  const DerivedDataCacheKey&                                    key,
+                                  const rta::BvhBundle&                                         bundle,
+                                  const std::vector<std::shared_ptr<RraAsyncRayHistoryLoader>>& loaders);
+
+    private:
+        std::vector<rta::RawAccelStructHeaderData>       blas_header_data_;  ///< The header data of the BLAS chunks.
+        std::vector<std::uint8_t>                        bvh_data_;          ///< The serialized BVH data.
+        std::vector<std::shared_ptr<CachedDispatchData>> dispatch_data_;     ///< The cached dispatch data, indexed by dispatch.
+        bool                                             loaded_ = false;    ///< Has a valid cache been loaded.
+    };
+}  // namespace rra
+
+#endif  // RRA_BACKEND_DERIVED_DATA_CACHE_H_
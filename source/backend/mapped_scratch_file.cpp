@@ -0,0 +1,158 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Implementation for the mapped scratch file.
+//=============================================================================
+
+#include "mapped_scratch_file.h"
+
+#include <algorithm>
+#include <string>
+
+#include "public/rra_macro.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace rra
+{
+    std::unique_ptr<MappedScratchFile> MappedScratchFile::Create(std::uint64_t size)
+    {
+        if (size == 0)
+        {
+            return nullptr;
+        }
+
+        std::unique_ptr<MappedScratchFile> scratch_file(new MappedScratchFile());
+
+#ifdef _WIN32
+        char temp_path[MAX_PATH + 1] = {};
+        char file_name[MAX_PATH + 1] = {};
+        if (GetTempPathA(sizeof(temp_path), temp_path) == 0 || GetTempFileNameA(temp_path, "rra", 0, file_name) == 0)
+        {
+            return nullptr;
+        }
+
+        // Temporary files are kept in the file cache when memory allows, and deleted once the last handle closes.
+        HANDLE file = CreateFileA(file_name,
+                                  GENERIC_READ | GENERIC_WRITE,
+                                  0,
+                                  nullptr,
+                                  CREATE_ALWAYS,
+                                  FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                                  nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            DeleteFileA(file_name);
+            return nullptr;
+        }
+        scratch_file->file_ = file;
+
+        // Creating the mapping extends the file to its full size, which fails if the disk is full.
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+        if (mapping == nullptr)
+        {
+            return nullptr;
+        }
+        scratch_file->mapping_ = mapping;
+
+        void* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<SIZE_T>(size));
+        if (data == nullptr)
+        {
+            return nullptr;
+        }
+#else
+        // /tmp is often a tmpfs, which is held in RAM and swap, so the default is /var/tmp, which is kept on disk.
+        const char* temp_dir  = getenv("TMPDIR");
+        std::string file_name = std::string((temp_dir != nullptr && temp_dir[0] != '\0') ? temp_dir : "/var/tmp") + "/rra_scratch_XXXXXX";
+
+        int file = mkstemp(&file_name[0]);
+        if (file < 0)
+        {
+            return nullptr;
+        }
+
+        // Unlink right away, so the file goes away with the last reference even if the process dies.
+        unlink(file_name.c_str());
+
+        // Reserve the blocks up front rather than leave the file sparse. A sparse file on a full file system, such as
+        // a tmpfs out of memory, only fails when a page is first written, which raises SIGBUS instead of returning an error.
+        if (posix_fallocate(file, 0, static_cast<off_t>(size)) != 0)
+        {
+            close(file);
+            return nullptr;
+        }
+
+        void* data = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        close(file);
+        if (data == MAP_FAILED)
+        {
+            return nullptr;
+        }
+#endif
+
+        scratch_file->data_ = static_cast<std::byte*>(data);
+        scratch_file->size_ = size;
+        return scratch_file;
+    }
+
+    MappedScratchFile::~MappedScratchFile()
+    {
+#ifdef _WIN32
+        if (data_ != nullptr)
+        {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_ != nullptr)
+        {
+            CloseHandle(mapping_);
+        }
+        if (file_ != nullptr)
+        {
+            CloseHandle(file_);
+        }
+#else
+        if (data_ != nullptr)
+        {
+            munmap(data_, static_cast<size_t>(size_));
+        }
+#endif
+    }
+
+    std::byte* MappedScratchFile::GetData() const
+    {
+        return data_;
+    }
+
+    std::uint64_t MappedScratchFile::GetSize() const
+    {
+        return size_;
+    }
+
+    void MappedScratchFile::Release(std::uint64_t offset, std::uint64_t size)
+    {
+#ifdef _WIN32
+        // Windows has no way to drop part of a mapped file's backing store. The temporary file attribute still
+        // lets the OS write the pages out rather than keep them in memory.
+        RRA_UNUSED(offset);
+        RRA_UNUSED(size);
+#else
+        static const std::uint64_t page_size = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+
+        const std::uint64_t first_page = (offset + page_size - 1) / page_size * page_size;
+        const std::uint64_t last_page  = std::min(offset + size, size_) / page_size * page_size;
+        if (first_page < last_page)
+        {
+            madvise(data_ + first_page, static_cast<size_t>(last_page - first_page), MADV_REMOVE);
+        }
+#endif
+    }
+}  // namespace rra
@@ -0,0 +1,76 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Definition for the mapped scratch file.
+///
+/// A scratch file is a temporary file mapped into memory, used to hold data
+/// too big to keep in RAM. The OS pages the data in and out as it is used.
+/// The file is deleted when the mapping is destroyed, or when the process
+/// exits.
+//=============================================================================
+
+#ifndef RRA_BACKEND_MAPPED_SCRATCH_FILE_H_
+#define RRA_BACKEND_MAPPED_SCRATCH_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace rra
+{
+    class MappedScratchFile
+    {
+    public:
+        /// @brief Create a scratch file in the temporary directory and map it.
+        ///
+        /// On Linux the file is made in TMPDIR, or /var/tmp if TMPDIR isn't set. /tmp is avoided since it is often a
+        /// tmpfs, whose pages are RAM and swap rather than disk, and a TMPDIR on a tmpfs has the same problem.
+        ///
+        /// The space for the whole file is reserved when it is created, so writing to the mapping can't fail later
+        /// for lack of space. Callers should keep the data on the heap if this fails.
+        ///
+        /// @param [in] size The size of the file, in bytes.
+        ///
+        /// @return The mapped file, or nullptr if it couldn't be created, given its space, or mapped.
+        static std::unique_ptr<MappedScratchFile> Create(std::uint64_t size);
+
+        /// @brief Destructor. Unmaps and deletes the file.
+        ~MappedScratchFile();
+
+        MappedScratchFile(const MappedScratchFile&)            = delete;
+        MappedScratchFile& operator=(const MappedScratchFile&) = delete;
+
+        /// @brief Get the mapped data.
+        ///
+        /// @return The start of the mapping, writable.
+        std::byte* GetData() const;
+
+        /// @brief Get the size of the mapping.
+        ///
+        /// @return The size, in bytes.
+        std::uint64_t GetSize() const;
+
+        /// @brief Give back the memory and disk space of part of the file that is no longer needed.
+        ///
+        /// Only the whole pages inside the range are released, so data sharing a page with the range is kept.
+        /// Released pages read back as zeroes. Does nothing where the platform can't release file pages early.
+        ///
+        /// @param [in] offset The offset of the range, in bytes.
+        /// @param [in] size   The size of the range, in bytes.
+        void Release(std::uint64_t offset, std::uint64_t size);
+
+    private:
+        /// @brief Constructor.
+        MappedScratchFile() = default;
+
+        std::byte*    data_ = nullptr;  ///< The start of the mapping.
+        std::uint64_t size_ = 0;        ///< The size of the mapping.
+#ifdef _WIN32
+        void* file_    = nullptr;  ///< The file handle.
+        void* mapping_ = nullptr;  ///< The file mapping handle.
+#endif
+    };
+}  // namespace rra
+
+#endif  // RRA_BACKEND_MAPPED_SCRATCH_FILE_H_
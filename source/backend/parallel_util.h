@@ -0,0 +1,77 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Helpers for splitting backend work across threads.
+//=============================================================================
+
+#ifndef RRA_BACKEND_PARALLEL_UTIL_H_
+#define RRA_BACKEND_PARALLEL_UTIL_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace rra
+{
+    /// @brief Get the number of tasks to split work into.
+    ///
+    /// @param [in] item_count         The number of items of work.
+    /// @param [in] min_items_per_task The smallest number of items worth giving a task of its own.
+    ///
+    /// @return The number of tasks, between 1 and the number of hardware threads.
+    inline size_t GetParallelTaskCount(size_t item_count, size_t min_items_per_task)
+    {
+        const size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+        return std::clamp<size_t>(item_count / min_items_per_task, 1, hardware_threads);
+    }
+
+    /// @brief Run a function for each task index, one thread per task.
+    ///
+    /// The first task runs on the calling thread. If a task throws, the exception is rethrown once all the tasks are done.
+    ///
+    /// @param [in] task_count The number of tasks.
+    /// @param [in] work       The function to call with each task index.
+    template <typename Work>
+    void RunInParallel(size_t task_count, Work&& work)
+    {
+        std::vector<std::exception_ptr> errors(task_count);
+        auto                            run = [&](size_t i) {
+            try
+            {
+                work(i);
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve(task_count);
+        for (size_t i = 1; i < task_count; i++)
+        {
+            workers.emplace_back(run, i);
+        }
+        if (task_count > 0)
+        {
+            run(0);
+        }
+        for (auto& thread : workers)
+        {
+            thread.join();
+        }
+
+        for (const auto& error : errors)
+        {
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+}  // namespace rra
+
+#endif  // RRA_BACKEND_PARALLEL_UTIL_H_
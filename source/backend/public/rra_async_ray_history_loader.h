@@ -8,18 +8,65 @@
 #ifndef RRA_BACKEND_PUBLIC_ASYNC_RAY_HISTORY_LOADER_H_
 #define RRA_BACKEND_PUBLIC_ASYNC_RAY_HISTORY_LOADER_H_
 
+#include <atomic>
 #include <future>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
 
 #include "rra_ray_history.h"
 #include <ray_history/ray_history.h>
 
+namespace rra
+{
+    struct CachedDispatchData;
+    class MappedScratchFile;
+    class RayHistoryLoadScheduler;
+}  // namespace rra
+
+struct DispatchIndexPartial;
+
+/// The default spill budget of a ray history dispatch, in bytes.
+constexpr uint64_t kDefaultRayHistorySpillBudget = 1024ull * 1024ull * 1024ull;
+
+/// @brief How the parsed ray history of a dispatch is stored.
+struct RayHistoryStorageOptions
+{
+    bool     compress_tokens = false;                          ///< Keep the parsed tokens compressed in memory, decompressing blocks of rays on access.
+    uint64_t spill_budget    = kDefaultRayHistorySpillBudget;  ///< Dispatch data bigger than this, in bytes, is kept in a mapped scratch file. 0 never spills.
+};
+
+/// @brief The dispatch data of the rays indexed so far, published while the dispatch is still loading.
+///
+/// A snapshot is never changed once published. The coordinates it has rays for already have all of their rays.
+struct RayDispatchSnapshot
+{
+    std::shared_ptr<rta::RayHistoryTrace> ray_history_trace = nullptr;  ///< The parsed trace the snapshot indexes.
+    RayDispatchData                       dispatch_data     = {};       ///< The dispatch data of the rays indexed so far.
+    RraRayHistoryStats                    stats             = {};       ///< The stats of the rays indexed so far.
+};
+
 /// @brief A class to load the ray history data.
-class RraAsyncRayHistoryLoader
+class RraAsyncRayHistoryLoader : public std::enable_shared_from_this<RraAsyncRayHistoryLoader>
 {
 public:
-    RraAsyncRayHistoryLoader(const char* file_path, int64_t dispatch_index);
+    /// @brief Constructor.
+    ///
+    /// @param file_path      The path of the trace file.
+    /// @param dispatch_index The dispatch index to load.
+    /// @param cached_data    The derived dispatch data from the derived data cache, or nullptr to derive it from the tokens.
+    /// @param storage_options How to store the parsed ray history.
+    RraAsyncRayHistoryLoader(const char*                              file_path,
+                             int64_t                                  dispatch_index,
+                             std::shared_ptr<rra::CachedDispatchData> cached_data     = nullptr,
+                             const RayHistoryStorageOptions&          storage_options = {});
+
+    /// @brief Start loading the dispatch.
+    ///
+    /// @param scheduler   The scheduler to queue the load on, or nullptr to load on a thread of its own.
+    /// @param memory_cost An estimate of the peak memory used while loading, in bytes.
+    void Start(rra::RayHistoryLoadScheduler* scheduler, uint64_t memory_cost);
 
     /// @brief Check if the loader has finished it's work.
     /// @return True if the loader is done.
@@ -41,6 +88,14 @@ public:
     /// @return The dispatch data.
     RayDispatchData& GetDispatchData();
 
+    /// @brief Get the columnar ray table of the dispatch, building it on first use.
+    /// @return The ray table.
+    const RayDispatchRayTable& GetRayTable();
+
+    /// @brief Get the latest snapshot of the dispatch data, without waiting.
+    /// @return The snapshot, or nullptr if none has been published yet or the load is done.
+    std::shared_ptr<const RayDispatchSnapshot> GetSnapshot() const;
+
     /// @brief Get stats of the dispatch.
     /// @return The stats.
     RraRayHistoryStats GetStats();
@@ -57,6 +112,19 @@ public:
     /// @return The derived dispatch size.
     rta::DispatchSize GetDerivedDispatchSize() const;
 
+    /// @brief Move this dispatch to the front of the load queue, if it hasn't started loading.
+    void Prioritize();
+
+    /// @brief Ask the load to stop as soon as it can.
+    ///
+    /// Does not wait. The parse and indexing loops check for cancellation as they go, and a load that hasn't
+    /// started yet finishes without reading the trace. A cancelled load finishes with errors and no dispatch data.
+    void Cancel();
+
+    /// @brief Check if the load was cancelled.
+    /// @return True if Cancel() was called.
+    bool IsCancelled() const;
+
 private:
     /// @brief Get the percentage of the loader's progress.
     /// @return The loaded percentage.
@@ -65,44 +133,92 @@ private:
     /// @brief Read all the data from the raw buffer.
     /// @param buffer_size The buffer size in bytes.
     /// @param buffer_data The buffer pointer.
+    /// @param buffer_file The scratch file the buffer is mapped from, or nullptr. Its pages are released once parsed.
     /// @param dx X dimension size.
     /// @param dy Y dimension size.
     /// @param dz Z dimension size.
-    void ReadRayHistoryTraceFromRawBuffer(size_t buffer_size, std::byte* buffer_data, uint32_t dx, uint32_t dy, uint32_t dz);
-
-    /// @brief Process dispatch data.
-    void PreProcessDispatchData();
-
-    /// @brief Process the invocation counts.
-    void ProcessInvocationCounts();
+    void ReadRayHistoryTraceFromRawBuffer(size_t                  buffer_size,
+                                          std::byte*              buffer_data,
+                                          rra::MappedScratchFile* buffer_file,
+                                          uint32_t                dx,
+                                          uint32_t                dy,
+                                          uint32_t                dz);
+
+    /// @brief Index the dispatch data and count the invocations.
+    ///
+    /// Finds the dispatch dimensions if the counter info doesn't have them, the begin tokens and stats of each
+    /// dispatch coordinate, and the invocation counts of the dispatch, in a single parallel pass over the tokens.
+    void IndexDispatchData();
+
+    /// @brief Sweep a range of rays for their begin tokens and stats, in parallel.
+    /// @param first_ray The first ray of the range.
+    /// @param last_ray  One past the last ray of the range.
+    /// @param partials  The results to append the range's results to.
+    void SweepDispatchRays(int first_ray, int last_ray, std::vector<DispatchIndexPartial>& partials);
+
+    /// @brief Build the dispatch data from the results of the sweeps.
+    /// @param partials      The results of the sweeps, in ray order.
+    /// @param dim_x         The dispatch dimension x.
+    /// @param dim_y         The dispatch dimension y.
+    /// @param dim_z         The dispatch dimension z.
+    /// @param dispatch_data The dispatch data to build.
+    /// @return False if a begin token has a coordinate outside the dispatch, or the load was cancelled.
+    bool BuildDispatchData(const std::vector<DispatchIndexPartial>& partials, uint32_t dim_x, uint32_t dim_y, uint32_t dim_z, RayDispatchData& dispatch_data);
+
+    /// @brief Publish a snapshot of the dispatch data of the rays swept so far.
+    /// @param partials The results of the sweeps, in ray order.
+    void PublishSnapshot(const std::vector<DispatchIndexPartial>& partials);
+
+    /// @brief Fill in the ray table from the begin tokens and ray results, in parallel.
+    void BuildRayTable();
+
+    /// @brief Load and process the dispatch. Runs on a worker thread.
+    void Process();
+
+    /// @brief Use the cached dispatch data instead of processing the tokens.
+    void RestoreCachedDispatchData();
 
     /// @brief Waits for everthing to finish.
     void WaitProcess();
 
-    /// @brief Find dispatch dims from token data.
-    void FindDispatchDimsFromTokens();
+    /// @brief Check for cancellation between the steps of the load.
+    /// @return True if the load was cancelled, in which case the error state is set.
+    bool StopIfCancelled();
+
+    std::string                   file_path_;                ///< The path of the trace file.
+    int64_t                       dispatch_index_ = 0;       ///< The dispatch index to load.
+    rra::RayHistoryLoadScheduler* scheduler_      = nullptr;  ///< The scheduler the load was queued on, if any.
+    std::promise<void>            process_promise_;          ///< Fulfilled when a scheduled load finishes.
+    std::shared_future<void>      process_;                  ///< The future of the loading process, shared by every waiting thread.
+    std::mutex        process_mutex_;                   ///< A mutex guarding the load status and the dispatch stats.
+    std::atomic<bool> process_complete_       = false;  ///< A flag to indicate if the loading is complete.
 
-    int64_t           dispatch_index_ = 0;              ///< The dispatch index to load.
-    std::future<void> process_;                         ///< The future of the loading process.
-    std::mutex        process_mutex_;                   ///< A mutex to manage loading steps and feedback.
-    bool              process_complete_       = false;  ///< A flag to indicate if the loading is complete.
-    bool              process_complete_local_ = false;  ///< A thread-local flag to check if the process is complete, so it can be accessed without a lock.
+    // The progress counters are updated from the hot loops of the loading thread and polled by the UI,
+    // so they are relaxed atomics rather than being guarded by the mutex.
+    std::atomic<size_t> bytes_required_  = 0;  ///< Number of bytes required to finish loading.
+    std::atomic<size_t> bytes_processed_ = 0;  ///< Number of bytes processed.
 
-    size_t bytes_required_  = 0;  ///< Number of bytes required to finish loading.
-    size_t bytes_processed_ = 0;  ///< Number of bytes processed.
+    std::atomic<size_t> total_dispatch_indices_     = 0;  ///< Number of dispatch indices. (or pixels)
+    std::atomic<size_t> processed_dispatch_indices_ = 0;  ///< Number of processed indices.
 
-    size_t total_dispatch_indices_     = 0;  ///< Number of dispatch indices. (or pixels)
-    size_t processed_dispatch_indices_ = 0;  ///< Number of processed indices.
+    std::atomic<bool> error_state_ = false;  ///< If there was an error this becomes true.
+    std::atomic<bool> cancelled_   = false;  ///< Set by Cancel(), polled by the loading thread.
 
-    bool error_state_ = false;  ///< If there was an error this becomes true.
+    RayHistoryStorageOptions storage_options_ = {};  ///< How to store the parsed ray history.
 
-    size_t total_ray_count_ = 0;  ///< Number of rays. (not pixels)
+    std::atomic<size_t> total_ray_count_ = 0;  ///< Number of rays. (not pixels)
 
     GpuRt::CounterInfo counter_info_;  ///< The counter info from the metadata chunk.
 
     std::shared_ptr<rta::RayHistoryTrace> ray_history_trace_ = nullptr;  ///< The actual trace data.
 
+    std::shared_ptr<rra::CachedDispatchData> cached_data_ = nullptr;  ///< The derived dispatch data from the derived data cache, if any.
+
+    std::shared_ptr<const RayDispatchSnapshot> snapshot_ = nullptr;  ///< The latest snapshot while indexing. Only accessed with std::atomic_load and std::atomic_store.
+
     RayDispatchData       dispatch_data_     = {};  ///< All of the indexing and individual stats that we've gathered.
+    RayDispatchRayTable   ray_table_         = {};  ///< The rays as one array per field. Empty until first asked for.
+    std::once_flag        ray_table_once_;          ///< Builds the ray table once.
     RraRayHistoryStats    invocation_counts_ = {};  ///< The general stats of the dispatch.
     RraDispatchLoadStatus load_status_       = {};  ///< The status of the loader for outside use.
 
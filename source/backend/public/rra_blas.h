@@ -162,6 +162,10 @@ RraErrorCode RraBlasGetMinimumSurfaceAreaHeuristic(uint64_t blas_index, uint32_t
 
 /// @brief Get the average surface area heuristic of a given node's triangle leaf nodes.
 ///
+/// For a box node, the average is read from a summary of its sub tree built at load time. The summary totals are
+/// summed per sub tree rather than in tree walk order, so the average can differ in the last bits from earlier
+/// versions, which walked the sub tree on each call.
+///
 /// @param [in]  blas_index                     The index of the BLAS to use.
 /// @param [in]  node_ptr                       The node pointer whose SAH is to be found.
 /// @param [in]  tri_only                       All non-triangle nodes will be ignored if this is true.
@@ -36,6 +36,7 @@ static const RraErrorCode kRraErrorInvalidChildNode       = 0x8000000b;  /// The
 static const RraErrorCode kRraErrorNoASChunks = 0x8000000c;  /// The operation failed because there were no acceleration structure chunks in the loaded trace.
 static const RraErrorCode kRraMajorVersionIncompatible =
     0x8000000d;  /// The operation failed because the major version across the data set had an incompatibility.
+static const RraErrorCode kRraErrorCancelled = 0x8000000e;  /// The operation was cancelled before it completed.
 
 /// Helper macro to return error code y from a function when a specific condition, x, is not met.
 #define RRA_RETURN_ON_ERROR(x, y) \
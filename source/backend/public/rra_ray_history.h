@@ -104,14 +104,34 @@ struct RraRayHistoryStats
     uint64_t pixel_count                 = 0;
 };
 
+/// @brief The stats of every coordinate of a dispatch, as separate arrays.
+///
+/// Each array that isn't nullptr must hold width * height * depth entries, and is indexed by
+/// x + y * width + z * width * height. The totals and maxima are always filled in.
+struct RraDispatchCoordinateStatsGrid
+{
+    uint32_t* ray_counts                      = nullptr;  ///< The number of rays of each coordinate.
+    uint32_t* first_ray_offsets               = nullptr;  ///< The number of rays of all the coordinates before each coordinate.
+    uint32_t* traversal_counts                = nullptr;  ///< The traversal loop iteration count of each coordinate.
+    uint32_t* instance_intersection_counts    = nullptr;  ///< The instance intersection count of each coordinate.
+    uint32_t* any_hit_counts                  = nullptr;  ///< The any hit invocation count of each coordinate.
+    uint32_t  total_ray_count                 = 0;        ///< The number of rays of the whole dispatch.
+    uint32_t  max_ray_count                   = 0;        ///< The highest ray count of any coordinate.
+    uint32_t  max_traversal_count             = 0;        ///< The highest traversal count of any coordinate.
+    uint32_t  max_instance_intersection_count = 0;        ///< The highest instance intersection count of any coordinate.
+    uint32_t  max_any_hit_count               = 0;        ///< The highest any hit invocation count of any coordinate.
+};
+
 struct RraDispatchLoadStatus
 {
-    bool  raw_data_parsed  = false;
-    bool  data_indexed     = false;
-    bool  loading_complete = false;
-    bool  has_errors       = false;
-    bool  incomplete_data  = false;
-    float load_percentage  = 0.0f;
+    bool     raw_data_parsed   = false;
+    bool     partially_indexed = false;  ///< Some coordinates can be queried before the dispatch finishes indexing.
+    bool     data_indexed      = false;
+    bool     loading_complete  = false;
+    bool     has_errors        = false;
+    bool     incomplete_data   = false;
+    float    load_percentage   = 0.0f;
+    uint32_t snapshot_count    = 0;  ///< The number of snapshots published while indexing. Changes each time more coordinates can be queried.
 };
 
 struct RayDispatchBeginIdentifier
@@ -128,33 +148,194 @@ struct DispatchCoordinateStats
     uint32_t any_hit_count        = 0;
 };
 
-struct DispatchCoordinateData
+/// @brief The end token and intersection result of a ray, recorded when the dispatch is indexed.
+struct RayDispatchRayResult
+{
+    static constexpr uint32_t kNoEndToken = UINT32_MAX;  ///< The end token index of a ray without tokens.
+
+    uint32_t           end_token_index = kNoEndToken;  ///< The index of the ray's end token in its ray history.
+    IntersectionResult intersection    = {};           ///< The intersection result from the end token.
+};
+
+/// @brief The begin identifiers of one dispatch coordinate.
+struct RayDispatchBeginIdentifierSpan
 {
-    DispatchCoordinateStats                 stats = {};
-    std::vector<RayDispatchBeginIdentifier> begin_identifiers;
+    const RayDispatchBeginIdentifier* data  = nullptr;  ///< The first begin identifier.
+    uint32_t                          count = 0;        ///< The number of begin identifiers.
+
+    /// @brief Get the number of begin identifiers.
+    /// @return The number of begin identifiers.
+    uint32_t size() const
+    {
+        return count;
+    }
+
+    /// @brief Get a begin identifier.
+    /// @param index The index of the begin identifier.
+    /// @return The begin identifier.
+    const RayDispatchBeginIdentifier& operator[](uint32_t index) const
+    {
+        return data[index];
+    }
+
+    /// @brief Get the start of the begin identifiers.
+    /// @return A pointer to the first begin identifier.
+    const RayDispatchBeginIdentifier* begin() const
+    {
+        return data;
+    }
+
+    /// @brief Get the end of the begin identifiers.
+    /// @return A pointer past the last begin identifier.
+    const RayDispatchBeginIdentifier* end() const
+    {
+        return data + count;
+    }
 };
 
+/// @brief The rays and stats of every coordinate of a dispatch.
+///
+/// The begin identifiers are stored in compressed sparse row form: the identifiers of all coordinates are
+/// in a single array grouped by coordinate, and coordinate_offsets holds where each coordinate's group starts.
 struct RayDispatchData
 {
+    static constexpr uint32_t kRootRay     = UINT32_MAX;      ///< The parent of a ray at the root of its coordinate's ray tree.
+    static constexpr uint32_t kDetachedRay = UINT32_MAX - 1;  ///< The parent of a ray that isn't part of its coordinate's ray tree.
+
     uint32_t dispatch_width  = 0;  ///< Dispatch width for coordinate mapping.
     uint32_t dispatch_height = 0;  ///< Dispatch height for coordinate mapping.
 
-    std::vector<DispatchCoordinateData> dispatch_ray_indices;  ///< A buffer to keep all of the dispatch coordinate data.
-    bool                                error = false;         ///< True if an error occured during loading, such as malformed data.
+    std::vector<uint32_t>                   coordinate_offsets;  ///< The start of each coordinate's begin identifiers, plus the total at the end.
+    std::vector<RayDispatchBeginIdentifier> begin_identifiers;   ///< The begin identifiers of all of the coordinates, grouped by coordinate.
+    std::vector<DispatchCoordinateStats>    coordinate_stats;    ///< The stats of each coordinate.
+    std::vector<RayDispatchRayResult>       ray_results;         ///< The end token and intersection result of each begin identifier.
+    std::vector<uint32_t>                   ray_parents;         ///< The index within its coordinate of the parent of each ray, or kRootRay or kDetachedRay.
+    std::vector<uint32_t>                   ray_child_offsets;   ///< The start of each ray's children in ray_children, plus the total at the end.
+    std::vector<uint32_t>                   ray_children;        ///< The index within their coordinate of the children of each ray, grouped by parent.
+    bool                                    error = false;       ///< True if an error occured during loading, such as malformed data.
 
-    /// @brief Get the dispatch coordinate data.
+    /// @brief Get the index of a dispatch coordinate.
     /// @param x The x coord.
     /// @param y The y coord.
     /// @param z The z coord.
-    /// @return A reference to the exact coordinate data.
-    DispatchCoordinateData& GetCoordinate(uint32_t x, uint32_t y, uint32_t z);
+    /// @return The coordinate index.
+    uint64_t GetCoordinateIndex(uint32_t x, uint32_t y, uint32_t z) const;
 
     /// @brief Check if the given coordinate is valid.
     /// @param x The x coord.
     /// @param y The y coord.
     /// @param z The z coord.
     /// @return True if the coordinate is valid.
-    bool CoordinateIsValid(uint32_t x, uint32_t y, uint32_t z);
+    bool CoordinateIsValid(uint32_t x, uint32_t y, uint32_t z) const;
+
+    /// @brief Get the begin identifiers of a dispatch coordinate.
+    /// @param x The x coord.
+    /// @param y The y coord.
+    /// @param z The z coord.
+    /// @return The begin identifiers.
+    RayDispatchBeginIdentifierSpan GetBeginIdentifiers(uint32_t x, uint32_t y, uint32_t z) const;
+
+    /// @brief Get the end token and intersection result of a ray of a dispatch coordinate.
+    /// @param x         The x coord.
+    /// @param y         The y coord.
+    /// @param z         The z coord.
+    /// @param ray_index The index of the ray within the coordinate.
+    /// @return The ray result, or nullptr if the ray index is out of range.
+    const RayDispatchRayResult* GetRayResult(uint32_t x, uint32_t y, uint32_t z, uint32_t ray_index) const;
+
+    /// @brief Get the stats of a dispatch coordinate.
+    /// @param x The x coord.
+    /// @param y The y coord.
+    /// @param z The z coord.
+    /// @return The coordinate stats.
+    const DispatchCoordinateStats& GetStats(uint32_t x, uint32_t y, uint32_t z) const;
+};
+
+/// @brief The rays of a dispatch as one array per field.
+///
+/// The rays are ordered like RayDispatchData::begin_identifiers, so the rays of a coordinate start at its
+/// coordinate offset. Vectors are stored as 3 consecutive floats per ray.
+struct RayDispatchRayTable
+{
+    std::vector<float>    origins;            ///< The origin of each ray.
+    std::vector<float>    directions;         ///< The direction of each ray.
+    std::vector<float>    t_mins;             ///< The tMin of each ray.
+    std::vector<float>    t_maxs;             ///< The tMax of each ray.
+    std::vector<uint32_t> ray_flags;          ///< The ray flags of each ray.
+    std::vector<uint32_t> cull_masks;         ///< The cull mask of each ray.
+    std::vector<uint64_t> tlas_addresses;     ///< The TLAS address of each ray.
+    std::vector<uint32_t> dynamic_ids;        ///< The dynamic id of each ray.
+    std::vector<uint32_t> parent_ids;         ///< The dynamic id of the parent of each ray.
+    std::vector<uint32_t> wave_ids;           ///< The hardware wave id of each ray.
+    std::vector<uint32_t> iteration_counts;   ///< The traversal loop iteration count of each ray.
+    std::vector<float>    hit_ts;             ///< The hit distance of each ray, or -1 for a miss.
+    std::vector<uint32_t> hit_kinds;          ///< The hit kind of each ray.
+    std::vector<uint32_t> instance_indices;   ///< The index of the instance hit by each ray.
+    std::vector<uint32_t> geometry_indices;   ///< The index of the geometry hit by each ray.
+    std::vector<uint32_t> primitive_indices;  ///< The index of the primitive hit by each ray.
+};
+
+/// @brief Read-only views of the columns of a dispatch's ray table.
+///
+/// Each array holds ray_count entries, or 3 * ray_count for origins and directions. The arrays stay
+/// valid until the trace is unloaded.
+struct RraDispatchRayColumns
+{
+    uint32_t        ray_count         = 0;        ///< The number of rays in the dispatch.
+    const float*    origins           = nullptr;  ///< The x, y and z origin of each ray.
+    const float*    directions        = nullptr;  ///< The x, y and z direction of each ray.
+    const float*    t_mins            = nullptr;  ///< The tMin of each ray.
+    const float*    t_maxs            = nullptr;  ///< The tMax of each ray.
+    const uint32_t* ray_flags         = nullptr;  ///< The ray flags of each ray.
+    const uint32_t* cull_masks        = nullptr;  ///< The cull mask of each ray.
+    const uint64_t* tlas_addresses    = nullptr;  ///< The TLAS address of each ray.
+    const uint32_t* dynamic_ids       = nullptr;  ///< The dynamic id of each ray.
+    const uint32_t* parent_ids        = nullptr;  ///< The dynamic id of the parent of each ray.
+    const uint32_t* wave_ids          = nullptr;  ///< The hardware wave id of each ray.
+    const uint32_t* iteration_counts  = nullptr;  ///< The traversal loop iteration count of each ray.
+    const float*    hit_ts            = nullptr;  ///< The hit distance of each ray, or -1 for a miss.
+    const uint32_t* hit_kinds         = nullptr;  ///< The hit kind of each ray.
+    const uint32_t* instance_indices  = nullptr;  ///< The index of the instance hit by each ray.
+    const uint32_t* geometry_indices  = nullptr;  ///< The index of the geometry hit by each ray.
+    const uint32_t* primitive_indices = nullptr;  ///< The index of the primitive hit by each ray.
+};
+
+/// @brief The conditions a ray query can test. A ray matches a query if it passes all of the query's conditions.
+enum RraRayQueryPredicate : uint32_t
+{
+    kRraRayQueryMiss          = 1 << 0,  ///< The ray missed.
+    kRraRayQueryHit           = 1 << 1,  ///< The ray hit something.
+    kRraRayQueryMinIterations = 1 << 2,  ///< The ray ran at least min_iterations traversal loop iterations.
+    kRraRayQueryMaxIterations = 1 << 3,  ///< The ray ran at most max_iterations traversal loop iterations.
+    kRraRayQueryInstanceIndex = 1 << 4,  ///< The ray hit the instance instance_index.
+    kRraRayQueryAllRayFlags   = 1 << 5,  ///< The ray has all of the ray flags in ray_flags.
+    kRraRayQueryAnyRayFlags   = 1 << 6,  ///< The ray has at least one of the ray flags in ray_flags.
+    kRraRayQueryTlasAddress   = 1 << 7,  ///< The ray was traced against the TLAS at tlas_address.
+};
+
+/// @brief A query over all the rays of a dispatch.
+struct RraRayQuery
+{
+    uint32_t predicates     = 0;  ///< The RraRayQueryPredicate conditions to test. 0 matches every ray.
+    uint32_t min_iterations = 0;  ///< The iteration count for kRraRayQueryMinIterations.
+    uint32_t max_iterations = 0;  ///< The iteration count for kRraRayQueryMaxIterations.
+    uint32_t instance_index = 0;  ///< The instance index for kRraRayQueryInstanceIndex.
+    uint32_t ray_flags      = 0;  ///< The ray flags for kRraRayQueryAllRayFlags and kRraRayQueryAnyRayFlags.
+    uint64_t tlas_address   = 0;  ///< The TLAS address for kRraRayQueryTlasAddress.
+};
+
+/// @brief The rays and coordinates matching a ray query.
+///
+/// Rays are numbered like the columns of RraRayGetDispatchRayColumns(), and coordinates by
+/// x + y * width + z * width * height. Any of the arrays may be nullptr; the counts are always filled in.
+struct RraRayQueryResult
+{
+    uint64_t* ray_bits                  = nullptr;  ///< Bit i is set if ray i matches. Must hold (ray count + 63) / 64 words.
+    uint32_t* coordinate_match_counts   = nullptr;  ///< The number of matching rays of each coordinate. Must hold one entry per coordinate.
+    uint32_t* matching_coordinates      = nullptr;  ///< The coordinates with a matching ray, in order. Must hold one entry per coordinate.
+    uint32_t  ray_count                 = 0;        ///< The number of rays in the dispatch.
+    uint32_t  match_count               = 0;        ///< The number of matching rays.
+    uint32_t  matching_coordinate_count = 0;        ///< The number of coordinates with a matching ray.
 };
 
 #ifdef __cplusplus
@@ -208,6 +389,8 @@ RraErrorCode RraRayGetIntersectionResult(uint32_t dispatch_id, GlobalInvocationI
 
 /// @brief Get all the stats related to a dispatch.
 ///
+/// While the dispatch is partially indexed, these are the stats of the coordinates indexed so far.
+///
 /// @param [in]  dispatch_id The ID of the dispatch.
 /// @param [out] out_stats   The stats to gather.
 ///
@@ -223,6 +406,86 @@ RraErrorCode RraRayGetDispatchStats(uint32_t dispatch_id, RraRayHistoryStats* ou
 /// @return kRraOk if successful or an RraErrorCode if an error occurred.
 RraErrorCode RraRayGetDispatchCoordinateStats(uint32_t dispatch_id, GlobalInvocationID invocation_id, DispatchCoordinateStats* out_stats);
 
+/// @brief Get the stats of every coordinate of a dispatch at once.
+///
+/// While the dispatch is partially indexed, the stats of the coordinates indexed so far are returned without
+/// waiting, and the other coordinates have no rays.
+///
+/// @param [in]     dispatch_id The ID of the dispatch.
+/// @param [in,out] grid        The arrays to fill in, and the totals and maxima.
+///
+/// @return kRraOk if successful or an RraErrorCode if an error occurred.
+RraErrorCode RraRayGetDispatchCoordinateStatsGrid(uint32_t dispatch_id, RraDispatchCoordinateStatsGrid* grid);
+
+/// @brief Get the direction of every ray of a dispatch at once.
+///
+/// The rays are ordered by coordinate, so the rays of a coordinate start at its first ray offset
+/// from RraRayGetDispatchCoordinateStatsGrid(). The directions are copied from the ray table, which
+/// is built the first time it is asked for. While the dispatch is partially indexed, only the rays of the
+/// coordinates indexed so far are returned, without waiting.
+///
+/// @param [in]  dispatch_id    The ID of the dispatch.
+/// @param [out] out_directions The x, y and z direction of each ray. May be nullptr to only get the ray count.
+/// @param [in]  capacity       The number of rays out_directions can hold.
+/// @param [out] out_count      The number of rays of the dispatch.
+///
+/// @return kRraOk if successful, kRraErrorInvalidSize if out_directions can't hold every ray, or another
+/// RraErrorCode if an error occurred.
+RraErrorCode RraRayGetDispatchRayDirections(uint32_t dispatch_id, float* out_directions, uint32_t capacity, uint32_t* out_count);
+
+/// @brief Get the columns of the ray table of a dispatch, without copying them.
+///
+/// The table is built in parallel the first time it is asked for. The rays are ordered by coordinate,
+/// as for RraRayGetDispatchRayDirections().
+///
+/// @param [in]  dispatch_id The ID of the dispatch.
+/// @param [out] out_columns The column pointers and ray count.
+///
+/// @return kRraOk if successful or an RraErrorCode if an error occurred.
+RraErrorCode RraRayGetDispatchRayColumns(uint32_t dispatch_id, RraDispatchRayColumns* out_columns);
+
+/// @brief Find the rays of a dispatch that match a query.
+///
+/// The ray columns are scanned on all threads.
+///
+/// @param [in]     dispatch_id The ID of the dispatch.
+/// @param [in]     query       The query.
+/// @param [in,out] result      The arrays to fill in, and the counts.
+///
+/// @return kRraOk if successful or an RraErrorCode if an error occurred.
+RraErrorCode RraRayQueryDispatch(uint32_t dispatch_id, const RraRayQuery* query, RraRayQueryResult* result);
+
+/// @brief Get the parent of a ray in its dispatch coordinate's ray tree.
+///
+/// @param [in]  dispatch_id      The ID of the dispatch.
+/// @param [in]  invocation_id    The global invocation ID.
+/// @param [in]  ray_index        The index of the ray.
+/// @param [out] out_parent_index The index of the parent ray, RayDispatchData::kRootRay if the ray is a root, or
+///                               RayDispatchData::kDetachedRay if the ray isn't part of the tree.
+///
+/// @return kRraOk if successful or an RraErrorCode if an error occurred.
+RraErrorCode RraRayGetRayParent(uint32_t dispatch_id, GlobalInvocationID invocation_id, uint32_t ray_index, uint32_t* out_parent_index);
+
+/// @brief Get the number of child rays of a ray.
+///
+/// @param [in]  dispatch_id   The ID of the dispatch.
+/// @param [in]  invocation_id The global invocation ID.
+/// @param [in]  ray_index     The index of the ray.
+/// @param [out] out_count     The number of child rays.
+///
+/// @return kRraOk if successful or an RraErrorCode if an error occurred.
+RraErrorCode RraRayGetChildRayCount(uint32_t dispatch_id, GlobalInvocationID invocation_id, uint32_t ray_index, uint32_t* out_count);
+
+/// @brief Get the child rays of a ray, in ray order.
+///
+/// @param [in]  dispatch_id       The ID of the dispatch.
+/// @param [in]  invocation_id     The global invocation ID.
+/// @param [in]  ray_index         The index of the ray.
+/// @param [out] out_child_indices The indices of the child rays. Must hold RraRayGetChildRayCount() entries.
+///
+/// @return kRraOk if successful or an RraErrorCode if an error occurred.
+RraErrorCode RraRayGetChildRays(uint32_t dispatch_id, GlobalInvocationID invocation_id, uint32_t ray_index, uint32_t* out_child_indices);
+
 /// @brief Get data about the any hit shader invocations for this ray.
 ///
 /// @param dispatch_id   The ID of the vkCmdTraceRaysKHR() call.
@@ -263,6 +526,15 @@ RraErrorCode RraRayGetDispatchType(uint32_t dispatch_id, DispatchType* type);
 /// @returnkRraOk if successful.
 RraErrorCode RraRayGetDispatchStatus(uint32_t dispatch_id, RraDispatchLoadStatus* status);
 
+/// @brief Load a dispatch ahead of the dispatches still waiting to load.
+///
+/// Does nothing if the dispatch has already started loading.
+///
+/// @param [in] dispatch_id The id of the dispatch.
+///
+/// @return kRraOk if successful or an RraErrorCode if an error occurred.
+RraErrorCode RraRayPrioritizeDispatch(uint32_t dispatch_id);
+
 #ifdef __cplusplus
 }
 #endif  // #ifdef __cplusplus
@@ -253,6 +253,10 @@ RraErrorCode RraTlasGetMinimumSurfaceAreaHeuristic(uint64_t tlas_index, uint32_t
 
 /// @brief Get the average surface area heuristic of a given node and its children.
 ///
+/// For a box node, the average is read from a summary of its sub tree built at load time. The summary totals are
+/// summed per sub tree rather than in tree walk order, so the average can differ in the last bits from earlier
+/// versions, which walked the sub tree on each call.
+///
 /// @param [in]  tlas_index                     The index of the TLAS to use.
 /// @param [in]  node_ptr                       The node pointer whose SAH is to be found.
 /// @param [out] out_avg_surface_area_heuristic A pointer to receive the average surface area heuristic.
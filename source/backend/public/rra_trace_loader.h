@@ -23,9 +23,89 @@ extern "C" {
 /// @return kRraOk if trace file loaded OK, an RraErrorCode if an error occurred.
 RraErrorCode RraTraceLoaderLoad(const char* trace_file_name);
 
+/// @brief Set whether BLAS node data is decoded lazily.
+///
+/// When enabled, only the BLAS headers are decoded when a trace is loaded. The node data of
+/// each BLAS is decoded on a background thread, or on first access if that comes sooner. If the
+/// derived data cache holds the BLAS headers from an earlier load, the BLAS chunks aren't read at
+/// all when the trace is opened. If the node data of a BLAS can't be decoded later, for instance because the trace
+/// was moved or truncated, the BLAS is left empty and the queries on its nodes return kRraErrorMalformedData.
+/// Takes effect on the next call to RraTraceLoaderLoad().
+///
+/// @param [in] enabled true to defer BLAS node decoding, false to decode everything at load time.
+void RraTraceLoaderSetDeferredBlasDecode(bool enabled);
+
+/// @brief Set whether the box nodes are decoded into a cache after loading.
+///
+/// When enabled, the child pointers and bounding boxes of every box node are decoded once, into
+/// arrays of fp32 values, after the node data of each acceleration structure is loaded. The bounding
+/// volume, surface area and child node queries then read from those arrays rather than decoding the
+/// node, and converting fp16 bounds, on every call. This costs about twice the interior node memory.
+/// Disabled by default. Takes effect on the next call to RraTraceLoaderLoad().
+///
+/// @param [in] enabled true to build the decoded node cache, false to decode the box nodes on each query.
+void RraTraceLoaderSetDecodedNodeCache(bool enabled);
+
+/// @brief Set whether the derived data cache is used.
+///
+/// When enabled, the data derived from a trace after loading it (tree depths, surface area
+/// heuristics, instance lists and ray history indexing) is written to a sidecar file next to
+/// the trace, and restored from it the next time the unchanged trace is loaded. A trace is recognized
+/// as unchanged by its size, last write time and chunk table, so checking the cache doesn't read the
+/// trace data. Disabled by default, since it writes a file next to the trace.
+/// Takes effect on the next call to RraTraceLoaderLoad().
+///
+/// @param [in] enabled true to use the derived data cache, false to always derive the data from the trace.
+void RraTraceLoaderSetDerivedDataCache(bool enabled);
+
+/// @brief Set the limits used when loading the ray history dispatches.
+///
+/// Dispatches are loaded on a pool of worker threads. A dispatch only starts loading once its
+/// estimated memory use fits in what the dispatches already loading leave of the budget.
+/// Takes effect on the next call to RraTraceLoaderLoad().
+///
+/// @param [in] worker_count  The number of worker threads. 0 uses the number of hardware threads.
+/// @param [in] memory_budget The memory budget, in bytes. 0 means no limit.
+void RraTraceLoaderSetRayHistoryLoadLimits(uint32_t worker_count, uint64_t memory_budget);
+
+/// @brief Set whether the ray history tokens are kept compressed in memory.
+///
+/// When enabled, the parsed tokens of each dispatch are zstd-compressed in blocks of rays, and blocks
+/// are decompressed on access into a bounded cache of recently used blocks. This uses several times less
+/// memory for large dispatches once they are loaded, at the cost of decompressing blocks when rays are read.
+/// It also lowers the peak while a dispatch loads: each block is compressed as soon as its tokens have been
+/// parsed, so only the blocks still being filled are held uncompressed, alongside the raw tokens read from the
+/// trace. Disabled by default. Takes effect on the next call to RraTraceLoaderLoad().
+///
+/// @param [in] enabled true to compress the ray history tokens, false to keep them uncompressed.
+void RraTraceLoaderSetRayHistoryCompression(bool enabled);
+
+/// @brief Set the memory budget of a single ray history dispatch.
+///
+/// The parsed tokens, token indices and ray ranges of a dispatch bigger than the budget are written to a
+/// temporary file mapped into memory, so the OS can page them in and out instead of the data having to
+/// fit in RAM. The file is deleted when the trace is unloaded. Raw tokens bigger than the budget are also read
+/// into a temporary file while they are parsed. Takes effect on the next call to RraTraceLoaderLoad().
+///
+/// The raw tokens are decompressed into the temporary file whole, as RDF only reads a chunk in one go. The file is
+/// given back in windows as the tokens are parsed. On Linux the file is made in TMPDIR, or /var/tmp if it isn't set,
+/// rather than /tmp, which is often a tmpfs held in RAM. A TMPDIR on a tmpfs doesn't take any load off RAM.
+///
+/// @param [in] spill_budget The budget, in bytes. Defaults to 1 GiB. 0 keeps every dispatch in memory.
+void RraTraceLoaderSetRayHistorySpillBudget(uint64_t spill_budget);
+
 /// @brief Unload (close) a trace file.
+///
+/// Does not wait for the ray history dispatches still loading. They are cancelled, and they and the
+/// rest of the trace data are freed in the background. RraTraceLoaderShutdown() waits for that to finish.
 void RraTraceLoaderUnload();
 
+/// @brief Unload the trace file, if one is loaded, and wait for the data of every unloaded trace to be freed.
+///
+/// The loads still running are cancelled rather than waited for. Call before the application exits, so no
+/// background work is left running when the process shuts down.
+void RraTraceLoaderShutdown();
+
 /// @brief Is the trace data valid (has a trace been loaded).
 ///
 /// @return true if trace file is valid, false if not.
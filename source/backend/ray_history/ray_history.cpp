@@ -10,13 +10,20 @@
 #include "../bvh/flags_util.h"
 
 #include "public/rra_assert.h"
+#include "parallel_util.h"
 
+#include <zstd.h>
+
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <cstring>
 
 #include <limits>
 #include <algorithm>
+#include <list>
+#include <mutex>
 #include <stack>
 
 #include <map>
@@ -332,6 +339,147 @@ namespace rta
         };
     }  // namespace io
 
+    ///////////////////////////////////////////////////////////////////////////
+    // An array the trace reads from, owned either by the trace or by external storage.
+    template <typename T>
+    struct ArrayView
+    {
+        const T*    ptr   = nullptr;
+        std::size_t count = 0;
+
+        ArrayView() = default;
+
+        ArrayView(const T* p, const std::size_t n)
+            : ptr(p)
+            , count(n)
+        {
+        }
+
+        ArrayView(const std::vector<T>& v)
+            : ptr(v.data())
+            , count(v.size())
+        {
+        }
+
+        const T* data() const
+        {
+            return ptr;
+        }
+
+        std::size_t size() const
+        {
+            return count;
+        }
+
+        bool empty() const
+        {
+            return count == 0;
+        }
+
+        const T& back() const
+        {
+            return ptr[count - 1];
+        }
+
+        const T& operator[](const std::size_t i) const
+        {
+            return ptr[i];
+        }
+    };
+
+    ///////////////////////////////////////////////////////////////////////////
+    // A zstd-compressed block of token data, covering a run of consecutive rays.
+    using CompressedTokenBlock = RayHistoryTrace::CompressedTokenBlock;
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Keeps the most recently used decompressed token blocks. Blocks handed out
+    // stay alive while they are in use, even once they are evicted. The blocks
+    // are spread over shards, each with its own lock and share of the capacity,
+    // so threads reading different blocks rarely wait on each other.
+    class TokenBlockCache
+    {
+    public:
+        using Block = std::shared_ptr<const std::vector<std::byte>>;
+
+        TokenBlockCache(const std::size_t blockCount, const std::size_t capacity)
+            : entries_(blockCount)
+        {
+            for (auto& shard : shards_)
+            {
+                shard.capacity = capacity / ShardCount;
+            }
+        }
+
+        Block Find(const std::size_t blockIndex)
+        {
+            Shard&                       shard = GetShard(blockIndex);
+            std::scoped_lock<std::mutex> lock(shard.mutex);
+
+            Entry& entry = entries_[blockIndex];
+            if (entry.block)
+            {
+                shard.order.splice(shard.order.begin(), shard.order, entry.position);
+            }
+            return entry.block;
+        }
+
+        // Returns the block already cached if another thread inserted it first
+        Block Insert(const std::size_t blockIndex, Block block)
+        {
+            Shard&                       shard = GetShard(blockIndex);
+            std::scoped_lock<std::mutex> lock(shard.mutex);
+
+            Entry& entry = entries_[blockIndex];
+            if (entry.block)
+            {
+                shard.order.splice(shard.order.begin(), shard.order, entry.position);
+                return entry.block;
+            }
+
+            entry.block    = std::move(block);
+            entry.position = shard.order.insert(shard.order.begin(), blockIndex);
+            shard.size += entry.block->size();
+
+            // Always keep the block just inserted, even if it is bigger than the shard
+            while (shard.size > shard.capacity && shard.order.size() > 1)
+            {
+                Entry& evicted = entries_[shard.order.back()];
+                shard.size -= evicted.block->size();
+                evicted.block.reset();
+                shard.order.pop_back();
+            }
+
+            return entry.block;
+        }
+
+    private:
+        // Consecutive blocks go to different shards, since the rays are mostly read in order
+        static constexpr std::size_t ShardCount = 16;
+
+        // Only accessed with the lock of the shard the block belongs to
+        struct Entry
+        {
+            Block                            block;
+            std::list<std::size_t>::iterator position;
+        };
+
+        struct Shard
+        {
+            std::mutex             mutex;
+            std::list<std::size_t> order;
+            std::size_t            capacity = 0;
+            std::size_t            size     = 0;
+        };
+
+        Shard& GetShard(const std::size_t blockIndex)
+        {
+            return shards_[blockIndex % ShardCount];
+        }
+
+        std::vector<Entry>            entries_;
+        std::array<Shard, ShardCount> shards_;
+    };
+
     ///////////////////////////////////////////////////////////////////////////
     struct RayHistoryTrace::Impl
     {
@@ -341,9 +489,27 @@ namespace rta
         static constexpr const char* RayIndexChunkIdentifier = "HistoryRayIndex";
 
         Impl(std::vector<std::byte>&& tokens, std::vector<TokenIndex>&& tokenIndices, std::vector<RayRange>&& rayRanges, const std::uint32_t highestRayId)
-            : tokenData_(std::move(tokens))
-            , tokenIndices_(std::move(tokenIndices))
-            , rayRanges_(std::move(rayRanges))
+            : ownedTokenData_(std::move(tokens))
+            , ownedTokenIndices_(std::move(tokenIndices))
+            , ownedRayRanges_(std::move(rayRanges))
+            , lastRayId_(highestRayId)
+        {
+            UseOwnedStorage();
+            CreateRayIndex();
+        }
+
+        Impl(std::shared_ptr<const void> storage,
+             const std::byte*            tokens,
+             const std::size_t           tokenSize,
+             const TokenIndex*           tokenIndices,
+             const std::size_t           tokenIndexCount,
+             const RayRange*             rayRanges,
+             const std::size_t           rayRangeCount,
+             const std::uint32_t         highestRayId)
+            : tokenData_(tokens, tokenSize)
+            , tokenIndices_(tokenIndices, tokenIndexCount)
+            , rayRanges_(rayRanges, rayRangeCount)
+            , externalStorage_(std::move(storage))
             , lastRayId_(highestRayId)
         {
             CreateRayIndex();
@@ -364,6 +530,16 @@ namespace rta
         RayHistory GetRayByIndex(const int index) const
         {
             const auto& range = rayRanges_[index];
+
+            if (!tokenBlocks_.empty())
+            {
+                const std::size_t blockIndex = index / raysPerBlock_;
+                auto              block      = GetTokenBlock(blockIndex);
+                const std::byte*  data       = block->data() + (range.dataStart - tokenBlocks_[blockIndex].dataStart);
+
+                return RayHistory(data, tokenIndices_.data() + range.tokenStart, range.tokenCount, range.rayId, std::move(block));
+            }
+
             return RayHistory(tokenData_.data() + range.dataStart, tokenIndices_.data() + range.tokenStart, range.tokenCount, range.rayId);
         }
 
@@ -371,9 +547,7 @@ namespace rta
         {
             if (const auto it = rayIndices_.find(index); it != rayIndices_.end())
             {
-                const auto& range = rayRanges_[it->second];
-
-                return RayHistory(tokenData_.data() + range.dataStart, tokenIndices_.data() + range.tokenStart, range.tokenCount, range.rayId);
+                return GetRayByIndex(static_cast<int>(it->second));
             }
             else
             {
@@ -381,6 +555,98 @@ namespace rta
             }
         }
 
+        bool CompressTokens(const RayHistoryTrace::TokenCompressionOptions& options)
+        {
+            if (!tokenBlocks_.empty() || tokenData_.empty() || options.raysPerBlock == 0)
+            {
+                return false;
+            }
+
+            // Each block holds the token data from its first ray up to the first ray of the next block, so the
+            // rays must be laid out in order.
+            for (std::size_t i = 1; i < rayRanges_.size(); ++i)
+            {
+                if (rayRanges_[i].dataStart < rayRanges_[i - 1].dataStart)
+                {
+                    return false;
+                }
+            }
+            if (rayRanges_.empty() || rayRanges_.back().dataStart > tokenData_.size())
+            {
+                return false;
+            }
+
+            const std::size_t                 blockCount = (rayRanges_.size() + options.raysPerBlock - 1) / options.raysPerBlock;
+            std::vector<CompressedTokenBlock> blocks(blockCount);
+            std::atomic<bool>                 failed{false};
+
+            const std::size_t taskCount = rra::GetParallelTaskCount(blockCount, 16);
+            rra::RunInParallel(taskCount, [&](std::size_t taskIndex) {
+                for (std::size_t i = blockCount * taskIndex / taskCount; i < blockCount * (taskIndex + 1) / taskCount; ++i)
+                {
+                    const std::size_t firstRay = i * options.raysPerBlock;
+                    const std::size_t lastRay  = firstRay + options.raysPerBlock;
+
+                    CompressedTokenBlock& block = blocks[i];
+                    block.dataStart             = rayRanges_[firstRay].dataStart;
+                    block.dataSize              = (lastRay < rayRanges_.size() ? rayRanges_[lastRay].dataStart : tokenData_.size()) - block.dataStart;
+
+                    if (!RayHistoryTrace::CompressTokenBlock(tokenData_.data() + block.dataStart, options.compressionLevel, block))
+                    {
+                        failed = true;
+                        return;
+                    }
+                }
+            });
+
+            if (failed)
+            {
+                return false;
+            }
+
+            tokenBlocks_  = std::move(blocks);
+            raysPerBlock_ = options.raysPerBlock;
+            blockCache_   = std::make_unique<TokenBlockCache>(blockCount, options.cacheSize);
+
+            // Token data in external storage is left to its owner.
+            tokenData_ = {};
+            std::vector<std::byte>().swap(ownedTokenData_);
+
+            return true;
+        }
+
+        bool SetCompressedTokens(std::vector<CompressedTokenBlock>&& blocks, const RayHistoryTrace::TokenCompressionOptions& options)
+        {
+            if (!tokenBlocks_.empty() || !tokenData_.empty() || options.raysPerBlock == 0)
+            {
+                return false;
+            }
+
+            const std::size_t blockCount = (rayRanges_.size() + options.raysPerBlock - 1) / options.raysPerBlock;
+            if (blocks.size() != blockCount)
+            {
+                return false;
+            }
+            for (std::size_t i = 0; i < blockCount; ++i)
+            {
+                if (blocks[i].dataStart != rayRanges_[i * options.raysPerBlock].dataStart)
+                {
+                    return false;
+                }
+            }
+
+            tokenBlocks_  = std::move(blocks);
+            raysPerBlock_ = options.raysPerBlock;
+            blockCache_   = std::make_unique<TokenBlockCache>(blockCount, options.cacheSize);
+
+            return true;
+        }
+
+        bool HasCompressedTokens() const
+        {
+            return !tokenBlocks_.empty();
+        }
+
         MetadataStore& GetMetadataStore()
         {
             return metadataStore_;
@@ -398,7 +664,19 @@ namespace rta
         void SaveToFile(rdf::ChunkFileWriter& cfw, const rdfCompression compression, const bool includeEmptyMetadata) const
         {
             cfw.BeginChunk(TokenChunkIdentifier, 0, nullptr, compression, 2);
-            cfw.AppendToChunk(tokenData_.size(), tokenData_.data());
+            if (tokenBlocks_.empty())
+            {
+                cfw.AppendToChunk(tokenData_.size(), tokenData_.data());
+            }
+            else
+            {
+                // Write the blocks one at a time, so the whole token data is never decompressed at once.
+                for (const auto& block : tokenBlocks_)
+                {
+                    const auto data = DecompressTokenBlock(block);
+                    cfw.AppendToChunk(data->size(), data->data());
+                }
+            }
             cfw.EndChunk();
 
             cfw.BeginChunk(IndexChunkIdentifier, 0, nullptr, compression, 2);
@@ -471,24 +749,31 @@ namespace rta
         {
             CheckChunks(chunkFile);
 
-            tokenData_.resize(chunkFile.GetChunkDataSize(TokenChunkIdentifier, chunkIndex));
-            if (!tokenData_.empty())
+            tokenBlocks_.clear();
+            raysPerBlock_ = 0;
+            blockCache_.reset();
+            externalStorage_.reset();
+
+            ownedTokenData_.resize(chunkFile.GetChunkDataSize(TokenChunkIdentifier, chunkIndex));
+            if (!ownedTokenData_.empty())
             {
-                chunkFile.ReadChunkDataToBuffer(TokenChunkIdentifier, chunkIndex, tokenData_.data());
+                chunkFile.ReadChunkDataToBuffer(TokenChunkIdentifier, chunkIndex, ownedTokenData_.data());
             }
 
-            tokenIndices_.resize(chunkFile.GetChunkDataSize(IndexChunkIdentifier, chunkIndex) / sizeof(RayHistoryTrace::TokenIndex));
-            if (!tokenIndices_.empty())
+            ownedTokenIndices_.resize(chunkFile.GetChunkDataSize(IndexChunkIdentifier, chunkIndex) / sizeof(RayHistoryTrace::TokenIndex));
+            if (!ownedTokenIndices_.empty())
             {
-                chunkFile.ReadChunkDataToBuffer(IndexChunkIdentifier, chunkIndex, tokenIndices_.data());
+                chunkFile.ReadChunkDataToBuffer(IndexChunkIdentifier, chunkIndex, ownedTokenIndices_.data());
             }
 
-            rayRanges_.resize(chunkFile.GetChunkDataSize(RayIndexChunkIdentifier, chunkIndex) / sizeof(RayHistoryTrace::RayRange));
-            if (!rayRanges_.empty())
+            ownedRayRanges_.resize(chunkFile.GetChunkDataSize(RayIndexChunkIdentifier, chunkIndex) / sizeof(RayHistoryTrace::RayRange));
+            if (!ownedRayRanges_.empty())
             {
-                chunkFile.ReadChunkDataToBuffer(RayIndexChunkIdentifier, chunkIndex, rayRanges_.data());
+                chunkFile.ReadChunkDataToBuffer(RayIndexChunkIdentifier, chunkIndex, ownedRayRanges_.data());
             }
 
+            UseOwnedStorage();
+
             metadataStore_.LoadFromFile(chunkFile, chunkIndex);
 
             // Try to reconstruct the last ray ID from the dispatch size. If
@@ -533,6 +818,35 @@ namespace rta
             }
         }
 
+        static TokenBlockCache::Block DecompressTokenBlock(const CompressedTokenBlock& block)
+        {
+            auto              data = std::make_shared<std::vector<std::byte>>(block.dataSize);
+            const std::size_t size = ZSTD_decompress(data->data(), data->size(), block.compressedData.data(), block.compressedData.size());
+            if (ZSTD_isError(size) || size != block.dataSize)
+            {
+                RRA_ASSERT_FAIL("Corrupt ray history token block");
+            }
+            return data;
+        }
+
+        TokenBlockCache::Block GetTokenBlock(const std::size_t blockIndex) const
+        {
+            if (auto block = blockCache_->Find(blockIndex))
+            {
+                return block;
+            }
+
+            // Decompress outside the cache locks, so other threads can keep reading cached blocks.
+            return blockCache_->Insert(blockIndex, DecompressTokenBlock(tokenBlocks_[blockIndex]));
+        }
+
+        void UseOwnedStorage()
+        {
+            tokenData_    = ownedTokenData_;
+            tokenIndices_ = ownedTokenIndices_;
+            rayRanges_    = ownedRayRanges_;
+        }
+
         void CreateRayIndex()
         {
             for (std::size_t i = 0; i < rayRanges_.size(); ++i)
@@ -543,9 +857,20 @@ namespace rta
             }
         }
 
-        std::vector<std::byte>                   tokenData_;
-        std::vector<RayHistoryTrace::TokenIndex> tokenIndices_;
-        std::vector<RayHistoryTrace::RayRange>   rayRanges_;
+        // The arrays read from, in either the owned vectors or the external storage
+        ArrayView<std::byte>                   tokenData_;
+        ArrayView<RayHistoryTrace::TokenIndex> tokenIndices_;
+        ArrayView<RayHistoryTrace::RayRange>   rayRanges_;
+
+        std::vector<std::byte>                   ownedTokenData_;
+        std::vector<RayHistoryTrace::TokenIndex> ownedTokenIndices_;
+        std::vector<RayHistoryTrace::RayRange>   ownedRayRanges_;
+        std::shared_ptr<const void>              externalStorage_;
+
+        // Compressed token storage, used instead of tokenData_ when not empty
+        std::vector<CompressedTokenBlock> tokenBlocks_;
+        std::uint32_t                     raysPerBlock_ = 0;
+        std::unique_ptr<TokenBlockCache>  blockCache_;
 
         std::unordered_map<std::uint32_t, std::size_t> rayIndices_;
         std::uint32_t                                  lastRayId_ = 0;
@@ -584,6 +909,19 @@ namespace rta
     {
     }
 
+    ///////////////////////////////////////////////////////////////////////////
+    RayHistoryTrace::RayHistoryTrace(std::shared_ptr<const void> storage,
+                                     const std::byte*            tokens,
+                                     const std::size_t           tokenSize,
+                                     const TokenIndex*           tokenIndices,
+                                     const std::size_t           tokenIndexCount,
+                                     const RayRange*             rayRanges,
+                                     const std::size_t           rayRangeCount,
+                                     const std::uint32_t         highestRayId)
+        : impl_(new Impl(std::move(storage), tokens, tokenSize, tokenIndices, tokenIndexCount, rayRanges, rayRangeCount, highestRayId))
+    {
+    }
+
     ///////////////////////////////////////////////////////////////////////////
     RayHistoryTrace::RayHistoryTrace()
         : impl_(new Impl())
@@ -602,6 +940,40 @@ namespace rta
         return impl_->GetRayById(id);
     }
 
+    ///////////////////////////////////////////////////////////////////////////
+    bool RayHistoryTrace::CompressTokens(const TokenCompressionOptions& options)
+    {
+        return impl_->CompressTokens(options);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    bool RayHistoryTrace::CompressTokenBlock(const std::byte* data, const int compressionLevel, CompressedTokenBlock& block)
+    {
+        block.compressedData.resize(ZSTD_compressBound(block.dataSize));
+        const std::size_t compressedSize =
+            ZSTD_compress(block.compressedData.data(), block.compressedData.size(), data, block.dataSize, compressionLevel);
+        if (ZSTD_isError(compressedSize))
+        {
+            std::vector<std::byte>().swap(block.compressedData);
+            return false;
+        }
+        block.compressedData.resize(compressedSize);
+        block.compressedData.shrink_to_fit();
+        return true;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    bool RayHistoryTrace::SetCompressedTokens(std::vector<CompressedTokenBlock>&& blocks, const TokenCompressionOptions& options)
+    {
+        return impl_->SetCompressedTokens(std::move(blocks), options);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    bool RayHistoryTrace::HasCompressedTokens() const
+    {
+        return impl_->HasCompressedTokens();
+    }
+
     ///////////////////////////////////////////////////////////////////////////
     int RayHistoryTrace::GetRayCount(IterationMode mode) const
     {
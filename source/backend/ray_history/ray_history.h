@@ -285,10 +285,48 @@ namespace rta
             std::uint32_t isControl : 1;
         };
 
+        /**
+    Options for compressed token storage. The token data is split into blocks
+    of raysPerBlock consecutive rays, each compressed with zstd. Blocks are
+    decompressed on access, and up to cacheSize bytes of decompressed blocks
+    are kept, evicting the least recently used block first.
+    */
+        struct TokenCompressionOptions
+        {
+            std::uint32_t raysPerBlock     = 1024;
+            std::size_t   cacheSize        = 256 * 1024 * 1024;
+            int           compressionLevel = 1;
+        };
+
+        /**
+    A block of compressed token data, holding the tokens of raysPerBlock
+    consecutive rays.
+    */
+        struct CompressedTokenBlock
+        {
+            // Offset of the block within the uncompressed token data
+            std::size_t dataStart = 0;
+            std::size_t dataSize  = 0;
+
+            std::vector<std::byte> compressedData;
+        };
+
         RayHistoryTrace(std::vector<std::byte>&&  tokens,
                         std::vector<TokenIndex>&& tokenIndices,
                         std::vector<RayRange>&&   rayRanges,
                         const std::uint32_t       highestRayId);
+        /**
+    Create a trace that reads its arrays from storage it doesn't own, such as
+    a mapped file. The storage is kept alive as long as the trace.
+    */
+        RayHistoryTrace(std::shared_ptr<const void> storage,
+                        const std::byte*            tokens,
+                        const std::size_t           tokenSize,
+                        const TokenIndex*           tokenIndices,
+                        const std::size_t           tokenIndexCount,
+                        const RayRange*             rayRanges,
+                        const std::size_t           rayRangeCount,
+                        const std::uint32_t         highestRayId);
         RayHistoryTrace();
         ~RayHistoryTrace();
 
@@ -426,6 +464,40 @@ namespace rta
         */
         RayHistory GetRayById(const int rayId) const;
 
+        /**
+        * Switch the token data to compressed storage. This is not thread safe,
+        * so it must be done before the trace is shared. Returns false and
+        * leaves the trace unchanged if the token data can't be split into
+        * blocks of rays, or fails to compress.
+        *
+        * The uncompressed token data is only released once every block is
+        * compressed, so the peak memory use includes both. To avoid that,
+        * compress the blocks as they are written with CompressTokenBlock()
+        * and hand them over with SetCompressedTokens().
+        *
+        * A RayHistory returned by a compressed trace keeps its block
+        * decompressed, so its tokens must not outlive it.
+        */
+        bool CompressTokens(const TokenCompressionOptions& options);
+
+        /**
+        * Compress the token data of one block, with block.dataStart and
+        * block.dataSize already set. data points to the start of the block.
+        * Returns false if the data fails to compress.
+        */
+        static bool CompressTokenBlock(const std::byte* data, int compressionLevel, CompressedTokenBlock& block);
+
+        /**
+        * Use token data that was compressed as it was written, for a trace
+        * created without token data. There must be one block for every
+        * options.raysPerBlock rays, in order. Like CompressTokens(), this
+        * must be done before the trace is shared. Returns false and leaves
+        * the trace unchanged if the blocks don't cover the rays.
+        */
+        bool SetCompressedTokens(std::vector<CompressedTokenBlock>&& blocks, const TokenCompressionOptions& options);
+
+        bool HasCompressedTokens() const;
+
         void AddMetadata(const RayHistoryMetadataKind kind, const std::size_t size, const void* buffer);
         void RemoveMetadata(const RayHistoryMetadataKind kind);
 
@@ -783,6 +855,20 @@ namespace rta
         {
         }
 
+        // block keeps the decompressed token block that data points into alive.
+        RayHistory(const std::byte*                              data,
+                   const RayHistoryTrace::TokenIndex*            indices,
+                   const int                                     count,
+                   const std::uint32_t                           rayId,
+                   std::shared_ptr<const std::vector<std::byte>> block)
+            : data_(data)
+            , indices_(indices)
+            , count_(count)
+            , rayId_(rayId)
+            , block_(std::move(block))
+        {
+        }
+
         RayHistory() = default;
 
         int GetTokenCount() const
@@ -868,6 +954,8 @@ namespace rta
         const RayHistoryTrace::TokenIndex* indices_ = nullptr;
         int                                count_   = 0;
         std::uint32_t                      rayId_   = 0xFFFFFFFF;
+
+        std::shared_ptr<const std::vector<std::byte>> block_;
     };
 
     // Loads ray history trace from file in binary format
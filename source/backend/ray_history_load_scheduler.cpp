@@ -0,0 +1,117 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Implementation for the ray history load scheduler.
+//=============================================================================
+
+#include "ray_history_load_scheduler.h"
+
+#include <algorithm>
+
+namespace rra
+{
+    RayHistoryLoadScheduler::RayHistoryLoadScheduler(std::uint32_t worker_count, std::uint64_t memory_budget)
+        : memory_budget_(memory_budget)
+    {
+        if (worker_count == 0)
+        {
+            worker_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        workers_.reserve(worker_count);
+        for (std::uint32_t i = 0; i < worker_count; ++i)
+        {
+            workers_.emplace_back(&RayHistoryLoadScheduler::WorkerLoop, this);
+        }
+    }
+
+    RayHistoryLoadScheduler::~RayHistoryLoadScheduler()
+    {
+        decltype(queue_) unstarted;
+        {
+            std::scoped_lock<std::mutex> lock(mutex_);
+            shutdown_ = true;
+            unstarted.swap(queue_);
+        }
+        condition_.notify_all();
+
+        for (auto& worker : workers_)
+        {
+            worker.join();
+        }
+
+        // Run the loads that never started, so they finish and release anything waiting on them.
+        for (auto& queued_job : unstarted)
+        {
+            queued_job.job();
+        }
+    }
+
+    void RayHistoryLoadScheduler::Submit(std::int64_t dispatch_index, std::uint64_t memory_cost, std::function<void()> job)
+    {
+        {
+            std::scoped_lock<std::mutex> lock(mutex_);
+            queue_.push_back({dispatch_index, memory_cost, std::move(job)});
+        }
+        condition_.notify_one();
+    }
+
+    void RayHistoryLoadScheduler::Prioritize(std::int64_t dispatch_index)
+    {
+        {
+            std::scoped_lock<std::mutex> lock(mutex_);
+
+            auto it = std::find_if(queue_.begin(), queue_.end(), [dispatch_index](const QueuedJob& job) { return job.dispatch_index == dispatch_index; });
+            if (it == queue_.end() || it == queue_.begin())
+            {
+                return;
+            }
+
+            QueuedJob job = std::move(*it);
+            queue_.erase(it);
+            queue_.push_front(std::move(job));
+        }
+        condition_.notify_all();
+    }
+
+    bool RayHistoryLoadScheduler::CanStartFrontJob() const
+    {
+        if (queue_.empty())
+        {
+            return false;
+        }
+        if (memory_budget_ == 0 || running_jobs_ == 0)
+        {
+            return true;
+        }
+        return memory_in_use_ + queue_.front().memory_cost <= memory_budget_;
+    }
+
+    void RayHistoryLoadScheduler::WorkerLoop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;)
+        {
+            // Only the front of the queue is considered, so a large load isn't starved by smaller ones behind it.
+            condition_.wait(lock, [this]() { return shutdown_ || CanStartFrontJob(); });
+            if (shutdown_)
+            {
+                return;
+            }
+
+            QueuedJob job = std::move(queue_.front());
+            queue_.pop_front();
+            memory_in_use_ += job.memory_cost;
+            running_jobs_++;
+
+            lock.unlock();
+            job.job();
+            lock.lock();
+
+            memory_in_use_ -= job.memory_cost;
+            running_jobs_--;
+            condition_.notify_all();
+        }
+    }
+}  // namespace rra
@@ -0,0 +1,88 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Definition for the ray history load scheduler.
+///
+/// The scheduler runs the ray history dispatch loaders on a fixed number of
+/// worker threads, and only starts a load once its memory estimate fits in
+/// the budget left by the loads already running.
+//=============================================================================
+
+#ifndef RRA_BACKEND_RAY_HISTORY_LOAD_SCHEDULER_H_
+#define RRA_BACKEND_RAY_HISTORY_LOAD_SCHEDULER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rra
+{
+    class RayHistoryLoadScheduler
+    {
+    public:
+        /// @brief Constructor.
+        ///
+        /// @param [in] worker_count  The number of worker threads. 0 uses the number of hardware threads.
+        /// @param [in] memory_budget The number of bytes the running loads may use between them. 0 means no limit.
+        RayHistoryLoadScheduler(std::uint32_t worker_count, std::uint64_t memory_budget);
+
+        /// @brief Destructor.
+        ///
+        /// Loads that are running are waited for. Loads that haven't started are run on the calling thread, so
+        /// every load finishes and nothing waiting on one is left blocked. Cancel the loads first, so the ones that
+        /// haven't started finish without reading the trace.
+        ~RayHistoryLoadScheduler();
+
+        /// @brief Queue a dispatch load.
+        ///
+        /// Loads start in the order they are queued, unless moved with Prioritize(). A load whose estimate
+        /// is larger than the whole budget still runs, but only once nothing else is running.
+        ///
+        /// @param [in] dispatch_index The dispatch index.
+        /// @param [in] memory_cost    An estimate of the peak memory used while loading, in bytes.
+        /// @param [in] job            The function that loads the dispatch.
+        void Submit(std::int64_t dispatch_index, std::uint64_t memory_cost, std::function<void()> job);
+
+        /// @brief Move a dispatch load to the front of the queue.
+        ///
+        /// Does nothing if the load has already started.
+        ///
+        /// @param [in] dispatch_index The dispatch index.
+        void Prioritize(std::int64_t dispatch_index);
+
+    private:
+        /// @brief A dispatch load waiting to start.
+        struct QueuedJob
+        {
+            std::int64_t          dispatch_index = 0;  ///< The dispatch index.
+            std::uint64_t         memory_cost    = 0;  ///< The memory estimate, in bytes.
+            std::function<void()> job;                 ///< The function that loads the dispatch.
+        };
+
+        /// @brief The worker thread function.
+        void WorkerLoop();
+
+        /// @brief Can the job at the front of the queue start now.
+        ///
+        /// Must be called with the mutex held.
+        ///
+        /// @return true if the front job fits in the memory budget.
+        bool CanStartFrontJob() const;
+
+        std::mutex               mutex_;                 ///< Guards the members below.
+        std::condition_variable  condition_;             ///< Signalled when the queue or memory use changes.
+        std::deque<QueuedJob>    queue_;                 ///< The loads waiting to start.
+        std::vector<std::thread> workers_;               ///< The worker threads.
+        std::uint64_t            memory_budget_ = 0;     ///< The memory budget, in bytes. 0 means no limit.
+        std::uint64_t            memory_in_use_ = 0;     ///< The memory estimate of the running loads, in bytes.
+        std::uint32_t            running_jobs_  = 0;     ///< The number of running loads.
+        bool                     shutdown_      = false;  ///< Set when the workers should exit.
+    };
+}  // namespace rra
+
+#endif  // RRA_BACKEND_RAY_HISTORY_LOAD_SCHEDULER_H_
@@ -0,0 +1,273 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Implementation for the ray history query engine.
+//=============================================================================
+
+#include "ray_history_query.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+#include <vector>
+
+#include "parallel_util.h"
+#include "public/rra_assert.h"
+
+namespace rra
+{
+    static constexpr size_t kBitsPerWord = 64;
+
+    // Test one column of up to 64 rays.
+    //
+    // Kept free of early outs so the compiler can vectorize the compares.
+    //
+    // @param column The first entry of the column to test.
+    // @param count  The number of rays to test, at most 64.
+    // @param test   The condition, called with each entry.
+    //
+    // @return A bit for each ray, set if it passes the condition.
+    template <typename T, typename Test>
+    static uint64_t ScanColumn(const T* column, size_t count, Test test)
+    {
+        uint64_t bits = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            bits |= static_cast<uint64_t>(test(column[i])) << i;
+        }
+        return bits;
+    }
+
+    // Count the set bits in a range of a bitset.
+    //
+    // @param words The bitset.
+    // @param begin The first bit of the range.
+    // @param end   One past the last bit of the range.
+    //
+    // @return The number of set bits.
+    static uint32_t CountBits(const uint64_t* words, size_t begin, size_t end)
+    {
+        uint32_t count = 0;
+        while (begin < end)
+        {
+            const size_t word_index = begin / kBitsPerWord;
+            const size_t first_bit  = begin % kBitsPerWord;
+            const size_t last_bit   = std::min(kBitsPerWord, first_bit + (end - begin));
+
+            uint64_t mask = ~0ull << first_bit;
+            if (last_bit < kBitsPerWord)
+            {
+                mask &= ~(~0ull << last_bit);
+            }
+
+            count += static_cast<uint32_t>(std::bitset<kBitsPerWord>(words[word_index] & mask).count());
+            begin += last_bit - first_bit;
+        }
+        return count;
+    }
+
+    // Find which rays of a block of up to 64 match a query.
+    //
+    // @param table The ray table.
+    // @param query The query.
+    // @param first The first ray of the block.
+    // @param count The number of rays in the block.
+    //
+    // @return A bit for each ray, set if it matches.
+    static uint64_t ScanBlock(const RayDispatchRayTable& table, const RraRayQuery& query, size_t first, size_t count)
+    {
+        uint64_t bits = count == kBitsPerWord ? ~0ull : ((1ull << count) - 1);
+
+        if (query.predicates & kRraRayQueryMiss)
+        {
+            bits &= ScanColumn(table.hit_ts.data() + first, count, [](float hit_t) { return hit_t < 0.0f; });
+        }
+        if (query.predicates & kRraRayQueryHit)
+        {
+            bits &= ScanColumn(table.hit_ts.data() + first, count, [](float hit_t) { return hit_t >= 0.0f; });
+        }
+        if (query.predicates & kRraRayQueryMinIterations)
+        {
+            const uint32_t min_iterations = query.min_iterations;
+            bits &= ScanColumn(table.iteration_counts.data() + first, count, [min_iterations](uint32_t c) { return c >= min_iterations; });
+        }
+        if (query.predicates & kRraRayQueryMaxIterations)
+        {
+            const uint32_t max_iterations = query.max_iterations;
+            bits &= ScanColumn(table.iteration_counts.data() + first, count, [max_iterations](uint32_t c) { return c <= max_iterations; });
+        }
+        if (query.predicates & kRraRayQueryInstanceIndex)
+        {
+            // A miss leaves the instance index of the end token undefined, so only hits can match.
+            const uint32_t instance_index = query.instance_index;
+            bits &= ScanColumn(table.instance_indices.data() + first, count, [instance_index](uint32_t i) { return i == instance_index; });
+            bits &= ScanColumn(table.hit_ts.data() + first, count, [](float hit_t) { return hit_t >= 0.0f; });
+        }
+        if (query.predicates & kRraRayQueryAllRayFlags)
+        {
+            const uint32_t ray_flags = query.ray_flags;
+            bits &= ScanColumn(table.ray_flags.data() + first, count, [ray_flags](uint32_t f) { return (f & ray_flags) == ray_flags; });
+        }
+        if (query.predicates & kRraRayQueryAnyRayFlags)
+        {
+            const uint32_t ray_flags = query.ray_flags;
+            bits &= ScanColumn(table.ray_flags.data() + first, count, [ray_flags](uint32_t f) { return (f & ray_flags) != 0; });
+        }
+        if (query.predicates & kRraRayQueryTlasAddress)
+        {
+            const uint64_t tlas_address = query.tlas_address;
+            bits &= ScanColumn(table.tlas_addresses.data() + first, count, [tlas_address](uint64_t a) { return a == tlas_address; });
+        }
+
+        return bits;
+    }
+
+#ifdef _DEBUG
+    // Test one ray against a query, one condition at a time.
+    //
+    // @param table The ray table.
+    // @param query The query.
+    // @param ray   The ray to test.
+    //
+    // @return true if the ray matches.
+    static bool DebugRayMatchesQuery(const RayDispatchRayTable& table, const RraRayQuery& query, size_t ray)
+    {
+        const bool hit = table.hit_ts[ray] >= 0.0f;
+        if ((query.predicates & kRraRayQueryMiss) && hit)
+        {
+            return false;
+        }
+        if ((query.predicates & kRraRayQueryHit) && !hit)
+        {
+            return false;
+        }
+        if ((query.predicates & kRraRayQueryMinIterations) && table.iteration_counts[ray] < query.min_iterations)
+        {
+            return false;
+        }
+        if ((query.predicates & kRraRayQueryMaxIterations) && table.iteration_counts[ray] > query.max_iterations)
+        {
+            return false;
+        }
+        if ((query.predicates & kRraRayQueryInstanceIndex) && (!hit || table.instance_indices[ray] != query.instance_index))
+        {
+            return false;
+        }
+        if ((query.predicates & kRraRayQueryAllRayFlags) && (table.ray_flags[ray] & query.ray_flags) != query.ray_flags)
+        {
+            return false;
+        }
+        if ((query.predicates & kRraRayQueryAnyRayFlags) && (table.ray_flags[ray] & query.ray_flags) == 0)
+        {
+            return false;
+        }
+        if ((query.predicates & kRraRayQueryTlasAddress) && table.tlas_addresses[ray] != query.tlas_address)
+        {
+            return false;
+        }
+        return true;
+    }
+#endif  // _DEBUG
+
+    RraErrorCode EvaluateRayQuery(const RayDispatchRayTable& table, const RayDispatchData& dispatch_data, const RraRayQuery& query, RraRayQueryResult& result)
+    {
+        const size_t ray_count        = table.hit_ts.size();
+        const size_t coordinate_count = dispatch_data.coordinate_stats.size();
+        if (ray_count != dispatch_data.begin_identifiers.size() || dispatch_data.coordinate_offsets.size() != coordinate_count + 1)
+        {
+            return kRraErrorMalformedData;
+        }
+
+        // Scan the columns into a bitset of matching rays. Tasks own whole words, so they never share one.
+        const size_t          word_count = (ray_count + kBitsPerWord - 1) / kBitsPerWord;
+        std::vector<uint64_t> local_bits;
+        uint64_t*             ray_bits = result.ray_bits;
+        if (ray_bits == nullptr)
+        {
+            local_bits.resize(word_count);
+            ray_bits = local_bits.data();
+        }
+
+        constexpr size_t kMinWordsPerTask = 1024;
+
+        const size_t scan_task_count = GetParallelTaskCount(word_count, kMinWordsPerTask);
+        RunInParallel(scan_task_count, [&](size_t task_index) {
+            const size_t first_word = word_count * task_index / scan_task_count;
+            const size_t last_word  = word_count * (task_index + 1) / scan_task_count;
+            for (size_t word = first_word; word < last_word; word++)
+            {
+                const size_t first_ray = word * kBitsPerWord;
+                ray_bits[word]         = ScanBlock(table, query, first_ray, std::min(kBitsPerWord, ray_count - first_ray));
+            }
+        });
+
+        // Reduce the bitset per coordinate. Each task collects its matching coordinates, and the lists are joined in order.
+        constexpr size_t kMinCoordinatesPerTask = 64 * 1024;
+
+        const size_t                       coordinate_task_count = GetParallelTaskCount(coordinate_count, kMinCoordinatesPerTask);
+        std::vector<std::vector<uint32_t>> task_coordinates(coordinate_task_count);
+        std::vector<uint32_t>              task_match_counts(coordinate_task_count);
+
+        RunInParallel(coordinate_task_count, [&](size_t task_index) {
+            const size_t first_coordinate = coordinate_count * task_index / coordinate_task_count;
+            const size_t last_coordinate  = coordinate_count * (task_index + 1) / coordinate_task_count;
+            for (size_t coordinate = first_coordinate; coordinate < last_coordinate; coordinate++)
+            {
+                const uint32_t match_count =
+                    CountBits(ray_bits, dispatch_data.coordinate_offsets[coordinate], dispatch_data.coordinate_offsets[coordinate + 1]);
+
+                if (result.coordinate_match_counts != nullptr)
+                {
+                    result.coordinate_match_counts[coordinate] = match_count;
+                }
+                if (match_count > 0)
+                {
+                    task_coordinates[task_index].push_back(static_cast<uint32_t>(coordinate));
+                }
+                task_match_counts[task_index] += match_count;
+            }
+        });
+
+        result.ray_count                 = static_cast<uint32_t>(ray_count);
+        result.match_count               = 0;
+        result.matching_coordinate_count = 0;
+        for (size_t i = 0; i < coordinate_task_count; i++)
+        {
+            if (result.matching_coordinates != nullptr)
+            {
+                std::copy(task_coordinates[i].begin(), task_coordinates[i].end(), result.matching_coordinates + result.matching_coordinate_count);
+            }
+            result.match_count += task_match_counts[i];
+            result.matching_coordinate_count += static_cast<uint32_t>(task_coordinates[i].size());
+        }
+
+#ifdef _DEBUG
+        // Check the result against testing the rays one at a time on this thread.
+        uint32_t debug_match_count      = 0;
+        uint32_t debug_coordinate_count = 0;
+        for (size_t coordinate = 0; coordinate < coordinate_count; coordinate++)
+        {
+            uint32_t match_count = 0;
+            for (size_t ray = dispatch_data.coordinate_offsets[coordinate]; ray < dispatch_data.coordinate_offsets[coordinate + 1]; ray++)
+            {
+                const bool matches = DebugRayMatchesQuery(table, query, ray);
+                RRA_ASSERT(((ray_bits[ray / kBitsPerWord] >> (ray % kBitsPerWord)) & 1) == (matches ? 1u : 0u));
+                match_count += matches ? 1 : 0;
+            }
+
+            RRA_ASSERT(result.coordinate_match_counts == nullptr || result.coordinate_match_counts[coordinate] == match_count);
+            if (match_count > 0)
+            {
+                RRA_ASSERT(result.matching_coordinates == nullptr || result.matching_coordinates[debug_coordinate_count] == coordinate);
+                debug_coordinate_count++;
+            }
+            debug_match_count += match_count;
+        }
+        RRA_ASSERT(result.match_count == debug_match_count);
+        RRA_ASSERT(result.matching_coordinate_count == debug_coordinate_count);
+#endif  // _DEBUG
+
+        return kRraOk;
+    }
+}  // namespace rra
@@ -0,0 +1,31 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Definition for the ray history query engine.
+///
+/// Queries are evaluated over the columnar ray table of a dispatch. The
+/// table is scanned 64 rays at a time, one column per condition, into a
+/// bitset of matching rays, which is then reduced per coordinate.
+//=============================================================================
+
+#ifndef RRA_BACKEND_RAY_HISTORY_QUERY_H_
+#define RRA_BACKEND_RAY_HISTORY_QUERY_H_
+
+#include "public/rra_error.h"
+#include "public/rra_ray_history.h"
+
+namespace rra
+{
+    /// @brief Find the rays of a dispatch that match a query.
+    ///
+    /// @param [in]     table         The ray table of the dispatch.
+    /// @param [in]     dispatch_data The indexed dispatch data, for the coordinate of each ray.
+    /// @param [in]     query         The query.
+    /// @param [in,out] result        The arrays to fill in, and the counts.
+    ///
+    /// @return kRraOk if successful, an error code if not.
+    RraErrorCode EvaluateRayQuery(const RayDispatchRayTable& table, const RayDispatchData& dispatch_data, const RraRayQuery& query, RraRayQueryResult& result);
+}  // namespace rra
+
+#endif  // RRA_BACKEND_RAY_HISTORY_QUERY_H_
@@ -7,8 +7,17 @@
 
 #include "public/rra_async_ray_history_loader.h"
 #include <rdf/rdf/inc/amdrdf.h>
+#include "derived_data_cache.h"
+#include "mapped_scratch_file.h"
+#include "parallel_util.h"
+#include "ray_history_load_scheduler.h"
+#include <algorithm>
+#include <atomic>
 #include <future>
+#include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
 
 struct AsyncLoaderRayHistoryData
 {
@@ -32,9 +41,637 @@ static bool ChunkVersionLessThan(uint32_t chunk_version, uint32_t major_version,
     return false;
 }
 
-RraAsyncRayHistoryLoader::RraAsyncRayHistoryLoader(const char* file_path, int64_t dispatch_index)
+/// @brief The per-ray bookkeeping of the ray history token parse.
+struct RaySlot
 {
-    dispatch_index_ = dispatch_index;
+    std::size_t   data_start  = 0;      ///< The offset of the ray's first token in the combined token data.
+    std::uint32_t token_start = 0;      ///< The index of the ray's first token in the combined token indices.
+    std::uint32_t token_count = 0;      ///< The number of tokens of the ray.
+    std::uint32_t data_size   = 0;      ///< The number of token bytes of the ray.
+    std::uint32_t block_index = 0;      ///< The compressed token block holding the ray.
+    bool          seen        = false;  ///< Does the ray have an entry in the trace.
+    bool          begin_token = false;  ///< Does the ray have a begin token.
+};
+
+/// @brief A block of token data being filled in by pass 2, before it is compressed.
+struct PendingTokenBlock
+{
+    std::once_flag               allocated;     ///< Allocates the buffer on the first write to the block.
+    std::unique_ptr<std::byte[]> data;          ///< The uncompressed token data of the block.
+    std::atomic<std::size_t>     remaining{0};  ///< The number of bytes of the block still to be written.
+};
+
+/// @brief Ray slots indexed by ray id.
+///
+/// Ids from the base id up to the dense limit index a flat array that grows on demand. Any other
+/// id goes to a map instead, so a corrupt id can't force a huge allocation.
+class RaySlotTable
+{
+public:
+    /// @brief Constructor.
+    ///
+    /// @param [in] base        The lowest ray id stored in the flat array.
+    /// @param [in] dense_limit The maximum number of ray ids stored in the flat array.
+    RaySlotTable(std::uint32_t base = 0, std::size_t dense_limit = 0)
+        : base_(base)
+        , dense_limit_(dense_limit)
+    {
+    }
+
+    /// @brief Get the slot of a ray, adding it if it isn't in the table.
+    ///
+    /// @param [in] ray_id The ray id.
+    ///
+    /// @return The slot.
+    RaySlot& Get(std::uint32_t ray_id)
+    {
+        if (IsDense(ray_id))
+        {
+            const std::size_t index = ray_id - base_;
+            if (index >= dense_.size())
+            {
+                dense_.resize(std::min(dense_limit_, std::max<std::size_t>(index + 1, dense_.size() * 2)));
+            }
+            return dense_[index];
+        }
+        return sparse_[ray_id];
+    }
+
+    /// @brief Get the slot of a ray that is already in the table.
+    ///
+    /// Doesn't modify the table, so it can be called from several threads at once.
+    ///
+    /// @param [in] ray_id The ray id.
+    ///
+    /// @return The slot.
+    const RaySlot& Find(std::uint32_t ray_id) const
+    {
+        if (IsDense(ray_id))
+        {
+            return dense_[ray_id - base_];
+        }
+        return sparse_.find(ray_id)->second;
+    }
+
+    /// @brief Visit the rays that have been seen, in ray id order.
+    ///
+    /// @param [in] visit The function to call with each ray id and slot.
+    template <typename Visit>
+    void ForEachSeen(Visit&& visit)
+    {
+        auto sparse_it = sparse_.begin();
+        for (; sparse_it != sparse_.end() && sparse_it->first < base_; ++sparse_it)
+        {
+            visit(sparse_it->first, sparse_it->second);
+        }
+        for (std::size_t i = 0; i < dense_.size(); i++)
+        {
+            if (dense_[i].seen)
+            {
+                visit(static_cast<std::uint32_t>(base_ + i), dense_[i]);
+            }
+        }
+        for (; sparse_it != sparse_.end(); ++sparse_it)
+        {
+            visit(sparse_it->first, sparse_it->second);
+        }
+    }
+
+private:
+    /// @brief Is a ray id stored in the flat array.
+    ///
+    /// @param [in] ray_id The ray id.
+    ///
+    /// @return true if the id is in the flat array range, false if it belongs in the map.
+    bool IsDense(std::uint32_t ray_id) const
+    {
+        return ray_id >= base_ && (ray_id - base_) < dense_limit_;
+    }
+
+    std::uint32_t                    base_        = 0;  ///< The lowest ray id stored in the flat array.
+    std::size_t                      dense_limit_ = 0;  ///< The maximum number of ray ids stored in the flat array.
+    std::vector<RaySlot>             dense_;            ///< The slots of the ray ids in the flat array range.
+    std::map<std::uint32_t, RaySlot> sparse_;           ///< The slots of any other ray ids.
+};
+
+/// @brief A range of the raw token buffer that is parsed on one thread.
+struct TokenShard
+{
+    std::size_t   begin      = 0;      ///< The offset of the first token in the shard.
+    std::size_t   end        = 0;      ///< The offset just past the shard.
+    std::uint32_t min_ray_id = ~0u;    ///< The lowest ray id in the shard.
+    std::uint32_t max_ray_id = 0;      ///< The highest ray id in the shard.
+    bool          complete   = true;   ///< false if the buffer ends part way through a token of the shard.
+    RaySlotTable  rays       = {};     ///< The rays in the shard. Their data and token starts are relative to the start of the ray.
+};
+
+/// @brief Walk the ray history tokens in part of a raw token buffer.
+///
+/// The tokens that start in [begin, end) are visited. The token framing has no sync markers, so begin must
+/// be the start of a token. The visitor is called with the ray id, the offset of the token, the token
+/// control (nullptr for data tokens), and the offset and size of the token data that follows the token id.
+/// A size of 0 means the token is invalid, and it only gives the ray an entry in the trace.
+///
+/// @param [in] buffer_data The raw token buffer.
+/// @param [in] buffer_size The raw token buffer size in bytes.
+/// @param [in] begin       The offset of the first token to visit.
+/// @param [in] end         The offset to stop at.
+/// @param [in] progress    The counter to add half of the walked bytes to, or nullptr.
+/// @param [in] cancelled   The flag that stops the walk early when set, or nullptr.
+/// @param [in] visit       The function to call for each token.
+///
+/// @return false if the buffer ends part way through a token or the walk was cancelled, true otherwise.
+template <typename Visit>
+static bool WalkRayHistoryTokens(const std::byte*         buffer_data,
+                                 size_t                   buffer_size,
+                                 size_t                   begin,
+                                 size_t                   end,
+                                 std::atomic<size_t>*     progress,
+                                 const std::atomic<bool>* cancelled,
+                                 Visit&&                  visit)
+{
+    using namespace rta;
+
+    // Progress is published and cancellation checked in steps, so the shards aren't all touching the same
+    // atomics for every token.
+    constexpr size_t kProgressStep = 1024 * 1024;
+
+    auto CheckOffsetIsInRange = [buffer_size](const size_t offset, const size_t size) -> bool { return offset + size <= buffer_size; };
+
+    bool   complete  = true;
+    size_t published = begin;
+    size_t offset    = begin;
+    while (offset < end)
+    {
+        if (offset - published >= kProgressStep)
+        {
+            if (progress != nullptr)
+            {
+                progress->fetch_add((offset - published) / 2, std::memory_order_relaxed);
+            }
+            published = offset;
+
+            if (cancelled != nullptr && cancelled->load(std::memory_order_relaxed))
+            {
+                complete = false;
+                break;
+            }
+        }
+
+        // We've reached the end of the stream, can't read anything here
+        if (!CheckOffsetIsInRange(offset, sizeof(RayHistoryTokenId)))
+        {
+            break;
+        }
+        // Tokens
+        const size_t token_offset = offset;
+        const auto   id           = reinterpret_cast<const RayHistoryTokenId*>(buffer_data + offset);
+        offset += sizeof(RayHistoryTokenId);
+
+        // The offset is pointing at the beginning of the control
+        // token, so check if we can read the whole control token. If not the
+        // trace is definitely broken
+        if (!CheckOffsetIsInRange(offset, sizeof(RayHistoryTokenControl)))
+        {
+            visit(id->id, token_offset, nullptr, offset, size_t(0));
+            complete = false;
+            break;
+        }
+
+        if (id->control)
+        {
+            // If it's a control word, then the payload comes right after
+            // this one
+            const auto control = reinterpret_cast<const RayHistoryTokenControl*>(buffer_data + offset);
+
+            // Check that we can actually read the whole token payload. At
+            // this point we know that we can dereference control, because
+            // that's checked above
+            if (!CheckOffsetIsInRange(offset, sizeof(RayHistoryTokenControl) + static_cast<std::size_t>(control->tokenLength) * 4))
+            {
+                visit(id->id, token_offset, nullptr, offset, size_t(0));
+                complete = false;
+                break;
+            }
+
+            const size_t token_size = sizeof(RayHistoryTokenControl) + static_cast<std::size_t>(control->tokenLength) * 4 /* size in DWORDS */;
+            visit(id->id, token_offset, control, offset, token_size);
+            offset += token_size;
+        }
+        else
+        {
+            // No need to check anything here because the control token is
+            // fully available.
+            // Tokens where TokenId and TokenControl are all zero are invalid
+            const bool is_invalid = std::all_of(
+                buffer_data + token_offset, buffer_data + offset + sizeof(RayHistoryTokenControl), [](const std::byte b) { return b == std::byte(); });
+
+            visit(id->id, token_offset, nullptr, offset, is_invalid ? size_t(0) : sizeof(RayHistoryTokenControl));
+            offset += sizeof(RayHistoryTokenControl);
+        }
+    }
+
+    if (progress != nullptr && offset > published)
+    {
+        progress->fetch_add((offset - published) / 2, std::memory_order_relaxed);
+    }
+
+    return complete;
+}
+
+/// @brief The tokens visited by a walk started at the nominal start of a shard, before its first real token is known.
+struct TokenShardWindow
+{
+    std::size_t                begin   = 0;   ///< The offset the walk started at.
+    std::size_t                end     = 0;   ///< The offset the walk stopped at.
+    std::vector<std::size_t>   offsets = {};  ///< The offsets of the tokens visited, in buffer order.
+    std::vector<std::uint32_t> ray_ids = {};  ///< The ray ids of the tokens visited.
+};
+
+/// @brief Find the shard boundaries of a raw token buffer, and the range of ray ids in each shard, with a single walk.
+///
+/// @param [in]     buffer_data The raw token buffer.
+/// @param [in]     buffer_size The raw token buffer size in bytes.
+/// @param [in]     cancelled   The flag that stops the walk early when set.
+/// @param [in,out] shards      The shards. Each is given its range of the buffer and its range of ray ids.
+static void FindTokenShardBoundariesSerial(const std::byte* buffer_data, size_t buffer_size, const std::atomic<bool>* cancelled, std::vector<TokenShard>& shards)
+{
+    const size_t nominal_shard_size = buffer_size / shards.size();
+    size_t       shard_index        = 0;
+
+    shards[0].begin = 0;
+    WalkRayHistoryTokens(buffer_data, buffer_size, 0, buffer_size, nullptr, cancelled, [&](std::uint32_t ray_id, size_t token_offset, const rta::RayHistoryTokenControl*, size_t, size_t) {
+        while (shard_index + 1 < shards.size() && token_offset >= (shard_index + 1) * nominal_shard_size)
+        {
+            shards[shard_index].end = token_offset;
+            shard_index++;
+            shards[shard_index].begin = token_offset;
+        }
+
+        TokenShard& shard = shards[shard_index];
+        shard.min_ray_id  = std::min(shard.min_ray_id, ray_id);
+        shard.max_ray_id  = std::max(shard.max_ray_id, ray_id);
+    });
+
+    shards[shard_index].end = buffer_size;
+    for (size_t i = shard_index + 1; i < shards.size(); i++)
+    {
+        shards[i].begin = buffer_size;
+        shards[i].end   = buffer_size;
+    }
+}
+
+/// @brief Find the shard boundaries of a raw token buffer, and the range of ray ids in each shard, walking the shards in parallel.
+///
+/// Tokens vary in size and have no sync markers, so a walk started part way through the buffer may read the middle
+/// of a token as a token header. Once two walks visit the same offset though, they are the same walk from then on.
+/// Each shard but the first walks a window from its nominal start and records the tokens it visits. Then each shard
+/// walks on past its end, until it visits a token that the next shard's window visited too. That token is the first
+/// token of the next shard. The first shard starts with the first token of the buffer, so by induction each shard
+/// starts with a real token, and the rest of its walk follows the real tokens.
+///
+/// @param [in]     buffer_data The raw token buffer.
+/// @param [in]     buffer_size The raw token buffer size in bytes.
+/// @param [in]     cancelled   The flag that stops the walks early when set.
+/// @param [in,out] shards      The shards. Each is given its range of the buffer and its range of ray ids.
+///
+/// @return false if a shard's walk didn't meet the next shard's window, true otherwise. If false, the shards must be
+/// found with FindTokenShardBoundariesSerial() instead.
+static bool FindTokenShardBoundaries(const std::byte* buffer_data, size_t buffer_size, const std::atomic<bool>* cancelled, std::vector<TokenShard>& shards)
+{
+    // A walk out of step with the real tokens gets back in step when it reads a header that straddles the real
+    // tokens by the right amount, which is usually within a few tokens. The window allows for long runs that don't.
+    constexpr size_t kWindowSize = 1024 * 1024;
+
+    const size_t nominal_shard_size = buffer_size / shards.size();
+    RRA_ASSERT(nominal_shard_size > kWindowSize);
+
+    // Walk the window at the start of each shard. Every token is a whole number of DWORDs, so the tokens all start
+    // on a DWORD boundary, and so do the windows.
+    std::vector<TokenShardWindow> windows(shards.size());
+    rra::RunInParallel(shards.size(), [&](size_t shard_index) {
+        if (shard_index == 0)
+        {
+            return;
+        }
+
+        TokenShardWindow& window = windows[shard_index];
+        window.begin             = (shard_index * nominal_shard_size) & ~size_t(3);
+        window.end               = std::min(buffer_size, window.begin + kWindowSize);
+        WalkRayHistoryTokens(
+            buffer_data, buffer_size, window.begin, window.end, nullptr, cancelled, [&window](std::uint32_t ray_id, size_t token_offset, const rta::RayHistoryTokenControl*, size_t, size_t) {
+                window.offsets.push_back(token_offset);
+                window.ray_ids.push_back(ray_id);
+            });
+    });
+
+    if (cancelled->load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+
+    // Walk each shard from the end of its window until it meets the next shard's window. The walk can't be stopped
+    // from the visitor, so it runs to the end of the next window, and ignores the tokens after the meeting point.
+    std::vector<size_t> next_begin(shards.size(), buffer_size);
+    std::vector<char>   met(shards.size(), 0);
+    rra::RunInParallel(shards.size(), [&](size_t shard_index) {
+        const TokenShardWindow& window = windows[shard_index];
+        const TokenShardWindow* next   = shard_index + 1 < shards.size() ? &windows[shard_index + 1] : nullptr;
+        TokenShard&             shard  = shards[shard_index];
+
+        // The first shard has no window. Any other shard carries on from the last token of its window.
+        size_t resume = 0;
+        if (shard_index > 0)
+        {
+            if (window.offsets.empty())
+            {
+                return;
+            }
+            resume = window.offsets.back();
+        }
+
+        const size_t end        = next != nullptr ? next->end : buffer_size;
+        size_t       next_token = 0;
+        bool         found      = false;
+        WalkRayHistoryTokens(buffer_data, buffer_size, resume, end, nullptr, cancelled, [&](std::uint32_t ray_id, size_t token_offset, const rta::RayHistoryTokenControl*, size_t, size_t) {
+            if (found || (shard_index > 0 && token_offset == resume))
+            {
+                return;
+            }
+
+            if (next != nullptr && token_offset >= next->begin)
+            {
+                while (next_token < next->offsets.size() && next->offsets[next_token] < token_offset)
+                {
+                    next_token++;
+                }
+                if (next_token < next->offsets.size() && next->offsets[next_token] == token_offset)
+                {
+                    next_begin[shard_index] = token_offset;
+                    found                   = true;
+                    return;
+                }
+            }
+
+            shard.min_ray_id = std::min(shard.min_ray_id, ray_id);
+            shard.max_ray_id = std::max(shard.max_ray_id, ray_id);
+        });
+
+        met[shard_index] = (found || next == nullptr) ? 1 : 0;
+    });
+
+    if (cancelled->load(std::memory_order_relaxed) || std::find(met.begin(), met.end(), 0) != met.end())
+    {
+        for (auto& shard : shards)
+        {
+            shard.min_ray_id = ~0u;
+            shard.max_ray_id = 0;
+        }
+        return false;
+    }
+
+    // Each shard's window tokens from its first real token on belong to it too.
+    shards[0].begin = 0;
+    for (size_t shard_index = 0; shard_index < shards.size(); shard_index++)
+    {
+        TokenShard& shard = shards[shard_index];
+        shard.end         = next_begin[shard_index];
+        if (shard_index + 1 < shards.size())
+        {
+            shards[shard_index + 1].begin = shard.end;
+        }
+
+        const TokenShardWindow& window = windows[shard_index];
+        for (size_t token = 0; token < window.offsets.size(); token++)
+        {
+            if (window.offsets[token] >= shard.begin)
+            {
+                shard.min_ray_id = std::min(shard.min_ray_id, window.ray_ids[token]);
+                shard.max_ray_id = std::max(shard.max_ray_id, window.ray_ids[token]);
+            }
+        }
+    }
+
+    return true;
+}
+
+/// @brief What the dispatch indexing found for one begin token of a ray.
+///
+/// The tokens of a ray that come before its first begin token get a record too, without an identifier.
+struct BeginTokenRecord
+{
+    uint32_t                   x          = 0;      ///< The dispatch coordinate x.
+    uint32_t                   y          = 0;      ///< The dispatch coordinate y.
+    uint32_t                   z          = 0;      ///< The dispatch coordinate z.
+    bool                       is_begin   = false;  ///< Does the record have a begin token.
+    RayDispatchBeginIdentifier identifier = {};     ///< The ray index and begin token index.
+    DispatchCoordinateStats    stats      = {};     ///< The stats to add to the dispatch coordinate.
+};
+
+/// @brief The dispatch indexing results for a range of rays.
+struct DispatchIndexPartial
+{
+    std::vector<BeginTokenRecord> records;     ///< The begin token records, in ray and token order.
+    RraRayHistoryStats            stats = {};  ///< The invocation counts of the range.
+    uint32_t                      max_x = 0;   ///< The highest dispatch coordinate x.
+    uint32_t                      max_y = 0;   ///< The highest dispatch coordinate y.
+    uint32_t                      max_z = 0;   ///< The highest dispatch coordinate z.
+};
+
+/// @brief Total up the invocation counts of the ranges of rays swept so far.
+///
+/// @param [in] partials The dispatch indexing results.
+///
+/// @return The invocation counts, without the raygen and pixel counts.
+static RraRayHistoryStats ReducePartialStats(const std::vector<DispatchIndexPartial>& partials)
+{
+    RraRayHistoryStats stats = {};
+    for (const auto& partial : partials)
+    {
+        stats.ray_count += partial.stats.ray_count;
+        stats.intersection_count += partial.stats.intersection_count;
+        stats.any_hit_count += partial.stats.any_hit_count;
+        stats.miss_count += partial.stats.miss_count;
+        stats.closest_hit_count += partial.stats.closest_hit_count;
+        stats.loop_iteration_count += partial.stats.loop_iteration_count;
+        stats.instance_intersection_count += partial.stats.instance_intersection_count;
+    }
+    return stats;
+}
+
+/// @brief The ids of a ray that link it into its coordinate's ray tree.
+struct RayLink
+{
+    uint32_t dynamic_id = 0;      ///< The dynamic id of the ray.
+    uint32_t parent_id  = 0;      ///< The dynamic id of the ray's parent.
+    uint32_t ray_index  = 0;      ///< The index of the ray within its coordinate.
+    bool     valid      = false;  ///< Does the ray have a begin token to take the ids from.
+};
+
+/// @brief Link the rays of one dispatch coordinate to their parents.
+///
+/// A ray's parent is the ray of the same coordinate whose dynamic id is the ray's parent id. When several rays share
+/// a dynamic id the last of them takes it, and the others are detached. Rays with a parent id of 0 or 0xFFFFFFFF are
+/// roots, and rays whose parent can't be found are detached. Each ray's child count is added to the entry after it
+/// in the child offsets.
+///
+/// The dynamic ids of a coordinate's rays are normally a dense range, so the owner of each id is found with a table
+/// indexed by id, filled in ray order in a single pass. If the ids are too spread out for a table, the rays are sorted
+/// by id and the owners are found with a binary search instead.
+///
+/// @param [in]     rh            The ray history trace.
+/// @param [in,out] dispatch_data The dispatch data to fill in the ray parents and child counts of.
+/// @param [in]     first_ray     The first ray of the coordinate.
+/// @param [in]     last_ray      One past the last ray of the coordinate.
+/// @param [in,out] links         Scratch space, reused between coordinates.
+/// @param [in,out] owners        Scratch space, reused between coordinates.
+static void LinkCoordinateRays(const rta::RayHistoryTrace& rh,
+                               RayDispatchData&            dispatch_data,
+                               uint32_t                    first_ray,
+                               uint32_t                    last_ray,
+                               std::vector<RayLink>&       links,
+                               std::vector<uint32_t>&      owners)
+{
+    // The owner table may be this many times the ray count, plus a little for coordinates with few rays.
+    constexpr uint64_t kMaxOwnerTableScale = 4;
+    constexpr uint64_t kMinOwnerTableSize  = 64;
+
+    links.clear();
+    uint32_t min_dynamic_id = std::numeric_limits<uint32_t>::max();
+    uint32_t max_dynamic_id = 0;
+    for (uint32_t i = first_ray; i < last_ray; i++)
+    {
+        const RayDispatchBeginIdentifier& begin_identifier = dispatch_data.begin_identifiers[i];
+        rta::RayHistory                   rta_ray{rh.GetRayByIndex(begin_identifier.dispatch_coord_index)};
+
+        RayLink link   = {};
+        link.ray_index = i - first_ray;
+        if (rta_ray.GetTokenCount() > 0 && rta_ray.GetToken(begin_identifier.begin_token_index).IsBegin())
+        {
+            auto begin_data = reinterpret_cast<const rta::RayHistoryTokenBeginDataV2*>(rta_ray.GetToken(begin_identifier.begin_token_index).GetPayload());
+            link.dynamic_id = begin_data->dynamicId;
+            link.parent_id  = begin_data->parentId;
+            link.valid      = true;
+            min_dynamic_id  = std::min(min_dynamic_id, link.dynamic_id);
+            max_dynamic_id  = std::max(max_dynamic_id, link.dynamic_id);
+        }
+        links.push_back(link);
+    }
+
+    const uint64_t owner_table_size = min_dynamic_id <= max_dynamic_id ? uint64_t(max_dynamic_id - min_dynamic_id) + 1 : 0;
+    const bool     use_owner_table  = owner_table_size <= kMaxOwnerTableScale * links.size() + kMinOwnerTableSize;
+
+    auto valid_end = links.end();
+    if (use_owner_table)
+    {
+        // The links are in ray order, so the last ray with an id overwrites the others.
+        owners.assign(owner_table_size, RayDispatchData::kDetachedRay);
+        for (const RayLink& link : links)
+        {
+            if (link.valid)
+            {
+                owners[link.dynamic_id - min_dynamic_id] = link.ray_index;
+            }
+        }
+    }
+    else
+    {
+        // Sort by dynamic id so owners can be found with a binary search. Rays without ids go last, and ties keep
+        // ray order, so the ray that owns a dynamic id is the last with that id.
+        std::sort(links.begin(), links.end(), [](const RayLink& a, const RayLink& b) {
+            if (a.valid != b.valid)
+            {
+                return a.valid;
+            }
+            return a.dynamic_id < b.dynamic_id || (a.dynamic_id == b.dynamic_id && a.ray_index < b.ray_index);
+        });
+        valid_end = std::partition_point(links.begin(), links.end(), [](const RayLink& link) { return link.valid; });
+    }
+
+    // Find the ray that owns a dynamic id, or kDetachedRay if there is none.
+    auto find_owner = [&](uint32_t dynamic_id) {
+        if (use_owner_table)
+        {
+            if (dynamic_id < min_dynamic_id || dynamic_id > max_dynamic_id)
+            {
+                return RayDispatchData::kDetachedRay;
+            }
+            return owners[dynamic_id - min_dynamic_id];
+        }
+
+        auto it = std::upper_bound(links.begin(), valid_end, dynamic_id, [](uint32_t id, const RayLink& link) { return id < link.dynamic_id; });
+        if (it == links.begin() || (it - 1)->dynamic_id != dynamic_id)
+        {
+            return RayDispatchData::kDetachedRay;
+        }
+        return (it - 1)->ray_index;
+    };
+
+    for (const RayLink& link : links)
+    {
+        uint32_t& parent = dispatch_data.ray_parents[first_ray + link.ray_index];
+        parent           = RayDispatchData::kDetachedRay;
+
+        // A ray that lost its dynamic id to a later ray isn't part of the tree.
+        if (!link.valid || find_owner(link.dynamic_id) != link.ray_index)
+        {
+            continue;
+        }
+
+        if (link.parent_id == 0 || link.parent_id == 0xFFFFFFFF)
+        {
+            parent = RayDispatchData::kRootRay;
+            continue;
+        }
+
+        const uint32_t owner = find_owner(link.parent_id);
+        if (owner != RayDispatchData::kDetachedRay && owner != link.ray_index)
+        {
+            parent = owner;
+            dispatch_data.ray_child_offsets[first_ray + owner + 1]++;
+        }
+    }
+
+#ifdef _DEBUG
+    // Check the parents against a plain map from each dynamic id to the last ray with it.
+    std::map<uint32_t, uint32_t> debug_owners;
+    for (const RayLink& link : links)
+    {
+        if (link.valid)
+        {
+            uint32_t& owner = debug_owners.try_emplace(link.dynamic_id, link.ray_index).first->second;
+            owner           = std::max(owner, link.ray_index);
+        }
+    }
+    for (const RayLink& link : links)
+    {
+        uint32_t expected_parent = RayDispatchData::kDetachedRay;
+        if (link.valid && debug_owners[link.dynamic_id] == link.ray_index)
+        {
+            const auto it = debug_owners.find(link.parent_id);
+            if (link.parent_id == 0 || link.parent_id == 0xFFFFFFFF)
+            {
+                expected_parent = RayDispatchData::kRootRay;
+            }
+            else if (it != debug_owners.end() && it->second != link.ray_index)
+            {
+                expected_parent = it->second;
+            }
+        }
+        RRA_ASSERT(dispatch_data.ray_parents[first_ray + link.ray_index] == expected_parent);
+    }
+#endif  // _DEBUG
+}
+
+RraAsyncRayHistoryLoader::RraAsyncRayHistoryLoader(const char*                              file_path,
+                                                   int64_t                                  dispatch_index,
+                                                   std::shared_ptr<rra::CachedDispatchData> cached_data,
+                                                   const RayHistoryStorageOptions&          storage_options)
+{
+    file_path_       = file_path;
+    dispatch_index_  = dispatch_index;
+    cached_data_     = std::move(cached_data);
+    storage_options_ = storage_options;
     {
         auto           file       = rdf::Stream::OpenFile(file_path);
         rdf::ChunkFile chunk_file = rdf::ChunkFile(file);
@@ -109,72 +746,127 @@ RraAsyncRayHistoryLoader::RraAsyncRayHistoryLoader(const char* file_path, int64_
     dim_z_ = counter_info_.dispatchRayDimensionZ;
 
     total_dispatch_indices_ = dim_x_ * dim_y_ * dim_z_;
+}
 
-    process_ = std::async(std::launch::async, [=]() {
-        auto           file       = rdf::Stream::OpenFile(file_path);
-        rdf::ChunkFile chunk_file = rdf::ChunkFile(file);
+void RraAsyncRayHistoryLoader::Start(rra::RayHistoryLoadScheduler* scheduler, uint64_t memory_cost)
+{
+    scheduler_ = scheduler;
+    if (scheduler_ == nullptr)
+    {
+        process_ = std::async(std::launch::async, [this]() { Process(); }).share();
+        return;
+    }
 
-        size_t buffer_size = chunk_file.GetChunkDataSize(RRA_RAY_HISTORY_RAW_TOKENS_IDENTIFIER, (int)dispatch_index);
+    // The job holds a reference to the loader, so the loader outlives the load.
+    process_  = process_promise_.get_future().share();
+    auto self = shared_from_this();
+    scheduler_->Submit(dispatch_index_, memory_cost, [self]() {
+        try
         {
-            std::scoped_lock<std::mutex> plock(process_mutex_);
-            bytes_required_  = buffer_size;
-            bytes_processed_ = 0;
+            self->Process();
+            self->process_promise_.set_value();
         }
-
-        std::byte* byte_buffer = static_cast<std::byte*>(malloc(buffer_size));
-
-        chunk_file.ReadChunkDataToBuffer(RRA_RAY_HISTORY_RAW_TOKENS_IDENTIFIER, (int)dispatch_index, byte_buffer);
-        file.Close();
-
-        ReadRayHistoryTraceFromRawBuffer(buffer_size, byte_buffer, dim_x_, dim_y_, dim_z_);
-        free(byte_buffer);
+        catch (...)
         {
-            std::scoped_lock<std::mutex> plock(process_mutex_);
-            load_status_.raw_data_parsed = true;
-            load_status_.has_errors      = error_state_;
-        }
-
-        PreProcessDispatchData();
-        {
-            std::scoped_lock<std::mutex> plock(process_mutex_);
-            load_status_.data_indexed = true;
-            load_status_.has_errors   = error_state_;
+            self->process_promise_.set_exception(std::current_exception());
         }
+    });
+}
 
-        ProcessInvocationCounts();
+void RraAsyncRayHistoryLoader::Process()
+{
+    // A load cancelled before it started doesn't need to touch the trace.
+    if (StopIfCancelled())
+    {
+        cached_data_ = nullptr;
         {
             std::scoped_lock<std::mutex> plock(process_mutex_);
-            process_complete_             = true;
             load_status_.loading_complete = true;
-            load_status_.has_errors       = error_state_;
+            load_status_.has_errors       = true;
         }
-    });
-}
+        process_complete_.store(true, std::memory_order_release);
+        return;
+    }
 
-bool RraAsyncRayHistoryLoader::IsDone()
-{
-    if (process_complete_local_)
+    auto           file       = rdf::Stream::OpenFile(file_path_.c_str());
+    rdf::ChunkFile chunk_file = rdf::ChunkFile(file);
+
+    size_t buffer_size = chunk_file.GetChunkDataSize(RRA_RAY_HISTORY_RAW_TOKENS_IDENTIFIER, (int)dispatch_index_);
+    bytes_processed_.store(0, std::memory_order_relaxed);
+    bytes_required_.store(buffer_size, std::memory_order_relaxed);
+
+    // Raw tokens bigger than the spill budget are read into a scratch file rather than the heap. The OS can page
+    // them out instead of holding them next to the parsed trace, and the parser gives back each window of the file
+    // it is done with. Smaller dispatches, and any whose file can't be made, use the heap.
+    std::unique_ptr<rra::MappedScratchFile> raw_token_file = nullptr;
+    if (storage_options_.spill_budget > 0 && buffer_size > storage_options_.spill_budget)
     {
-        return true;
+        raw_token_file = rra::MappedScratchFile::Create(buffer_size);
     }
 
-    std::scoped_lock<std::mutex> plock(process_mutex_);
-    process_complete_local_ = process_complete_;
-    return process_complete_;
-}
+    std::byte* byte_buffer = raw_token_file != nullptr ? raw_token_file->GetData() : static_cast<std::byte*>(malloc(buffer_size));
+
+    chunk_file.ReadChunkDataToBuffer(RRA_RAY_HISTORY_RAW_TOKENS_IDENTIFIER, (int)dispatch_index_, byte_buffer);
+    file.Close();
+
+    ReadRayHistoryTraceFromRawBuffer(buffer_size, byte_buffer, raw_token_file.get(), dim_x_, dim_y_, dim_z_);
+    if (raw_token_file == nullptr)
+    {
+        free(byte_buffer);
+    }
+    raw_token_file = nullptr;
 
-float RraAsyncRayHistoryLoader::GetProcessPercentage()
-{
-    float percentage = 0.0f;
     {
         std::scoped_lock<std::mutex> plock(process_mutex_);
+        load_status_.raw_data_parsed = true;
+        load_status_.has_errors      = error_state_;
+    }
 
-        float file_progress     = float(double(bytes_processed_) / double(bytes_required_)) * 50.0f;
-        float indexing_progress = float(double(processed_dispatch_indices_) / double(total_dispatch_indices_)) * 50.0f;
+    if (cached_data_ != nullptr)
+    {
+        RestoreCachedDispatchData();
+    }
+    else
+    {
+        IndexDispatchData();
+    }
+    cached_data_ = nullptr;
+    {
+        std::scoped_lock<std::mutex> plock(process_mutex_);
+        load_status_.data_indexed = true;
+        load_status_.has_errors   = error_state_;
+    }
 
-        percentage = file_progress + indexing_progress;
+    {
+        std::scoped_lock<std::mutex> plock(process_mutex_);
+        load_status_.loading_complete = true;
+        load_status_.has_errors       = error_state_;
     }
 
+    // Publishes the loaded data to the threads that check IsDone() without waiting on the future.
+    process_complete_.store(true, std::memory_order_release);
+
+    // The final data replaces the snapshots.
+    std::atomic_store(&snapshot_, std::shared_ptr<const RayDispatchSnapshot>());
+}
+
+bool RraAsyncRayHistoryLoader::IsDone()
+{
+    return process_complete_.load(std::memory_order_acquire);
+}
+
+float RraAsyncRayHistoryLoader::GetProcessPercentage()
+{
+    size_t bytes_processed            = bytes_processed_.load(std::memory_order_relaxed);
+    size_t bytes_required             = bytes_required_.load(std::memory_order_relaxed);
+    size_t processed_dispatch_indices = processed_dispatch_indices_.load(std::memory_order_relaxed);
+    size_t total_dispatch_indices     = total_dispatch_indices_.load(std::memory_order_relaxed);
+
+    float file_progress     = float(double(bytes_processed) / double(bytes_required)) * 50.0f;
+    float indexing_progress = float(double(processed_dispatch_indices) / double(total_dispatch_indices)) * 50.0f;
+
+    float percentage = file_progress + indexing_progress;
+
     if (IsDone() && !HasErrors())
     {
         percentage = 100.0f;
@@ -183,462 +875,1081 @@ float RraAsyncRayHistoryLoader::GetProcessPercentage()
     return percentage;
 }
 
+void RraAsyncRayHistoryLoader::Cancel()
+{
+    cancelled_.store(true, std::memory_order_relaxed);
+}
+
+bool RraAsyncRayHistoryLoader::IsCancelled() const
+{
+    return cancelled_.load(std::memory_order_relaxed);
+}
+
+bool RraAsyncRayHistoryLoader::StopIfCancelled()
+{
+    if (!cancelled_.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+    error_state_ = true;
+    return true;
+}
+
 bool RraAsyncRayHistoryLoader::HasErrors()
+{
+    return error_state_.load(std::memory_order_relaxed);
+}
+
+void RraAsyncRayHistoryLoader::WaitProcess()
+{
+    if (!IsDone())
+    {
+        // Someone is waiting on this dispatch, so don't leave it behind the rest of the queue.
+        Prioritize();
+
+        // Several threads can wait on the same dispatch, so each one waits through its own copy of the future.
+        std::shared_future<void> process = process_;
+        process.get();
+    }
+}
+
+rta::RayHistoryTrace* RraAsyncRayHistoryLoader::GetRayHistoryTrace()
+{
+    WaitProcess();
+    return ray_history_trace_.get();
+}
+
+GpuRt::CounterInfo RraAsyncRayHistoryLoader::GetCounterInfo()
+{
+    return counter_info_;
+}
+
+RayDispatchData& RraAsyncRayHistoryLoader::GetDispatchData()
+{
+    WaitProcess();
+    return dispatch_data_;
+}
+
+const RayDispatchRayTable& RraAsyncRayHistoryLoader::GetRayTable()
+{
+    WaitProcess();
+    std::call_once(ray_table_once_, [this]() { BuildRayTable(); });
+    return ray_table_;
+}
+
+void RraAsyncRayHistoryLoader::BuildRayTable()
+{
+    if (ray_history_trace_ == nullptr)
+    {
+        return;
+    }
+
+    const auto&  identifiers = dispatch_data_.begin_identifiers;
+    const size_t ray_count   = identifiers.size();
+
+    ray_table_.origins.resize(ray_count * 3);
+    ray_table_.directions.resize(ray_count * 3);
+    ray_table_.t_mins.resize(ray_count);
+    ray_table_.t_maxs.resize(ray_count);
+    ray_table_.ray_flags.resize(ray_count);
+    ray_table_.cull_masks.resize(ray_count);
+    ray_table_.tlas_addresses.resize(ray_count);
+    ray_table_.dynamic_ids.resize(ray_count);
+    ray_table_.parent_ids.resize(ray_count);
+    ray_table_.wave_ids.resize(ray_count);
+    ray_table_.iteration_counts.resize(ray_count);
+    ray_table_.hit_ts.resize(ray_count);
+    ray_table_.hit_kinds.resize(ray_count);
+    ray_table_.instance_indices.resize(ray_count);
+    ray_table_.geometry_indices.resize(ray_count);
+    ray_table_.primitive_indices.resize(ray_count);
+
+    constexpr size_t kMinRaysPerTask = 64 * 1024;
+
+    const size_t task_count = rra::GetParallelTaskCount(ray_count, kMinRaysPerTask);
+    rra::RunInParallel(task_count, [&](size_t task_index) {
+        const size_t first = ray_count * task_index / task_count;
+        const size_t last  = ray_count * (task_index + 1) / task_count;
+        for (size_t i = first; i < last; i++)
+        {
+            const RayDispatchBeginIdentifier& begin_identifier = identifiers[i];
+            rta::RayHistory                   rta_ray{ray_history_trace_->GetRayByIndex(begin_identifier.dispatch_coord_index)};
+
+            // The vectors are zero initialized, so rays without a begin token are left as zeroes.
+            if (rta_ray.GetTokenCount() > 0 && rta_ray.GetToken(begin_identifier.begin_token_index).IsBegin())
+            {
+                auto begin_data = reinterpret_cast<const rta::RayHistoryTokenBeginDataV2*>(rta_ray.GetToken(begin_identifier.begin_token_index).GetPayload());
+                ray_table_.origins[i * 3 + 0]    = begin_data->rayDesc.origin.x;
+                ray_table_.origins[i * 3 + 1]    = begin_data->rayDesc.origin.y;
+                ray_table_.origins[i * 3 + 2]    = begin_data->rayDesc.origin.z;
+                ray_table_.directions[i * 3 + 0] = begin_data->rayDesc.direction.x;
+                ray_table_.directions[i * 3 + 1] = begin_data->rayDesc.direction.y;
+                ray_table_.directions[i * 3 + 2] = begin_data->rayDesc.direction.z;
+                ray_table_.t_mins[i]             = begin_data->rayDesc.tMin;
+                ray_table_.t_maxs[i]             = begin_data->rayDesc.tMax;
+                ray_table_.ray_flags[i]          = begin_data->rayFlags;
+                ray_table_.cull_masks[i]         = begin_data->instanceInclusionMask;
+                ray_table_.tlas_addresses[i]     = ((uint64_t)begin_data->accelStructAddrHi << 32) | begin_data->accelStructAddrLo;
+                ray_table_.dynamic_ids[i]        = begin_data->dynamicId;
+                ray_table_.parent_ids[i]         = begin_data->parentId;
+                ray_table_.wave_ids[i]           = begin_data->hwWaveId;
+            }
+
+            const IntersectionResult& intersection = dispatch_data_.ray_results[i].intersection;
+            ray_table_.iteration_counts[i]         = intersection.num_iterations;
+            ray_table_.hit_ts[i]                   = intersection.hit_t;
+            ray_table_.hit_kinds[i]                = intersection.hit_kind;
+            ray_table_.instance_indices[i]         = intersection.instance_index;
+            ray_table_.geometry_indices[i]         = intersection.geometry_index;
+            ray_table_.primitive_indices[i]        = intersection.primitive_index;
+        }
+    });
+}
+
+RraRayHistoryStats RraAsyncRayHistoryLoader::GetStats()
 {
     std::scoped_lock<std::mutex> plock(process_mutex_);
-    return error_state_;
+    return invocation_counts_;
+}
+
+size_t RraAsyncRayHistoryLoader::GetTotalRayCount()
+{
+    return total_ray_count_.load(std::memory_order_relaxed);
+}
+
+rta::DispatchSize RraAsyncRayHistoryLoader::GetDerivedDispatchSize() const
+{
+    rta::DispatchSize dispatch_size = {};
+
+    dispatch_size.width  = dim_x_;
+    dispatch_size.height = dim_y_;
+    dispatch_size.depth  = dim_z_;
+
+    return dispatch_size;
+}
+
+void RraAsyncRayHistoryLoader::Prioritize()
+{
+    if (scheduler_ != nullptr)
+    {
+        scheduler_->Prioritize(dispatch_index_);
+    }
 }
 
-void RraAsyncRayHistoryLoader::WaitProcess()
-{
-    if (process_complete_local_)
+RraDispatchLoadStatus RraAsyncRayHistoryLoader::GetStatus()
+{
+    RraDispatchLoadStatus status = {};
+    {
+        std::scoped_lock<std::mutex> plock(process_mutex_);
+        status = load_status_;
+    }
+    status.load_percentage = GetProcessPercentage();
+    return status;
+}
+
+#ifdef _DEBUG
+/// @brief Check a parsed trace against a single walk over the raw tokens, that appends each token to its ray.
+///
+/// @param [in] buffer_data The raw token buffer.
+/// @param [in] buffer_size The raw token buffer size in bytes.
+/// @param [in] trace       The trace parsed from the buffer.
+static void DebugCheckParsedTrace(const std::byte* buffer_data, size_t buffer_size, const rta::RayHistoryTrace& trace)
+{
+    /// @brief A token of the reference parse.
+    struct DebugToken
+    {
+        size_t data_offset = 0;      ///< The offset of the token data in the raw buffer.
+        size_t data_size   = 0;      ///< The size of the token data.
+        bool   is_control  = false;  ///< Is the token a control token.
+    };
+
+    std::map<std::uint32_t, std::vector<DebugToken>> rays;
+    WalkRayHistoryTokens(buffer_data,
+                         buffer_size,
+                         0,
+                         buffer_size,
+                         nullptr,
+                         nullptr,
+                         [&rays](std::uint32_t ray_id, size_t, const rta::RayHistoryTokenControl* control, size_t data_offset, size_t token_size) {
+                             auto& tokens = rays[ray_id];
+                             if (token_size > 0)
+                             {
+                                 tokens.push_back({data_offset, token_size, control != nullptr});
+                             }
+                         });
+
+    RRA_ASSERT(static_cast<size_t>(trace.GetRayCount(rta::RayHistoryTrace::ExcludeEmptyRays)) == rays.size());
+    for (const auto& [ray_id, tokens] : rays)
+    {
+        const rta::RayHistory ray = trace.GetRayById(static_cast<int>(ray_id));
+        RRA_ASSERT(ray.GetRayId() == ray_id);
+        RRA_ASSERT(static_cast<size_t>(ray.GetTokenCount()) == tokens.size());
+        for (size_t i = 0; i < tokens.size() && i < static_cast<size_t>(ray.GetTokenCount()); i++)
+        {
+            const rta::RayHistoryToken token = ray.GetToken(static_cast<int>(i));
+            RRA_ASSERT(token.IsControl() == tokens[i].is_control);
+
+            const auto* data = reinterpret_cast<const std::byte*>(token.GetPayload()) - (token.IsControl() ? sizeof(rta::RayHistoryTokenControl) : 0);
+            RRA_ASSERT(std::equal(data, data + tokens[i].data_size, buffer_data + tokens[i].data_offset));
+        }
+    }
+}
+#endif  // _DEBUG
+
+void RraAsyncRayHistoryLoader::ReadRayHistoryTraceFromRawBuffer(size_t                  buffer_size,
+                                                                std::byte*              buffer_data,
+                                                                rra::MappedScratchFile* buffer_file,
+                                                                uint32_t                dx,
+                                                                uint32_t                dy,
+                                                                uint32_t                dz)
+{
+    if (error_state_)
+    {
+        return;
+    }
+
+    using namespace rta;
+
+    // The tokens of all rays are interleaved in the buffer. The buffer is split into shards, and each
+    // shard is parsed on its own thread in two passes. The first counts the tokens and token bytes of each
+    // ray, and the second copies every token straight into its place in the combined arrays, which are
+    // grouped by ray and sorted by ray id. Within a ray the shards are laid out in buffer order, so each
+    // ray's tokens keep their order.
+    constexpr size_t kMinShardSize = 16 * 1024 * 1024;
+
+    // Ray ids are normally bounded by the dispatch size, so they index flat arrays. Any id beyond
+    // the dispatch size goes to a map instead, so the token data can't size the flat arrays.
+    const std::size_t dense_ray_limit = std::size_t(dx) * dy * dz;
+
+    std::size_t shard_count = rra::GetParallelTaskCount(buffer_size, kMinShardSize);
+
+    std::vector<TokenShard> shards(shard_count);
+    shards[0].end = buffer_size;
+
+    // Tokens vary in size and have no sync markers, so the shard boundaries are found by walking the token
+    // headers. The shards are walked in parallel, and fall back to a single walk if their walks don't meet up.
+    // The walks also find the range of ray ids in each shard.
+    std::uint32_t min_ray_id = std::numeric_limits<std::uint32_t>::max();
+    std::uint32_t max_ray_id = 0;
+    if (shard_count > 1)
+    {
+        if (!FindTokenShardBoundaries(buffer_data, buffer_size, &cancelled_, shards) && !cancelled_.load(std::memory_order_relaxed))
+        {
+            FindTokenShardBoundariesSerial(buffer_data, buffer_size, &cancelled_, shards);
+        }
+#ifdef _DEBUG
+        else if (!cancelled_.load(std::memory_order_relaxed))
+        {
+            // Check the parallel walks against the single walk.
+            std::vector<TokenShard> debug_shards(shard_count);
+            FindTokenShardBoundariesSerial(buffer_data, buffer_size, nullptr, debug_shards);
+            for (size_t i = 0; i < shard_count; i++)
+            {
+                RRA_ASSERT(shards[i].begin == debug_shards[i].begin && shards[i].end == debug_shards[i].end);
+                RRA_ASSERT(shards[i].min_ray_id == debug_shards[i].min_ray_id && shards[i].max_ray_id == debug_shards[i].max_ray_id);
+            }
+        }
+#endif  // _DEBUG
+
+        if (StopIfCancelled())
+        {
+            return;
+        }
+
+        for (const auto& shard : shards)
+        {
+            min_ray_id = std::min(min_ray_id, shard.min_ray_id);
+            max_ray_id = std::max(max_ray_id, shard.max_ray_id);
+        }
+
+        // Each shard gets a flat array covering its ray id range. If the ranges are too large between them,
+        // parse the buffer as a single shard rather than use that much memory.
+        size_t total_shard_range = 0;
+        for (const auto& shard : shards)
+        {
+            if (shard.min_ray_id <= shard.max_ray_id)
+            {
+                total_shard_range += size_t(shard.max_ray_id - shard.min_ray_id) + 1;
+            }
+        }
+
+        if (min_ray_id > max_ray_id || total_shard_range > dense_ray_limit || size_t(max_ray_id - min_ray_id) + 1 > dense_ray_limit)
+        {
+            shard_count = 1;
+            shards.resize(1);
+            shards[0].begin = 0;
+            shards[0].end   = buffer_size;
+        }
+    }
+
+    RaySlotTable rays;
+    if (shard_count == 1)
+    {
+        shards[0].rays = RaySlotTable(0, dense_ray_limit);
+        rays           = RaySlotTable(0, dense_ray_limit);
+    }
+    else
+    {
+        for (auto& shard : shards)
+        {
+            if (shard.min_ray_id <= shard.max_ray_id)
+            {
+                shard.rays = RaySlotTable(shard.min_ray_id, size_t(shard.max_ray_id - shard.min_ray_id) + 1);
+            }
+        }
+        rays = RaySlotTable(min_ray_id, size_t(max_ray_id - min_ray_id) + 1);
+    }
+
+    // Pass 1: count the tokens and token bytes of each ray in each shard.
+    rra::RunInParallel(shards.size(), [&](size_t shard_index) {
+        TokenShard& shard = shards[shard_index];
+        shard.complete = WalkRayHistoryTokens(
+            buffer_data,
+            buffer_size,
+            shard.begin,
+            shard.end,
+            &bytes_processed_,
+            &cancelled_,
+            [&shard](std::uint32_t ray_id, size_t, const RayHistoryTokenControl* control, size_t, size_t token_size) {
+                // The ray gets an entry even if the token turns out to be invalid.
+                RaySlot& slot = shard.rays.Get(ray_id);
+                slot.seen     = true;
+
+                if (token_size == 0)
+                {
+                    return;
+                }
+
+                if (control != nullptr)
+                {
+                    switch (control->type)
+                    {
+                    case RayHistoryTokenType::Begin:
+                        assert(control->tokenLength * 4 == sizeof(RayHistoryTokenBeginData));
+                        slot.begin_token = true;
+                        break;
+                    case RayHistoryTokenType::BeginV2:
+                        assert(control->tokenLength * 4 == sizeof(RayHistoryTokenBeginDataV2));
+                        slot.begin_token = true;
+                        break;
+                    case RayHistoryTokenType::AnyHitStatus:
+                        assert(control->tokenLength == 0);
+                        break;
+                    case RayHistoryTokenType::FunctionCallV2:
+                        // The new function call control token has length 3
+                        assert(control->tokenLength == 3);
+                        break;
+                    case RayHistoryTokenType::End:
+                        assert(control->tokenLength * 4 == sizeof(RayHistoryTokenEndData));
+                        break;
+                    case RayHistoryTokenType::EndV2:
+                        assert(control->tokenLength * 4 == sizeof(RayHistoryTokenEndDataV2));
+                        break;
+                    default:
+                        // All other tokens have length 2
+                        //assert(control->tokenLength == 2);
+                        break;
+                    }
+                }
+
+                slot.token_count++;
+                slot.data_size += static_cast<std::uint32_t>(token_size);
+            });
+    });
+
+    for (const auto& shard : shards)
+    {
+        if (!shard.complete)
+        {
+            error_state_ = true;
+        }
+    }
+
+    if (StopIfCancelled())
+    {
+        return;
+    }
+
+    // Total up each ray over the shards, in buffer order. Each shard slot records where the shard's tokens
+    // start within the ray, and its counts are reset so pass 2 can use them as write cursors.
+    for (auto& shard : shards)
+    {
+        shard.rays.ForEachSeen([&rays](std::uint32_t ray_id, RaySlot& shard_slot) {
+            RaySlot& ray    = rays.Get(ray_id);
+            ray.seen        = true;
+            ray.begin_token = ray.begin_token || shard_slot.begin_token;
+
+            shard_slot.token_start = ray.token_count;
+            shard_slot.data_start  = ray.data_size;
+            ray.token_count += shard_slot.token_count;
+            ray.data_size += shard_slot.data_size;
+
+            shard_slot.token_count = 0;
+            shard_slot.data_size   = 0;
+        });
+    }
+
+    // Lay the rays out in id order.
+    const bool                                     compress_tokens = storage_options_.compress_tokens;
+    const RayHistoryTrace::TokenCompressionOptions compression_options;
+
+    std::vector<RayHistoryTrace::RayRange> combinedRayRanges;
+    std::size_t                            totalCombinedTokenSize = 0;
+    std::uint32_t                          totalTokenCount        = 0;
+
+    rays.ForEachSeen([&](std::uint32_t ray_id, RaySlot& ray) {
+        RRA_ASSERT(ray.begin_token);
+
+        ray.data_start  = totalCombinedTokenSize;
+        ray.token_start = totalTokenCount;
+        ray.block_index = static_cast<std::uint32_t>(combinedRayRanges.size() / compression_options.raysPerBlock);
+
+        const RayHistoryTrace::RayRange range = {ray_id, ray.token_start, ray.token_count, ray.data_start};
+        combinedRayRanges.push_back(range);
+
+        totalCombinedTokenSize += ray.data_size;
+        totalTokenCount += ray.token_count;
+    });
+
+    // The ray ranges, token indices and token data go in a scratch file if they don't fit the budget, laid out
+    // in that order so each array stays aligned. Compressed token data is kept in memory.
+    const uint64_t ray_ranges_size    = sizeof(RayHistoryTrace::RayRange) * combinedRayRanges.size();
+    const uint64_t token_indices_size = sizeof(RayHistoryTrace::TokenIndex) * uint64_t(totalTokenCount);
+    const uint64_t token_data_size    = compress_tokens ? 0 : totalCombinedTokenSize;
+    const uint64_t trace_size         = ray_ranges_size + token_indices_size + token_data_size;
+
+    std::shared_ptr<rra::MappedScratchFile> scratch_file = nullptr;
+    if (storage_options_.spill_budget > 0 && trace_size > storage_options_.spill_budget)
+    {
+        // If the file can't be made the dispatch stays in memory.
+        scratch_file = rra::MappedScratchFile::Create(trace_size);
+    }
+
+    std::vector<std::byte>                   combinedTokenData;
+    std::vector<RayHistoryTrace::TokenIndex> combinedTokenIndices;
+    std::byte*                               token_data    = nullptr;
+    RayHistoryTrace::TokenIndex*             token_indices = nullptr;
+    if (scratch_file != nullptr)
+    {
+        std::byte* ray_ranges = scratch_file->GetData();
+        std::copy(combinedRayRanges.begin(), combinedRayRanges.end(), reinterpret_cast<RayHistoryTrace::RayRange*>(ray_ranges));
+        token_indices = reinterpret_cast<RayHistoryTrace::TokenIndex*>(ray_ranges + ray_ranges_size);
+        token_data    = ray_ranges + ray_ranges_size + token_indices_size;
+    }
+    else
+    {
+        combinedTokenData.resize(token_data_size);
+        combinedTokenIndices.resize(totalTokenCount);
+        token_data    = combinedTokenData.data();
+        token_indices = combinedTokenIndices.data();
+    }
+
+    // With compressed storage the token data is never held whole. A block of rays gets a buffer when pass 2 first
+    // writes to it, and the thread that writes its last byte compresses it and frees the buffer, so only the blocks
+    // still being filled are held uncompressed.
+    std::vector<RayHistoryTrace::CompressedTokenBlock> compressed_blocks;
+    std::unique_ptr<PendingTokenBlock[]>               pending_blocks;
+    std::atomic<bool>                                  compression_failed{false};
+    if (compress_tokens)
+    {
+        const size_t block_count = (combinedRayRanges.size() + compression_options.raysPerBlock - 1) / compression_options.raysPerBlock;
+        compressed_blocks.resize(block_count);
+        pending_blocks = std::make_unique<PendingTokenBlock[]>(block_count);
+
+        for (size_t i = 0; i < block_count; i++)
+        {
+            const size_t first_ray = i * compression_options.raysPerBlock;
+            const size_t last_ray  = first_ray + compression_options.raysPerBlock;
+
+            RayHistoryTrace::CompressedTokenBlock& block = compressed_blocks[i];
+            block.dataStart = combinedRayRanges[first_ray].dataStart;
+            block.dataSize  = (last_ray < combinedRayRanges.size() ? combinedRayRanges[last_ray].dataStart : totalCombinedTokenSize) - block.dataStart;
+            pending_blocks[i].remaining = block.dataSize;
+        }
+    }
+
+    const auto compress_block = [&](size_t block_index) {
+        PendingTokenBlock&                     pending = pending_blocks[block_index];
+        RayHistoryTrace::CompressedTokenBlock& block   = compressed_blocks[block_index];
+        if (!RayHistoryTrace::CompressTokenBlock(pending.data.get(), compression_options.compressionLevel, block))
+        {
+            compression_failed = true;
+        }
+        pending.data.reset();
+    };
+
+    // Pass 2: copy each token into its place. This is the last pass over the raw tokens, so when they are in a
+    // scratch file each shard releases them in fixed windows behind it. A window only ends at the start of the
+    // token being visited, so a token that straddles the window boundary is kept until it has been copied.
+    constexpr size_t kReleaseWindowSize = 64 * 1024 * 1024;
+
+    rra::RunInParallel(shards.size(), [&](size_t shard_index) {
+        TokenShard& shard    = shards[shard_index];
+        size_t      released = shard.begin;
+        WalkRayHistoryTokens(
+            buffer_data,
+            buffer_size,
+            shard.begin,
+            shard.end,
+            &bytes_processed_,
+            &cancelled_,
+            [&](std::uint32_t ray_id, size_t token_offset, const RayHistoryTokenControl* control, size_t data_offset, size_t token_size) {
+                if (buffer_file != nullptr && token_offset - released >= kReleaseWindowSize)
+                {
+                    buffer_file->Release(released, token_offset - released);
+                    released = token_offset;
+                }
+
+                if (token_size == 0)
+                {
+                    return;
+                }
+
+                const RaySlot& ray  = rays.Find(ray_id);
+                RaySlot&       slot = shard.rays.Get(ray_id);
+
+                const std::uint32_t ray_data_offset = static_cast<std::uint32_t>(slot.data_start) + slot.data_size;
+
+                const RayHistoryTrace::TokenIndex tokenIndex = {ray_data_offset, control != nullptr ? 1u : 0u};
+                token_indices[ray.token_start + slot.token_start + slot.token_count] = tokenIndex;
+
+                if (compress_tokens)
+                {
+                    PendingTokenBlock&                           pending = pending_blocks[ray.block_index];
+                    const RayHistoryTrace::CompressedTokenBlock& block   = compressed_blocks[ray.block_index];
+
+                    std::call_once(pending.allocated, [&pending, &block]() { pending.data = std::make_unique<std::byte[]>(block.dataSize); });
+                    std::copy(buffer_data + data_offset,
+                              buffer_data + data_offset + token_size,
+                              pending.data.get() + (ray.data_start + ray_data_offset - block.dataStart));
+
+                    if (pending.remaining.fetch_sub(token_size, std::memory_order_acq_rel) == token_size)
+                    {
+                        compress_block(ray.block_index);
+                    }
+                }
+                else
+                {
+                    std::copy(buffer_data + data_offset, buffer_data + data_offset + token_size, token_data + ray.data_start + ray_data_offset);
+                }
+
+                slot.token_count++;
+                slot.data_size += static_cast<std::uint32_t>(token_size);
+            });
+
+        if (buffer_file != nullptr)
+        {
+            buffer_file->Release(released, shard.end - released);
+        }
+    });
+
+    if (StopIfCancelled())
     {
         return;
     }
 
-    bool get_the_future = false;
+    // Blocks with no token data, and blocks left incomplete where a walk stopped at a bad token, haven't been
+    // compressed yet. Their unwritten bytes are zero, as they would be in the uncompressed token data.
+    for (size_t i = 0; compress_tokens && i < compressed_blocks.size(); i++)
     {
-        std::scoped_lock<std::mutex> plock(process_mutex_);
-        get_the_future = !process_complete_;
-        process_complete_local_ = process_complete_;
+        if (pending_blocks[i].remaining != 0 || compressed_blocks[i].dataSize == 0)
+        {
+            std::call_once(pending_blocks[i].allocated, [&]() { pending_blocks[i].data = std::make_unique<std::byte[]>(compressed_blocks[i].dataSize); });
+            compress_block(i);
+        }
     }
+    pending_blocks = nullptr;
 
-    if (get_the_future)
+    if (compression_failed)
     {
-        process_.get();
+        error_state_ = true;
+        return;
     }
-}
 
-void RraAsyncRayHistoryLoader::FindDispatchDimsFromTokens()
-{
-    if (total_dispatch_indices_ != 0)
+    std::shared_ptr<RayHistoryTrace> result = nullptr;
+    if (scratch_file != nullptr)
+    {
+        const auto* ray_ranges = reinterpret_cast<const RayHistoryTrace::RayRange*>(scratch_file->GetData());
+
+        result = std::make_shared<RayHistoryTrace>(std::static_pointer_cast<const void>(scratch_file),
+                                                   token_data,
+                                                   token_data_size,
+                                                   token_indices,
+                                                   totalTokenCount,
+                                                   ray_ranges,
+                                                   combinedRayRanges.size(),
+                                                   (dx * dy * dz) - 1);
+    }
+    else
+    {
+        result = std::make_shared<RayHistoryTrace>(
+            std::move(combinedTokenData), std::move(combinedTokenIndices), std::move(combinedRayRanges), (dx * dy * dz) - 1);
+    }
+
+    if (compress_tokens && !result->SetCompressedTokens(std::move(compressed_blocks), compression_options))
     {
+        RRA_ASSERT_FAIL("Compressed token blocks don't match the rays");
+        error_state_ = true;
         return;
     }
 
-    auto& rh = ray_history_trace_;
-    int   dispatch_coord_count{rh->GetRayCount(rta::RayHistoryTrace::ExcludeEmptyRays)};
+    const DispatchSize dispatchSize = {dx, dy, dz};
 
-    // Gather indices
-    for (int dispatch_coord_index{0}; dispatch_coord_index < dispatch_coord_count; ++dispatch_coord_index)
+    // Sanity check: #dispatched pixels = #rays
+    const auto rayCount = result->GetRayCount(RayHistoryTrace::IncludeEmptyRays);
+    if ((dispatchSize.width * dispatchSize.height * dispatchSize.depth) != (uint32_t)rayCount)
     {
-        rta::RayHistory ray{rh->GetRayByIndex(dispatch_coord_index)};
-
-        for (rta::RayHistoryToken token : ray)
+        if (total_dispatch_indices_ > 0)
         {
-            if (token.IsBegin())
-            {
-                auto begin_data = reinterpret_cast<const rta::RayHistoryTokenBeginDataV2*>(token.GetPayload());
-                dim_x_          = std::max(dim_x_, begin_data->dispatchRaysIndex[0]);
-                dim_y_          = std::max(dim_y_, begin_data->dispatchRaysIndex[1]);
-                dim_z_          = std::max(dim_z_, begin_data->dispatchRaysIndex[2]);
-            }
+            error_state_ = true;
         }
     }
 
-    // Increment each dim by one since these are dimension sizes and not indices.
-    dim_x_ += 1;
-    dim_y_ += 1;
-    dim_z_ += 1;
-
-    total_dispatch_indices_ = dim_x_ * dim_y_ * dim_z_;
-}
-
-rta::RayHistoryTrace* RraAsyncRayHistoryLoader::GetRayHistoryTrace()
-{
-    WaitProcess();
-    return ray_history_trace_.get();
-}
+#ifdef _DEBUG
+    // Check the two-pass parse against a single walk. The raw tokens must still be there, and the walk is kept to
+    // smaller dispatches, since it holds a copy of the token layout.
+    constexpr size_t kMaxDebugCheckSize = 256 * 1024 * 1024;
+    if (buffer_file == nullptr && buffer_size <= kMaxDebugCheckSize && !error_state_)
+    {
+        DebugCheckParsedTrace(buffer_data, buffer_size, *result);
+    }
+#endif  // _DEBUG
 
-GpuRt::CounterInfo RraAsyncRayHistoryLoader::GetCounterInfo()
-{
-    return counter_info_;
+    ray_history_trace_ = result;
 }
 
-RayDispatchData& RraAsyncRayHistoryLoader::GetDispatchData()
+void RraAsyncRayHistoryLoader::SweepDispatchRays(int first_ray, int last_ray, std::vector<DispatchIndexPartial>& partials)
 {
-    WaitProcess();
-    return dispatch_data_;
-}
+    constexpr int kMinRaysPerTask  = 64 * 1024;
+    constexpr int kProgressRayStep = 1024;
 
-RraRayHistoryStats RraAsyncRayHistoryLoader::GetStats()
-{
-    std::scoped_lock<std::mutex> plock(process_mutex_);
-    return invocation_counts_;
-}
+    const rta::RayHistoryTrace& rh = *ray_history_trace_;
 
-size_t RraAsyncRayHistoryLoader::GetTotalRayCount()
-{
-    std::scoped_lock<std::mutex> plock(process_mutex_);
-    return total_ray_count_;
-}
+    const size_t task_count    = rra::GetParallelTaskCount(last_ray - first_ray, kMinRaysPerTask);
+    const size_t first_partial = partials.size();
+    partials.resize(first_partial + task_count);
 
-rta::DispatchSize RraAsyncRayHistoryLoader::GetDerivedDispatchSize() const
-{
-    rta::DispatchSize dispatch_size = {};
+    rra::RunInParallel(task_count, [&](size_t task_index) {
+        DispatchIndexPartial& partial     = partials[first_partial + task_index];
+        const int             first_index = first_ray + static_cast<int>(int64_t(last_ray - first_ray) * task_index / task_count);
+        const int             last_index  = first_ray + static_cast<int>(int64_t(last_ray - first_ray) * (task_index + 1) / task_count);
 
-    dispatch_size.width  = dim_x_;
-    dispatch_size.height = dim_y_;
-    dispatch_size.depth  = dim_z_;
+        for (int dispatch_coord_index{first_index}; dispatch_coord_index < last_index; ++dispatch_coord_index)
+        {
+            if ((dispatch_coord_index - first_index) % kProgressRayStep == kProgressRayStep - 1)
+            {
+                processed_dispatch_indices_.fetch_add(kProgressRayStep, std::memory_order_relaxed);
+                if (cancelled_.load(std::memory_order_relaxed))
+                {
+                    return;
+                }
+            }
 
-    return dispatch_size;
-}
+            rta::RayHistory ray{rh.GetRayByIndex(dispatch_coord_index)};
 
-RraDispatchLoadStatus RraAsyncRayHistoryLoader::GetStatus()
-{
-    RraDispatchLoadStatus status = {};
-    {
-        std::scoped_lock<std::mutex> plock(process_mutex_);
-        status = load_status_;
-    }
-    status.load_percentage = GetProcessPercentage();
-    return status;
-}
+            // Tokens before the first begin token count towards coordinate (0, 0, 0).
+            BeginTokenRecord* record = nullptr;
 
-void RraAsyncRayHistoryLoader::ReadRayHistoryTraceFromRawBuffer(size_t buffer_size, std::byte* buffer_data, uint32_t dx, uint32_t dy, uint32_t dz)
-{
-    if (error_state_)
-    {
-        return;
-    }
+            uint32_t begin_token_index = 0;
 
-    using namespace rta;
+            for (rta::RayHistoryToken token : ray)
+            {
+                if (token.IsBegin())
+                {
+                    auto begin_data = reinterpret_cast<const rta::RayHistoryTokenBeginDataV2*>(token.GetPayload());
+
+                    record             = &partial.records.emplace_back();
+                    record->x          = begin_data->dispatchRaysIndex[0];
+                    record->y          = begin_data->dispatchRaysIndex[1];
+                    record->z          = begin_data->dispatchRaysIndex[2];
+                    record->is_begin   = true;
+                    record->identifier = {(uint32_t)dispatch_coord_index, begin_token_index};
+                    record->stats.ray_count++;
+
+                    partial.max_x = std::max(partial.max_x, record->x);
+                    partial.max_y = std::max(partial.max_y, record->y);
+                    partial.max_z = std::max(partial.max_z, record->z);
+                    partial.stats.ray_count++;
+                }
 
-    struct RayStateAsyncLoader
-    {
-        std::vector<std::byte> tokenData;
-        // Offsets of token starts
-        std::vector<RayHistoryTrace::TokenIndex> index;
+                const rta::RayHistoryTokenType type = token.GetType();
+                if (type == rta::RayHistoryTokenType::ProceduralIntersectionStatus)
+                {
+                    partial.stats.intersection_count++;
+                }
+                else if (type == rta::RayHistoryTokenType::AnyHitStatus)
+                {
+                    if (record == nullptr)
+                    {
+                        record = &partial.records.emplace_back();
+                    }
+                    record->stats.any_hit_count++;
+                    partial.stats.any_hit_count++;
+                }
+                else if (type == rta::RayHistoryTokenType::EndV2)
+                {
+                    auto end_token = reinterpret_cast<const rta::RayHistoryTokenEndDataV2*>(token.GetPayload());
 
-        bool beginToken = false;
-        bool endToken   = false;
-    };
+                    if (record == nullptr)
+                    {
+                        record = &partial.records.emplace_back();
+                    }
+                    record->stats.loop_iteration_count += end_token->numIterations;
+                    record->stats.intersection_count += end_token->numInstanceIntersections;
 
-    // Using a map here improves compression ratio on Windows by 2x, as
-    // consecutive indices compress _much_ better. On Linux the effect is
-    // minimal as the unordered_map implementation there is well sorted
-    std::map<uint32_t, RayStateAsyncLoader> rayData;
-    int                                     totalTokenCount = 0;
+                    if (token.IsMiss())
+                    {
+                        partial.stats.miss_count++;
+                    }
+                    else
+                    {
+                        partial.stats.closest_hit_count++;
+                    }
 
-    const auto bufferStart          = buffer_data;
-    const auto bufferEnd            = buffer_data + buffer_size;
-    auto       CheckOffsetIsInRange = [bufferStart, bufferEnd](const void* p, const size_t size) -> bool {
-        return p >= bufferStart && (static_cast<const std::byte*>(p) + size) <= bufferEnd;
-    };
+                    partial.stats.loop_iteration_count += end_token->numIterations;
+                    partial.stats.instance_intersection_count += end_token->numInstanceIntersections;
+                }
 
-    for (size_t offset = 0, end = buffer_size; offset < end;)
-    {
-        {
-            std::scoped_lock<std::mutex> plock(process_mutex_);
-            bytes_processed_ = offset;
+                begin_token_index++;
+            }
         }
 
-        const void* readPointer = buffer_data + offset;
-        // We've reached the end of the stream, can't read anything here
-        if (!CheckOffsetIsInRange(readPointer, sizeof(RayHistoryTokenId)))
-        {
-            break;
-        }
-        // Tokens
-        const auto id = static_cast<const RayHistoryTokenId*>(readPointer);
+        processed_dispatch_indices_.fetch_add((last_index - first_index) % kProgressRayStep, std::memory_order_relaxed);
+    });
+}
 
-        auto& rayState = rayData[id->id];
+bool RraAsyncRayHistoryLoader::BuildDispatchData(const std::vector<DispatchIndexPartial>& partials,
+                                                 uint32_t                                 dim_x,
+                                                 uint32_t                                 dim_y,
+                                                 uint32_t                                 dim_z,
+                                                 RayDispatchData&                         dispatch_data)
+{
+    constexpr int kProgressRayStep = 1024;
 
-        ++totalTokenCount;
+    const rta::RayHistoryTrace& rh = *ray_history_trace_;
 
-        readPointer = buffer_data + offset + sizeof(RayHistoryTokenId);
+    dispatch_data                 = {};
+    dispatch_data.dispatch_width  = dim_x;
+    dispatch_data.dispatch_height = dim_y;
 
-        // The read pointer is pointing at the beginning of the control
-        // token, so check if we can read the whole control token. If not the
-        // trace is definitely broken
-        if (!CheckOffsetIsInRange(readPointer, sizeof(RayHistoryTokenControl)))
+    const size_t coordinate_count = size_t(dim_x) * dim_y * dim_z;
+    dispatch_data.coordinate_stats.resize(coordinate_count);
+    dispatch_data.coordinate_offsets.assign(coordinate_count + 1, 0);
+
+    // Count the begin tokens of each coordinate and total up its stats.
+    for (const auto& partial : partials)
+    {
+        for (const auto& record : partial.records)
         {
+            if (!dispatch_data.CoordinateIsValid(record.x, record.y, record.z))
             {
-                std::scoped_lock<std::mutex> plock(process_mutex_);
-                error_state_ = true;
+                return false;
             }
-            break;
-        }
 
-        if (id->control)
-        {
-            // If it's a control word, then the payload comes right after
-            // this one
-            const auto control = static_cast<const RayHistoryTokenControl*>(readPointer);
-            offset += sizeof(RayHistoryTokenId);
-
-            // Check that we can actually read the whole token payload. Note
-            // that the read pointer didn't move yet so we need to check for
-            // both the token and the payload. At this point we know
-            // that we can dereference control, because that's checked before
-            // this loop
-            if (!CheckOffsetIsInRange(readPointer, sizeof(RayHistoryTokenControl) + control->tokenLength))
+            const uint64_t           coordinate_index = dispatch_data.GetCoordinateIndex(record.x, record.y, record.z);
+            DispatchCoordinateStats& stats            = dispatch_data.coordinate_stats[coordinate_index];
+            if (record.is_begin)
             {
-                {
-                    std::scoped_lock<std::mutex> plock(process_mutex_);
-                    error_state_ = true;
-                }
-                break;
+                dispatch_data.coordinate_offsets[coordinate_index + 1]++;
             }
+            stats.ray_count += record.stats.ray_count;
+            stats.any_hit_count += record.stats.any_hit_count;
+            stats.loop_iteration_count += record.stats.loop_iteration_count;
+            stats.intersection_count += record.stats.intersection_count;
+        }
+    }
 
-            const auto tokenStart = rayState.tokenData.size();
+    for (size_t i = 0; i < coordinate_count; i++)
+    {
+        dispatch_data.coordinate_offsets[i + 1] += dispatch_data.coordinate_offsets[i];
+    }
 
-            //assert(tokenStart <= std::numeric_limits<std::uint32_t>::max());
+    // Gather indices. The records are in ray order, so each coordinate's identifiers stay in ray order.
+    dispatch_data.begin_identifiers.resize(dispatch_data.coordinate_offsets.back());
+    std::vector<uint32_t> cursors(dispatch_data.coordinate_offsets.begin(), dispatch_data.coordinate_offsets.end() - 1);
+    for (const auto& partial : partials)
+    {
+        for (const auto& record : partial.records)
+        {
+            if (record.is_begin)
+            {
+                const uint64_t coordinate_index = dispatch_data.GetCoordinateIndex(record.x, record.y, record.z);
 
-            const RayHistoryTrace::TokenIndex tokenIndex = {static_cast<uint32_t>(tokenStart), 1};
-            rayState.index.push_back(tokenIndex);
+                dispatch_data.begin_identifiers[cursors[coordinate_index]++] = record.identifier;
+            }
+        }
+    }
 
-            switch (control->type)
+#ifdef _DEBUG
+    // Check the lists against one vector per coordinate, filled in record order.
+    std::vector<std::vector<RayDispatchBeginIdentifier>> debug_coordinate_rays(coordinate_count);
+    for (const auto& partial : partials)
+    {
+        for (const auto& record : partial.records)
+        {
+            if (record.is_begin)
             {
-            case RayHistoryTokenType::Begin:
-                assert(control->tokenLength * 4 == sizeof(RayHistoryTokenBeginData));
-                rayState.beginToken = true;
-                break;
-            case RayHistoryTokenType::BeginV2:
-                assert(control->tokenLength * 4 == sizeof(RayHistoryTokenBeginDataV2));
-                rayState.beginToken = true;
-                break;
-            case RayHistoryTokenType::AnyHitStatus:
-                assert(control->tokenLength == 0);
-                break;
-            case RayHistoryTokenType::FunctionCallV2:
-                // The new function call control token has length 3
-                assert(control->tokenLength == 3);
-                break;
-            case RayHistoryTokenType::End:
-                assert(control->tokenLength * 4 == sizeof(RayHistoryTokenEndData));
-                rayState.endToken = true;
-                break;
-            case RayHistoryTokenType::EndV2:
-                assert(control->tokenLength * 4 == sizeof(RayHistoryTokenEndDataV2));
-                rayState.endToken = true;
-                break;
-            default:
-                // All other tokens have length 2
-                //assert(control->tokenLength == 2);
-                break;
+                debug_coordinate_rays[dispatch_data.GetCoordinateIndex(record.x, record.y, record.z)].push_back(record.identifier);
             }
-
-            rayState.tokenData.insert(
-                rayState.tokenData.end(),
-                buffer_data + offset,
-                buffer_data + offset + sizeof(RayHistoryTokenControl) + static_cast<std::size_t>(control->tokenLength) * 4 /* size in DWORDS */);
-
-            offset += sizeof(RayHistoryTokenControl);
-            offset += static_cast<std::size_t>(control->tokenLength) * 4 /* size in DWORDS */;
         }
-        else
+    }
+    for (size_t i = 0; i < coordinate_count; i++)
+    {
+        const auto& rays = debug_coordinate_rays[i];
+        RRA_ASSERT(dispatch_data.coordinate_offsets[i + 1] - dispatch_data.coordinate_offsets[i] == rays.size());
+        for (size_t ray = 0; ray < rays.size(); ray++)
         {
-            // No need to check anything here because the control token is
-            // fully available
-            offset += sizeof(RayHistoryTokenId);
-
-            const auto tokenStart = rayState.tokenData.size();
-
-            // Check if TokenId and TokenControl are invalid, i.e. all zero
-            if (std::all_of(buffer_data + offset - sizeof(RayHistoryTokenId), buffer_data + offset + sizeof(RayHistoryTokenControl), [](const std::byte b) {
-                    return b == std::byte();
-                }))
+            const RayDispatchBeginIdentifier& identifier = dispatch_data.begin_identifiers[dispatch_data.coordinate_offsets[i] + ray];
+            RRA_ASSERT(identifier.dispatch_coord_index == rays[ray].dispatch_coord_index);
+            RRA_ASSERT(identifier.begin_token_index == rays[ray].begin_token_index);
+        }
+    }
+#endif  // _DEBUG
+
+    // Record the end token and intersection result of each ray, so intersection queries don't need the tokens.
+    // A ray's end token is the one before the next begin token of the coordinate, or the last token of the ray.
+    // Each ray is linked to its parent at the same time, and its child count is gathered for the child lists.
+    dispatch_data.ray_results.resize(dispatch_data.begin_identifiers.size());
+    dispatch_data.ray_parents.resize(dispatch_data.begin_identifiers.size());
+    dispatch_data.ray_child_offsets.assign(dispatch_data.begin_identifiers.size() + 1, 0);
+
+    constexpr size_t kMinCoordinatesPerTask = 64 * 1024;
+
+    const size_t result_task_count = rra::GetParallelTaskCount(coordinate_count, kMinCoordinatesPerTask);
+    rra::RunInParallel(result_task_count, [&](size_t task_index) {
+        const size_t          first_coordinate = coordinate_count * task_index / result_task_count;
+        const size_t          last_coordinate  = coordinate_count * (task_index + 1) / result_task_count;
+        std::vector<RayLink>  links;
+        std::vector<uint32_t> owners;
+        for (size_t coordinate_index = first_coordinate; coordinate_index < last_coordinate; coordinate_index++)
+        {
+            if ((coordinate_index - first_coordinate) % kProgressRayStep == 0 && cancelled_.load(std::memory_order_relaxed))
             {
-                offset += sizeof(RayHistoryTokenControl);
-                // Do not count invalid tokens
-                --totalTokenCount;
-                continue;
+                return;
             }
 
-            const RayHistoryTrace::TokenIndex tokenIndex = {static_cast<uint32_t>(tokenStart), 0};
-
-            rayState.index.push_back(tokenIndex);
+            const uint32_t first_ray = dispatch_data.coordinate_offsets[coordinate_index];
+            const uint32_t last_ray  = dispatch_data.coordinate_offsets[coordinate_index + 1];
 
-            rayState.tokenData.insert(rayState.tokenData.end(), buffer_data + offset, buffer_data + offset + sizeof(RayHistoryTokenControl));
-
-            offset += sizeof(RayHistoryTokenControl);
-        }
-    }
+            LinkCoordinateRays(rh, dispatch_data, first_ray, last_ray, links, owners);
 
-    // At this point, we have the data in rayData. We now compact it such
-    // that all tokenData entries get pasted together, and adjust the
-    // indices accordingly.
-    std::size_t totalCombinedTokenSize = 0;
+            for (uint32_t i = first_ray; i < last_ray; i++)
+            {
+                const RayDispatchBeginIdentifier& begin_identifier = dispatch_data.begin_identifiers[i];
+                RayDispatchRayResult&             ray_result       = dispatch_data.ray_results[i];
+                ray_result.intersection.hit_t                      = -1.0f;
 
-    for (const auto& kv : rayData)
-    {
-        totalCombinedTokenSize += kv.second.tokenData.size();
-        RRA_ASSERT(kv.second.beginToken);
-    }
+                rta::RayHistory rta_ray{rh.GetRayByIndex(begin_identifier.dispatch_coord_index)};
 
-    std::vector<std::byte> combinedTokenData;
-    combinedTokenData.reserve(totalCombinedTokenSize);
+                // If there are no tokens there is no result.
+                if (rta_ray.GetTokenCount() == 0)
+                {
+                    continue;
+                }
 
-    std::vector<RayHistoryTrace::TokenIndex> combinedTokenIndices;
-    combinedTokenIndices.reserve(totalTokenCount);
+                int64_t end_token_index = static_cast<int64_t>(rta_ray.GetTokenCount()) - 1;
 
-    std::vector<RayHistoryTrace::RayRange> combinedRayRanges;
-    combinedRayRanges.reserve(rayData.size());
+                // If not the last ray
+                if (i + 1 < last_ray)
+                {
+                    // Get the token behind the first token of the next ray.
+                    end_token_index = static_cast<int64_t>(dispatch_data.begin_identifiers[i + 1].begin_token_index) - 1;
+                }
 
-    for (const auto& kv : rayData)
-    {
-        const RayHistoryTrace::RayRange range = {
-            kv.first, static_cast<std::uint32_t>(combinedTokenIndices.size()), static_cast<std::uint32_t>(kv.second.index.size()), combinedTokenData.size()};
+                if (end_token_index < 0 || end_token_index >= rta_ray.GetTokenCount())
+                {
+                    continue;
+                }
 
-        combinedRayRanges.push_back(range);
+                ray_result.end_token_index = static_cast<uint32_t>(end_token_index);
 
-        combinedTokenData.insert(combinedTokenData.end(), kv.second.tokenData.begin(), kv.second.tokenData.end());
+                auto token = rta_ray.GetToken(ray_result.end_token_index);
+                if (token.GetType() == rta::RayHistoryTokenType::EndV2)
+                {
+                    IntersectionResult& result            = ray_result.intersection;
+                    auto                intersection_data = reinterpret_cast<const rta::RayHistoryTokenEndDataV2*>(token.GetPayload());
+                    result.hit_kind                       = intersection_data->hitKind;
+                    result.instance_index                 = intersection_data->instanceIndex;
+                    result.geometry_index                 = intersection_data->geometryIndex;
+                    result.primitive_index                = intersection_data->primitiveIndex;
+                    result.num_iterations                 = intersection_data->numIterations;
+                    result.num_instance_intersections     = intersection_data->numInstanceIntersections;
+
+                    if (!token.IsMiss())
+                    {
+                        result.hit_t = intersection_data->hitT;
+                    }
+                }
+            }
+        }
+    });
 
-        combinedTokenIndices.insert(combinedTokenIndices.end(), kv.second.index.begin(), kv.second.index.end());
+    if (cancelled_.load(std::memory_order_relaxed))
+    {
+        return false;
     }
 
-    auto result =
-        std::make_shared<RayHistoryTrace>(std::move(combinedTokenData), std::move(combinedTokenIndices), std::move(combinedRayRanges), (dx * dy * dz) - 1);
+    // Gather the child lists. A parent is always in the same coordinate as its children, so the coordinates can be done in parallel,
+    // and scattering the rays in order leaves each list in ray order.
+    for (size_t i = 0; i + 1 < dispatch_data.ray_child_offsets.size(); i++)
+    {
+        dispatch_data.ray_child_offsets[i + 1] += dispatch_data.ray_child_offsets[i];
+    }
+    dispatch_data.ray_children.resize(dispatch_data.ray_child_offsets.back());
 
-    const DispatchSize dispatchSize = {dx, dy, dz};
+    rra::RunInParallel(result_task_count, [&](size_t task_index) {
+        const size_t first_coordinate = coordinate_count * task_index / result_task_count;
+        const size_t last_coordinate  = coordinate_count * (task_index + 1) / result_task_count;
+        const size_t first_ray        = dispatch_data.coordinate_offsets[first_coordinate];
+        const size_t last_ray         = dispatch_data.coordinate_offsets[last_coordinate];
 
-    // Sanity check: #dispatched pixels = #rays
-    const auto rayCount = result->GetRayCount(RayHistoryTrace::IncludeEmptyRays);
-    if ((dispatchSize.width * dispatchSize.height * dispatchSize.depth) != (uint32_t)rayCount)
-    {
-        std::scoped_lock<std::mutex> plock(process_mutex_);
-        if (total_dispatch_indices_ > 0)
+        std::vector<uint32_t> child_cursors(dispatch_data.ray_child_offsets.begin() + first_ray, dispatch_data.ray_child_offsets.begin() + last_ray);
+        for (size_t coordinate_index = first_coordinate; coordinate_index < last_coordinate; coordinate_index++)
         {
-            error_state_ = true;
+            const uint32_t coordinate_first_ray = dispatch_data.coordinate_offsets[coordinate_index];
+            const uint32_t coordinate_last_ray  = dispatch_data.coordinate_offsets[coordinate_index + 1];
+            for (uint32_t i = coordinate_first_ray; i < coordinate_last_ray; i++)
+            {
+                const uint32_t parent = dispatch_data.ray_parents[i];
+                if (parent != RayDispatchData::kRootRay && parent != RayDispatchData::kDetachedRay)
+                {
+                    dispatch_data.ray_children[child_cursors[coordinate_first_ray + parent - first_ray]++] = i - coordinate_first_ray;
+                }
+            }
         }
-    }
+    });
 
-    ray_history_trace_ = result;
+    return !cancelled_.load(std::memory_order_relaxed);
 }
 
-void RraAsyncRayHistoryLoader::PreProcessDispatchData()
+void RraAsyncRayHistoryLoader::IndexDispatchData()
 {
     if (error_state_)
     {
         return;
     }
 
-    FindDispatchDimsFromTokens();
-
-    auto& rh = ray_history_trace_;
-    int   dispatch_coord_count{rh->GetRayCount(rta::RayHistoryTrace::ExcludeEmptyRays)};
+    // One sweep over the tokens finds the dispatch dimensions, the begin tokens of each dispatch coordinate
+    // with their stats, and the invocation counts. The dimensions aren't known until the sweep is done, so
+    // each range of rays keeps a record per begin token, and the records are applied in ray order afterwards.
+    //
+    // When the counter info gives the dimensions, the rays are swept in blocks that double in size, and the
+    // dispatch data of the rays swept so far is published after each block. A ray id is a dispatch coordinate,
+    // so the coordinates in a snapshot already have all of their rays. Doubling the blocks keeps the extra
+    // work of building the snapshots below that of building the final dispatch data.
+    constexpr int kMinSnapshotRays = 256 * 1024;
+    constexpr int kSnapshotCount   = 6;
 
-    rta::DispatchSize dispatch_size = {};
-    dispatch_size.width             = dim_x_;
-    dispatch_size.height            = dim_y_;
-    dispatch_size.depth             = dim_z_;
-
-    RayDispatchData dispatch_data = {};
+    const int dispatch_coord_count{ray_history_trace_->GetRayCount(rta::RayHistoryTrace::ExcludeEmptyRays)};
 
-    // Resize indices
-    dispatch_data.dispatch_width  = dispatch_size.width;
-    dispatch_data.dispatch_height = dispatch_size.height;
+    const bool publish_snapshots = total_dispatch_indices_ > 0 && dispatch_coord_count >= 2 * kMinSnapshotRays;
 
-    dispatch_data.dispatch_ray_indices.resize(dispatch_size.width * dispatch_size.height * dispatch_size.depth);
+    std::vector<DispatchIndexPartial> partials;
 
-    // Gather indices
-    for (int dispatch_coord_index{0}; dispatch_coord_index < dispatch_coord_count; ++dispatch_coord_index)
+    int64_t block_size = publish_snapshots ? std::max(kMinSnapshotRays, dispatch_coord_count >> kSnapshotCount) : dispatch_coord_count;
+    for (int first_ray = 0; first_ray < dispatch_coord_count; block_size *= 2)
     {
-        processed_dispatch_indices_++;
-
-        rta::RayHistory ray{rh->GetRayByIndex(dispatch_coord_index)};
+        // Don't leave a final block smaller than the one before it.
+        const int last_ray = (dispatch_coord_count - first_ray < 2 * block_size) ? dispatch_coord_count : static_cast<int>(first_ray + block_size);
 
-        uint32_t x = 0;
-        uint32_t y = 0;
-        uint32_t z = 0;
-
-        uint32_t begin_token_index = 0;
-
-        for (rta::RayHistoryToken token : ray)
+        SweepDispatchRays(first_ray, last_ray, partials);
+        if (StopIfCancelled())
         {
-            if (token.IsBegin())
-            {
-                auto begin_data = reinterpret_cast<const rta::RayHistoryTokenBeginDataV2*>(token.GetPayload());
-                x               = begin_data->dispatchRaysIndex[0];
-                y               = begin_data->dispatchRaysIndex[1];
-                z               = begin_data->dispatchRaysIndex[2];
+            return;
+        }
 
-                RayDispatchBeginIdentifier begin_identifier = {(uint32_t)dispatch_coord_index, begin_token_index};
+        if (last_ray < dispatch_coord_count)
+        {
+            PublishSnapshot(partials);
+        }
+        first_ray = last_ray;
+    }
 
-                if (!dispatch_data.CoordinateIsValid(x, y, z))
-                {
-                    std::scoped_lock<std::mutex> plock(process_mutex_);
-                    error_state_ = true;
-                    return;
-                }
+    // Reduce the partial results.
+    RraRayHistoryStats invocation_counts = ReducePartialStats(partials);
+    uint32_t           max_x             = 0;
+    uint32_t           max_y             = 0;
+    uint32_t           max_z             = 0;
+    for (const auto& partial : partials)
+    {
+        max_x = std::max(max_x, partial.max_x);
+        max_y = std::max(max_y, partial.max_y);
+        max_z = std::max(max_z, partial.max_z);
+    }
 
-                dispatch_data.GetCoordinate(x, y, z).begin_identifiers.push_back(begin_identifier);
-                dispatch_data.GetCoordinate(x, y, z).stats.ray_count++;
+    // Use the dimensions from the counter info if there are any, otherwise derive them from the begin tokens.
+    if (total_dispatch_indices_ == 0)
+    {
+        // Increment each dim by one since these are dimension sizes and not indices.
+        dim_x_ = max_x + 1;
+        dim_y_ = max_y + 1;
+        dim_z_ = max_z + 1;
 
-                std::scoped_lock<std::mutex> plock(process_mutex_);
-                total_ray_count_++;
-            }
+        total_dispatch_indices_ = dim_x_ * dim_y_ * dim_z_;
+    }
 
-            if (token.GetType() == rta::RayHistoryTokenType::AnyHitStatus)
-            {
-                dispatch_data.GetCoordinate(x, y, z).stats.any_hit_count++;
-            }
+    RayDispatchData dispatch_data = {};
+    if (!BuildDispatchData(partials, dim_x_, dim_y_, dim_z_, dispatch_data))
+    {
+        error_state_ = true;
+        return;
+    }
 
-            if (token.GetType() == rta::RayHistoryTokenType::EndV2)
-            {
-                auto end_token = reinterpret_cast<const rta::RayHistoryTokenEndDataV2*>(token.GetPayload());
-                dispatch_data.GetCoordinate(x, y, z).stats.loop_iteration_count += end_token->numIterations;
-                dispatch_data.GetCoordinate(x, y, z).stats.intersection_count += end_token->numInstanceIntersections;
-            }
+    invocation_counts.raygen_count = dim_x_ * dim_y_ * dim_z_;
 
-            begin_token_index++;
-        }
-    }
+    // This may change some day.
+    invocation_counts.pixel_count = invocation_counts.raygen_count;
 
     // Add data to the dispatch list.
-    dispatch_data_ = dispatch_data;
+    dispatch_data_ = std::move(dispatch_data);
+    total_ray_count_.store(invocation_counts.ray_count, std::memory_order_relaxed);
+
+    std::scoped_lock<std::mutex> plock(process_mutex_);
+    invocation_counts_ = invocation_counts;
 }
 
-void RraAsyncRayHistoryLoader::ProcessInvocationCounts()
+void RraAsyncRayHistoryLoader::PublishSnapshot(const std::vector<DispatchIndexPartial>& partials)
 {
-    if (error_state_)
+    auto snapshot               = std::make_shared<RayDispatchSnapshot>();
+    snapshot->ray_history_trace = ray_history_trace_;
+    if (!BuildDispatchData(partials, dim_x_, dim_y_, dim_z_, snapshot->dispatch_data))
     {
+        // An invalid coordinate fails the final build too, and that reports the error.
         return;
     }
 
-    invocation_counts_.raygen_count = dim_x_ * dim_y_ * dim_z_;
+    snapshot->stats              = ReducePartialStats(partials);
+    snapshot->stats.raygen_count = dim_x_ * dim_y_ * dim_z_;
+    snapshot->stats.pixel_count  = snapshot->stats.raygen_count;
 
-    // This may change some day.
-    invocation_counts_.pixel_count = invocation_counts_.raygen_count;
+    std::atomic_store(&snapshot_, std::shared_ptr<const RayDispatchSnapshot>(std::move(snapshot)));
 
-    invocation_counts_.ray_count = total_ray_count_;
+    std::scoped_lock<std::mutex> plock(process_mutex_);
+    load_status_.partially_indexed = true;
+    load_status_.snapshot_count++;
+}
 
-    auto& rh = ray_history_trace_;
+std::shared_ptr<const RayDispatchSnapshot> RraAsyncRayHistoryLoader::GetSnapshot() const
+{
+    return std::atomic_load(&snapshot_);
+}
 
-    const int dispatch_coord_count{rh->GetRayCount(rta::RayHistoryTrace::ExcludeEmptyRays)};
-    for (int dispatch_coord_index{0}; dispatch_coord_index < dispatch_coord_count; ++dispatch_coord_index)
+void RraAsyncRayHistoryLoader::RestoreCachedDispatchData()
+{
+    if (error_state_)
     {
-        const rta::RayHistory& rta_ray{rh->GetRayByIndex(dispatch_coord_index)};
-
-        for (const rta::RayHistoryToken& token : rta_ray)
-        {
-            std::scoped_lock<std::mutex> plock(process_mutex_);
+        return;
+    }
 
-            if (token.GetType() == rta::RayHistoryTokenType::ProceduralIntersectionStatus)
-            {
-                invocation_counts_.intersection_count++;
-            }
-            else if (token.GetType() == rta::RayHistoryTokenType::AnyHitStatus)
-            {
-                invocation_counts_.any_hit_count++;
-            }
-            else if (token.GetType() == rta::RayHistoryTokenType::EndV2)
-            {
-                auto end_token = reinterpret_cast<const rta::RayHistoryTokenEndDataV2*>(token.GetPayload());
+    std::scoped_lock<std::mutex> plock(process_mutex_);
 
-                if (token.IsMiss())
-                {
-                    invocation_counts_.miss_count++;
-                }
-                else
-                {
-                    invocation_counts_.closest_hit_count++;
-                }
+    dim_x_                  = cached_data_->dim_x;
+    dim_y_                  = cached_data_->dim_y;
+    dim_z_                  = cached_data_->dim_z;
+    total_dispatch_indices_ = dim_x_ * dim_y_ * dim_z_;
 
-                invocation_counts_.loop_iteration_count += end_token->numIterations;
-                invocation_counts_.instance_intersection_count += end_token->numInstanceIntersections;
-            }
-        }
-    }
+    dispatch_data_              = std::move(cached_data_->dispatch_data);
+    invocation_counts_          = cached_data_->stats;
+    total_ray_count_            = cached_data_->total_ray_count;
+    processed_dispatch_indices_ = total_dispatch_indices_.load();
 }
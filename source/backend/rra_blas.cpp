@@ -42,12 +42,7 @@ static float GetLength(const dxr::amd::Float3& vert_1, const dxr::amd::Float3& v
 rta::EncodedRtIp11BottomLevelBvh* RraBlasGetBlasFromBlasIndex(uint64_t blas_index)
 {
     RRA_ASSERT(data_set_.bvh_bundle.get() != nullptr);
-    const auto& bottom_level_bvhs = data_set_.bvh_bundle->GetBottomLevelBvhs();
-    if (blas_index >= bottom_level_bvhs.size())
-    {
-        return nullptr;
-    }
-    return dynamic_cast<rta::EncodedRtIp11BottomLevelBvh*>(&(*bottom_level_bvhs[blas_index]));
+    return data_set_.bvh_bundle->GetEncodedBottomLevelBvh(blas_index);
 }
 
 RraErrorCode RraBlasGetBaseAddress(uint64_t blas_index, uint64_t* out_address)
@@ -178,6 +173,11 @@ RraErrorCode RraBlasGetMaxTreeDepth(uint64_t blas_index, uint32_t* out_tree_dept
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     *out_tree_depth = blas->GetMaxTreeDepth();
 
     return kRraOk;
@@ -197,6 +197,11 @@ RraErrorCode RraBlasGetAvgTreeDepth(uint64_t blas_index, uint32_t* out_tree_dept
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     *out_tree_depth = blas->GetAvgTreeDepth();
 
     return kRraOk;
@@ -234,6 +239,12 @@ RraErrorCode RraBlasGetNodeParent(uint64_t blas_index, uint32_t node_ptr, uint32
     {
         return kRraErrorInvalidPointer;
     }
+
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     const dxr::amd::NodePointer* node        = reinterpret_cast<dxr::amd::NodePointer*>(&node_ptr);
     dxr::amd::NodePointer  parent_node = blas->GetParentNode(node);
 
@@ -250,6 +261,11 @@ RraErrorCode RraBlasGetSurfaceArea(uint64_t blas_index, uint32_t node_ptr, float
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     return RraBlasGetSurfaceAreaImpl(blas, reinterpret_cast<dxr::amd::NodePointer*>(&node_ptr), out_surface_area);
 }
 
@@ -328,8 +344,7 @@ RraErrorCode RraBlasGetSurfaceAreaImpl(const rta::EncodedRtIp11BottomLevelBvh* b
         RRA_ASSERT(&tri_node == triangle_node);
 #endif  // DEBUG
 
-        uint32_t tri_count{};
-        RraBlasGetNodeTriangleCount(blas->GetID(), node_ptr->GetRawPointer(), &tri_count);
+        const uint32_t tri_count = RraBlasGetNodeTriangleCountImpl(blas, *node_ptr);
 
         *out_surface_area = RraBlasGetTriangleSurfaceArea(*triangle_node, tri_count);
         return kRraOk;
@@ -349,6 +364,11 @@ RraErrorCode RraBlasGetMinimumSurfaceAreaHeuristic(uint64_t blas_index, uint32_t
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     if (RraBlasIsEmpty(blas_index))
     {
         *out_min_surface_area_heuristic = 0.0f;
@@ -369,6 +389,11 @@ RraErrorCode RraBlasGetAverageSurfaceAreaHeuristic(uint64_t blas_index, uint32_t
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     if (RraBlasIsEmpty(blas_index))
     {
         *out_avg_surface_area_heuristic = 0.0f;
@@ -389,6 +414,11 @@ RraErrorCode RraBlasGetTriangleSurfaceAreaHeuristic(uint64_t blas_index, uint32_
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     const dxr::amd::NodePointer* current_node = reinterpret_cast<dxr::amd::NodePointer*>(&node_ptr);
 
     *out_tri_surface_area_heuristic = rra::GetAverageSurfaceAreaHeuristic(blas, *current_node, true);
@@ -404,6 +434,11 @@ RraErrorCode RraBlasGetUniqueTriangleCount(uint64_t blas_index, uint32_t* out_tr
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     if (blas->GetHeader().GetGeometryType() == rta::BottomLevelBvhGeometryType::kTriangle)
     {
         uint32_t total_triangle_count = 0;
@@ -475,6 +510,11 @@ RraErrorCode RraBlasGetGeometryIndex(uint64_t blas_index, uint32_t node_ptr, uin
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     const dxr::amd::NodePointer* current_node = reinterpret_cast<dxr::amd::NodePointer*>(&node_ptr);
     if (current_node->IsTriangleNode())
     {
@@ -517,6 +557,11 @@ RraErrorCode RraBlasGetGeometryPrimitiveCount(uint64_t blas_index, uint32_t geom
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     if (geometry_index > blas->GetGeometryInfos().size())
     {
         return kRraErrorIndexOutOfRange;
@@ -536,6 +581,11 @@ RraErrorCode RraBlasGetGeometryCount(uint64_t blas_index, uint32_t* out_geometry
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     *out_geometry_count = (uint32_t)blas->GetGeometryInfos().size();
 
     return kRraOk;
@@ -550,6 +600,11 @@ RraErrorCode RraBlasGetPrimitiveIndex(uint64_t blas_index, uint32_t node_ptr, ui
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     const dxr::amd::NodePointer* current_node = reinterpret_cast<dxr::amd::NodePointer*>(&node_ptr);
     if (current_node->IsTriangleNode())
     {
@@ -596,6 +651,11 @@ RraErrorCode RraBlasGetGeometryFlags(uint64_t blas_index, uint32_t geometry_inde
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     if (out_geometry_flags == nullptr)
     {
         return kRraErrorInvalidPointer;
@@ -622,13 +682,17 @@ RraErrorCode RraBlasGetGeometryFlags(uint64_t blas_index, uint32_t geometry_inde
 
 RraErrorCode RraBlasGetIsInactive(uint64_t blas_index, uint32_t node_ptr, bool* out_is_inactive)
 {
-    const auto&                             bottom_level_bvhs = data_set_.bvh_bundle->GetBottomLevelBvhs();
-    const rta::EncodedRtIp11BottomLevelBvh* blas              = dynamic_cast<rta::EncodedRtIp11BottomLevelBvh*>(&(*bottom_level_bvhs[blas_index]));
+    const rta::EncodedRtIp11BottomLevelBvh* blas = RraBlasGetBlasFromBlasIndex(blas_index);
     if (blas == nullptr)
     {
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     dxr::amd::NodePointer* current_node = reinterpret_cast<dxr::amd::NodePointer*>(&node_ptr);
 
     if (current_node == nullptr)
@@ -660,53 +724,50 @@ RraErrorCode RraBlasGetIsInactive(uint64_t blas_index, uint32_t node_ptr, bool*
     return kRraErrorInvalidChildNode;
 }
 
-RraErrorCode RraBlasGetNodeTriangleCount(uint64_t blas_index, uint32_t node_ptr, uint32_t* out_triangle_count)
+uint32_t RraBlasGetNodeTriangleCountImpl(const rta::EncodedRtIp11BottomLevelBvh* blas, const dxr::amd::NodePointer node_ptr)
 {
-    const auto&                             bottom_level_bvhs = data_set_.bvh_bundle->GetBottomLevelBvhs();
-    const rta::EncodedRtIp11BottomLevelBvh* blas              = dynamic_cast<rta::EncodedRtIp11BottomLevelBvh*>(&(*bottom_level_bvhs[blas_index]));
-    if (blas == nullptr)
-    {
-        return kRraErrorInvalidPointer;
-    }
-
-    if (RraBlasIsEmpty(blas_index))
-    {
-        *out_triangle_count = 0;
-        return kRraOk;
-    }
-
-    dxr::amd::NodePointer* current_node = reinterpret_cast<dxr::amd::NodePointer*>(&node_ptr);
-
-    if (current_node == nullptr)
+    if (blas->IsEmpty())
     {
-        return kRraErrorInvalidPointer;
+        return 0;
     }
 
     // The incoming node id should be a triangle node. If it's not, we can't extract triangle data.
-    if (current_node->GetType() == dxr::amd::NodeType::kAmdNodeTriangle0)
+    if (node_ptr.GetType() == dxr::amd::NodeType::kAmdNodeTriangle0)
     {
-        *out_triangle_count = 1;
+        return 1;
     }
-    else if (current_node->GetType() == dxr::amd::NodeType::kAmdNodeTriangle1)
+    else if (node_ptr.GetType() == dxr::amd::NodeType::kAmdNodeTriangle1)
     {
-        *out_triangle_count = 2;
+        return 2;
     }
-    else
+    return 0;
+}
+
+RraErrorCode RraBlasGetNodeTriangleCount(uint64_t blas_index, uint32_t node_ptr, uint32_t* out_triangle_count)
+{
+    const rta::EncodedRtIp11BottomLevelBvh* blas = RraBlasGetBlasFromBlasIndex(blas_index);
+    if (blas == nullptr)
     {
-        *out_triangle_count = 0;
+        return kRraErrorInvalidPointer;
     }
+
+    *out_triangle_count = RraBlasGetNodeTriangleCountImpl(blas, *reinterpret_cast<dxr::amd::NodePointer*>(&node_ptr));
     return kRraOk;
 }
 
 RraErrorCode RraBlasGetNodeTriangles(uint64_t blas_index, uint32_t node_ptr, TriangleVertices* out_triangles)
 {
-    const auto&                             bottom_level_bvhs = data_set_.bvh_bundle->GetBottomLevelBvhs();
-    const rta::EncodedRtIp11BottomLevelBvh* blas              = dynamic_cast<rta::EncodedRtIp11BottomLevelBvh*>(&(*bottom_level_bvhs[blas_index]));
+    const rta::EncodedRtIp11BottomLevelBvh* blas = RraBlasGetBlasFromBlasIndex(blas_index);
     if (blas == nullptr)
     {
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     dxr::amd::NodePointer* current_node = reinterpret_cast<dxr::amd::NodePointer*>(&node_ptr);
 
     if (current_node == nullptr)
@@ -757,13 +818,17 @@ RraErrorCode RraBlasGetNodeTriangles(uint64_t blas_index, uint32_t node_ptr, Tri
 
 RraErrorCode RraBlasGetNodeVertices(uint64_t blas_index, uint32_t node_ptr, struct VertexPosition* out_vertices)
 {
-    const auto&                             bottom_level_bvhs = data_set_.bvh_bundle->GetBottomLevelBvhs();
-    const rta::EncodedRtIp11BottomLevelBvh* blas              = dynamic_cast<rta::EncodedRtIp11BottomLevelBvh*>(&(*bottom_level_bvhs[blas_index]));
+    const rta::EncodedRtIp11BottomLevelBvh* blas = RraBlasGetBlasFromBlasIndex(blas_index);
     if (blas == nullptr)
     {
         return kRraErrorInvalidPointer;
     }
 
+    if (!blas->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     dxr::amd::NodePointer* current_node = reinterpret_cast<dxr::amd::NodePointer*>(&node_ptr);
 
     if (current_node == nullptr)
@@ -29,6 +29,14 @@ rta::EncodedRtIp11BottomLevelBvh* RraBlasGetBlasFromBlasIndex(uint64_t blas_inde
 /// @return The triangle node surface area.
 float RraBlasGetTriangleSurfaceArea(const dxr::amd::TriangleNode& triangle_node, uint32_t tri_count);
 
+/// @brief Get the number of triangles in a given BLAS node.
+///
+/// @param [in] blas     The bottom level acceleration structure.
+/// @param [in] node_ptr The node of interest.
+///
+/// @return The number of triangles, or 0 if the node isn't a triangle node.
+uint32_t RraBlasGetNodeTriangleCountImpl(const rta::EncodedRtIp11BottomLevelBvh* blas, const dxr::amd::NodePointer node_ptr);
+
 /// @brief Get the surface area for a given BLAS node.
 ///
 /// @param [in]  blas             The bottom level acceleration structure.
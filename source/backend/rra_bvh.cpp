@@ -12,6 +12,8 @@
 #include <float.h>
 
 #include "bvh/rtip11/iencoded_rt_ip_11_bvh.h"
+#include "bvh/rtip11/encoded_rt_ip_11_bottom_level_bvh.h"
+#include "bvh/rtip11/encoded_rt_ip_11_top_level_bvh.h"
 #include "bvh/dxr_definitions.h"
 #include "public/rra_assert.h"
 #include "rra_data_set.h"
@@ -23,6 +25,11 @@ RraErrorCode RraBvhGetNodeBoundingVolume(const rta::IEncodedRtIp11Bvh*     bvh,
                                          const dxr::amd::NodePointer*      node_ptr,
                                          dxr::amd::AxisAlignedBoundingBox& out_bounding_box)
 {
+    if (!bvh->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     if (node_ptr->IsInvalid())
     {
         return kRraErrorInvalidPointer;
@@ -51,6 +58,21 @@ RraErrorCode RraBvhGetNodeBoundingVolume(const rta::IEncodedRtIp11Bvh*     bvh,
     }
     else
     {
+        const rta::DecodedBoxNodeCache* decoded_node_cache = bvh->GetDecodedNodeCache();
+        if (decoded_node_cache != nullptr && decoded_node_cache->Contains(parent_node))
+        {
+            const dxr::amd::NodePointer* child_array = decoded_node_cache->GetChildren(parent_node);
+            for (uint32_t child_index = 0; child_index < 4; child_index++)
+            {
+                if (child_array[child_index].GetRawPointer() == node_ptr->GetRawPointer())
+                {
+                    out_bounding_box = decoded_node_cache->GetChildBoundingBox(parent_node, child_index);
+                    return kRraOk;
+                }
+            }
+            return kRraErrorInvalidPointer;
+        }
+
         uint64_t parent_index;
         if (parent_node.IsBoxNode())
         {
@@ -237,6 +259,11 @@ RraErrorCode RraBvhGetBoundingVolumeSurfaceArea(const rta::IEncodedRtIp11Bvh* bv
 
 RraErrorCode RraBvhGetSurfaceAreaHeuristic(const rta::IEncodedRtIp11Bvh* bvh, const dxr::amd::NodePointer node_ptr, float* out_surface_area_heuristic)
 {
+    if (!bvh->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     if (node_ptr.IsInvalid())
     {
         return kRraErrorInvalidPointer;
@@ -262,11 +289,28 @@ RraErrorCode RraBvhGetSurfaceAreaHeuristic(const rta::IEncodedRtIp11Bvh* bvh, co
 
 RraErrorCode RraBvhGetChildNodeCount(const rta::IEncodedRtIp11Bvh* bvh, uint32_t parent_node, uint32_t* out_child_count)
 {
+    if (!bvh->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     const auto&            header_offsets = bvh->GetHeader().GetBufferOffsets();
     dxr::amd::NodePointer* node_ptr       = reinterpret_cast<dxr::amd::NodePointer*>(&parent_node);
     auto                   byte_offset    = node_ptr->GetByteOffset() - header_offsets.interior_nodes;
     const auto&            interior_nodes = bvh->GetInteriorNodesData();
 
+    const rta::DecodedBoxNodeCache* decoded_node_cache = bvh->GetDecodedNodeCache();
+    if (decoded_node_cache != nullptr && decoded_node_cache->Contains(*node_ptr))
+    {
+        const dxr::amd::NodePointer* children = decoded_node_cache->GetChildren(*node_ptr);
+        *out_child_count                      = 0;
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            *out_child_count += static_cast<uint32_t>(!children[i].IsInvalid());
+        }
+        return kRraOk;
+    }
+
     if (interior_nodes.size() > byte_offset)
     {
         if (node_ptr->IsFp32BoxNode())
@@ -289,11 +333,31 @@ RraErrorCode RraBvhGetChildNodeCount(const rta::IEncodedRtIp11Bvh* bvh, uint32_t
 
 RraErrorCode RraBvhGetChildNodes(const rta::IEncodedRtIp11Bvh* bvh, uint32_t parent_node, uint32_t* out_child_nodes)
 {
+    if (!bvh->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     const auto&            header_offsets = bvh->GetHeader().GetBufferOffsets();
     dxr::amd::NodePointer* node_ptr       = reinterpret_cast<dxr::amd::NodePointer*>(&parent_node);
     auto                   byte_offset    = node_ptr->GetByteOffset() - header_offsets.interior_nodes;
     const auto&            interior_nodes = bvh->GetInteriorNodesData();
 
+    const rta::DecodedBoxNodeCache* decoded_node_cache = bvh->GetDecodedNodeCache();
+    if (decoded_node_cache != nullptr && decoded_node_cache->Contains(*node_ptr))
+    {
+        const dxr::amd::NodePointer* children = decoded_node_cache->GetChildren(*node_ptr);
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            if (!children[i].IsInvalid())
+            {
+                *out_child_nodes = children[i].GetRawPointer();
+                out_child_nodes++;
+            }
+        }
+        return kRraOk;
+    }
+
     if (interior_nodes.size() > byte_offset)
     {
         if (node_ptr->IsFp32BoxNode())
@@ -328,6 +392,11 @@ RraErrorCode RraBvhGetChildNodes(const rta::IEncodedRtIp11Bvh* bvh, uint32_t par
 
 RraErrorCode RraBvhGetChildNodePtr(const rta::IEncodedRtIp11Bvh* bvh, uint32_t parent_node, uint32_t child_index, uint32_t* out_node_ptr)
 {
+    if (!bvh->LoadDeferredNodeData())
+    {
+        return kRraErrorMalformedData;
+    }
+
     const auto&            header_offsets = bvh->GetHeader().GetBufferOffsets();
     dxr::amd::NodePointer* node_ptr       = reinterpret_cast<dxr::amd::NodePointer*>(&parent_node);
     auto                   byte_offset    = node_ptr->GetByteOffset() - header_offsets.interior_nodes;
@@ -457,10 +526,9 @@ RraErrorCode RraBvhGetTotalTlasSizeInBytes(uint64_t* out_size_in_bytes)
     if (RraBvhGetTlasCount(&tlas_count) == kRraOk)
     {
         RRA_ASSERT(data_set_.bvh_bundle.get() != nullptr);
-        const auto& top_level_bvhs = data_set_.bvh_bundle->GetTopLevelBvhs();
         for (uint64_t tlas_index = 0; tlas_index < tlas_count; tlas_index++)
         {
-            const rta::IEncodedRtIp11Bvh* tlas = dynamic_cast<rta::IEncodedRtIp11Bvh*>(&(*top_level_bvhs[tlas_index]));
+            const rta::IEncodedRtIp11Bvh* tlas = data_set_.bvh_bundle->GetEncodedTopLevelBvh(tlas_index);
             if (tlas != nullptr)
             {
                 *out_size_in_bytes += tlas->GetHeader().GetFileSize();
@@ -476,15 +544,14 @@ RraErrorCode RraBvhGetTotalBlasSizeInBytes(uint64_t* out_size_in_bytes)
     if (RraBvhGetBlasCount(&blas_count) == kRraOk)
     {
         RRA_ASSERT(data_set_.bvh_bundle.get() != nullptr);
-        const auto& bottom_level_bvhs = data_set_.bvh_bundle->GetBottomLevelBvhs();
-        uint64_t    offset            = 0;
+        uint64_t offset = 0;
         if (data_set_.bvh_bundle->ContainsEmptyPlaceholder())
         {
             offset = 1;
         }
         for (uint64_t blas_index = offset; blas_index < (blas_count + offset); blas_index++)
         {
-            const rta::IEncodedRtIp11Bvh* blas = dynamic_cast<rta::IEncodedRtIp11Bvh*>(&(*bottom_level_bvhs[blas_index]));
+            const rta::IEncodedRtIp11Bvh* blas = data_set_.bvh_bundle->GetEncodedBottomLevelBvh(blas_index);
             if (blas != nullptr)
             {
                 *out_size_in_bytes += blas->GetHeader().GetFileSize();
@@ -21,6 +21,7 @@
 
 #include "ray_history/raytracing_counter.h"
 
+#include "derived_data_cache.h"
 #include "surface_area_heuristic.h"
 
 #ifndef _WIN32
@@ -33,28 +34,24 @@
 #include <map>
 #include <algorithm>
 
-static bool ContainsChunk(const char* identifier, const rdf::ChunkFile& chunk_file)
+static std::vector<std::shared_ptr<RraAsyncRayHistoryLoader>> LaunchAsyncRayHistoryLoaders(const rra::TraceChunkIndex&     chunk_index,
+                                                                                           const char*                     file_path,
+                                                                                           rra::DerivedDataCache&          derived_data_cache,
+                                                                                           rra::RayHistoryLoadScheduler*   scheduler,
+                                                                                           const RayHistoryStorageOptions& storage_options)
 {
-    try
-    {
-        auto result = chunk_file.ContainsChunk(identifier);
-        return result;
-    }
-    catch (...)
-    {
-        return false;
-    }
-}
+    // The raw token buffer and the ray data parsed from it are both held while a dispatch loads.
+    constexpr uint64_t kLoadMemoryFactor = 2;
 
-static std::vector<std::shared_ptr<RraAsyncRayHistoryLoader>> LaunchAsyncRayHistoryLoaders(rdf::ChunkFile& chunk_file, const char* file_path)
-{
     std::vector<std::shared_ptr<RraAsyncRayHistoryLoader>> loaders;
 
-    int64_t dispatch_count = chunk_file.GetChunkCount(RRA_RAY_HISTORY_RAW_TOKENS_IDENTIFIER);
+    const auto& token_chunks   = chunk_index.GetChunks(RRA_RAY_HISTORY_RAW_TOKENS_IDENTIFIER);
+    int64_t     dispatch_count = static_cast<int64_t>(token_chunks.size());
 
     for (int64_t i = 0; i < dispatch_count; i++)
     {
-        auto loader = std::make_shared<RraAsyncRayHistoryLoader>(file_path, i);
+        auto loader = std::make_shared<RraAsyncRayHistoryLoader>(file_path, i, derived_data_cache.TakeDispatchData(i), storage_options);
+        loader->Start(scheduler, static_cast<uint64_t>(token_chunks[i].data_size) * kLoadMemoryFactor);
         loaders.push_back(loader);
     }
 
@@ -83,8 +80,16 @@ static RraErrorCode ParseRdf(const char* path, RraDataSet* data_set)
 
     rdf::ChunkFile chunk_file = rdf::ChunkFile(file);
 
+    // Index the chunks once, so the probes below don't need to walk the chunk table again.
+    error_code = data_set->chunk_index.Build(chunk_file);
+    if (error_code != kRraOk)
+    {
+        return error_code;
+    }
+    const rra::TraceChunkIndex& chunk_index = data_set->chunk_index;
+
     // Load the API Info and ASIC info chunks if they exist in the file.
-    if (ContainsChunk(rra::ApiInfo::kChunkIdentifier, chunk_file))
+    if (chunk_index.ContainsChunk(rra::ApiInfo::kChunkIdentifier))
     {
         error_code = data_set->api_info.LoadChunk(chunk_file);
         if (error_code != kRraOk)
@@ -92,7 +97,7 @@ static RraErrorCode ParseRdf(const char* path, RraDataSet* data_set)
             return error_code;
         }
     }
-    if (ContainsChunk(rra::AsicInfo::kChunkIdentifier, chunk_file))
+    if (chunk_index.ContainsChunk(rra::AsicInfo::kChunkIdentifier))
     {
         error_code = data_set->asic_info.LoadChunk(chunk_file);
         if (error_code != kRraOk)
@@ -103,7 +108,7 @@ static RraErrorCode ParseRdf(const char* path, RraDataSet* data_set)
 
     int max_as_major_version       = 0;
     int max_dispatch_major_version = 0;
-    error_code                     = rta::GetMaxMajorVersions(chunk_file, &max_as_major_version, &max_dispatch_major_version);
+    error_code                     = rta::GetMaxMajorVersions(chunk_index, &max_as_major_version, &max_dispatch_major_version);
     if (error_code != kRraOk)
     {
         return error_code;
@@ -118,13 +123,50 @@ static RraErrorCode ParseRdf(const char* path, RraDataSet* data_set)
     bool system_info_result = system_info_utils::SystemInfoReader::Parse(chunk_file, *data_set->system_info);
     RRA_UNUSED(system_info_result);
 
+    // Look for data derived from this trace on a previous load.
+    rra::DerivedDataCache derived_data_cache;
+    if (data_set->use_derived_data_cache)
+    {
+        if (rra::DerivedDataCache::GetKey(path, chunk_index, data_set->derived_data_cache_key))
+        {
+            data_set->derived_data_cache_loaded = derived_data_cache.Load(path, data_set->derived_data_cache_key);
+        }
+        else
+        {
+            data_set->use_derived_data_cache = false;
+        }
+    }
+
     // Launch ray history loaders.
     data_set->async_ray_histories.clear();
-    data_set->async_ray_histories = LaunchAsyncRayHistoryLoaders(chunk_file, path);
+    data_set->ray_history_scheduler =
+        std::make_unique<rra::RayHistoryLoadScheduler>(data_set->ray_history_worker_count, data_set->ray_history_memory_budget);
+    data_set->async_ray_histories = LaunchAsyncRayHistoryLoaders(
+        chunk_index, path, derived_data_cache, data_set->ray_history_scheduler.get(), data_set->ray_history_storage);
 
-    // Load the BVH chunks.
-    rta::RayTracingIpLevel rtip_level = rta::GetRtIpLevel(chunk_file, &error_code);
-    data_set->bvh_bundle              = rta::LoadBvhBundleFromFile(chunk_file, rtip_level, rta::BvhBundleReadOption::kDefault, &error_code);
+    // Load the BVH chunks. With deferred BLAS decoding the cache also provides the BLAS headers, which saves reading the
+    // BLAS chunks, and each BLAS keeps its derived data until its node data is decoded.
+    const bool restore_bvh_data = derived_data_cache.IsLoaded();
+
+    rta::BvhBundleReadOption read_option = data_set->bvh_read_option;
+    if (restore_bvh_data)
+    {
+        read_option = static_cast<rta::BvhBundleReadOption>(static_cast<std::uint8_t>(read_option) |
+                                                            static_cast<std::uint8_t>(rta::BvhBundleReadOption::kDeferPostLoad));
+    }
+
+    rta::RayTracingIpLevel rtip_level = rta::GetRtIpLevel(chunk_file, chunk_index, &error_code);
+    data_set->bvh_bundle =
+        rta::LoadBvhBundleFromFile(chunk_file, path, chunk_index, derived_data_cache.GetBlasHeaderData(), rtip_level, read_option, &error_code);
+
+    if (data_set->bvh_bundle != nullptr && restore_bvh_data)
+    {
+        data_set->derived_data_cache_hit = derived_data_cache.RestoreBvhBundle(*data_set->bvh_bundle);
+        if (!data_set->derived_data_cache_hit && !data_set->bvh_bundle->PostLoad())
+        {
+            error_code = kRraErrorMalformedData;
+        }
+    }
 
     return error_code;
 }
@@ -160,16 +202,77 @@ RraErrorCode RraDataSetInitialize(const char* path, RraDataSet* data_set)
 
     data_set->file_loaded = true;
 
+    // Skips the BVHs restored from the cache. With deferred BLAS decoding, this also starts the background decode.
     rra::CalculateSurfaceAreaHeuristics(*data_set);
 
+    // Cache the derived data for the next time this trace is loaded. The ray history loaders, and the deferred BLAS
+    // decoding, may still be running, so this is done in the background.
+    if (data_set->use_derived_data_cache && !data_set->derived_data_cache_hit)
+    {
+        const std::string              trace_path(path);
+        const rra::DerivedDataCacheKey key     = data_set->derived_data_cache_key;
+        const rta::BvhBundle*          bundle  = data_set->bvh_bundle.get();
+        const auto                     loaders = data_set->async_ray_histories;
+
+        data_set->derived_data_cache_writer = std::async(std::launch::async, [trace_path, key, bundle, loaders]() {
+            rra::DerivedDataCache::Write(trace_path, key, *bundle, loaders);
+        });
+    }
+
     return kRraOk;
 }
 
 // Destroy the data set.
-RraErrorCode RraDataSetDestroy(RraDataSet* data_set)
+RraErrorCode RraDataSetDestroy(RraDataSet* data_set, std::future<void>& teardown)
 {
     data_set->file_loaded = false;
-    data_set->bvh_bundle.reset();
+
+    // Stop the dispatch loads where they are. They check for cancellation as they go, and the ones that haven't
+    // started finish without reading the trace.
+    for (const auto& loader : data_set->async_ray_histories)
+    {
+        loader->Cancel();
+    }
+
+    // The deferred BLAS decode thread calculates SAH values on the bundle, so it is stopped while the bundle still
+    // belongs to the data set. It finishes the BLAS it is on, the rest are left undecoded.
+    if (data_set->bvh_bundle != nullptr)
+    {
+        data_set->bvh_bundle->StopDeferredBlasDecode();
+    }
+
+    // Waiting for the loads and the cache writer, and freeing the trace data, is left to a background task so
+    // unloading doesn't block. The cache writer reads from the BVH bundle, so the bundle is freed after it is done.
+    // Everything the task waits on has been cancelled, so it doesn't wait for long.
+    auto retired_writer    = std::make_shared<std::future<void>>(std::move(data_set->derived_data_cache_writer));
+    auto retired_bundle    = std::shared_ptr<rta::BvhBundle>(std::move(data_set->bvh_bundle));
+    auto retired_scheduler = std::shared_ptr<rra::RayHistoryLoadScheduler>(std::move(data_set->ray_history_scheduler));
+    auto retired_loaders   = std::move(data_set->async_ray_histories);
+    data_set->async_ray_histories.clear();
+
+    teardown = std::async(std::launch::async, [retired_writer, retired_bundle, retired_scheduler, retired_loaders]() mutable {
+        if (retired_writer->valid())
+        {
+            retired_writer->wait();
+        }
+        retired_bundle.reset();
+
+        // Waits for any load that is still running, and finishes the ones that never started.
+        retired_scheduler.reset();
+
+#ifdef _DEBUG
+        // Every load has been cancelled, so none of them can have been left unfinished.
+        for (const auto& loader : retired_loaders)
+        {
+            RRA_ASSERT(loader->IsCancelled() && loader->IsDone());
+        }
+#endif  // _DEBUG
+
+        retired_loaders.clear();
+    });
+
+    data_set->chunk_index.Clear();
+
     delete data_set->system_info;
     data_set->system_info = nullptr;
 
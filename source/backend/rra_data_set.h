@@ -10,14 +10,18 @@
 
 #include <stdio.h>
 #include <time.h>
+#include <future>
 
 #include "public/rra_error.h"
 
 #include "rra_configuration.h"
 
 #include "bvh/bvh_bundle.h"
+#include "trace_chunk_index.h"
+#include "derived_data_cache.h"
 #include "ray_history/ray_history.h"
 #include "public/rra_async_ray_history_loader.h"
+#include "ray_history_load_scheduler.h"
 #include "api_info.h"
 #include "asic_info.h"
 #include "system_info_utils/source/system_info_reader.h"
@@ -35,6 +39,17 @@ typedef struct RraDataSet
     time_t                                                 create_time;         ///< The time the trace was created.
     std::unique_ptr<rta::BvhBundle>                        bvh_bundle;  ///< The BVH bundle class encapsulating all the BLAS and TLAS for the loaded trace.
     std::vector<std::shared_ptr<RraAsyncRayHistoryLoader>> async_ray_histories;    ///< The ray histories made available per asnyc work.
+    std::unique_ptr<rra::RayHistoryLoadScheduler>          ray_history_scheduler;  ///< Runs the ray history loaders.
+    uint32_t                                               ray_history_worker_count  = 0;  ///< The number of ray history load workers. 0 uses the hardware thread count.
+    uint64_t                                               ray_history_memory_budget  = 0;  ///< The memory budget for ray history loading, in bytes. 0 means no limit.
+    RayHistoryStorageOptions                               ray_history_storage        = {};  ///< How the parsed ray history is stored.
+    rra::TraceChunkIndex                                   chunk_index = {};       ///< The index of the chunks in the trace file.
+    rta::BvhBundleReadOption                               bvh_read_option = rta::BvhBundleReadOption::kDefault;  ///< How the BVH chunks are loaded.
+    bool                                                   use_derived_data_cache = false;  ///< Should the derived data cache be read and written.
+    bool                                                   derived_data_cache_hit = false;  ///< Was the derived data restored from the cache.
+    bool                                                   derived_data_cache_loaded = false;  ///< Was a cache matching the trace found.
+    rra::DerivedDataCacheKey                               derived_data_cache_key = {};     ///< Identifies the trace in the derived data cache.
+    std::future<void>                                      derived_data_cache_writer;       ///< Writes the derived data cache in the background.
     rra::ApiInfo                                           api_info    = {};       ///< The API info.
     rra::AsicInfo                                          asic_info   = {};       ///< The ASIC info.
     system_info_utils::SystemInfo*                         system_info = nullptr;  ///< The System Info.
@@ -53,12 +68,16 @@ RraErrorCode RraDataSetInitialize(const char* path, RraDataSet* data_set);
 
 /// Destroy the data set.
 ///
+/// Cancels the ray history loads, and leaves waiting for them and freeing the trace data to a background task.
+/// The caller owns the task, and must wait for it before the process exits.
+///
 /// @param [in]  data_set                       A pointer to a <c><i>RraDataSet</i></c> structure that will contain the data set.
+/// @param [out] teardown                       The background task freeing the trace data.
 ///
 /// kRraOk                                      The operation completed successfully.
 /// @retval
 /// kRraErrorInvalidPointer                     The operation failed due to <c><i>data_set</i></c> being set to <c><i>NULL</i></c>.
-RraErrorCode RraDataSetDestroy(RraDataSet* data_set);
+RraErrorCode RraDataSetDestroy(RraDataSet* data_set, std::future<void>& teardown);
 
 #ifdef __cplusplus
 }
@@ -9,22 +9,130 @@
 
 #include "public/rra_ray_history.h"
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "parallel_util.h"
+#include "ray_history_query.h"
 #include "rra_data_set.h"
 #include "ray_history/raytracing_counter.h"
 
 // External reference to the global dataset.
 extern RraDataSet data_set_;
 
-DispatchCoordinateData& RayDispatchData::GetCoordinate(uint32_t x, uint32_t y, uint32_t z)
+uint64_t RayDispatchData::GetCoordinateIndex(uint32_t x, uint32_t y, uint32_t z) const
+{
+    return x + (uint64_t(y) * dispatch_width) + (uint64_t(z) * dispatch_width * dispatch_height);
+}
+
+bool RayDispatchData::CoordinateIsValid(uint32_t x, uint32_t y, uint32_t z) const
+{
+    return GetCoordinateIndex(x, y, z) < coordinate_stats.size();
+}
+
+RayDispatchBeginIdentifierSpan RayDispatchData::GetBeginIdentifiers(uint32_t x, uint32_t y, uint32_t z) const
 {
-    auto idx = x + (y * dispatch_width) + (z * dispatch_width * dispatch_height);
-    return dispatch_ray_indices[idx];
+    auto idx = GetCoordinateIndex(x, y, z);
+    return {begin_identifiers.data() + coordinate_offsets[idx], coordinate_offsets[idx + 1] - coordinate_offsets[idx]};
+}
+
+const RayDispatchRayResult* RayDispatchData::GetRayResult(uint32_t x, uint32_t y, uint32_t z, uint32_t ray_index) const
+{
+    auto idx = GetCoordinateIndex(x, y, z);
+    if (ray_index >= coordinate_offsets[idx + 1] - coordinate_offsets[idx])
+    {
+        return nullptr;
+    }
+    return &ray_results[coordinate_offsets[idx] + ray_index];
+}
+
+const DispatchCoordinateStats& RayDispatchData::GetStats(uint32_t x, uint32_t y, uint32_t z) const
+{
+    return coordinate_stats[GetCoordinateIndex(x, y, z)];
+}
+
+/// @brief The data read by a query for one dispatch coordinate.
+struct CoordinateQueryData
+{
+    std::shared_ptr<const RayDispatchSnapshot> snapshot          = nullptr;  ///< Keeps the snapshot alive, if the data is from one.
+    const RayDispatchData*                     dispatch_data     = nullptr;  ///< The dispatch data.
+    const rta::RayHistoryTrace*                ray_history_trace = nullptr;  ///< The trace.
+};
+
+/// @brief Get the data to answer a query for one dispatch coordinate.
+///
+/// While the dispatch is loading, a coordinate the latest snapshot has rays for is read from the snapshot, so it
+/// can be queried without waiting for the rest of the dispatch. Otherwise this waits for the load to finish.
+///
+/// @param [in] dispatch_id   The ID of the dispatch. Must be in range.
+/// @param [in] invocation_id The global invocation ID.
+///
+/// @return The data to read.
+static CoordinateQueryData GetCoordinateQueryData(uint32_t dispatch_id, GlobalInvocationID invocation_id)
+{
+    auto& loader = data_set_.async_ray_histories[dispatch_id];
+
+    CoordinateQueryData data = {};
+    if (!loader->IsDone())
+    {
+        data.snapshot = loader->GetSnapshot();
+    }
+
+    if (data.snapshot != nullptr)
+    {
+        const RayDispatchData& snapshot_data = data.snapshot->dispatch_data;
+        if (snapshot_data.CoordinateIsValid(invocation_id.x, invocation_id.y, invocation_id.z) &&
+            snapshot_data.GetBeginIdentifiers(invocation_id.x, invocation_id.y, invocation_id.z).size() > 0)
+        {
+            data.dispatch_data     = &snapshot_data;
+            data.ray_history_trace = data.snapshot->ray_history_trace.get();
+            return data;
+        }
+        data.snapshot = nullptr;
+    }
+
+    data.dispatch_data     = &loader->GetDispatchData();
+    data.ray_history_trace = loader->GetRayHistoryTrace();
+    return data;
 }
 
-bool RayDispatchData::CoordinateIsValid(uint32_t x, uint32_t y, uint32_t z)
+/// @brief The data read by a query for a whole dispatch.
+struct DispatchQueryData
+{
+    std::shared_ptr<const RayDispatchSnapshot> snapshot          = nullptr;  ///< Keeps the snapshot alive, if the data is from one.
+    const RayDispatchData*                     dispatch_data     = nullptr;  ///< The dispatch data.
+    const rta::RayHistoryTrace*                ray_history_trace = nullptr;  ///< The trace.
+};
+
+/// @brief Get the data to answer a query for a whole dispatch.
+///
+/// While the dispatch is loading, the latest snapshot is read if there is one, so the coordinates indexed so far
+/// can be shown without waiting for the rest of the dispatch. Otherwise this waits for the load to finish.
+///
+/// @param [in] dispatch_id The ID of the dispatch. Must be in range.
+///
+/// @return The data to read.
+static DispatchQueryData GetDispatchQueryData(uint32_t dispatch_id)
 {
-    auto idx = x + (y * dispatch_width) + (z * dispatch_width * dispatch_height);
-    return idx < dispatch_ray_indices.size();
+    auto& loader = data_set_.async_ray_histories[dispatch_id];
+
+    DispatchQueryData data = {};
+    if (!loader->IsDone())
+    {
+        data.snapshot = loader->GetSnapshot();
+    }
+
+    if (data.snapshot != nullptr)
+    {
+        data.dispatch_data     = &data.snapshot->dispatch_data;
+        data.ray_history_trace = data.snapshot->ray_history_trace.get();
+        return data;
+    }
+
+    data.dispatch_data     = &loader->GetDispatchData();
+    data.ray_history_trace = loader->GetRayHistoryTrace();
+    return data;
 }
 
 RraErrorCode RraRayGetDispatchCount(uint32_t* out_count)
@@ -54,7 +162,8 @@ RraErrorCode RraRayGetRayCount(uint32_t dispatch_id, GlobalInvocationID invocati
     {
         return kRraErrorIndexOutOfRange;
     }
-    auto& dispatch_data = data_set_.async_ray_histories[dispatch_id]->GetDispatchData();
+    const auto  query_data    = GetCoordinateQueryData(dispatch_id, invocation_id);
+    const auto& dispatch_data = *query_data.dispatch_data;
 
     if (!dispatch_data.CoordinateIsValid(invocation_id.x, invocation_id.y, invocation_id.z))
     {
@@ -62,9 +171,7 @@ RraErrorCode RraRayGetRayCount(uint32_t dispatch_id, GlobalInvocationID invocati
         return kRraErrorMalformedData;
     }
 
-    auto& ray_indices = dispatch_data.GetCoordinate(invocation_id.x, invocation_id.y, invocation_id.z).begin_identifiers;
-
-    *out_count = (uint32_t)ray_indices.size();
+    *out_count = dispatch_data.GetBeginIdentifiers(invocation_id.x, invocation_id.y, invocation_id.z).size();
 
     return kRraOk;
 }
@@ -75,15 +182,16 @@ RraErrorCode RraRayGetRays(uint32_t dispatch_id, GlobalInvocationID invocation_i
     {
         return kRraErrorIndexOutOfRange;
     }
-    auto  rh            = data_set_.async_ray_histories[dispatch_id]->GetRayHistoryTrace();
-    auto& dispatch_data = data_set_.async_ray_histories[dispatch_id]->GetDispatchData();
+    const auto  query_data    = GetCoordinateQueryData(dispatch_id, invocation_id);
+    auto        rh            = query_data.ray_history_trace;
+    const auto& dispatch_data = *query_data.dispatch_data;
 
     if (!dispatch_data.CoordinateIsValid(invocation_id.x, invocation_id.y, invocation_id.z))
     {
         return kRraErrorMalformedData;
     }
 
-    auto& ray_indices = dispatch_data.GetCoordinate(invocation_id.x, invocation_id.y, invocation_id.z).begin_identifiers;
+    auto ray_indices = dispatch_data.GetBeginIdentifiers(invocation_id.x, invocation_id.y, invocation_id.z);
 
     uint32_t i{0};
     for (RayDispatchBeginIdentifier begin_identifier : ray_indices)
@@ -130,78 +238,360 @@ RraErrorCode RraRayGetIntersectionResult(uint32_t dispatch_id, GlobalInvocationI
     {
         return kRraErrorIndexOutOfRange;
     }
-    auto                                           rh            = data_set_.async_ray_histories[dispatch_id]->GetRayHistoryTrace();
-    auto&                                          dispatch_data = data_set_.async_ray_histories[dispatch_id]->GetDispatchData();
-    auto&                                          ray_id = dispatch_data.GetCoordinate(invocation_id.x, invocation_id.y, invocation_id.z).begin_identifiers;
-    const std::vector<RayDispatchBeginIdentifier>& ray_indices{ray_id};
+    const auto  query_data    = GetCoordinateQueryData(dispatch_id, invocation_id);
+    const auto& dispatch_data = *query_data.dispatch_data;
+
+    if (!dispatch_data.CoordinateIsValid(invocation_id.x, invocation_id.y, invocation_id.z))
+    {
+        return kRraErrorMalformedData;
+    }
+
+    const RayDispatchRayResult* ray_result = dispatch_data.GetRayResult(invocation_id.x, invocation_id.y, invocation_id.z, ray_index);
+    if (ray_result == nullptr)
+    {
+        return kRraErrorIndexOutOfRange;
+    }
 
-    rta::RayHistory rta_ray{rh->GetRayByIndex(ray_indices[ray_index].dispatch_coord_index)};
+    *out_result = ray_result->intersection;
+
+    return kRraOk;
+}
+
+RraErrorCode RraRayGetDispatchStats(uint32_t dispatch_id, RraRayHistoryStats* out_stats)
+{
+    if (dispatch_id >= data_set_.async_ray_histories.size())
+    {
+        return kRraErrorIndexOutOfRange;
+    }
 
-    *out_result       = {};
-    out_result->hit_t = -1.0f;
+    auto& loader = data_set_.async_ray_histories[dispatch_id];
 
-    // If there are no rays just return.
-    if (rta_ray.GetTokenCount() == 0)
+    // The stats of the coordinates indexed so far, while the dispatch is loading.
+    std::shared_ptr<const RayDispatchSnapshot> snapshot = loader->IsDone() ? nullptr : loader->GetSnapshot();
+    if (snapshot != nullptr)
     {
+        *out_stats = snapshot->stats;
         return kRraOk;
     }
 
-    int end_token_index = static_cast<size_t>(rta_ray.GetTokenCount()) - 1;
+    *out_stats = loader->GetStats();
 
-    // If not the last ray
-    if (ray_index < ray_indices.size() - 1)
+    return kRraOk;
+}
+
+RraErrorCode RraRayGetDispatchCoordinateStats(uint32_t dispatch_id, GlobalInvocationID invocation_id, DispatchCoordinateStats* out_stats)
+{
+    if (dispatch_id >= data_set_.async_ray_histories.size())
     {
-        // Get the token behind the first token of the next ray.
-        end_token_index = ray_id[ray_index + 1].begin_token_index - 1;
+        return kRraErrorIndexOutOfRange;
     }
+    const auto  query_data    = GetCoordinateQueryData(dispatch_id, invocation_id);
+    const auto& dispatch_data = *query_data.dispatch_data;
+
+    if (!dispatch_data.CoordinateIsValid(invocation_id.x, invocation_id.y, invocation_id.z))
+    {
+        return kRraErrorMalformedData;
+    }
+
+    *out_stats = dispatch_data.GetStats(invocation_id.x, invocation_id.y, invocation_id.z);
+
+    return kRraOk;
+}
 
-    auto token = rta_ray.GetToken(end_token_index);
+RraErrorCode RraRayGetDispatchCoordinateStatsGrid(uint32_t dispatch_id, RraDispatchCoordinateStatsGrid* grid)
+{
+    if (dispatch_id >= data_set_.async_ray_histories.size())
+    {
+        return kRraErrorIndexOutOfRange;
+    }
+    auto&       loader        = data_set_.async_ray_histories[dispatch_id];
+    const auto  query_data    = GetDispatchQueryData(dispatch_id);
+    const auto& dispatch_data = *query_data.dispatch_data;
 
-    if (token.GetType() == rta::RayHistoryTokenType::EndV2)
+    const rta::DispatchSize dispatch_size    = loader->GetDerivedDispatchSize();
+    const size_t            coordinate_count = size_t(dispatch_size.width) * dispatch_size.height * dispatch_size.depth;
+    if (dispatch_data.coordinate_stats.size() != coordinate_count)
     {
-        auto intersection_data                 = reinterpret_cast<const rta::RayHistoryTokenEndDataV2*>(token.GetPayload());
-        out_result->hit_kind                   = intersection_data->hitKind;
-        out_result->instance_index             = intersection_data->instanceIndex;
-        out_result->geometry_index             = intersection_data->geometryIndex;
-        out_result->primitive_index            = intersection_data->primitiveIndex;
-        out_result->num_iterations             = intersection_data->numIterations;
-        out_result->num_instance_intersections = intersection_data->numInstanceIntersections;
+        return kRraErrorMalformedData;
+    }
+
+    // Each task fills in a range of coordinates and keeps its own maxima.
+    constexpr size_t kMinCoordinatesPerTask = 64 * 1024;
+
+    const size_t                                task_count = rra::GetParallelTaskCount(coordinate_count, kMinCoordinatesPerTask);
+    std::vector<RraDispatchCoordinateStatsGrid> maxima(task_count);
 
-        if (!token.IsMiss())
+    rra::RunInParallel(task_count, [&](size_t task_index) {
+        RraDispatchCoordinateStatsGrid& task_maxima = maxima[task_index];
+
+        const size_t first = coordinate_count * task_index / task_count;
+        const size_t last  = coordinate_count * (task_index + 1) / task_count;
+        for (size_t i = first; i < last; i++)
         {
-            out_result->hit_t = intersection_data->hitT;
+            const DispatchCoordinateStats& stats     = dispatch_data.coordinate_stats[i];
+            const uint32_t                 ray_count = dispatch_data.coordinate_offsets[i + 1] - dispatch_data.coordinate_offsets[i];
+
+            if (grid->ray_counts != nullptr)
+            {
+                grid->ray_counts[i] = ray_count;
+            }
+            if (grid->first_ray_offsets != nullptr)
+            {
+                grid->first_ray_offsets[i] = dispatch_data.coordinate_offsets[i];
+            }
+            if (grid->traversal_counts != nullptr)
+            {
+                grid->traversal_counts[i] = stats.loop_iteration_count;
+            }
+            if (grid->instance_intersection_counts != nullptr)
+            {
+                grid->instance_intersection_counts[i] = stats.intersection_count;
+            }
+            if (grid->any_hit_counts != nullptr)
+            {
+                grid->any_hit_counts[i] = stats.any_hit_count;
+            }
+
+            task_maxima.max_ray_count                   = std::max(task_maxima.max_ray_count, ray_count);
+            task_maxima.max_traversal_count             = std::max(task_maxima.max_traversal_count, stats.loop_iteration_count);
+            task_maxima.max_instance_intersection_count = std::max(task_maxima.max_instance_intersection_count, stats.intersection_count);
+            task_maxima.max_any_hit_count               = std::max(task_maxima.max_any_hit_count, stats.any_hit_count);
         }
+    });
+
+    grid->total_ray_count                 = dispatch_data.coordinate_offsets.back();
+    grid->max_ray_count                   = 0;
+    grid->max_traversal_count             = 0;
+    grid->max_instance_intersection_count = 0;
+    grid->max_any_hit_count               = 0;
+    for (const auto& task_maxima : maxima)
+    {
+        grid->max_ray_count                   = std::max(grid->max_ray_count, task_maxima.max_ray_count);
+        grid->max_traversal_count             = std::max(grid->max_traversal_count, task_maxima.max_traversal_count);
+        grid->max_instance_intersection_count = std::max(grid->max_instance_intersection_count, task_maxima.max_instance_intersection_count);
+        grid->max_any_hit_count               = std::max(grid->max_any_hit_count, task_maxima.max_any_hit_count);
     }
 
     return kRraOk;
 }
 
-RraErrorCode RraRayGetDispatchStats(uint32_t dispatch_id, RraRayHistoryStats* out_stats)
+/// @brief Decode the direction of every ray of a dispatch from its begin tokens.
+///
+/// @param [in]  dispatch_data     The dispatch data.
+/// @param [in]  ray_history_trace The trace the dispatch data indexes.
+/// @param [out] out_directions    The x, y and z direction of each ray.
+static void DecodeRayDirections(const RayDispatchData& dispatch_data, const rta::RayHistoryTrace& ray_history_trace, float* out_directions)
+{
+    constexpr size_t kMinRaysPerTask = 64 * 1024;
+
+    const auto&  identifiers = dispatch_data.begin_identifiers;
+    const size_t task_count  = rra::GetParallelTaskCount(identifiers.size(), kMinRaysPerTask);
+
+    rra::RunInParallel(task_count, [&](size_t task_index) {
+        const size_t first = identifiers.size() * task_index / task_count;
+        const size_t last  = identifiers.size() * (task_index + 1) / task_count;
+        for (size_t i = first; i < last; i++)
+        {
+            const RayDispatchBeginIdentifier& begin_identifier = identifiers[i];
+            rta::RayHistory                   rta_ray{ray_history_trace.GetRayByIndex(begin_identifier.dispatch_coord_index)};
+
+            float* direction = out_directions + i * 3;
+            direction[0]     = 0.0f;
+            direction[1]     = 0.0f;
+            direction[2]     = 0.0f;
+
+            if (rta_ray.GetTokenCount() > 0 && (rta_ray.GetToken(begin_identifier.begin_token_index).IsBegin()))
+            {
+                auto begin_data = reinterpret_cast<const rta::RayHistoryTokenBeginDataV2*>(rta_ray.GetToken(begin_identifier.begin_token_index).GetPayload());
+                direction[0]    = begin_data->rayDesc.direction.x;
+                direction[1]    = begin_data->rayDesc.direction.y;
+                direction[2]    = begin_data->rayDesc.direction.z;
+            }
+        }
+    });
+}
+
+RraErrorCode RraRayGetDispatchRayDirections(uint32_t dispatch_id, float* out_directions, uint32_t capacity, uint32_t* out_count)
+{
+    if (dispatch_id >= data_set_.async_ray_histories.size())
+    {
+        return kRraErrorIndexOutOfRange;
+    }
+    if (out_count == nullptr)
+    {
+        return kRraErrorInvalidPointer;
+    }
+
+    // While the dispatch is loading, decode the directions of the rays indexed so far. The ray table isn't built
+    // until the load is done.
+    auto&                                      loader   = data_set_.async_ray_histories[dispatch_id];
+    std::shared_ptr<const RayDispatchSnapshot> snapshot = loader->IsDone() ? nullptr : loader->GetSnapshot();
+    if (snapshot != nullptr)
+    {
+        const size_t ray_count = snapshot->dispatch_data.begin_identifiers.size();
+
+        *out_count = static_cast<uint32_t>(ray_count);
+        if (out_directions == nullptr)
+        {
+            return kRraOk;
+        }
+        if (capacity < ray_count)
+        {
+            return kRraErrorInvalidSize;
+        }
+
+        DecodeRayDirections(snapshot->dispatch_data, *snapshot->ray_history_trace, out_directions);
+        return kRraOk;
+    }
+
+    const RayDispatchRayTable& table     = loader->GetRayTable();
+    const size_t               ray_count = table.directions.size() / 3;
+
+    *out_count = static_cast<uint32_t>(ray_count);
+    if (out_directions == nullptr)
+    {
+        return kRraOk;
+    }
+    if (capacity < ray_count)
+    {
+        return kRraErrorInvalidSize;
+    }
+
+    if (ray_count > 0)
+    {
+        memcpy(out_directions, table.directions.data(), table.directions.size() * sizeof(float));
+    }
+
+    return kRraOk;
+}
+
+RraErrorCode RraRayGetDispatchRayColumns(uint32_t dispatch_id, RraDispatchRayColumns* out_columns)
 {
     if (dispatch_id >= data_set_.async_ray_histories.size())
     {
         return kRraErrorIndexOutOfRange;
     }
+    if (out_columns == nullptr)
+    {
+        return kRraErrorInvalidPointer;
+    }
 
-    *out_stats = data_set_.async_ray_histories[dispatch_id]->GetStats();
+    const RayDispatchRayTable& table = data_set_.async_ray_histories[dispatch_id]->GetRayTable();
+
+    out_columns->ray_count         = static_cast<uint32_t>(table.t_mins.size());
+    out_columns->origins           = table.origins.data();
+    out_columns->directions        = table.directions.data();
+    out_columns->t_mins            = table.t_mins.data();
+    out_columns->t_maxs            = table.t_maxs.data();
+    out_columns->ray_flags         = table.ray_flags.data();
+    out_columns->cull_masks        = table.cull_masks.data();
+    out_columns->tlas_addresses    = table.tlas_addresses.data();
+    out_columns->dynamic_ids       = table.dynamic_ids.data();
+    out_columns->parent_ids        = table.parent_ids.data();
+    out_columns->wave_ids          = table.wave_ids.data();
+    out_columns->iteration_counts  = table.iteration_counts.data();
+    out_columns->hit_ts            = table.hit_ts.data();
+    out_columns->hit_kinds         = table.hit_kinds.data();
+    out_columns->instance_indices  = table.instance_indices.data();
+    out_columns->geometry_indices  = table.geometry_indices.data();
+    out_columns->primitive_indices = table.primitive_indices.data();
 
     return kRraOk;
 }
 
-RraErrorCode RraRayGetDispatchCoordinateStats(uint32_t dispatch_id, GlobalInvocationID invocation_id, DispatchCoordinateStats* out_stats)
+RraErrorCode RraRayQueryDispatch(uint32_t dispatch_id, const RraRayQuery* query, RraRayQueryResult* result)
 {
     if (dispatch_id >= data_set_.async_ray_histories.size())
     {
         return kRraErrorIndexOutOfRange;
     }
-    auto& dispatch_data = data_set_.async_ray_histories[dispatch_id]->GetDispatchData();
+    if (query == nullptr || result == nullptr)
+    {
+        return kRraErrorInvalidPointer;
+    }
+
+    auto&                      loader = data_set_.async_ray_histories[dispatch_id];
+    const RayDispatchRayTable& table  = loader->GetRayTable();
+
+    return rra::EvaluateRayQuery(table, loader->GetDispatchData(), *query, *result);
+}
+
+RraErrorCode RraRayGetRayParent(uint32_t dispatch_id, GlobalInvocationID invocation_id, uint32_t ray_index, uint32_t* out_parent_index)
+{
+    if (dispatch_id >= data_set_.async_ray_histories.size())
+    {
+        return kRraErrorIndexOutOfRange;
+    }
+    const auto  query_data    = GetCoordinateQueryData(dispatch_id, invocation_id);
+    const auto& dispatch_data = *query_data.dispatch_data;
 
     if (!dispatch_data.CoordinateIsValid(invocation_id.x, invocation_id.y, invocation_id.z))
     {
         return kRraErrorMalformedData;
     }
 
-    *out_stats = dispatch_data.GetCoordinate(invocation_id.x, invocation_id.y, invocation_id.z).stats;
+    auto ray_indices = dispatch_data.GetBeginIdentifiers(invocation_id.x, invocation_id.y, invocation_id.z);
+    if (ray_index >= ray_indices.size())
+    {
+        return kRraErrorIndexOutOfRange;
+    }
+
+    const auto first_ray = dispatch_data.coordinate_offsets[dispatch_data.GetCoordinateIndex(invocation_id.x, invocation_id.y, invocation_id.z)];
+    *out_parent_index    = dispatch_data.ray_parents[first_ray + ray_index];
+
+    return kRraOk;
+}
+
+RraErrorCode RraRayGetChildRayCount(uint32_t dispatch_id, GlobalInvocationID invocation_id, uint32_t ray_index, uint32_t* out_count)
+{
+    if (dispatch_id >= data_set_.async_ray_histories.size())
+    {
+        return kRraErrorIndexOutOfRange;
+    }
+    const auto  query_data    = GetCoordinateQueryData(dispatch_id, invocation_id);
+    const auto& dispatch_data = *query_data.dispatch_data;
+
+    if (!dispatch_data.CoordinateIsValid(invocation_id.x, invocation_id.y, invocation_id.z))
+    {
+        return kRraErrorMalformedData;
+    }
+
+    auto ray_indices = dispatch_data.GetBeginIdentifiers(invocation_id.x, invocation_id.y, invocation_id.z);
+    if (ray_index >= ray_indices.size())
+    {
+        return kRraErrorIndexOutOfRange;
+    }
+
+    const auto ray = dispatch_data.coordinate_offsets[dispatch_data.GetCoordinateIndex(invocation_id.x, invocation_id.y, invocation_id.z)] + ray_index;
+    *out_count     = dispatch_data.ray_child_offsets[ray + 1] - dispatch_data.ray_child_offsets[ray];
+
+    return kRraOk;
+}
+
+RraErrorCode RraRayGetChildRays(uint32_t dispatch_id, GlobalInvocationID invocation_id, uint32_t ray_index, uint32_t* out_child_indices)
+{
+    if (dispatch_id >= data_set_.async_ray_histories.size())
+    {
+        return kRraErrorIndexOutOfRange;
+    }
+    const auto  query_data    = GetCoordinateQueryData(dispatch_id, invocation_id);
+    const auto& dispatch_data = *query_data.dispatch_data;
+
+    if (!dispatch_data.CoordinateIsValid(invocation_id.x, invocation_id.y, invocation_id.z))
+    {
+        return kRraErrorMalformedData;
+    }
+
+    auto ray_indices = dispatch_data.GetBeginIdentifiers(invocation_id.x, invocation_id.y, invocation_id.z);
+    if (ray_index >= ray_indices.size())
+    {
+        return kRraErrorIndexOutOfRange;
+    }
+
+    const auto ray = dispatch_data.coordinate_offsets[dispatch_data.GetCoordinateIndex(invocation_id.x, invocation_id.y, invocation_id.z)] + ray_index;
+    std::copy(dispatch_data.ray_children.begin() + dispatch_data.ray_child_offsets[ray],
+              dispatch_data.ray_children.begin() + dispatch_data.ray_child_offsets[ray + 1],
+              out_child_indices);
 
     return kRraOk;
 }
@@ -216,9 +606,10 @@ RraErrorCode RraRayGetAnyHitInvocationData(uint32_t           dispatch_id,
     {
         return kRraErrorIndexOutOfRange;
     }
-    auto  rh            = data_set_.async_ray_histories[dispatch_id]->GetRayHistoryTrace();
-    auto& dispatch_data = data_set_.async_ray_histories[dispatch_id]->GetDispatchData();
-    auto& ray_indices   = dispatch_data.GetCoordinate(invocation_id.x, invocation_id.y, invocation_id.z).begin_identifiers;
+    const auto  query_data    = GetCoordinateQueryData(dispatch_id, invocation_id);
+    auto        rh            = query_data.ray_history_trace;
+    const auto& dispatch_data = *query_data.dispatch_data;
+    auto        ray_indices   = dispatch_data.GetBeginIdentifiers(invocation_id.x, invocation_id.y, invocation_id.z);
 
     rta::RayHistory rta_coordinate_tokens{rh->GetRayByIndex(ray_indices[ray_index].dispatch_coord_index)};
 
@@ -256,7 +647,8 @@ RraErrorCode RraRayGetAnyHitInvocationCount(uint32_t dispatch_id, GlobalInvocati
     {
         return kRraErrorIndexOutOfRange;
     }
-    auto& dispatch_data = data_set_.async_ray_histories[dispatch_id]->GetDispatchData();
+    const auto  query_data    = GetCoordinateQueryData(dispatch_id, invocation_id);
+    const auto& dispatch_data = *query_data.dispatch_data;
 
     if (!dispatch_data.CoordinateIsValid(invocation_id.x, invocation_id.y, invocation_id.z))
     {
@@ -264,7 +656,7 @@ RraErrorCode RraRayGetAnyHitInvocationCount(uint32_t dispatch_id, GlobalInvocati
         return kRraErrorMalformedData;
     }
 
-    *out_count = dispatch_data.GetCoordinate(invocation_id.x, invocation_id.y, invocation_id.z).stats.any_hit_count;
+    *out_count = dispatch_data.GetStats(invocation_id.x, invocation_id.y, invocation_id.z).any_hit_count;
 
     return kRraOk;
 }
@@ -288,3 +680,14 @@ RraErrorCode RraRayGetDispatchStatus(uint32_t dispatch_id, RraDispatchLoadStatus
     return kRraOk;
 }
 
+RraErrorCode RraRayPrioritizeDispatch(uint32_t dispatch_id)
+{
+    if (dispatch_id >= data_set_.async_ray_histories.size())
+    {
+        return kRraErrorIndexOutOfRange;
+    }
+
+    data_set_.async_ray_histories[dispatch_id]->Prioritize();
+    return kRraOk;
+}
+
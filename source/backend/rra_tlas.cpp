@@ -82,12 +82,7 @@ static RraErrorCode RraTlasGetBoundingVolumeExtentsImpl(const rta::IEncodedRtIp1
 rta::EncodedRtIp11TopLevelBvh* RraTlasGetTlasFromTlasIndex(uint64_t tlas_index)
 {
     RRA_ASSERT(data_set_.bvh_bundle.get() != nullptr);
-    const auto& top_level_bvhs = data_set_.bvh_bundle->GetTopLevelBvhs();
-    if (tlas_index >= top_level_bvhs.size())
-    {
-        return nullptr;
-    }
-    return dynamic_cast<rta::EncodedRtIp11TopLevelBvh*>(&(*top_level_bvhs[tlas_index]));
+    return data_set_.bvh_bundle->GetEncodedTopLevelBvh(tlas_index);
 }
 
 RraErrorCode RraTlasGetBaseAddress(uint64_t tlas_index, uint64_t* out_address)
@@ -150,14 +145,7 @@ RraErrorCode RraTlasGetTotalNodeCount(uint64_t tlas_index, uint64_t* out_node_co
 RraErrorCode RraTlasGetChildNodeCount(uint64_t tlas_index, uint32_t parent_node, uint32_t* out_child_count)
 {
     RRA_ASSERT(out_child_count != nullptr);
-    RRA_ASSERT(data_set_.bvh_bundle.get() != nullptr);
-    const auto& top_level_bvhs = data_set_.bvh_bundle->GetTopLevelBvhs();
-    if (tlas_index >= top_level_bvhs.size())
-    {
-        return kRraErrorInvalidPointer;
-    }
-
-    const rta::IEncodedRtIp11Bvh* tlas = dynamic_cast<rta::IEncodedRtIp11Bvh*>(&(*top_level_bvhs[tlas_index]));
+    const rta::IEncodedRtIp11Bvh* tlas = RraTlasGetTlasFromTlasIndex(tlas_index);
     if (tlas == nullptr)
     {
         return kRraErrorInvalidPointer;
@@ -167,14 +155,7 @@ RraErrorCode RraTlasGetChildNodeCount(uint64_t tlas_index, uint32_t parent_node,
 
 RraErrorCode RraTlasGetChildNodes(uint64_t tlas_index, uint32_t parent_node, uint32_t* out_child_nodes)
 {
-    RRA_ASSERT(data_set_.bvh_bundle.get() != nullptr);
-    const auto& top_level_bvhs = data_set_.bvh_bundle->GetTopLevelBvhs();
-    if (tlas_index >= top_level_bvhs.size())
-    {
-        return kRraErrorInvalidPointer;
-    }
-
-    const rta::IEncodedRtIp11Bvh* tlas = dynamic_cast<rta::IEncodedRtIp11Bvh*>(&(*top_level_bvhs[tlas_index]));
+    const rta::IEncodedRtIp11Bvh* tlas = RraTlasGetTlasFromTlasIndex(tlas_index);
     if (tlas == nullptr)
     {
         return kRraErrorInvalidPointer;
@@ -243,13 +224,7 @@ RraErrorCode RraTlasGetInstanceNodeInfo(uint64_t tlas_index, uint32_t node_ptr,
     const auto& desc       = instance_node->GetDesc();
     uint64_t    blas_index = desc.GetBottomLevelBvhGpuVa(dxr::InstanceDescType::kRaw) >> 3;
 
-    const auto& bottom_level_bvhs = data_set_.bvh_bundle->GetBottomLevelBvhs();
-    if (tlas_index >= bottom_level_bvhs.size())
-    {
-        return kRraErrorInvalidPointer;
-    }
-
-    const rta::IEncodedRtIp11Bvh* instance_blas = dynamic_cast<rta::IEncodedRtIp11Bvh*>(&(*bottom_level_bvhs[blas_index]));
+    const rta::IEncodedRtIp11Bvh* instance_blas = data_set_.bvh_bundle->GetEncodedBottomLevelBvh(blas_index);
     if (instance_blas == nullptr)
     {
         return kRraErrorIndexOutOfRange;
@@ -426,6 +401,20 @@ RraErrorCode RraTlasGetBlasIndexFromInstanceNode(uint64_t tlas_index, uint32_t n
 RraErrorCode RraTlasGetBlasFromInstanceNode(const rta::EncodedRtIp11TopLevelBvh*     tlas,
                                             const dxr::amd::NodePointer*             node_ptr,
                                             const rta::EncodedRtIp11BottomLevelBvh** out_blas)
+{
+    RRA_ASSERT(data_set_.bvh_bundle.get() != nullptr);
+    if (data_set_.bvh_bundle.get() == nullptr)
+    {
+        return kRraErrorInvalidPointer;
+    }
+
+    return RraTlasGetBlasFromInstanceNode(*data_set_.bvh_bundle, tlas, node_ptr, out_blas);
+}
+
+RraErrorCode RraTlasGetBlasFromInstanceNode(const rta::BvhBundle&                    bundle,
+                                            const rta::EncodedRtIp11TopLevelBvh*     tlas,
+                                            const dxr::amd::NodePointer*             node_ptr,
+                                            const rta::EncodedRtIp11BottomLevelBvh** out_blas)
 {
     uint64_t     blas_index = 0;
     RraErrorCode error_code = GetBlasIndexFromInstanceNodeImpl(tlas, node_ptr, &blas_index);
@@ -434,14 +423,7 @@ RraErrorCode RraTlasGetBlasFromInstanceNode(const rta::EncodedRtIp11TopLevelBvh*
         return error_code;
     }
 
-    RRA_ASSERT(data_set_.bvh_bundle.get() != nullptr);
-    const auto& bottom_level_bvhs = data_set_.bvh_bundle->GetBottomLevelBvhs();
-    if (blas_index >= bottom_level_bvhs.size())
-    {
-        return kRraErrorInvalidPointer;
-    }
-
-    const rta::EncodedRtIp11BottomLevelBvh* blas = dynamic_cast<rta::EncodedRtIp11BottomLevelBvh*>(&(*bottom_level_bvhs[blas_index]));
+    const rta::EncodedRtIp11BottomLevelBvh* blas = bundle.GetEncodedBottomLevelBvh(blas_index);
     if (blas != nullptr)
     {
         *out_blas = blas;
@@ -12,6 +12,7 @@
 
 #include "bvh/rtip11/encoded_rt_ip_11_top_level_bvh.h"
 #include "bvh/rtip11/encoded_rt_ip_11_bottom_level_bvh.h"
+#include "bvh/bvh_bundle.h"
 #include "public/rra_tlas.h"
 
 /// @brief Get a pointer to the TLAS from the tlas index passed in.
@@ -41,6 +42,22 @@ RraErrorCode RraTlasGetBlasFromInstanceNode(const rta::EncodedRtIp11TopLevelBvh*
                                             const dxr::amd::NodePointer*             node_ptr,
                                             const rta::EncodedRtIp11BottomLevelBvh** out_blas);
 
+/// @brief Get the BLAS associated with a given instance node, from a given bundle.
+///
+/// Unlike the overload above this doesn't go through the loaded data set, so it can be used on a bundle that
+/// is still being loaded, or one that is being torn down.
+///
+/// @param [in]  bundle           The BVH bundle containing the TLAS.
+/// @param [in]  tlas             The top level acceleration structure containing the node.
+/// @param [in]  node_ptr         The instance node of interest.
+/// @param [out] out_blas         The BLAS associated with the instance node.
+///
+/// @return kRraOk if successful or an RraErrorCode if an error occurred.
+RraErrorCode RraTlasGetBlasFromInstanceNode(const rta::BvhBundle&                    bundle,
+                                            const rta::EncodedRtIp11TopLevelBvh*     tlas,
+                                            const dxr::amd::NodePointer*             node_ptr,
+                                            const rta::EncodedRtIp11BottomLevelBvh** out_blas);
+
 /// @brief Get the transformed surface area for an instance node.
 ///
 /// Calculate the surface area for an instance node by taking the BLAS and applying
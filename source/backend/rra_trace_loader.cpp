@@ -9,14 +9,53 @@
 
 #include <string.h>
 
+#include <algorithm>
+#include <chrono>
+
 #include "rra_data_set.h"
 
 /// The one and only instance of the data set, which is initialized when loading in
 /// a trace file.
 RraDataSet data_set_ = {};
 
+/// Should the BLAS node data be decoded lazily.
+static bool deferred_blas_decode_ = false;
+
+/// Should the box nodes be decoded into a cache after loading.
+static bool decoded_node_cache_ = false;
+
+/// Should the derived data cache be used.
+static bool derived_data_cache_ = false;
+
+/// The number of ray history load workers. 0 uses the hardware thread count.
+static uint32_t ray_history_worker_count_ = 0;
+
+/// The memory budget for ray history loading, in bytes. 0 means no limit.
+static uint64_t ray_history_memory_budget_ = 0;
+
+/// How the parsed ray history is stored.
+static RayHistoryStorageOptions ray_history_storage_ = {};
+
+/// The background tasks freeing the data of unloaded traces. Joined by RraTraceLoaderShutdown().
+static std::vector<std::future<void>> retired_data_sets_;
+
 RraErrorCode RraTraceLoaderLoad(const char* trace_file_name)
 {
+    std::uint8_t read_option = static_cast<std::uint8_t>(rta::BvhBundleReadOption::kDefault);
+    if (deferred_blas_decode_)
+    {
+        read_option |= static_cast<std::uint8_t>(rta::BvhBundleReadOption::kDeferBlasNodeData);
+    }
+    if (decoded_node_cache_)
+    {
+        read_option |= static_cast<std::uint8_t>(rta::BvhBundleReadOption::kDecodedNodeCache);
+    }
+    data_set_.bvh_read_option = static_cast<rta::BvhBundleReadOption>(read_option);
+    data_set_.use_derived_data_cache    = derived_data_cache_;
+    data_set_.ray_history_worker_count  = ray_history_worker_count_;
+    data_set_.ray_history_memory_budget = ray_history_memory_budget_;
+    data_set_.ray_history_storage       = ray_history_storage_;
+
     RraErrorCode error_code = RraDataSetInitialize(trace_file_name, &data_set_);
 
     if (error_code != kRraOk)
@@ -26,15 +65,72 @@ RraErrorCode RraTraceLoaderLoad(const char* trace_file_name)
     return error_code;
 }
 
+void RraTraceLoaderSetDeferredBlasDecode(bool enabled)
+{
+    deferred_blas_decode_ = enabled;
+}
+
+void RraTraceLoaderSetDecodedNodeCache(bool enabled)
+{
+    decoded_node_cache_ = enabled;
+}
+
+void RraTraceLoaderSetDerivedDataCache(bool enabled)
+{
+    derived_data_cache_ = enabled;
+}
+
+void RraTraceLoaderSetRayHistoryLoadLimits(uint32_t worker_count, uint64_t memory_budget)
+{
+    ray_history_worker_count_  = worker_count;
+    ray_history_memory_budget_ = memory_budget;
+}
+
+void RraTraceLoaderSetRayHistoryCompression(bool enabled)
+{
+    ray_history_storage_.compress_tokens = enabled;
+}
+
+void RraTraceLoaderSetRayHistorySpillBudget(uint64_t spill_budget)
+{
+    ray_history_storage_.spill_budget = spill_budget;
+}
+
 void RraTraceLoaderUnload()
 {
+    // Join the tasks of earlier unloads that have already finished.
+    retired_data_sets_.erase(std::remove_if(retired_data_sets_.begin(),
+                                            retired_data_sets_.end(),
+                                            [](std::future<void>& task) {
+                                                if (task.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                                                {
+                                                    return false;
+                                                }
+                                                task.get();
+                                                return true;
+                                            }),
+                             retired_data_sets_.end());
+
     if (RraTraceLoaderValid())
     {
-        RraDataSetDestroy(&data_set_);
+        std::future<void> teardown;
+        RraDataSetDestroy(&data_set_, teardown);
+        retired_data_sets_.push_back(std::move(teardown));
     }
     data_set_ = {};
 }
 
+void RraTraceLoaderShutdown()
+{
+    RraTraceLoaderUnload();
+
+    for (auto& task : retired_data_sets_)
+    {
+        task.get();
+    }
+    retired_data_sets_.clear();
+}
+
 bool RraTraceLoaderValid()
 {
     return data_set_.file_loaded;
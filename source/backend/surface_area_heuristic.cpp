@@ -9,6 +9,9 @@
 
 #include <float.h>
 #include <math.h>
+#include <string.h>
+
+#include <atomic>
 
 #include "bvh/rtip11/iencoded_rt_ip_11_bvh.h"
 #include "bvh/rtip11/encoded_rt_ip_11_bottom_level_bvh.h"
@@ -16,6 +19,7 @@
 #include "bvh/dxr_definitions.h"
 #include "public/rra_assert.h"
 #include "public/rra_error.h"
+#include "parallel_util.h"
 #include "rra_bvh_impl.h"
 #include "rra_blas_impl.h"
 #include "rra_data_set.h"
@@ -147,77 +151,260 @@ namespace rra
         }
     }
 
-    /// @brief Recursive function to calculate the surface area heuristic for a given BLAS.
+    /// @brief A node visited by the BLAS surface area heuristic pass.
+    struct BlasSAHNode
+    {
+        dxr::amd::NodePointer node;                     ///< The node.
+        uint32_t              first_child      = 0;     ///< The index of the first of the 4 child entries, for box nodes.
+        float                 surface_area     = 0.0f;  ///< The surface area of the node, or 0 if it couldn't be found.
+        float                 total_child_area = 0.0f;  ///< The summed surface area of the children, for box nodes.
+        float                 sah              = 0.0f;  ///< The summed surface area heuristic of the sub tree.
+    };
+
+    /// @brief Get the surface area of a bounding box.
     ///
-    /// The BLAS will be traversed starting at the provided node given and the surface area heuristic will be
-    /// calculated for each child node.
+    /// Matches RraBvhGetBoundingVolumeSurfaceArea() for a node whose bounding box is stored in its parent.
+    ///
+    /// @param [in]  bounding_box     The bounding box.
+    /// @param [out] out_surface_area The surface area.
+    ///
+    /// @return kRraOk if successful, an error code if not.
+    static RraErrorCode GetBoundingBoxSurfaceArea(const dxr::amd::AxisAlignedBoundingBox& bounding_box, float* out_surface_area)
+    {
+        BoundingVolumeExtents bounding_volume_extents;
+
+        bounding_volume_extents.min_x = bounding_box.min.x;
+        bounding_volume_extents.min_y = bounding_box.min.y;
+        bounding_volume_extents.min_z = bounding_box.min.z;
+        bounding_volume_extents.max_x = bounding_box.max.x;
+        bounding_volume_extents.max_y = bounding_box.max.y;
+        bounding_volume_extents.max_z = bounding_box.max.z;
+
+        return RraBvhGetBoundingVolumeSurfaceArea(&bounding_volume_extents, out_surface_area);
+    }
+
+    /// @brief Calculate the surface area heuristic for a given BLAS.
+    ///
+    /// The nodes are listed breadth first from the root, with the 4 children of each box node stored next to each
+    /// other, then the list is swept in reverse so every node is done before its parent. Each box node is decoded
+    /// once, and the surface areas of all 4 children are taken from its bounding boxes, so the only other lookups
+    /// are the root's bounding box and the triangle areas. The values are summed in the same order as a depth first
+    /// traversal would, so deep BVHs don't need a deep native stack.
+    ///
+    /// The list is built from the root rather than by sweeping the interior node buffer with the parent block,
+    /// since the buffer order of the nodes isn't guaranteed to put every child after its parent, and a node that
+    /// isn't reachable from the root must not be counted.
     ///
     /// @param [in] blas      The bottom level acceleration structure to use.
     /// @param [in] root_node The root node of the BLAS to start from.
     ///
     /// @return The surface area heuristic for the node passed in.
     static float CalculateSAHForBlasNode(rta::EncodedRtIp11BottomLevelBvh* blas, const dxr::amd::NodePointer root_node)
+    {
+        const auto& interior_nodes = blas->GetInteriorNodesData();
+
+        if (!root_node.IsBoxNode())
+        {
+            return root_node.IsTriangleNode() ? blas->GetLeafNodeSurfaceAreaHeuristic(root_node) : 0.0f;
+        }
+
+        if (interior_nodes.size() == 0)
+        {
+            return 1.0f;
+        }
+
+        const auto interior_nodes_offset = blas->GetHeader().GetBufferOffsets().interior_nodes;
+
+        std::vector<BlasSAHNode> nodes;
+        nodes.reserve(interior_nodes.size() / sizeof(dxr::amd::Float32BoxNode) * 4 + 1);
+        nodes.push_back({root_node});
+
+        float root_surface_area = 0.0f;
+        if (RraBlasGetSurfaceAreaImpl(blas, &root_node, &root_surface_area) == kRraOk)
+        {
+            nodes[0].surface_area = root_surface_area;
+        }
+
+        // Build the list and find the surface areas top down.
+        for (size_t node_index = 0; node_index < nodes.size(); node_index++)
+        {
+            const dxr::amd::NodePointer box_node = nodes[node_index].node;
+            if (!box_node.IsBoxNode())
+            {
+                continue;
+            }
+
+            const auto  node_offset = box_node.GetByteOffset() - interior_nodes_offset;
+            const auto& child_array = GetChildNodeArray(box_node, interior_nodes, node_offset);
+
+            std::array<dxr::amd::AxisAlignedBoundingBox, 4> bbox_array;
+            if (box_node.IsFp16BoxNode())
+            {
+                bbox_array = reinterpret_cast<const dxr::amd::Float16BoxNode*>(&interior_nodes[node_offset])->GetBoundingBoxes();
+            }
+            else
+            {
+                bbox_array = reinterpret_cast<const dxr::amd::Float32BoxNode*>(&interior_nodes[node_offset])->GetBoundingBoxes();
+            }
+
+            nodes[node_index].first_child = static_cast<uint32_t>(nodes.size());
+
+            // Nodes that are neither triangles nor boxes don't update the area, so they add the last area found again.
+            float total_child_area = 0.0f;
+            float out_surface_area = 0.0f;
+            for (auto child_index = 0; child_index < 4; child_index++)
+            {
+                const auto  child_node    = child_array[child_index];
+                BlasSAHNode child         = {child_node};
+                bool        area_is_valid = true;
+
+                if (child_node.IsBoxNode())
+                {
+                    // The bounding box of a node is stored in its parent, in the first slot pointing at it. In a
+                    // well formed BVH that is this node, as recorded in the parent block.
+#ifdef _DEBUG
+                    RRA_ASSERT(blas->GetParentNode(&child_node).GetRawPointer() == box_node.GetRawPointer());
+#endif  // _DEBUG
+
+                    auto slot = 0;
+                    while (child_array[slot].GetRawPointer() != child_node.GetRawPointer())
+                    {
+                        slot++;
+                    }
+
+                    float child_area = 0.0f;
+                    area_is_valid    = GetBoundingBoxSurfaceArea(bbox_array[slot], &child_area) == kRraOk;
+
+                    if (area_is_valid)
+                    {
+                        out_surface_area   = child_area;
+                        child.surface_area = child_area;
+                    }
+                }
+                else if (child_node.IsTriangleNode())
+                {
+                    RraBlasGetSurfaceAreaImpl(blas, &child_node, &out_surface_area);
+                    child.sah = blas->GetLeafNodeSurfaceAreaHeuristic(child_node);
+                }
+
+                if (area_is_valid)
+                {
+                    total_child_area += out_surface_area;
+                }
+
+                nodes.push_back(child);
+            }
+
+            nodes[node_index].total_child_area = total_child_area;
+        }
+
+        // Sum the sub trees bottom up.
+        for (size_t node_index = nodes.size(); node_index-- > 0;)
+        {
+            BlasSAHNode& box = nodes[node_index];
+            if (!box.node.IsBoxNode())
+            {
+                continue;
+            }
+
+            float sub_tree_sah = 0.0f;
+            for (auto child_index = 0; child_index < 4; child_index++)
+            {
+                sub_tree_sah += nodes[box.first_child + child_index].sah;
+            }
+
+            // Take that as ratio of the current node.
+            float sah = 0.0f;
+            if (box.surface_area != 0.0)
+            {
+                sah = box.total_child_area / box.surface_area / 4.0f;
+            }
+
+            blas->SetInteriorNodeSurfaceAreaHeuristic(box.node, sah);
+            box.sah = sah + sub_tree_sah;
+        }
+
+        return nodes[0].sah;
+    }
+
+#ifdef _DEBUG
+    /// @brief Check that two floats are the same value, bit for bit, so a NaN matches a NaN.
+    ///
+    /// @param [in] a The first value.
+    /// @param [in] b The second value.
+    ///
+    /// @return true if the values have the same bits, false if not.
+    static bool IsSameFloat(float a, float b)
+    {
+        return memcmp(&a, &b, sizeof(float)) == 0;
+    }
+
+    /// @brief Recursively calculate the surface area heuristic of a BLAS the way it was done before the calculation
+    /// was made iterative, and check the value stored for each box node against it.
+    ///
+    /// @param [in] blas      The bottom level acceleration structure to use.
+    /// @param [in] root_node The root node of the BLAS to start from.
+    ///
+    /// @return The surface area heuristic for the node passed in.
+    static float DebugCheckSAHForBlasNode(const rta::EncodedRtIp11BottomLevelBvh* blas, const dxr::amd::NodePointer root_node)
     {
         float sah          = 0.0f;
         float sub_tree_sah = 0.0f;
 
         if (root_node.IsBoxNode())
         {
-            float total_child_area = 0.0f;
-
             const auto  node_offset    = root_node.GetByteOffset() - blas->GetHeader().GetBufferOffsets().interior_nodes;
             const auto& interior_nodes = blas->GetInteriorNodesData();
-
             if (interior_nodes.size() == 0)
             {
                 return 1.0f;
             }
-            const auto& child_array      = GetChildNodeArray(root_node, interior_nodes, node_offset);
+
+            float       total_child_area = 0.0f;
             float       out_surface_area = 0.0f;
+            const auto& child_array      = GetChildNodeArray(root_node, interior_nodes, node_offset);
             for (auto child_index = 0; child_index < 4; child_index++)
             {
-                // find SAH for child nodes.
                 const auto child_node = child_array[child_index];
-                sub_tree_sah += CalculateSAHForBlasNode(blas, child_node);
+                sub_tree_sah += DebugCheckSAHForBlasNode(blas, child_node);
                 if (RraBlasGetSurfaceAreaImpl(blas, &child_node, &out_surface_area) == kRraOk)
                 {
-                    total_child_area += static_cast<float>(out_surface_area);
+                    total_child_area += out_surface_area;
                 }
             }
 
-            // Take that as ratio of the current node.
-            out_surface_area = 0.0;
+            out_surface_area = 0.0f;
             if (RraBlasGetSurfaceAreaImpl(blas, &root_node, &out_surface_area) == kRraOk)
             {
-                sah = total_child_area / (static_cast<float>(out_surface_area)) / 4.0f;
+                sah = total_child_area / out_surface_area / 4.0f;
             }
-
-            if (out_surface_area == 0.0)
+            if (out_surface_area == 0.0f)
             {
                 sah = 0.0f;
             }
 
-            blas->SetInteriorNodeSurfaceAreaHeuristic(root_node, sah);
+            RRA_ASSERT(IsSameFloat(blas->GetInteriorNodeSurfaceAreaHeuristic(root_node), sah));
         }
         else if (root_node.IsTriangleNode())
         {
-            // Get SAH from BLAS since it's already been computed for triangle nodes.
             sah = blas->GetLeafNodeSurfaceAreaHeuristic(root_node);
         }
 
         return sah + sub_tree_sah;
     }
+#endif  // _DEBUG
 
     /// @brief Recursive function to calculate the surface area heuristic for a given TLAS.
     ///
     /// The TLAS will be traversed starting at the provided node given and the surface area heuristic will be
     /// calculated for each child node.
     ///
+    /// @param [in] bundle    The BVH bundle containing the TLAS, used to find the BLAS of each instance node.
     /// @param [in] tlas      The top level acceleration structure to use.
     /// @param [in] root_node The root node of the BLAS to start from.
     ///
     /// @return The surface area heuristic for the node passed in.
-    static float CalculateSAHForTlasNode(rta::EncodedRtIp11TopLevelBvh* tlas, const dxr::amd::NodePointer root_node)
+    static float CalculateSAHForTlasNode(const rta::BvhBundle& bundle, rta::EncodedRtIp11TopLevelBvh* tlas, const dxr::amd::NodePointer root_node)
     {
         float sah          = 0.0f;
         float sub_tree_sah = 0.0f;
@@ -240,7 +427,7 @@ namespace rra
             {
                 // Find SAH for child nodes.
                 const auto child_node = child_array[child_index];
-                sub_tree_sah += CalculateSAHForTlasNode(tlas, child_node);
+                sub_tree_sah += CalculateSAHForTlasNode(bundle, tlas, child_node);
                 if (RraTlasGetSurfaceAreaImpl(tlas, &child_node, &out_surface_area) == kRraOk)
                 {
                     total_child_area += static_cast<float>(out_surface_area);
@@ -267,7 +454,7 @@ namespace rra
         {
             // Get SAH from BLAS since it's already been computed for triangle nodes.
             const rta::EncodedRtIp11BottomLevelBvh* blas = nullptr;
-            if (RraTlasGetBlasFromInstanceNode(tlas, &root_node, &blas) == kRraOk)
+            if (RraTlasGetBlasFromInstanceNode(bundle, tlas, &root_node, &blas) == kRraOk)
             {
                 sub_tree_sah     = blas->GetSurfaceAreaHeuristic();
                 float child_area = 0.0f;
@@ -310,13 +497,109 @@ namespace rra
         return sah + sub_tree_sah;
     }
 
+    /// @brief Add a surface area heuristic value to a summary.
+    ///
+    /// @param [in, out] aggregate The summary.
+    /// @param [in]      sah       The surface area heuristic value.
+    static void AddSAH(rta::SurfaceAreaHeuristicAggregate& aggregate, float sah)
+    {
+        aggregate.min_sah = std::min(aggregate.min_sah, sah);
+        aggregate.total_sah += sah;
+        aggregate.node_count++;
+    }
+
+    /// @brief Add the values of one surface area heuristic summary to another.
+    ///
+    /// @param [in, out] aggregate The summary to add to.
+    /// @param [in]      other     The summary to add.
+    static void AddSAH(rta::SurfaceAreaHeuristicAggregate& aggregate, const rta::SurfaceAreaHeuristicAggregate& other)
+    {
+        aggregate.min_sah = std::min(aggregate.min_sah, other.min_sah);
+        aggregate.total_sah += other.total_sah;
+        aggregate.node_count += other.node_count;
+    }
+
+    /// @brief Summarize the surface area heuristic values of the sub tree below each box node.
+    ///
+    /// The SAH values of the BVH must already be set. Each summary holds the same nodes that walking the sub tree
+    /// would find, so the minimum and average queries can read it rather than walk the tree on every call. The
+    /// minimum and node count match the walk exactly. The total is summed per sub tree rather than in walk order,
+    /// so, being a float sum, it can differ from the walk's total in the last bits.
+    ///
+    /// @param [in] bvh The acceleration structure to use.
+    static void CalcSubTreeSAH(rta::IEncodedRtIp11Bvh* bvh)
+    {
+        const auto& interior_nodes = bvh->GetInteriorNodesData();
+        if (bvh->IsEmpty() || interior_nodes.size() == 0)
+        {
+            return;
+        }
+
+        // List the box nodes breadth first, so sweeping the list in reverse does every box node before its parent.
+        const auto                         interior_nodes_offset = bvh->GetHeader().GetBufferOffsets().interior_nodes;
+        std::vector<dxr::amd::NodePointer> box_nodes             = {
+            dxr::amd::NodePointer(dxr::amd::NodeType::kAmdNodeBoxFp32, dxr::amd::kAccelerationStructureHeaderSize)};
+
+        for (size_t node_index = 0; node_index < box_nodes.size(); node_index++)
+        {
+            const auto& child_array = GetChildNodeArray(box_nodes[node_index], interior_nodes, box_nodes[node_index].GetByteOffset() - interior_nodes_offset);
+            for (const auto& child_node : child_array)
+            {
+                if (child_node.IsBoxNode())
+                {
+                    box_nodes.push_back(child_node);
+                }
+            }
+        }
+
+        for (size_t node_index = box_nodes.size(); node_index-- > 0;)
+        {
+            const dxr::amd::NodePointer      box_node = box_nodes[node_index];
+            rta::SubTreeSurfaceAreaHeuristic sub_tree = {};
+            float                            sah      = 0.0f;
+
+            // The node pointers come from the tree itself, so the lookup only fails for a BVH whose node data failed
+            // to decode, which has no box nodes to get here.
+            if (RraBvhGetSurfaceAreaHeuristic(bvh, box_node, &sah) == kRraOk)
+            {
+                AddSAH(sub_tree.all_nodes, sah);
+            }
+
+            const auto& child_array = GetChildNodeArray(box_node, interior_nodes, box_node.GetByteOffset() - interior_nodes_offset);
+            for (const auto& child_node : child_array)
+            {
+                if (child_node.IsBoxNode())
+                {
+                    const auto& child_sub_tree = bvh->GetInteriorNodeSubTreeSurfaceAreaHeuristic(child_node);
+                    AddSAH(sub_tree.all_nodes, child_sub_tree.all_nodes);
+                    AddSAH(sub_tree.triangle_nodes, child_sub_tree.triangle_nodes);
+                }
+                else if (RraBvhGetSurfaceAreaHeuristic(bvh, child_node, &sah) == kRraOk)
+                {
+                    AddSAH(sub_tree.all_nodes, sah);
+                    if (child_node.IsTriangleNode())
+                    {
+                        AddSAH(sub_tree.triangle_nodes, sah);
+                    }
+                }
+            }
+
+            bvh->SetInteriorNodeSubTreeSurfaceAreaHeuristic(box_node, sub_tree);
+        }
+
+        bvh->SetSubTreeSurfaceAreaHeuristicComplete();
+    }
+
     /// @brief Get all the triangle NodePointers from the BLAS
     ///
-    /// @param [in] blas_index Index of BLAS to get the triangle NodePointers from.
+    /// The BLAS is used directly rather than looked up by index, since this runs on the deferred BLAS decode
+    /// thread, where the bundle may no longer be the one in the loaded data set.
+    ///
+    /// @param [in] blas The BLAS to get the triangle NodePointers from.
     /// @param [out] triangle_nodes The triangle nodes are written into this vector.
     ///
     /// @returns The error code.
-    RraErrorCode GetBlasTriangleNodes(uint64_t blas_index, std::vector<dxr::amd::NodePointer>& triangle_nodes)
+    static RraErrorCode GetBlasTriangleNodes(const rta::EncodedRtIp11BottomLevelBvh* blas, std::vector<dxr::amd::NodePointer>& triangle_nodes)
     {
         uint32_t root_node = UINT32_MAX;
         RRA_BUBBLE_ON_ERROR(RraBvhGetRootNodePtr(&root_node));
@@ -336,13 +619,13 @@ namespace rra
                 uint32_t current_node = traverse_nodes[i];
 
                 // Add the triangles to the list.
-                RRA_BUBBLE_ON_ERROR(RraBlasGetChildNodeCount(blas_index, current_node, &child_node_count));
+                RRA_BUBBLE_ON_ERROR(RraBvhGetChildNodeCount(blas, current_node, &child_node_count));
                 std::vector<uint32_t> child_nodes(child_node_count);
-                RRA_BUBBLE_ON_ERROR(RraBlasGetChildNodes(blas_index, current_node, child_nodes.data()));
+                RRA_BUBBLE_ON_ERROR(RraBvhGetChildNodes(blas, current_node, child_nodes.data()));
                 swap_nodes.insert(swap_nodes.end(), child_nodes.begin(), child_nodes.end());
 
                 // Get the triangle nodes. If this is not a triangle the triangle count is 0.
-                RRA_BUBBLE_ON_ERROR(RraBlasGetNodeTriangleCount(blas_index, current_node, &triangle_count));
+                triangle_count = RraBlasGetNodeTriangleCountImpl(blas, dxr::amd::NodePointer(current_node));
 
                 // Continue with processing the node if it's a triangle node with 1 or more triangles within.
                 if (triangle_count > 0)
@@ -381,7 +664,7 @@ namespace rra
         const auto& header_offsets = blas->GetHeader().GetBufferOffsets();
 
         std::vector<dxr::amd::NodePointer> tri_node_pointers;
-        RRA_BUBBLE_ON_ERROR(GetBlasTriangleNodes(blas->GetID(), tri_node_pointers));
+        RRA_BUBBLE_ON_ERROR(GetBlasTriangleNodes(blas, tri_node_pointers));
 
         for (const auto& node_ptr : tri_node_pointers)
         {
@@ -393,17 +676,7 @@ namespace rra
 
             const uint32_t node_index = (node_ptr.GetByteOffset() - header_offsets.leaf_nodes) / sizeof(dxr::amd::TriangleNode);
 
-            uint32_t tri_count{};
-            RraBlasGetNodeTriangleCount(blas->GetID(), node_ptr.GetID(), &tri_count);
-
-            if (node_ptr.GetType() == dxr::amd::NodeType::kAmdNodeTriangle0)
-            {
-                tri_count = 1;
-            }
-            else if (node_ptr.GetType() == dxr::amd::NodeType::kAmdNodeTriangle1)
-            {
-                tri_count = 2;
-            }
+            const uint32_t tri_count = RraBlasGetNodeTriangleCountImpl(blas, node_ptr);
 
             float aabb_surface_area         = CalculateTriangleAABBSurfaceArea(triangle_nodes[node_index], tri_count);
             float triangle_surface_area     = RraBlasGetTriangleSurfaceArea(triangle_nodes[node_index], tri_count);
@@ -446,21 +719,34 @@ namespace rra
         dxr::amd::NodePointer root_node = dxr::amd::NodePointer(dxr::amd::NodeType::kAmdNodeBoxFp32, dxr::amd::kAccelerationStructureHeaderSize);
         float                 sah       = CalculateSAHForBlasNode(blas, root_node);
 
+#ifdef _DEBUG
+        // Check the values against the recursive calculation they replaced. This runs on the worker thread that
+        // calculated them, so it covers the parallel pass too.
+        RRA_ASSERT(IsSameFloat(DebugCheckSAHForBlasNode(blas, root_node), sah));
+#endif  // _DEBUG
+
         blas->SetSurfaceAreaHeuristic(sah);
+        CalcSubTreeSAH(blas);
 
         return kRraOk;
     }
 
     /// @brief Calculate the surface area heuristic for a given TLAS.
     ///
-    /// @param [in] tlas The top level acceleration structure.
-    static void CalcTlasSAH(rta::EncodedRtIp11TopLevelBvh* tlas)
+    /// @param [in] bundle The BVH bundle containing the TLAS.
+    /// @param [in] tlas   The top level acceleration structure.
+    static void CalcTlasSAH(const rta::BvhBundle& bundle, rta::EncodedRtIp11TopLevelBvh* tlas)
     {
         // Iterate over the box nodes and calculate their SAH values.
         // Top level node doesn't exist in the data so needs to be created. Assumed to be a Box32.
         dxr::amd::NodePointer root_node = dxr::amd::NodePointer(dxr::amd::NodeType::kAmdNodeBoxFp32, dxr::amd::kAccelerationStructureHeaderSize);
-        float                 sah       = CalculateSAHForTlasNode(tlas, root_node);
+        float                 sah       = CalculateSAHForTlasNode(bundle, tlas, root_node);
         RRA_UNUSED(sah);
+
+        // Publish the values before the sub tree summaries read them back.
+        tlas->SetSurfaceAreaHeuristicComplete(true);
+
+        CalcSubTreeSAH(tlas);
     }
 
     /// @brief Recursive function to calculate the maximum surface area heuristic value for a given acceleration structure.
@@ -544,42 +830,130 @@ namespace rra
         }
     }
 
+    /// @brief Calculate the surface area heuristic of a list of acceleration structures across worker threads.
+    ///
+    /// The acceleration structures vary a lot in size, so each worker takes the next one from the list as soon as it
+    /// is done with its last, rather than the list being split evenly up front. The values of each acceleration
+    /// structure are calculated the same way as on a single thread, so the results are identical.
+    ///
+    /// @param [in] bvhs The acceleration structures.
+    /// @param [in] calc The function to calculate the SAH of one acceleration structure.
+    template <typename Bvh, typename Calc>
+    static void CalcSAHInParallel(const std::vector<Bvh*>& bvhs, Calc calc)
+    {
+        constexpr size_t kMinBvhsPerTask = 16;
+
+        std::atomic<size_t> next_bvh{0};
+        RunInParallel(GetParallelTaskCount(bvhs.size(), kMinBvhsPerTask), [&](size_t) {
+            for (size_t bvh_index = next_bvh++; bvh_index < bvhs.size(); bvh_index = next_bvh++)
+            {
+                calc(bvhs[bvh_index]);
+            }
+        });
+    }
+
+    /// @brief Calculate the surface area heuristic for each TLAS.
+    ///
+    /// The leaf nodes here will be an instance node/BLAS, so the BLAS SAH values must already be known.
+    ///
+    /// @param [in] bundle The BVH bundle containing the TLASes.
+    ///
+    /// @returns Error code.
+    static RraErrorCode CalcAllTlasSAH(const rta::BvhBundle& bundle)
+    {
+        // The TLASes restored from the derived data cache already have their values.
+        std::vector<rta::EncodedRtIp11TopLevelBvh*> tlases;
+        for (auto* tlas : bundle.GetEncodedTopLevelBvhs())
+        {
+            if (tlas == nullptr)
+            {
+                return kRraErrorInvalidPointer;
+            }
+            if (!tlas->HasRestoredDerivedData())
+            {
+                tlases.push_back(tlas);
+            }
+        }
+
+        // Each TLAS only writes its own SAH values, and only reads the BLAS values, so the TLASes can be done in any order.
+        CalcSAHInParallel(tlases, [&bundle](rta::EncodedRtIp11TopLevelBvh* tlas) { CalcTlasSAH(bundle, tlas); });
+
+        return kRraOk;
+    }
+
     RraErrorCode CalculateSurfaceAreaHeuristics(RraDataSet& data_set)
     {
-        // Calculate the SAH for each BLAS.
-        // The CalcBlasSAH can be done as a worker thread if needed.
-        const auto& bottom_level_bvhs = data_set.bvh_bundle->GetBottomLevelBvhs();
-        for (size_t blas_index = 0; blas_index < bottom_level_bvhs.size(); blas_index++)
+        rta::BvhBundle& bundle = *data_set.bvh_bundle;
+
+        // With deferred BLAS decoding, each BLAS SAH is calculated as soon as its node data has been decoded.
+        // The TLAS SAH depends on the BLAS SAH, so it is calculated once the background decode has finished.
+        // The BVHs whose derived data was restored from the cache are skipped. A deferred BLAS only finds out whether
+        // its data matches the cache once it is decoded, and the callback only runs if it doesn't.
+        const bool deferred = bundle.HasDeferredBlasNodeData();
+
+        // Calculate the SAH for each BLAS. Each BLAS only reads and writes its own data, so they are done in parallel.
+        std::vector<rta::EncodedRtIp11BottomLevelBvh*> blases;
+
+        for (rta::EncodedRtIp11BottomLevelBvh* blas : bundle.GetEncodedBottomLevelBvhs())
         {
-            rta::EncodedRtIp11BottomLevelBvh* blas = dynamic_cast<rta::EncodedRtIp11BottomLevelBvh*>(&(*bottom_level_bvhs[blas_index]));
             if (blas == nullptr)
             {
                 return kRraErrorInvalidPointer;
             }
 
-            CalcBlasSAH(blas);
+            if (deferred && !blas->IsNodeDataLoaded())
+            {
+                blas->SetNodeDataLoadedCallback(
+                    [](rta::IEncodedRtIp11Bvh& bvh) { CalcBlasSAH(static_cast<rta::EncodedRtIp11BottomLevelBvh*>(&bvh)); });
+                continue;
+            }
+
+            if (!blas->HasRestoredDerivedData())
+            {
+                blases.push_back(blas);
+            }
         }
 
-        // Calculate the SAH for each TLAS.
-        // The leaf nodes here will be an instance node/BLAS.
-        const auto& top_level_bvhs = data_set.bvh_bundle->GetTopLevelBvhs();
-        for (size_t tlas_index = 0; tlas_index < top_level_bvhs.size(); tlas_index++)
+        CalcSAHInParallel(blases, CalcBlasSAH);
+
+        if (deferred)
         {
-            rta::EncodedRtIp11TopLevelBvh* tlas = dynamic_cast<rta::EncodedRtIp11TopLevelBvh*>(&(*top_level_bvhs[tlas_index]));
-            if (tlas == nullptr)
+            // Until this completes, the TLAS SAH values read as 0. The UI reads them while they are written, so they are
+            // only published once each TLAS is done.
+            for (auto* tlas : bundle.GetEncodedTopLevelBvhs())
             {
-                return kRraErrorInvalidPointer;
+                if (tlas != nullptr && !tlas->HasRestoredDerivedData())
+                {
+                    tlas->SetSurfaceAreaHeuristicComplete(false);
+                }
             }
-            CalcTlasSAH(tlas);
+            bundle.StartDeferredBlasDecode([&bundle]() { CalcAllTlasSAH(bundle); });
+            return kRraOk;
         }
 
-        return kRraOk;
+        // Calculate the SAH for each TLAS.
+        return CalcAllTlasSAH(bundle);
     }
 
     float GetMinimumSurfaceAreaHeuristic(const rta::IEncodedRtIp11Bvh* bvh, const dxr::amd::NodePointer node_ptr, bool tri_only)
     {
         float min_sah = 1.0f;
-        GetMinimumSurfaceAreaHeuristicImpl(bvh, node_ptr, tri_only, &min_sah);
+        if (node_ptr.IsBoxNode() && bvh->HasSubTreeSurfaceAreaHeuristic())
+        {
+            const auto& sub_tree = bvh->GetInteriorNodeSubTreeSurfaceAreaHeuristic(node_ptr);
+            min_sah              = std::min(min_sah, tri_only ? sub_tree.triangle_nodes.min_sah : sub_tree.all_nodes.min_sah);
+
+#ifdef _DEBUG
+            // The summary holds the same nodes as the walk, so the minimum matches exactly.
+            float walk_min_sah = 1.0f;
+            GetMinimumSurfaceAreaHeuristicImpl(bvh, node_ptr, tri_only, &walk_min_sah);
+            RRA_ASSERT(IsSameFloat(min_sah, walk_min_sah));
+#endif  // _DEBUG
+        }
+        else
+        {
+            GetMinimumSurfaceAreaHeuristicImpl(bvh, node_ptr, tri_only, &min_sah);
+        }
 
         return min_sah;
     }
@@ -588,7 +962,28 @@ namespace rra
     {
         float   total      = 0.0f;
         int32_t node_count = 0;
-        GetTotalSurfaceAreaHeuristicImpl(bvh, node_ptr, tri_only, &total, &node_count);
+        if (node_ptr.IsBoxNode() && bvh->HasSubTreeSurfaceAreaHeuristic())
+        {
+            const auto& sub_tree = bvh->GetInteriorNodeSubTreeSurfaceAreaHeuristic(node_ptr);
+            const auto& nodes    = tri_only ? sub_tree.triangle_nodes : sub_tree.all_nodes;
+            total                = nodes.total_sah;
+            node_count           = static_cast<int32_t>(nodes.node_count);
+
+#ifdef _DEBUG
+            // The node count matches the walk exactly. The totals are summed in a different order, so they only
+            // agree to within the rounding of the two sums.
+            float   walk_total      = 0.0f;
+            int32_t walk_node_count = 0;
+            GetTotalSurfaceAreaHeuristicImpl(bvh, node_ptr, tri_only, &walk_total, &walk_node_count);
+            RRA_ASSERT(node_count == walk_node_count);
+            RRA_ASSERT(isnan(total) == isnan(walk_total));
+            RRA_ASSERT(isnan(total) || fabs(total - walk_total) <= 2.0f * node_count * FLT_EPSILON * fabs(walk_total));
+#endif  // _DEBUG
+        }
+        else
+        {
+            GetTotalSurfaceAreaHeuristicImpl(bvh, node_ptr, tri_only, &total, &node_count);
+        }
 
         if (node_count <= 0)
         {
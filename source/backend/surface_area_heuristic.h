@@ -33,6 +33,9 @@ namespace rra
 
     /// @brief Get the average (mean) surface area heuristic for a given node and its children.
     ///
+    /// Once the sub tree summaries are built, the total for a box node is read from them. It is summed per sub tree
+    /// rather than in the order the tree is walked, so the average can differ from the walked one in the last bits.
+    ///
     /// @param [in] bvh      The acceleration structure where the node is located.
     /// @param [in] node_ptr The node of interest.
     /// @param [in] tri_only All non-triangle nodes will be ignored if this is true.
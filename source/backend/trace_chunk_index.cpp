@@ -0,0 +1,138 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Implementation for the trace chunk index class.
+//=============================================================================
+
+#include "trace_chunk_index.h"
+
+#include "bvh/ibvh.h"
+#include "public/rra_ray_history.h"
+#include "api_info.h"
+#include "asic_info.h"
+
+namespace rra
+{
+    /// The chunk identifiers recorded in the index.
+    static const char* const kIndexedChunkIdentifiers[] = {
+        rta::IBvh::kAccelChunkIdentifier1,
+        rta::IBvh::kAccelChunkIdentifier2,
+        RRA_RAY_HISTORY_TOKENS_METADATA_IDENTIFIER,
+        RRA_RAY_HISTORY_RAW_TOKENS_IDENTIFIER,
+        ApiInfo::kChunkIdentifier,
+        AsicInfo::kChunkIdentifier,
+    };
+
+    TraceChunkIndex::TraceChunkIndex()
+    {
+    }
+
+    TraceChunkIndex::~TraceChunkIndex()
+    {
+    }
+
+    RraErrorCode TraceChunkIndex::Build(rdf::ChunkFile& chunk_file)
+    {
+        chunks_.clear();
+
+        for (const char* identifier : kIndexedChunkIdentifiers)
+        {
+            std::int64_t chunk_count = 0;
+            try
+            {
+                if (!chunk_file.ContainsChunk(identifier))
+                {
+                    continue;
+                }
+                chunk_count = chunk_file.GetChunkCount(identifier);
+            }
+            catch (...)
+            {
+                continue;
+            }
+
+            std::vector<TraceChunkInfo>& infos = chunks_[identifier];
+            infos.resize(chunk_count);
+
+            try
+            {
+                for (std::int64_t i = 0; i < chunk_count; ++i)
+                {
+                    const int       index = static_cast<int>(i);
+                    TraceChunkInfo& info  = infos[i];
+
+                    info.version     = chunk_file.GetChunkVersion(identifier, index);
+                    info.header_size = chunk_file.GetChunkHeaderSize(identifier, index);
+                    info.data_size   = chunk_file.GetChunkDataSize(identifier, index);
+
+                    if (info.header_size > 0)
+                    {
+                        info.header.resize(info.header_size);
+                        chunk_file.ReadChunkHeaderToBuffer(identifier, index, info.header.data());
+                    }
+                }
+            }
+            catch (...)
+            {
+                chunks_.clear();
+                return kRraErrorMalformedData;
+            }
+        }
+
+        return kRraOk;
+    }
+
+    void TraceChunkIndex::Clear()
+    {
+        chunks_.clear();
+    }
+
+    bool TraceChunkIndex::ContainsChunk(const char* identifier) const
+    {
+        return GetChunkCount(identifier) > 0;
+    }
+
+    bool TraceChunkIndex::IdentifiersContainedInChunkFile(const std::vector<const char*>& identifiers) const
+    {
+        for (const char* identifier : identifiers)
+        {
+            if (!ContainsChunk(identifier))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    std::int64_t TraceChunkIndex::GetChunkCount(const char* identifier) const
+    {
+        return static_cast<std::int64_t>(GetChunks(identifier).size());
+    }
+
+    const std::vector<TraceChunkInfo>& TraceChunkIndex::GetChunks(const char* identifier) const
+    {
+        static const std::vector<TraceChunkInfo> kNoChunks;
+
+        auto iter = chunks_.find(identifier);
+        if (iter == chunks_.end())
+        {
+            return kNoChunks;
+        }
+        return iter->second;
+    }
+
+    const char* TraceChunkIndex::GetAccelStructIdentifier() const
+    {
+        if (ContainsChunk(rta::IBvh::kAccelChunkIdentifier1))
+        {
+            return rta::IBvh::kAccelChunkIdentifier1;
+        }
+        else if (ContainsChunk(rta::IBvh::kAccelChunkIdentifier2))
+        {
+            return rta::IBvh::kAccelChunkIdentifier2;
+        }
+        return nullptr;
+    }
+}  // namespace rra
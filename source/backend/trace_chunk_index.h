@@ -0,0 +1,95 @@
+//=============================================================================
+// Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+/// @author AMD Developer Tools Team
+/// @file
+/// @brief  Definition for the trace chunk index class.
+///
+/// The chunk index is built once when a trace is opened and records the
+/// version, header and data size of every chunk the backend is interested
+/// in, so repeated probes of the chunk file can be answered from memory.
+//=============================================================================
+
+#ifndef RRA_BACKEND_TRACE_CHUNK_INDEX_H_
+#define RRA_BACKEND_TRACE_CHUNK_INDEX_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "public/rra_error.h"
+
+#include "rdf/rdf/inc/amdrdf.h"
+
+namespace rra
+{
+    /// @brief Information about a single chunk in the trace file.
+    struct TraceChunkInfo
+    {
+        std::uint32_t             version     = 0;  ///< The chunk version.
+        std::int64_t              header_size = 0;  ///< The size of the chunk header, in bytes.
+        std::int64_t              data_size   = 0;  ///< The size of the (uncompressed) chunk data, in bytes.
+        std::vector<std::uint8_t> header;           ///< The chunk header.
+    };
+
+    class TraceChunkIndex
+    {
+    public:
+        /// @brief Constructor.
+        TraceChunkIndex();
+
+        /// @brief Destructor.
+        ~TraceChunkIndex();
+
+        /// @brief Build the index from a chunk file.
+        ///
+        /// Walks the chunk table once for each identifier the backend knows about and caches
+        /// the chunk versions, sizes and headers.
+        ///
+        /// @param [in] chunk_file The chunk file to index.
+        ///
+        /// @return kRraOk if successful, error code if not.
+        RraErrorCode Build(rdf::ChunkFile& chunk_file);
+
+        /// @brief Clear the index.
+        void Clear();
+
+        /// @brief Does the trace contain at least one chunk with the identifier provided.
+        ///
+        /// @param [in] identifier The chunk identifier.
+        ///
+        /// @return true if the chunk exists, false if not.
+        bool ContainsChunk(const char* identifier) const;
+
+        /// @brief Does the trace contain chunks for all the identifiers provided.
+        ///
+        /// @param [in] identifiers The chunk identifiers.
+        ///
+        /// @return true if all the chunks exist, false if not.
+        bool IdentifiersContainedInChunkFile(const std::vector<const char*>& identifiers) const;
+
+        /// @brief Get the number of chunks with the identifier provided.
+        ///
+        /// @param [in] identifier The chunk identifier.
+        ///
+        /// @return The chunk count.
+        std::int64_t GetChunkCount(const char* identifier) const;
+
+        /// @brief Get the information for all chunks with the identifier provided.
+        ///
+        /// @param [in] identifier The chunk identifier.
+        ///
+        /// @return The chunk information, in chunk file order. Empty if there are no chunks.
+        const std::vector<TraceChunkInfo>& GetChunks(const char* identifier) const;
+
+        /// @brief Get the identifier used by the acceleration structure chunks in this trace.
+        ///
+        /// @return The chunk identifier, or nullptr if the trace has no acceleration structure chunks.
+        const char* GetAccelStructIdentifier() const;
+
+    private:
+        std::unordered_map<std::string, std::vector<TraceChunkInfo>> chunks_;  ///< The chunk information, keyed by identifier.
+    };
+}  // namespace rra
+
+#endif  // RRA_BACKEND_TRACE_CHUNK_INDEX_H_
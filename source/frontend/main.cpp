@@ -15,6 +15,7 @@
 #include "qt_common/utils/scaling_manager.h"
 
 #include "public/rra_print.h"
+#include "public/rra_trace_loader.h"
 #include "public/graphics_context.h"
 
 #include "constants.h"
@@ -113,6 +114,9 @@ int main(int argc, char* argv[])
         result = a.exec();
 
         delete window;
+
+        // Wait for the data of the unloaded traces to be freed in the background.
+        RraTraceLoaderShutdown();
     }
 
     return result;
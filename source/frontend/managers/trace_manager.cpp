@@ -10,6 +10,7 @@
 #include <QtCore>
 #include <QMessageBox>
 #include <QByteArray>
+#include <algorithm>
 #include <vector>
 
 #include "qt_common/utils/qt_util.h"
@@ -85,6 +86,16 @@ namespace rra
     {
         active_trace_path_ = QDir::toNativeSeparators(trace_file_name);
 
+        // Apply the trace loading settings.
+        const TraceLoadSettings settings = Settings::Get().GetTraceLoadSettings();
+        RraTraceLoaderSetDeferredBlasDecode(settings.deferred_blas_decode);
+        RraTraceLoaderSetDerivedDataCache(settings.derived_data_cache);
+        RraTraceLoaderSetDecodedNodeCache(settings.decoded_node_cache);
+        RraTraceLoaderSetRayHistoryLoadLimits(static_cast<uint32_t>(std::max(settings.ray_history_load_threads, 0)),
+                                              static_cast<uint64_t>(std::max(settings.ray_history_memory_budget, 0)) * 1024 * 1024);
+        RraTraceLoaderSetRayHistoryCompression(settings.ray_history_compression);
+        RraTraceLoaderSetRayHistorySpillBudget(static_cast<uint64_t>(std::max(settings.ray_history_spill_budget, 0)) * 1024 * 1024);
+
         // Loading regular binary RRA data.
         QByteArray   latin_1    = trace_file_name.toLatin1();
         const char*  file_name  = latin_1.data();
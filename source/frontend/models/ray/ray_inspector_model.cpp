@@ -74,7 +74,7 @@ namespace rra
         rays_.resize(ray_count);
         RraRayGetRays(key.dispatch_id, key.invocation_id, rays_.data());
 
-        std::unordered_map<uint32_t, std::shared_ptr<RayInspectorRayTreeItemData>> dynamic_id_to_ray_data;
+        std::vector<std::shared_ptr<RayInspectorRayTreeItemData>> ray_data(ray_count);
 
         for (uint32_t i = 0; i < ray_count; ++i)
         {
@@ -98,41 +98,39 @@ namespace rra
 
             results_.push_back(intersection_result);
 
-            dynamic_id_to_ray_data[item_data->dynamic_id] = item_data;
+            ray_data[i] = item_data;
         }
 
-        using data_handle = std::shared_ptr<RayInspectorRayTreeItemData>;
-
-        // Create ray hierarchies.
-        for (auto& [dynamic_id, item_data] : dynamic_id_to_ray_data)
+        // Create ray hierarchies. The backend indexes the children of each ray, in ray order, so the rays
+        // are linked in a single pass.
+        std::vector<std::shared_ptr<RayInspectorRayTreeItemData>> root_rays;
+        std::vector<uint32_t>                                     child_indices;
+        for (uint32_t i = 0; i < ray_count; ++i)
         {
-            for (auto& [other_dynamic_id, other_item_data] : dynamic_id_to_ray_data)
+            uint32_t parent_index = RayDispatchData::kDetachedRay;
+            RraRayGetRayParent(key.dispatch_id, key.invocation_id, i, &parent_index);
+            if (parent_index == RayDispatchData::kRootRay)
             {
-                // Am I the parent of the other item ?
-                if (dynamic_id == other_item_data->parent_id)
-                {
-                    item_data->child_rays.push_back(other_item_data);
-                }
+                root_rays.push_back(ray_data[i]);
             }
 
-            // Sort child rays.
-            std::sort(item_data->child_rays.begin(), item_data->child_rays.end(), [](const data_handle& a, const data_handle& b) {
-                return a->row_index < b->row_index;
-            });
-        }
+            uint32_t child_count{};
+            RraRayGetChildRayCount(key.dispatch_id, key.invocation_id, i, &child_count);
+            child_indices.resize(child_count);
+            if (child_count == 0 || RraRayGetChildRays(key.dispatch_id, key.invocation_id, i, child_indices.data()) != kRraOk)
+            {
+                continue;
+            }
 
-        std::vector<std::shared_ptr<RayInspectorRayTreeItemData>> root_rays;
-        for (auto& [dynamic_id, item_data] : dynamic_id_to_ray_data)
-        {
-            if (item_data->parent_id == 0xFFFFFFFF || item_data->parent_id == 0)
+            for (uint32_t child_index : child_indices)
             {
-                root_rays.push_back(item_data);
+                if (child_index < ray_count)
+                {
+                    ray_data[i]->child_rays.push_back(ray_data[child_index]);
+                }
             }
         }
 
-        // Sort root rays
-        std::sort(root_rays.begin(), root_rays.end(), [](const data_handle& a, const data_handle& b) { return a->row_index < b->row_index; });
-
         tree_model_->ClearRays();
         tree_model_->AddNewRays(root_rays);
 
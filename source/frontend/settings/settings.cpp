@@ -313,6 +313,14 @@ namespace rra
         default_settings_[kSettingGeneralFrustumCullRatio]         = {"FrustumCullRatio", "0.0005"};
         default_settings_[kSettingGeneralDecimalPrecision]         = {"DecimalPrecision", "2"};
 
+        default_settings_[kSettingTraceLoadDeferredBlasDecode]     = {"DeferredBlasDecode", "False"};
+        default_settings_[kSettingTraceLoadDerivedDataCache]       = {"DerivedDataCache", "False"};
+        default_settings_[kSettingTraceLoadDecodedNodeCache]       = {"DecodedNodeCache", "False"};
+        default_settings_[kSettingTraceLoadRayHistoryLoadThreads]  = {"RayHistoryLoadThreads", "0"};
+        default_settings_[kSettingTraceLoadRayHistoryMemoryBudget] = {"RayHistoryMemoryBudget", "0"};
+        default_settings_[kSettingTraceLoadRayHistoryCompression]  = {"RayHistoryCompression", "False"};
+        default_settings_[kSettingTraceLoadRayHistorySpillBudget]  = {"RayHistorySpillBudget", "1024"};
+
         default_settings_[kSettingThemesAndColorsPalette] = {"ColorPalette",
                                                              "#FFFFBA02,#FFFF8B00,#FFF76210,#FFE17F35,#FFDA3B01,#FFEF6950,#FFD03438,#FFFF4343,"
                                                              "#FFFF6062,#FFE81123,#FFEA015D,#FFC40052,#FFFF0080,#FFFF97FF,#FFFF4CFF,#FFDC00DD,"
@@ -817,6 +825,31 @@ namespace rra
         return GetIntValue(kSettingGeneralDecimalPrecision);
     }
 
+    void Settings::SetTraceLoadSettings(const TraceLoadSettings& value)
+    {
+        SetBoolValue(kSettingTraceLoadDeferredBlasDecode, value.deferred_blas_decode);
+        SetBoolValue(kSettingTraceLoadDerivedDataCache, value.derived_data_cache);
+        SetBoolValue(kSettingTraceLoadDecodedNodeCache, value.decoded_node_cache);
+        SetIntValue(kSettingTraceLoadRayHistoryLoadThreads, value.ray_history_load_threads);
+        SetIntValue(kSettingTraceLoadRayHistoryMemoryBudget, value.ray_history_memory_budget);
+        SetBoolValue(kSettingTraceLoadRayHistoryCompression, value.ray_history_compression);
+        SetIntValue(kSettingTraceLoadRayHistorySpillBudget, value.ray_history_spill_budget);
+        SaveSettings();
+    }
+
+    TraceLoadSettings Settings::GetTraceLoadSettings() const
+    {
+        TraceLoadSettings value         = {};
+        value.deferred_blas_decode      = GetBoolValue(kSettingTraceLoadDeferredBlasDecode);
+        value.derived_data_cache        = GetBoolValue(kSettingTraceLoadDerivedDataCache);
+        value.decoded_node_cache        = GetBoolValue(kSettingTraceLoadDecodedNodeCache);
+        value.ray_history_load_threads  = GetIntValue(kSettingTraceLoadRayHistoryLoadThreads);
+        value.ray_history_memory_budget = GetIntValue(kSettingTraceLoadRayHistoryMemoryBudget);
+        value.ray_history_compression   = GetBoolValue(kSettingTraceLoadRayHistoryCompression);
+        value.ray_history_spill_budget  = GetIntValue(kSettingTraceLoadRayHistorySpillBudget);
+        return value;
+    }
+
     // Viewer persistent settings. -------------------------------------
 
     SettingID Settings::GetSettingIndex(const SettingLookups& lut, rra::RRAPaneId pane, int index) const
@@ -106,6 +106,18 @@ enum CheckboxSetting
     kCheckboxSettingCullFrontFacingTriangles,
 };
 
+/// @brief The settings applied to the trace loader before a trace is loaded.
+struct TraceLoadSettings
+{
+    bool deferred_blas_decode;       ///< Decode the BLAS node data in the background after a trace is opened.
+    bool derived_data_cache;         ///< Cache the data derived from a trace in a file next to it.
+    bool decoded_node_cache;         ///< Decode the box nodes into a cache after a trace is loaded.
+    int  ray_history_load_threads;   ///< The number of threads loading the ray history dispatches. 0 uses one per hardware thread.
+    int  ray_history_memory_budget;  ///< The memory budget for loading the ray history dispatches, in MiB. 0 means no limit.
+    bool ray_history_compression;    ///< Keep the parsed ray history tokens compressed in memory.
+    int  ray_history_spill_budget;   ///< The size above which a ray history dispatch is kept in a scratch file, in MiB. 0 keeps them all in memory.
+};
+
 /// @brief Enum of all settings.
 enum SettingID
 {
@@ -129,6 +141,14 @@ enum SettingID
     kSettingGeneralDecimalPrecision,
     kSettingGeneralPersistentUIState,
 
+    kSettingTraceLoadDeferredBlasDecode,
+    kSettingTraceLoadDerivedDataCache,
+    kSettingTraceLoadDecodedNodeCache,
+    kSettingTraceLoadRayHistoryLoadThreads,
+    kSettingTraceLoadRayHistoryMemoryBudget,
+    kSettingTraceLoadRayHistoryCompression,
+    kSettingTraceLoadRayHistorySpillBudget,
+
     kSettingThemesAndColorsPalette,
 
     kSettingThemesAndColorsBoundingVolumeBox16,
@@ -497,6 +517,18 @@ namespace rra
         /// @return The decimal precision.
         int GetDecimalPrecision();
 
+        /// @brief Set the trace loading settings.
+        ///
+        /// @param [in] value The new trace loading settings.
+        void SetTraceLoadSettings(const TraceLoadSettings& value);
+
+        /// @brief Get the trace loading settings.
+        ///
+        /// These are applied to the trace loader before each trace is loaded.
+        ///
+        /// @return The trace loading settings.
+        TraceLoadSettings GetTraceLoadSettings() const;
+
         // Viewer persistent settings. -------------------------------------
 
         /// @brief Get the value of the continuous update state from the settings.
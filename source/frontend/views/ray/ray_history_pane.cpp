@@ -510,6 +510,14 @@ void RayHistoryPane::TimerUpdate()
         LoadDispatches();
     }
 
+    // While the current dispatch is indexing, show the heatmap of the coordinates indexed so far, and update it
+    // each time more are indexed.
+    if (dispatch_id_ < dispatch_count && !dispatches_loaded_[dispatch_id_] && load_status.partially_indexed && !load_status.loading_complete &&
+        !load_status.has_errors && load_status.snapshot_count != rendered_snapshot_count_)
+    {
+        ShowPartiallyIndexedDispatch(load_status.snapshot_count);
+    }
+
     if (all_dispatches_loaded)
     {
         timer_.stop();  // We are done with updating.
@@ -546,6 +554,12 @@ void RayHistoryPane::SetDispatchId(uint64_t dispatch_id)
         return;
     }
 
+    // The user is looking at this dispatch, so load it ahead of the others.
+    RraRayPrioritizeDispatch(dispatch_id);
+
+    // A partially indexed dispatch is shown by TimerUpdate() once its latest snapshot is available.
+    rendered_snapshot_count_ = 0;
+
     RraDispatchLoadStatus load_status = {};
     RraRayGetDispatchStatus(dispatch_id, &load_status);
 
@@ -583,6 +597,13 @@ void RayHistoryPane::SetDispatchId(uint64_t dispatch_id)
 
     CreateAndRenderImage();
 
+    UpdateDimensionControls(dispatch_id);
+
+    ray_history_viewer_.ray_graphics_view_->ClearBoxSelect();
+}
+
+void RayHistoryPane::UpdateDimensionControls(uint64_t dispatch_id)
+{
     switch (GetDispatchDimension(dispatch_id))
     {
     case 1:
@@ -621,8 +642,40 @@ void RayHistoryPane::SetDispatchId(uint64_t dispatch_id)
         ray_history_viewer_.rh_viewer_line_separator_1_->show();
         break;
     }
+}
 
-    ray_history_viewer_.ray_graphics_view_->ClearBoxSelect();
+void RayHistoryPane::ShowPartiallyIndexedDispatch(uint32_t snapshot_count)
+{
+    // The loading screen stays up until the pane has been shown.
+    if (!show_event_occured_)
+    {
+        return;
+    }
+
+    rendered_snapshot_count_ = snapshot_count;
+
+    // The reshaped dimensions are set once the dispatch is loaded, but the dispatch dimensions are known before that.
+    if (dispatch_reshaped_dimensions_[dispatch_id_].x == 0)
+    {
+        uint32_t x{};
+        uint32_t y{};
+        uint32_t z{};
+        RraRayGetDispatchDimensions(dispatch_id_, &x, &y, &z);
+
+        dispatch_reshaped_dimensions_[dispatch_id_].x = x;
+        dispatch_reshaped_dimensions_[dispatch_id_].y = y;
+        dispatch_reshaped_dimensions_[dispatch_id_].z = z;
+    }
+
+    // Only the heatmap is shown. The ray table is filled in once the dispatch is loaded, since looking up the
+    // coordinates that aren't indexed yet would wait for the load.
+    ui_->dispatch_valid_switch_->setCurrentIndex(0);
+
+    UpdateDispatchSpinBoxRanges();
+    UpdateReshapedDimensions(dispatch_id_);
+    UpdateDimensionControls(dispatch_id_);
+
+    CreateAndRenderImage();
 }
 
 void RayHistoryPane::UpdateSelectedDispatch()
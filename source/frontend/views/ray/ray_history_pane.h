@@ -146,6 +146,16 @@ private:
     /// @brief Called repeatedly by timer_ while the dispatch is loading.
     void TimerUpdate();
 
+    /// @brief Show the heatmap of the coordinates of the current dispatch indexed so far.
+    ///
+    /// @param snapshot_count The snapshot count of the dispatch load status.
+    void ShowPartiallyIndexedDispatch(uint32_t snapshot_count);
+
+    /// @brief Show the heatmap controls that apply to the dimensions of a dispatch.
+    ///
+    /// @param dispatch_id The dispatch ID.
+    void UpdateDimensionControls(uint64_t dispatch_id);
+
     /// @brief Loads the dispatches using backend.
     void LoadDispatches();
 
@@ -167,6 +177,7 @@ private:
     ZoomIconGroupManager*                        zoom_icon_manager_;             ///< The object responsible for the zoom icon status.
     std::vector<GlobalInvocationID>              dispatch_reshaped_dimensions_;  ///< The reshaped dimensions of 1D dispatches.
     QTimer                                       timer_;                         ///< A timer used to redraw the widget at a specific rate.
+    uint32_t                                     rendered_snapshot_count_{0};    ///< The snapshot count of the partially indexed dispatch in the heatmap.
 
     // Choose the color mode names and the order they're displayed in.
     const std::vector<std::pair<rra::renderer::RayHistoryColorMode, std::string>> color_modes_and_names_{
@@ -69,6 +69,29 @@ SettingsPane::SettingsPane(QWidget* parent)
 
     ui_->viewer_state_checkbox_->Initialize(rra::Settings::Get().GetPersistentUIState(), rra::kCheckboxEnableColor);
     connect(ui_->viewer_state_checkbox_, &ColoredCheckbox::Clicked, this, &SettingsPane::PersistentUIStateChanged);
+
+    const TraceLoadSettings trace_load_settings = rra::Settings::Get().GetTraceLoadSettings();
+    ui_->deferred_blas_decode_checkbox_->Initialize(trace_load_settings.deferred_blas_decode, rra::kCheckboxEnableColor);
+    ui_->derived_data_cache_checkbox_->Initialize(trace_load_settings.derived_data_cache, rra::kCheckboxEnableColor);
+    ui_->decoded_node_cache_checkbox_->Initialize(trace_load_settings.decoded_node_cache, rra::kCheckboxEnableColor);
+    ui_->content_ray_history_load_threads_->setMinimum(0);
+    ui_->content_ray_history_load_threads_->setMaximum(256);
+    ui_->content_ray_history_load_threads_->setValue(trace_load_settings.ray_history_load_threads);
+    ui_->content_ray_history_memory_budget_->setMinimum(0);
+    ui_->content_ray_history_memory_budget_->setMaximum(1024 * 1024);
+    ui_->content_ray_history_memory_budget_->setValue(trace_load_settings.ray_history_memory_budget);
+    ui_->ray_history_compression_checkbox_->Initialize(trace_load_settings.ray_history_compression, rra::kCheckboxEnableColor);
+    ui_->content_ray_history_spill_budget_->setMinimum(0);
+    ui_->content_ray_history_spill_budget_->setMaximum(1024 * 1024);
+    ui_->content_ray_history_spill_budget_->setValue(trace_load_settings.ray_history_spill_budget);
+
+    connect(ui_->deferred_blas_decode_checkbox_, &ColoredCheckbox::Clicked, this, &SettingsPane::TraceLoadSettingsChanged);
+    connect(ui_->derived_data_cache_checkbox_, &ColoredCheckbox::Clicked, this, &SettingsPane::TraceLoadSettingsChanged);
+    connect(ui_->decoded_node_cache_checkbox_, &ColoredCheckbox::Clicked, this, &SettingsPane::TraceLoadSettingsChanged);
+    connect(ui_->content_ray_history_load_threads_, SIGNAL(valueChanged(int)), this, SLOT(TraceLoadSettingsChanged()));
+    connect(ui_->content_ray_history_memory_budget_, SIGNAL(valueChanged(int)), this, SLOT(TraceLoadSettingsChanged()));
+    connect(ui_->ray_history_compression_checkbox_, &ColoredCheckbox::Clicked, this, &SettingsPane::TraceLoadSettingsChanged);
+    connect(ui_->content_ray_history_spill_budget_, SIGNAL(valueChanged(int)), this, SLOT(TraceLoadSettingsChanged()));
 }
 
 SettingsPane::~SettingsPane()
@@ -126,6 +149,19 @@ void SettingsPane::PersistentUIStateChanged()
     rra::Settings::Get().SaveSettings();
 }
 
+void SettingsPane::TraceLoadSettingsChanged()
+{
+    TraceLoadSettings trace_load_settings         = {};
+    trace_load_settings.deferred_blas_decode      = ui_->deferred_blas_decode_checkbox_->isChecked();
+    trace_load_settings.derived_data_cache        = ui_->derived_data_cache_checkbox_->isChecked();
+    trace_load_settings.decoded_node_cache        = ui_->decoded_node_cache_checkbox_->isChecked();
+    trace_load_settings.ray_history_load_threads  = ui_->content_ray_history_load_threads_->value();
+    trace_load_settings.ray_history_memory_budget = ui_->content_ray_history_memory_budget_->value();
+    trace_load_settings.ray_history_compression   = ui_->ray_history_compression_checkbox_->isChecked();
+    trace_load_settings.ray_history_spill_budget  = ui_->content_ray_history_spill_budget_->value();
+    rra::Settings::Get().SetTraceLoadSettings(trace_load_settings);
+}
+
 void SettingsPane::UpdateTreeviewComboBox(int index)
 {
     ui_->treeview_combo_push_button_->SetSelectedRow(index);
@@ -50,6 +50,11 @@ private slots:
     /// Update and save the settings.
     void PersistentUIStateChanged();
 
+    /// @brief Slot to handle what happens when any of the trace loading controls change.
+    ///
+    /// Update and save the trace loading settings.
+    void TraceLoadSettingsChanged();
+
     /// @brief Slot to handle what happens when the Treeview Node ID combo box changes.
     ///
     /// Update and save the settings.
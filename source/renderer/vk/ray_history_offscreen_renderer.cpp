@@ -7,11 +7,6 @@
 
 #include "ray_history_offscreen_renderer.h"
 
-#undef emit
-#include <execution>
-#include <algorithm>
-#define emit
-
 #include "framework/device.h"
 #include "vk_graphics_context.h"
 
@@ -68,94 +63,58 @@ namespace rra
                 return;
             }
 
-            uint32_t                    data_count{width_ * height_ * depth_};
-            std::vector<DispatchIdData> data(data_count);
+            uint32_t data_count{width_ * height_ * depth_};
 
             *out_max_count = {};
 
-            // Get ray counts.
-            uint32_t ray_data_size{0};
-            uint32_t max_ray_count{0};
-            for (uint32_t x{0}; x < width_; ++x)
+            // Get the stats of every coordinate in one call.
+            std::vector<uint32_t>          ray_counts(data_count);
+            std::vector<uint32_t>          first_ray_offsets(data_count);
+            std::vector<uint32_t>          traversal_counts(data_count);
+            std::vector<uint32_t>          instance_intersection_counts(data_count);
+            std::vector<uint32_t>          any_hit_counts(data_count);
+            RraDispatchCoordinateStatsGrid grid{};
+            grid.ray_counts                   = ray_counts.data();
+            grid.first_ray_offsets            = first_ray_offsets.data();
+            grid.traversal_counts             = traversal_counts.data();
+            grid.instance_intersection_counts = instance_intersection_counts.data();
+            grid.any_hit_counts               = any_hit_counts.data();
+            if (RraRayGetDispatchCoordinateStatsGrid(dispatch_id, &grid) != kRraOk)
+            {
+                return;
+            }
+
+            std::vector<DispatchIdData> data(data_count);
+            for (uint32_t data_idx{0}; data_idx < data_count; ++data_idx)
+            {
+                data[data_idx].ray_count                   = ray_counts[data_idx];
+                data[data_idx].traversal_count             = traversal_counts[data_idx];
+                data[data_idx].instance_intersection_count = instance_intersection_counts[data_idx];
+                data[data_idx].any_hit_invocation_count    = any_hit_counts[data_idx];
+                data[data_idx].first_ray_index             = first_ray_offsets[data_idx];
+            }
+
+            out_max_count->ray_count                   = grid.max_ray_count;
+            out_max_count->traversal_count             = grid.max_traversal_count;
+            out_max_count->instance_intersection_count = grid.max_instance_intersection_count;
+            out_max_count->any_hit_invocation_count    = grid.max_any_hit_count;
+
+            // Get the ray directions, ordered by first ray index.
+            std::vector<float> directions((size_t)grid.total_ray_count * 3);
+            uint32_t           direction_count = 0;
+            if (RraRayGetDispatchRayDirections(dispatch_id, directions.data(), grid.total_ray_count, &direction_count) != kRraOk ||
+                direction_count != grid.total_ray_count)
             {
-                for (uint32_t y{0}; y < height_; ++y)
-                {
-                    for (uint32_t z{0}; z < depth_; ++z)
-                    {
-                        uint32_t ray_count{};
-                        RraRayGetRayCount(dispatch_id, {x, y, z}, &ray_count);
-                        uint32_t data_idx{x + y * width_ + z * width_ * height_};
-                        data[data_idx].ray_count       = ray_count;
-                        data[data_idx].first_ray_index = ray_data_size;
-                        ray_data_size += ray_count;
-                        max_ray_count = std::max(ray_count, max_ray_count);
-                    }
-                }
+                return;
             }
 
-            std::vector<DispatchRayData> ray_data(ray_data_size);
-            std::vector<uint32_t>        x_coords(width_);
-            std::iota(x_coords.begin(), x_coords.end(), 0);
-            std::for_each(std::execution::par, x_coords.begin(), x_coords.end(), [&](uint32_t x) {
-                std::vector<Ray> rays{};
-                rays.resize(max_ray_count);
-                for (uint32_t y{0}; y < height_; ++y)
-                {
-                    for (uint32_t z{0}; z < depth_; ++z)
-                    {
-                        uint32_t data_idx{x + y * width_ + z * width_ * height_};
-                        uint32_t ray_count{data[data_idx].ray_count};
-
-                        if (ray_count > out_max_count->ray_count)
-                        {
-                            out_max_count->ray_count = ray_count;
-                        }
-
-                        uint32_t traversal_count{0};
-                        uint32_t instance_intersection_count{0};
-                        uint32_t total_any_hit_count{0};
-                        RraRayGetAnyHitInvocationCount(dispatch_id, {x, y, z}, &total_any_hit_count);
-
-                        for (uint32_t i{0}; i < ray_count; ++i)
-                        {
-                            IntersectionResult intersection_result{};
-                            RraRayGetIntersectionResult(dispatch_id, {x, y, z}, i, &intersection_result);
-                            traversal_count += intersection_result.num_iterations;
-                            instance_intersection_count += intersection_result.num_instance_intersections;
-                        }
-                        data[data_idx].traversal_count             = traversal_count;
-                        data[data_idx].instance_intersection_count = instance_intersection_count;
-                        data[data_idx].any_hit_invocation_count    = total_any_hit_count;
-
-                        if (traversal_count > out_max_count->traversal_count)
-                        {
-                            out_max_count->traversal_count = traversal_count;
-                        }
-
-                        if (instance_intersection_count > out_max_count->instance_intersection_count)
-                        {
-                            out_max_count->instance_intersection_count = instance_intersection_count;
-                        }
-
-                        if (total_any_hit_count > out_max_count->any_hit_invocation_count)
-                        {
-                            out_max_count->any_hit_invocation_count = total_any_hit_count;
-                        }
-
-
-                        RraRayGetRays(dispatch_id, {x, y, z}, rays.data());
-
-                        for (uint32_t ray_idx{0}; ray_idx < ray_count; ++ray_idx)
-                        {
-                            DispatchRayData individual_ray_data                        = {};
-                            individual_ray_data.direction.x                            = rays[ray_idx].direction[0];
-                            individual_ray_data.direction.y                            = rays[ray_idx].direction[1];
-                            individual_ray_data.direction.z                            = rays[ray_idx].direction[2];
-                            ray_data[(size_t)data[data_idx].first_ray_index + ray_idx] = individual_ray_data;
-                        }
-                    }
-                }
-            });
+            std::vector<DispatchRayData> ray_data(grid.total_ray_count);
+            for (size_t ray_idx{0}; ray_idx < ray_data.size(); ++ray_idx)
+            {
+                ray_data[ray_idx].direction.x = directions[ray_idx * 3 + 0];
+                ray_data[ray_idx].direction.y = directions[ray_idx * 3 + 1];
+                ray_data[ray_idx].direction.z = directions[ray_idx * 3 + 2];
+            }
 
             if (ray_data.empty())
             {